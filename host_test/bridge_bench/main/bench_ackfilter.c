@@ -0,0 +1,473 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bridge_bench.h"
+#include "wenet_pool.h"
+#include "wenet_bridge.h"
+#include "wenet_qos.h"
+#include "wenet_station.h"
+#include "wenet_ackfilter.h"
+#include "wenet_tunnel.h"
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_ACK_QUEUE 16 // Frames queued for the wifi peer of the ACK filter check, below the pool buffers
+#define BENCH_ACK_TRACE_MAX 2000
+#define BENCH_ACK_SACK_MAX 3 // SACK blocks that fit next to the timestamps
+/* Private typedef -----------------------------------------------------------*/
+// TCP segment of the synthetic ACK filter traces
+typedef struct
+{
+    bool ipv6;
+    uint16_t vlan; // VLAN identifier, 0 for an untagged frame
+    uint16_t port; // Client port, tells the flows of a trace apart
+    uint8_t flags;
+    bool ce;
+    uint16_t window;
+    uint16_t payload; // Data bytes, 0 for an ACK
+    uint32_t ack;
+    uint32_t tsval;
+    uint8_t sack_num;
+    uint32_t sack[BENCH_ACK_SACK_MAX][2];
+} bench_ack_segment_t;
+
+// What the bench itself reads from a replayed frame, to judge the decisions of the ACK filter
+typedef struct
+{
+    uint64_t flow; // Hash of the VLAN, addresses and ports, 0 if the frame is no TCP segment
+    bool pure;     // No payload, no flag but ACK and ECE, and no option but timestamps and SACK
+    bool ece;
+    bool ce;
+    uint32_t ack;
+    uint8_t sack_num;
+    uint32_t sack[BENCH_ACK_SACK_MAX + 1][2];
+    int64_t delivered; // Position in the order frames left the queue, -1 if thinned
+} bench_ack_frame_t;
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void bench_ack_trace_begin(bench_pcap_t *trace);
+static void bench_ack_trace_add(bench_pcap_t *trace, const bench_ack_segment_t *segment);
+static void bench_ack_read(const uint8_t *data, uint32_t len, bench_ack_frame_t *frame);
+static int bench_ack_replay(const char *name, const bench_pcap_t *trace, uint32_t service_every, bool expect_thinning, bench_ack_frame_t *frames);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Check the TCP ACK filter of the wifi peer queues: replay synthetic traces, and a capture with --pcap,
+ *        through a queue drained slower than it is filled, and judge every thinned ACK
+ * @param[in] argc Option count
+ * @param[in] argv Options
+ * @retval Process exit code
+ */
+int bench_mode_ackfilter(int argc, char **argv)
+{
+    if (bench_parse_options(argc, argv, &bench_options, "ackfilter") != 0 || pool_init() != ESP_OK)
+    {
+        return 2;
+    }
+    bench_ack_frame_t *frames = calloc(BENCH_ACK_TRACE_MAX > bench_pcap.count ? BENCH_ACK_TRACE_MAX : bench_pcap.count, sizeof(bench_ack_frame_t));
+    if (frames == NULL)
+    {
+        return 2;
+    }
+    int failures = 0;
+    bench_pcap_t trace;
+    // Bulk downloads: two IPv4 flows, one of them VLAN tagged, and one IPv6 flow acknowledging every other segment
+    bench_ack_trace_begin(&trace);
+    for (uint32_t i = 0; i < 600; i++)
+    {
+        for (uint32_t f = 0; f < 3; f++)
+        {
+            bench_ack_segment_t segment = {.ipv6 = f == 2, .vlan = f == 1 ? 10 : 0, .port = 40000 + f, .flags = 0x10,
+                                           .window = 502, .ack = 1 + i * 2896, .tsval = i};
+            bench_ack_trace_add(&trace, &segment);
+        }
+    }
+    failures += bench_ack_replay("download", &trace, 3, true, frames);
+    bench_pcap_free(&trace);
+    // Loss: duplicate ACKs with growing SACK blocks, a window update, then the partial and the full ACK
+    bench_ack_trace_begin(&trace);
+    bench_ack_segment_t segment = {.port = 40010, .flags = 0x10, .window = 502};
+    uint32_t hole = 1 + 60 * 1448;
+    for (uint32_t i = 0; i <= 60; i++)
+    {
+        segment.ack = 1 + i * 1448;
+        segment.tsval++;
+        bench_ack_trace_add(&trace, &segment);
+    }
+    segment.sack_num = 1;
+    segment.sack[0][0] = hole + 1448;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        segment.sack[0][1] = hole + (i + 2) * 1448;
+        segment.tsval++;
+        bench_ack_trace_add(&trace, &segment);
+    }
+    segment.window = 1024;
+    segment.tsval++;
+    bench_ack_trace_add(&trace, &segment);
+    segment.ack = hole + 1448;
+    segment.tsval++;
+    bench_ack_trace_add(&trace, &segment);
+    segment.sack_num = 0;
+    for (uint32_t i = 6; i < 60; i++)
+    {
+        segment.ack = hole + i * 1448;
+        segment.tsval++;
+        bench_ack_trace_add(&trace, &segment);
+    }
+    failures += bench_ack_replay("loss", &trace, 4, true, frames);
+    // The ACK up to the hole and its four duplicates reach the sender, the window update may give way to the partial ACK
+    uint32_t dupacks = 0;
+    for (uint32_t i = 0; i < trace.count; i++)
+    {
+        dupacks += frames[i].ack == hole && frames[i].delivered >= 0;
+    }
+    printf("ackfilter loss dupacks=%u%s\n", (unsigned)dupacks, dupacks >= 5 ? "" : " FAILED");
+    failures += dupacks < 5;
+    bench_pcap_free(&trace);
+    // Congestion signals: ECN echoes and CE marked ACKs, with data segments of the same flow in between
+    bench_ack_trace_begin(&trace);
+    for (uint32_t i = 0; i < 400; i++)
+    {
+        bench_ack_segment_t ecn = {.port = 40020, .flags = (i % 50) < 5 ? 0x50 : 0x10, .ce = (i % 70) == 3, .window = 502,
+                                   .ack = 1 + i * 2896, .tsval = i, .payload = (i % 40) == 7 ? 100 : 0};
+        ecn.flags |= ecn.payload > 0 ? 0x08 : 0;
+        bench_ack_trace_add(&trace, &ecn);
+    }
+    failures += bench_ack_replay("ecn", &trace, 3, true, frames);
+    bench_pcap_free(&trace);
+    if (bench_pcap.count > 0)
+    {
+        failures += bench_ack_replay("pcap", &bench_pcap, 3, false, frames);
+    }
+    free(frames);
+    printf("ackfilter %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
+
+/**
+ * @brief Start an empty synthetic trace
+ * @param[out] trace Trace
+ * @retval
+ */
+static void bench_ack_trace_begin(bench_pcap_t *trace)
+{
+    memset(trace, 0, sizeof(bench_pcap_t));
+    trace->frames = calloc(BENCH_ACK_TRACE_MAX, sizeof(bench_pcap_frame_t));
+}
+
+/**
+ * @brief Append a TCP segment from the client behind ethernet to a synthetic trace
+ * @param[in] trace Trace
+ * @param[in] segment Segment
+ * @retval
+ */
+static void bench_ack_trace_add(bench_pcap_t *trace, const bench_ack_segment_t *segment)
+{
+    if (trace->frames == NULL || trace->count == BENCH_ACK_TRACE_MAX)
+    {
+        return;
+    }
+    uint8_t *frame = calloc(1, BENCH_MAX_FRAME);
+    if (frame == NULL)
+    {
+        return;
+    }
+    static const uint8_t server[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x00, 0x02};
+    memcpy(frame, server, TUNNEL_ADDR_LEN);
+    memcpy(frame + TUNNEL_ADDR_LEN, bench_eth_host, TUNNEL_ADDR_LEN);
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    if (segment->vlan != 0)
+    {
+        bench_put16(frame + offset, BRIDGE_ETH_TYPE_VLAN);
+        bench_put16(frame + offset + 2, segment->vlan);
+        offset += 4;
+    }
+    uint32_t tcp_len = 20 + 12 + (segment->sack_num > 0 ? 4 + segment->sack_num * 8 : 0);
+    uint8_t *ip = frame + offset + 2;
+    uint8_t *tcp;
+    if (segment->ipv6)
+    {
+        static const uint8_t addrs[32] = {0xFD, [15] = 0x02, [16] = 0xFD, [29] = 0x01, [31] = 0x02};
+        bench_put16(frame + offset, BRIDGE_ETH_TYPE_IPV6);
+        ip[0] = 0x60;
+        ip[1] = segment->ce ? 0x30 : 0x20;
+        bench_put16(ip + 4, tcp_len + segment->payload);
+        ip[6] = BRIDGE_IP_PROTO_TCP;
+        ip[7] = 64;
+        memcpy(ip + 8, addrs, sizeof(addrs));
+        tcp = ip + 40;
+    }
+    else
+    {
+        static const uint8_t addrs[8] = {10, 0, 0, 2, 10, 0, 1, 2};
+        bench_put16(frame + offset, BRIDGE_ETH_TYPE_IPV4);
+        ip[0] = 0x45;
+        ip[1] = segment->ce ? 0x03 : 0x02;
+        bench_put16(ip + 2, 20 + tcp_len + segment->payload);
+        ip[6] = 0x40; // Don't fragment
+        ip[8] = 64;
+        ip[9] = BRIDGE_IP_PROTO_TCP;
+        memcpy(ip + 12, addrs, sizeof(addrs));
+        tcp = ip + 20;
+    }
+    bench_put16(tcp, segment->port);
+    bench_put16(tcp + 2, 443);
+    bench_put32(tcp + 4, 1000);
+    bench_put32(tcp + 8, segment->ack);
+    tcp[12] = (uint8_t)((tcp_len / 4) << 4);
+    tcp[13] = segment->flags;
+    bench_put16(tcp + 14, segment->window);
+    uint8_t *option = tcp + 20;
+    option[0] = 1;
+    option[1] = 1;
+    option[2] = 8;
+    option[3] = 10;
+    bench_put32(option + 4, segment->tsval);
+    option += 12;
+    if (segment->sack_num > 0)
+    {
+        option[0] = 1;
+        option[1] = 1;
+        option[2] = 5;
+        option[3] = (uint8_t)(2 + segment->sack_num * 8);
+        for (uint32_t i = 0; i < segment->sack_num; i++)
+        {
+            bench_put32(option + 4 + i * 8, segment->sack[i][0]);
+            bench_put32(option + 8 + i * 8, segment->sack[i][1]);
+        }
+    }
+    uint32_t len = (uint32_t)(tcp - frame) + tcp_len + segment->payload;
+    trace->frames[trace->count].data = frame;
+    trace->frames[trace->count].len = len < BENCH_MIN_FRAME ? BENCH_MIN_FRAME : len;
+    trace->count++;
+}
+
+/**
+ * @brief Read a frame the way the bench judges the ACK filter, independently of its parser
+ * @param[in] data Ethernet frame
+ * @param[in] len Frame length
+ * @param[out] frame Fields of the frame
+ * @retval
+ */
+static void bench_ack_read(const uint8_t *data, uint32_t len, bench_ack_frame_t *frame)
+{
+    memset(frame, 0, sizeof(bench_ack_frame_t));
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    uint64_t flow = 14695981039346656037ull;
+    uint16_t eth_type = len >= offset + 2 ? bench_get16(data + offset) : 0;
+    if (eth_type == BRIDGE_ETH_TYPE_VLAN && len >= offset + 6)
+    {
+        flow = (flow ^ (bench_get16(data + offset + 2) & 0x0FFF)) * 1099511628211ull;
+        eth_type = bench_get16(data + offset + 4);
+        offset += 4;
+    }
+    offset += 2;
+    const uint8_t *ip = data + offset;
+    uint32_t addr_offset;
+    uint32_t addr_len;
+    uint32_t payload;
+    if (eth_type == BRIDGE_ETH_TYPE_IPV4 && len >= offset + 20 && ip[9] == BRIDGE_IP_PROTO_TCP && (bench_get16(ip + 6) & 0x3FFF) == 0)
+    {
+        uint32_t header_len = (ip[0] & 0x0F) * 4;
+        frame->ce = (ip[1] & 0x03) == 0x03;
+        addr_offset = 12;
+        addr_len = 8;
+        payload = bench_get16(ip + 2) - header_len;
+        offset += header_len;
+    }
+    else if (eth_type == BRIDGE_ETH_TYPE_IPV6 && len >= offset + 40 && ip[6] == BRIDGE_IP_PROTO_TCP)
+    {
+        frame->ce = (ip[1] & 0x30) == 0x30;
+        addr_offset = 8;
+        addr_len = 32;
+        payload = bench_get16(ip + 4);
+        offset += 40;
+    }
+    else
+    {
+        return;
+    }
+    if (len < offset + 20)
+    {
+        return;
+    }
+    const uint8_t *tcp = data + offset;
+    for (uint32_t i = 0; i < addr_len; i++)
+    {
+        flow = (flow ^ ip[addr_offset + i]) * 1099511628211ull;
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        flow = (flow ^ tcp[i]) * 1099511628211ull;
+    }
+    frame->flow = flow | 1;
+    frame->ack = bench_get32(tcp + 8);
+    frame->ece = (tcp[13] & 0x40) != 0;
+    uint32_t header_len = (tcp[12] >> 4) * 4;
+    frame->pure = payload == header_len && (tcp[13] & ~0x40) == 0x10 && len >= offset + header_len;
+    for (uint32_t i = 20; frame->pure && i < header_len;)
+    {
+        uint8_t kind = tcp[i];
+        uint8_t option_len = kind <= 1 ? 1 : (i + 1 < header_len ? tcp[i + 1] : 0);
+        if (kind == 0)
+        {
+            break;
+        }
+        if (option_len < 1 || i + option_len > header_len || (kind > 1 && kind != 5 && kind != 8))
+        {
+            frame->pure = false;
+            break;
+        }
+        for (uint32_t b = 2; kind == 5 && b + 8 <= option_len && frame->sack_num <= BENCH_ACK_SACK_MAX; b += 8)
+        {
+            frame->sack[frame->sack_num][0] = bench_get32(tcp + i + b);
+            frame->sack[frame->sack_num][1] = bench_get32(tcp + i + b + 4);
+            frame->sack_num++;
+        }
+        i += option_len;
+    }
+}
+
+/**
+ * @brief Pass a trace through a wifi peer queue with the ACK filter, serving one frame every few frames
+ *        received, then check that the filter only dropped ACKs the next segment of their flow repeats and
+ *        that it never reordered a flow
+ * @param[in] name Trace name
+ * @param[in] trace Frames in arrival order
+ * @param[in] service_every Frames received per frame sent
+ * @param[in] expect_thinning Fail if no ACK was thinned
+ * @param[out] frames Fate of each frame of the trace
+ * @retval Number of failed checks
+ */
+static int bench_ack_replay(const char *name, const bench_pcap_t *trace, uint32_t service_every, bool expect_thinning, bench_ack_frame_t *frames)
+{
+    // Buffer of each queued frame, to tell which frame a descriptor carries after the filter swapped buffers
+    void *owners[BENCH_ACK_QUEUE] = {0};
+    uint32_t owner_index[BENCH_ACK_QUEUE] = {0};
+    drr_t drr;
+    drr_flow_t flows[QOS_CLASS_NUM];
+    ack_filter_t filter;
+    ack_filter_stats_t before;
+    ack_filter_stats_t after;
+    drr_init(&drr);
+    for (uint32_t c = 0; c < QOS_CLASS_NUM; c++)
+    {
+        drr_flow_init(&flows[c], STATION_QUANTUM);
+    }
+    ack_filter_init(&filter);
+    ack_filter_get_stats(&before);
+    int64_t position = 0;
+    uint32_t thinned = 0;
+    uint32_t next = 0;
+    int failures = 0;
+    while (next < trace->count || drr.count > 0)
+    {
+        bool serve = drr.count >= BENCH_ACK_QUEUE || next == trace->count || (next % service_every) == 0;
+        if (serve && drr.count > 0)
+        {
+            drr_flow_t *flow;
+            raw_data_t *raw_data = drr_dequeue(&drr, &flow);
+            ack_filter_forget(&filter, raw_data);
+            for (uint32_t q = 0; q < BENCH_ACK_QUEUE; q++)
+            {
+                if (owners[q] == raw_data->data)
+                {
+                    frames[owner_index[q]].delivered = position++;
+                    owners[q] = NULL;
+                }
+            }
+            pool_release(raw_data);
+        }
+        if (next == trace->count || drr.count >= BENCH_ACK_QUEUE)
+        {
+            continue;
+        }
+        const bench_pcap_frame_t *captured = &trace->frames[next];
+        bench_ack_read(captured->data, captured->len, &frames[next]);
+        raw_data_t *raw_data = pool_alloc_desc();
+        uint8_t *buffer = pool_alloc_buf();
+        if (raw_data == NULL || buffer == NULL || captured->len > POOL_BUF_SIZE)
+        {
+            fprintf(stderr, "ackfilter %s: frame pool exhausted\n", name);
+            return 1;
+        }
+        memcpy(buffer, captured->data, captured->len);
+        raw_data->data = buffer;
+        raw_data->data_length = captured->len;
+        raw_data->peer = 0;
+        raw_data->ingress_peer = RAW_DATA_PEER_ALL;
+        raw_data->qos_class = QOS_CLASS_BEST_EFFORT;
+        if (ack_filter_merge(&filter, flows, raw_data))
+        {
+            // The descriptor now carries the older ACK, the queued one carries this frame
+            for (uint32_t q = 0; q < BENCH_ACK_QUEUE; q++)
+            {
+                if (owners[q] == raw_data->data)
+                {
+                    frames[owner_index[q]].delivered = -1;
+                    owners[q] = buffer;
+                    owner_index[q] = next;
+                    thinned++;
+                }
+            }
+            pool_release(raw_data);
+        }
+        else
+        {
+            drr_enqueue(&drr, &flows[raw_data->qos_class], raw_data);
+            for (uint32_t q = 0; q < BENCH_ACK_QUEUE; q++)
+            {
+                if (owners[q] == NULL)
+                {
+                    owners[q] = buffer;
+                    owner_index[q] = next;
+                    break;
+                }
+            }
+        }
+        next++;
+    }
+    ack_filter_get_stats(&after);
+    uint32_t wrong = 0;
+    uint32_t reordered = 0;
+    for (uint32_t i = 0; i < trace->count; i++)
+    {
+        const bench_ack_frame_t *frame = &frames[i];
+        // The next frame of the flow must carry everything the thinned ACK told the sender
+        uint32_t j = i + 1;
+        while (j < trace->count && frames[j].flow != frame->flow)
+        {
+            j++;
+        }
+        const bench_ack_frame_t *later = frame->flow != 0 && j < trace->count ? &frames[j] : NULL;
+        if (later != NULL && frame->delivered >= 0 && later->delivered >= 0 && later->delivered < frame->delivered)
+        {
+            reordered++;
+        }
+        if (frame->delivered >= 0)
+        {
+            continue;
+        }
+        bool ok = frame->pure && later != NULL && later->pure && (int32_t)(later->ack - frame->ack) > 0 &&
+                  (later->ece || !frame->ece) && (later->ce || !frame->ce);
+        for (uint32_t s = 0; ok && s < frame->sack_num; s++)
+        {
+            bool covered = (int32_t)(later->ack - frame->sack[s][1]) >= 0;
+            for (uint32_t t = 0; !covered && t < later->sack_num; t++)
+            {
+                covered = (int32_t)(frame->sack[s][0] - later->sack[t][0]) >= 0 && (int32_t)(later->sack[t][1] - frame->sack[s][1]) >= 0;
+            }
+            ok = covered;
+        }
+        wrong += !ok;
+    }
+    bool ok = wrong == 0 && reordered == 0 && position + thinned == trace->count && after.thinned - before.thinned == thinned &&
+              (!expect_thinning || thinned > 0);
+    printf("ackfilter %s frames=%u sent=%lld thinned=%u pure_acks=%u kept=%u collisions=%u wrong=%u reordered=%u%s\n", name,
+           (unsigned)trace->count, (long long)position, (unsigned)thinned, (unsigned)(after.pure_acks - before.pure_acks),
+           (unsigned)(after.kept - before.kept), (unsigned)(after.collisions - before.collisions), (unsigned)wrong,
+           (unsigned)reordered, ok ? "" : " FAILED");
+    failures += !ok;
+    return failures;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
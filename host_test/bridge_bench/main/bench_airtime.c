@@ -0,0 +1,140 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "bridge_bench.h"
+#include "wenet_bridge.h"
+#include "wenet_tunnel.h"
+#include "wenet_transport.h"
+#if CONFIG_WENET_TUNNEL_COMPACT
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_AIRTIME_DEVICES 8 // Hosts on the wifi side the frames are sent to, in turn
+/* Private typedef -----------------------------------------------------------*/
+// Wifi frames one tunnel version put on the air for the frames of one size
+typedef struct
+{
+    uint64_t airtime_us;
+    uint64_t wire_frames;
+    uint64_t refused; // Wifi frames longer than the driver takes
+} bench_airtime_t;
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static bool bench_airtime_send(void *ctx, uint8_t *frame, uint32_t len);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Encode the same frame size mix with the legacy trailer and with the compact encapsulation, and report
+ *        the wifi airtime of both per frame size and in total. Fails unless the compact encapsulation takes less
+ *        airtime. Sizes a version can only send in frames the wifi driver refuses are left out of the totals
+ * @param[in] argc Option count
+ * @param[in] argv Options
+ * @retval Process exit code
+ */
+int bench_mode_airtime(int argc, char **argv)
+{
+    if (bench_parse_options(argc, argv, &bench_options, "airtime") != 0)
+    {
+        return 2;
+    }
+    static const char *const names[2] = {"legacy", "compact"};
+    static const uint8_t wifi_local[TUNNEL_ADDR_LEN] = {0x24, 0x0a, 0xc4, 0x57, 0x00, 0x01};
+    static const uint8_t wifi_peer[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x02, 0x01};
+    static const uint8_t device[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x00, 0x10};
+    static tunnel_peer_t peers[2];
+    static bench_airtime_t airtime[2][BENCH_SIZE_MAX];
+    static uint8_t frame[BENCH_MAX_FRAME + TUNNEL_MAX_OVERHEAD];
+    uint64_t frames[BENCH_SIZE_MAX] = {0};
+    memset(airtime, 0, sizeof(airtime));
+    for (uint32_t v = 0; v < 2; v++)
+    {
+        tunnel_peer_init(&peers[v]);
+    }
+    // The compact peer has negotiated as the coordinators do, without compression so only the encapsulation differs
+    atomic_store(&peers[TUNNEL_VERSION_COMPACT].peer_version, TUNNEL_VERSION_COMPACT);
+    atomic_store(&peers[TUNNEL_VERSION_COMPACT].peer_heard, true);
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    atomic_store(&peers[TUNNEL_VERSION_COMPACT].peer_fragment, true);
+    tunnel_set_mtu(&peers[TUNNEL_VERSION_COMPACT], TRANSPORT_WIFI_MTU);
+#endif
+    for (uint64_t seq = 0; seq < bench_options.frames; seq++)
+    {
+        uint32_t pick = (uint32_t)(seq % bench_options.weight_total);
+        uint32_t s = 0;
+        while (pick >= bench_options.weights[s])
+        {
+            pick -= bench_options.weights[s++];
+        }
+        uint32_t len = bench_options.sizes[s];
+        frames[s]++;
+        for (uint32_t v = 0; v < 2; v++)
+        {
+            memset(frame, 0, len);
+            memcpy(frame, device, TUNNEL_ADDR_LEN);
+            frame[TUNNEL_ADDR_LEN - 1] = (uint8_t)(device[TUNNEL_ADDR_LEN - 1] + seq % BENCH_AIRTIME_DEVICES);
+            memcpy(frame + TUNNEL_ADDR_LEN, bench_eth_host, TUNNEL_ADDR_LEN);
+            bench_put16(frame + BRIDGE_ETH_TYPE_OFFSET, BRIDGE_ETH_TYPE_IPV4);
+            uint32_t wire_len = tunnel_encapsulate(&peers[v], frame, len, wifi_peer, wifi_local);
+            tunnel_send(&peers[v], frame, wire_len, bench_airtime_send, &airtime[v][s]);
+        }
+    }
+    uint64_t total[2] = {0};
+    uint64_t counted = 0;
+    for (uint32_t s = 0; s < bench_options.size_count; s++)
+    {
+        if (frames[s] == 0)
+        {
+            continue;
+        }
+        bool carried = airtime[TUNNEL_VERSION_LEGACY][s].refused == 0 && airtime[TUNNEL_VERSION_COMPACT][s].refused == 0;
+        if (carried)
+        {
+            counted += frames[s];
+        }
+        for (uint32_t v = 0; v < 2; v++)
+        {
+            total[v] += carried ? airtime[v][s].airtime_us : 0;
+        }
+        uint64_t legacy = airtime[TUNNEL_VERSION_LEGACY][s].airtime_us;
+        uint64_t compact = airtime[TUNNEL_VERSION_COMPACT][s].airtime_us;
+        printf("airtime size=%u frames=%llu", (unsigned)bench_options.sizes[s], (unsigned long long)frames[s]);
+        for (uint32_t v = 0; v < 2; v++)
+        {
+            printf(" %s_us_per_frame=%.1f %s_wire_frames=%llu", names[v], (double)airtime[v][s].airtime_us / frames[s],
+                   names[v], (unsigned long long)airtime[v][s].wire_frames);
+        }
+        if (carried)
+        {
+            printf(" saving=%.1f%%\n", legacy ? 100.0 * ((double)legacy - (double)compact) / (double)legacy : 0.0);
+        }
+        else
+        {
+            printf(" refused legacy=%llu compact=%llu, left out of the totals\n",
+                   (unsigned long long)airtime[TUNNEL_VERSION_LEGACY][s].refused,
+                   (unsigned long long)airtime[TUNNEL_VERSION_COMPACT][s].refused);
+        }
+    }
+    bool failed = counted == 0 || total[TUNNEL_VERSION_COMPACT] >= total[TUNNEL_VERSION_LEGACY];
+    printf("airtime total frames=%llu legacy_us=%llu compact_us=%llu saving=%.1f%%\n", (unsigned long long)counted,
+           (unsigned long long)total[TUNNEL_VERSION_LEGACY], (unsigned long long)total[TUNNEL_VERSION_COMPACT],
+           total[TUNNEL_VERSION_LEGACY] ? 100.0 * ((double)total[TUNNEL_VERSION_LEGACY] - (double)total[TUNNEL_VERSION_COMPACT]) / (double)total[TUNNEL_VERSION_LEGACY] : 0.0);
+    printf("airtime %s\n", failed ? "FAILED" : "ok");
+    return failed ? 1 : 0;
+}
+
+/**
+ * @brief Account a wifi frame, or fragment, handed over by the tunnel
+ * @param[in] ctx Airtime counters of the frame size
+ * @param[in] frame Wifi frame
+ * @param[in] len Wifi frame length
+ * @retval true, the frame is taken
+ */
+static bool bench_airtime_send(void *ctx, uint8_t *frame, uint32_t len)
+{
+    bench_airtime_t *airtime = ctx;
+    (void)frame;
+    airtime->airtime_us += bridge_airtime_us(len);
+    airtime->wire_frames++;
+    airtime->refused += len > TRANSPORT_WIFI_MTU;
+    return true;
+}
+#endif /* CONFIG_WENET_TUNNEL_COMPACT */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,910 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_event.h"
+#include "esp_eth.h"
+#include "esp_wifi.h"
+#include "esp_mac.h"
+#include "wenet_shim.h"
+#define SHIM_ALLOC_NO_REDIRECT
+#include "shim_alloc.h"
+#include "bridge_bench.h"
+#include "wenet_ethernet.h"
+#include "wenet_wifi.h"
+#include "wenet_pool.h"
+#include "wenet_bridge.h"
+#include "wenet_fdb.h"
+#include "wenet_qos.h"
+#include "wenet_arp.h"
+#include "wenet_filter.h"
+#include "wenet_telemetry.h"
+#include "wenet_capture.h"
+#include "wenet_station.h"
+#include "wenet_tunnel.h"
+#include "wenet_compress.h"
+#include "wenet_transport.h"
+#include "wenet_espnow.h"
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_HEADER_LEN 42 // Ethernet, IPv4 and UDP headers of a synthetic frame
+// Every frame ends with a stamp: magic, direction, send time. The receiving end takes the latency from it.
+#define BENCH_STAMP_LEN 16
+#define BENCH_STAMP_MAGIC 0x57454E54
+#define BENCH_LATENCY_MAX 2000000
+#define BENCH_STALL_NS 20000000LL
+#define BENCH_DRAIN_NS 200000000LL
+#define BENCH_NEGOTIATE_MS 5000
+#define BENCH_WIFI_MAX_FRAME 1514 // Longest frame the wifi driver takes
+/* Private typedef -----------------------------------------------------------*/
+// A wifi peer as seen from the air: its radio address, one host behind it, and its end of the tunnel
+typedef struct
+{
+    uint8_t addr[TUNNEL_ADDR_LEN];
+    uint8_t host[TUNNEL_ADDR_LEN];
+    tunnel_peer_t tunnel;
+} bench_remote_t;
+
+typedef struct
+{
+    atomic_uint_fast64_t sent;
+    atomic_uint_fast64_t delivered;
+    atomic_uint_fast64_t delivered_bytes;
+    atomic_int_fast64_t first_ns; // First frame sent
+    atomic_int_fast64_t last_ns;  // Last frame delivered
+    atomic_uint_fast64_t latency_count;
+    uint32_t *latency_ns;
+} bench_dir_t;
+/* Private variables ---------------------------------------------------------*/
+uint32_t bench_aggregate_hold_us = BENCH_AGGREGATE_HOLD_US_DEFAULT;
+static bench_remote_t bench_remotes[STATION_MAX];
+static uint32_t bench_remote_count;
+static uint8_t bench_local_addr[TUNNEL_ADDR_LEN];
+static wifi_interface_t bench_ifx;
+static bench_dir_t bench_dirs[TELEMETRY_DIR_MAX];
+static atomic_uint_fast64_t bench_wire_frames;
+static atomic_uint_fast64_t bench_wire_bytes;
+static atomic_uint_fast64_t bench_airtime_us;
+static atomic_uint_fast64_t bench_plain_airtime_us; // Airtime if every delivered frame went alone, without tunnel
+static atomic_uint_fast64_t bench_stalls;
+static atomic_bool bench_wifi_generate;
+static int64_t bench_reset_ns;
+static bridge_drop_stats_t bench_drops_base;
+static shim_alloc_stats_t bench_alloc_base;
+// Only the wifi send task transmits, the copy stands for the frame on the air
+static uint8_t bench_air_frame[POOL_BUF_SIZE];
+#if CONFIG_WENET_TUNNEL_COMPRESS
+static compress_t bench_remote_compress;
+static uint8_t bench_remote_expand[TUNNEL_EXPAND_BUF_LEN];
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+static tunnel_reassembly_t bench_remote_reassembly;
+#endif
+/* Private function prototypes -----------------------------------------------*/
+static int bench_setup(void);
+static void bench_learn(void);
+static void bench_reset(void);
+static void bench_run(void);
+static int bench_report(bool verbose);
+static void bench_pace(uint64_t seq, int64_t start_ns);
+static int64_t bench_in_flight(void);
+static uint32_t bench_build_frame(uint8_t *frame, uint64_t seq, telemetry_dir_t dir, const uint8_t *dst, const uint8_t *src);
+static bool bench_read_stamp(const uint8_t *frame, uint32_t len, telemetry_dir_t *dir, int64_t *sent_ns);
+static void bench_record(telemetry_dir_t dir, int64_t sent_ns, uint32_t len);
+static esp_err_t bench_eth_transmit(void *buffer, size_t len);
+static esp_err_t bench_wifi_transmit(wifi_interface_t ifx, void *buffer, uint16_t len);
+static esp_err_t bench_espnow_transmit(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+static void bench_remote_deliver(void *ctx, uint8_t *frame, uint32_t len);
+static void bench_wifi_send(bench_remote_t *remote, const uint8_t *frame, uint32_t len);
+static bool bench_wifi_inject(void *ctx, uint8_t *frame, uint32_t len);
+static esp_err_t bench_wifi_receive(const uint8_t *frame, uint32_t len);
+static void *bench_eth_thread(void *arg);
+static void *bench_wifi_thread(void *arg);
+static int bench_percentile_compare(const void *a, const void *b);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Forward frames through the bridge core in both directions and report rate, latency and heap use
+ * @param[in] argc Option count
+ * @param[in] argv Options
+ * @retval Process exit code
+ */
+int bench_mode_run(int argc, char **argv)
+{
+    if (bench_parse_options(argc, argv, &bench_options, "run") != 0 || bench_setup() != 0)
+    {
+        return 2;
+    }
+    if (bench_options.hold_count > 0)
+    {
+        bench_aggregate_hold_us = bench_options.holds[0];
+    }
+    bench_learn();
+    bench_reset();
+    bench_run();
+    return bench_report(true);
+}
+
+/**
+ * @brief Run the same paced load once per aggregation hold time, to trade wifi airtime against latency
+ * @param[in] argc Option count
+ * @param[in] argv Options
+ * @retval Process exit code
+ */
+int bench_mode_sweep(int argc, char **argv)
+{
+    if (bench_parse_options(argc, argv, &bench_options, "sweep") != 0 || bench_setup() != 0)
+    {
+        return 2;
+    }
+    bench_learn();
+    int ret = 0;
+    for (uint32_t i = 0; i < bench_options.hold_count; i++)
+    {
+        bench_aggregate_hold_us = bench_options.holds[i];
+        printf("hold_us=%u\n", (unsigned)bench_aggregate_hold_us);
+        bench_reset();
+        bench_run();
+        ret |= bench_report(false);
+    }
+    return ret;
+}
+
+/**
+ * @brief Bring the bridge core up like system_manager_init does, connect the emulated wifi peers and the
+ *        ethernet link, and wait until every tunnel is negotiated
+ * @param None
+ * @retval 0 on success
+ */
+static int bench_setup(void)
+{
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_ERROR_CHECK(pool_init());
+    fdb_init();
+    qos_init();
+    arp_init();
+    filter_init();
+    telemetry_init();
+#if CONFIG_WENET_CAPTURE
+    capture_init();
+#endif
+    ethernet_init();
+    wifi_init();
+    shim_eth_set_transmit(bench_eth_transmit);
+    shim_wifi_set_transmit(bench_wifi_transmit);
+    shim_espnow_set_transmit(bench_espnow_transmit);
+
+    bench_remote_count = bench_options.stations;
+    for (uint32_t i = 0; i < bench_remote_count; i++)
+    {
+        bench_remote_t *remote = &bench_remotes[i];
+        const uint8_t addr[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x02, (uint8_t)(i + 1)};
+        const uint8_t host[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x01, (uint8_t)(i + 1)};
+        memcpy(remote->addr, addr, TUNNEL_ADDR_LEN);
+        memcpy(remote->host, host, TUNNEL_ADDR_LEN);
+        tunnel_peer_init(&remote->tunnel);
+#if CONFIG_WENET_TUNNEL_COMPRESS
+        // Every remote is expanded on the wifi send task and compressed on the bench wifi thread
+        tunnel_set_compression(&remote->tunnel, &bench_remote_compress, bench_remote_expand);
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+        tunnel_set_reassembly(&remote->tunnel, &bench_remote_reassembly);
+        tunnel_set_mtu(&remote->tunnel, bench_options.espnow ? ESPNOW_MTU : TRANSPORT_WIFI_MTU);
+#endif
+    }
+    wifi_change_ssid_pass("WeNet", "bridge_bench");
+    wifi_set_raw_mode(true);
+    wifi_set_transport(bench_options.espnow ? TRANSPORT_ESPNOW : TRANSPORT_WIFI);
+    if (bench_options.espnow)
+    {
+        // No association, the transport links the listed remotes as soon as it starts
+        bench_ifx = bench_remote_count == 1 ? WIFI_IF_STA : WIFI_IF_AP;
+        esp_read_mac(bench_local_addr, bench_remote_count == 1 ? ESP_MAC_WIFI_STA : ESP_MAC_WIFI_SOFTAP);
+        wifi_change_mode(bench_remote_count == 1 ? WIFI_MODE_STA : WIFI_MODE_AP);
+        if (bench_options.check && shim_espnow_encrypted_peers() < bench_remote_count)
+        {
+            printf("espnow encrypted_peers=%u FAILED\n", (unsigned)shim_espnow_encrypted_peers());
+            return 1;
+        }
+    }
+    else if (bench_remote_count == 1)
+    {
+        bench_ifx = WIFI_IF_STA;
+        esp_read_mac(bench_local_addr, ESP_MAC_WIFI_STA);
+        shim_wifi_set_ap_bssid(bench_remotes[0].addr);
+        wifi_change_mode(WIFI_MODE_STA);
+        wifi_event_sta_connected_t event = {.channel = 1};
+        memcpy(event.bssid, bench_remotes[0].addr, TUNNEL_ADDR_LEN);
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &event, sizeof(event), portMAX_DELAY);
+    }
+    else
+    {
+        bench_ifx = WIFI_IF_AP;
+        esp_read_mac(bench_local_addr, ESP_MAC_WIFI_SOFTAP);
+        wifi_change_mode(WIFI_MODE_AP);
+        for (uint32_t i = 0; i < bench_remote_count; i++)
+        {
+            wifi_event_ap_staconnected_t event = {.aid = (uint8_t)(i + 1)};
+            memcpy(event.mac, bench_remotes[i].addr, TUNNEL_ADDR_LEN);
+            esp_event_post(WIFI_EVENT, WIFI_EVENT_AP_STACONNECTED, &event, sizeof(event), portMAX_DELAY);
+        }
+    }
+    esp_event_post(ETH_EVENT, ETHERNET_EVENT_CONNECTED, NULL, 0, portMAX_DELAY);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, bench_wifi_thread, NULL);
+    pthread_detach(thread);
+
+    uint8_t version = CONFIG_WENET_TUNNEL_COMPACT ? TUNNEL_VERSION_COMPACT : TUNNEL_VERSION_LEGACY;
+    for (uint32_t waited = 0;; waited++)
+    {
+        bool ready = true;
+        for (uint32_t i = 0; i < bench_remote_count; i++)
+        {
+            station_t *station = station_find(bench_remotes[i].addr);
+            ready &= station != NULL && tunnel_tx_version(&station->tunnel) == version && tunnel_tx_version(&bench_remotes[i].tunnel) == version;
+#if CONFIG_WENET_AGGREGATION && CONFIG_WENET_TUNNEL_COMPACT
+            ready &= station != NULL && tunnel_aggregate_supported(&station->tunnel);
+#endif
+#if CONFIG_WENET_TUNNEL_COMPRESS
+            ready &= station != NULL && atomic_load(&station->tunnel.peer_compress) && atomic_load(&bench_remotes[i].tunnel.peer_compress);
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+            ready &= station != NULL && atomic_load(&station->tunnel.peer_fragment) && atomic_load(&bench_remotes[i].tunnel.peer_fragment);
+#endif
+        }
+        if (ready)
+        {
+            fprintf(stderr, "Tunnels negotiated after %u ms\n", (unsigned)waited);
+            return 0;
+        }
+        if (waited == BENCH_NEGOTIATE_MS)
+        {
+            fprintf(stderr, "Tunnel negotiation did not complete\n");
+            return -1;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+/**
+ * @brief Let the bridge learn where every host is, so the measured unicast frames are not flooded
+ * @param None
+ * @retval
+ */
+static void bench_learn(void)
+{
+    uint8_t frame[POOL_BUF_SIZE];
+    for (uint32_t i = 0; i < bench_remote_count; i++)
+    {
+        uint32_t len = bench_build_frame(frame, i, TELEMETRY_DIR_MAX, bench_eth_host, bench_remotes[i].host);
+        bench_wifi_send(&bench_remotes[i], frame, len);
+    }
+    uint32_t len = bench_build_frame(frame, 0, TELEMETRY_DIR_MAX, bench_remotes[0].host, bench_eth_host);
+    uint8_t *buffer = malloc(len);
+    memcpy(buffer, frame, len);
+    shim_eth_receive(buffer, len);
+    vTaskDelay(pdMS_TO_TICKS(50));
+}
+
+/**
+ * @brief Clear the counters before a measurement
+ * @param None
+ * @retval
+ */
+static void bench_reset(void)
+{
+    for (uint32_t d = 0; d < TELEMETRY_DIR_MAX; d++)
+    {
+        bench_dir_t *dir = &bench_dirs[d];
+        if (dir->latency_ns == NULL)
+        {
+            dir->latency_ns = calloc(BENCH_LATENCY_MAX, sizeof(uint32_t));
+        }
+        atomic_store(&dir->sent, 0);
+        atomic_store(&dir->delivered, 0);
+        atomic_store(&dir->delivered_bytes, 0);
+        atomic_store(&dir->first_ns, 0);
+        atomic_store(&dir->last_ns, 0);
+        atomic_store(&dir->latency_count, 0);
+    }
+    atomic_store(&bench_wire_frames, 0);
+    atomic_store(&bench_wire_bytes, 0);
+    atomic_store(&bench_airtime_us, 0);
+    atomic_store(&bench_plain_airtime_us, 0);
+    atomic_store(&bench_stalls, 0);
+    telemetry_reset();
+    bridge_get_drop_stats(&bench_drops_base);
+    shim_alloc_get_stats(&bench_alloc_base);
+    bench_reset_ns = bench_now_ns();
+}
+
+/**
+ * @brief Send the frames of both directions and wait until the bridge has delivered or dropped them
+ * @param None
+ * @retval
+ */
+static void bench_run(void)
+{
+    pthread_t eth_thread;
+    if (bench_options.eth_dir)
+    {
+        pthread_create(&eth_thread, NULL, bench_eth_thread, NULL);
+    }
+    if (bench_options.wifi_dir)
+    {
+        atomic_store(&bench_wifi_generate, true);
+    }
+    if (bench_options.eth_dir)
+    {
+        pthread_join(eth_thread, NULL);
+    }
+    while (atomic_load(&bench_wifi_generate))
+    {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    // Wait for the queues to drain, held aggregates are sent at the latest after the hold time
+    int64_t last_change = bench_now_ns();
+    int64_t last_in_flight = bench_in_flight();
+    while (last_in_flight > 0 && bench_now_ns() - last_change < BENCH_DRAIN_NS)
+    {
+        vTaskDelay(pdMS_TO_TICKS(1));
+        int64_t in_flight = bench_in_flight();
+        if (in_flight != last_in_flight)
+        {
+            last_in_flight = in_flight;
+            last_change = bench_now_ns();
+        }
+    }
+}
+
+/**
+ * @brief Print the results of the last measurement as key=value lines
+ * @param[in] verbose Also print the heap, airtime and drop details
+ * @retval Process exit code, 1 if --check is given and a check failed
+ */
+static int bench_report(bool verbose)
+{
+    int ret = 0;
+    uint64_t total_sent = 0;
+    uint64_t total_lost = 0;
+    for (uint32_t d = 0; d < TELEMETRY_DIR_MAX; d++)
+    {
+        bench_dir_t *dir = &bench_dirs[d];
+        uint64_t sent = atomic_load(&dir->sent);
+        uint64_t delivered = atomic_load(&dir->delivered);
+        if (sent == 0 && delivered == 0)
+        {
+            continue;
+        }
+        uint64_t count = atomic_load(&dir->latency_count);
+        count = count < BENCH_LATENCY_MAX ? count : BENCH_LATENCY_MAX;
+        qsort(dir->latency_ns, count, sizeof(uint32_t), bench_percentile_compare);
+        const double percents[] = {50, 90, 99, 99.9};
+        double latency_us[5] = {0};
+        for (uint32_t p = 0; p < 4 && count > 0; p++)
+        {
+            latency_us[p] = dir->latency_ns[(uint64_t)(percents[p] / 100 * (count - 1))] / 1000.0;
+        }
+        latency_us[4] = count > 0 ? dir->latency_ns[count - 1] / 1000.0 : 0;
+        int64_t elapsed_ns = atomic_load(&dir->last_ns) - atomic_load(&dir->first_ns);
+        double seconds = elapsed_ns > 0 ? elapsed_ns / 1e9 : 1e-9;
+        // Relayed frames have no sender of their own, their losses are counted on the wifi to ethernet side
+        uint64_t lost = sent > delivered ? sent - delivered : 0;
+        total_sent += sent;
+        total_lost += lost;
+        printf("dir=%s sent=%llu delivered=%llu lost=%llu pps=%.0f mbps=%.1f p50_us=%.1f p90_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+               telemetry_dir_name(d), (unsigned long long)sent, (unsigned long long)delivered, (unsigned long long)lost,
+               delivered / seconds, atomic_load(&dir->delivered_bytes) * 8 / seconds / 1e6,
+               latency_us[0], latency_us[1], latency_us[2], latency_us[3], latency_us[4]);
+    }
+
+    uint64_t wire_frames = atomic_load(&bench_wire_frames);
+    uint64_t wifi_frames = atomic_load(&bench_dirs[TELEMETRY_DIR_ETH_TO_WIFI].delivered) + atomic_load(&bench_dirs[TELEMETRY_DIR_WIFI_TO_WIFI].delivered);
+    uint64_t airtime = atomic_load(&bench_airtime_us);
+    uint64_t plain_airtime = atomic_load(&bench_plain_airtime_us);
+    printf("wifi wire_frames=%llu frames_per_wire_frame=%.2f airtime_us_per_frame=%.1f airtime_vs_plain=%.3f\n",
+           (unsigned long long)wire_frames, wire_frames ? (double)wifi_frames / wire_frames : 0.0,
+           wifi_frames ? (double)airtime / wifi_frames : 0.0, plain_airtime ? (double)airtime / plain_airtime : 0.0);
+
+    shim_alloc_stats_t alloc;
+    shim_alloc_get_stats(&alloc);
+    uint64_t allocs = alloc.allocs - bench_alloc_base.allocs;
+    printf("heap allocs=%llu allocs_per_frame=%.3f bytes_per_frame=%.1f\n", (unsigned long long)allocs,
+           total_sent ? (double)allocs / total_sent : 0.0, total_sent ? (double)(alloc.bytes - bench_alloc_base.bytes) / total_sent : 0.0);
+    uint64_t copies = alloc.copies - bench_alloc_base.copies;
+    printf("copies realloc_moves=%llu frame_copies=%llu copies_per_frame=%.3f copy_bytes_per_frame=%.1f\n",
+           (unsigned long long)(alloc.realloc_moves - bench_alloc_base.realloc_moves), (unsigned long long)copies,
+           total_sent ? (double)copies / total_sent : 0.0, total_sent ? (double)(alloc.copy_bytes - bench_alloc_base.copy_bytes) / total_sent : 0.0);
+
+    if (verbose)
+    {
+        bridge_drop_stats_t drops;
+        bridge_get_drop_stats(&drops);
+        printf("drops");
+        for (uint32_t r = 0; r < BRIDGE_DROP_REASON_MAX; r++)
+        {
+            printf(" %s=%u", bridge_drop_reason_name(r), (unsigned)(drops.drops[r] - bench_drops_base.drops[r]));
+        }
+        printf(" ecn_marks=%u pause_frames=%u stalls=%llu\n", (unsigned)(drops.ecn_marks - bench_drops_base.ecn_marks),
+               (unsigned)(drops.pause_frames - bench_drops_base.pause_frames), (unsigned long long)atomic_load(&bench_stalls));
+        telemetry_stats_t telemetry;
+        telemetry_get_stats(&telemetry);
+        printf("queues");
+        for (uint32_t q = 0; q < TELEMETRY_QUEUE_MAX; q++)
+        {
+            printf(" %s_max=%u", telemetry_queue_name(q), (unsigned)telemetry.queue_max[q]);
+        }
+        printf("\n");
+    }
+
+    if (bench_options.check)
+    {
+        // An open loop rate overruns the rings whenever the host deschedules the bridge for a few milliseconds,
+        // only the closed loop window is expected to be lossless
+        if (total_sent == 0 || (bench_pcap.count == 0 && bench_options.rate == 0 && total_lost > 0))
+        {
+            printf("CHECK FAILED: %llu of %llu frames lost\n", (unsigned long long)total_lost, (unsigned long long)total_sent);
+            ret = 1;
+        }
+        if (allocs > 0)
+        {
+            printf("CHECK FAILED: %llu heap allocations on the forwarding path\n", (unsigned long long)allocs);
+            ret = 1;
+        }
+        // A block realloc moved is a hidden frame copy, the host heap grows blocks in place far more often than the
+        // heap on the target does
+        uint64_t realloc_moves = alloc.realloc_moves - bench_alloc_base.realloc_moves;
+        if (realloc_moves > 0)
+        {
+            printf("CHECK FAILED: %llu heap blocks moved by realloc on the forwarding path\n", (unsigned long long)realloc_moves);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Wait until the next frame of a generator may be sent, by rate or by the in flight window
+ * @param[in] seq Sequence number of the frame
+ * @param[in] start_ns Time the generator sent its first frame
+ * @retval
+ */
+static void bench_pace(uint64_t seq, int64_t start_ns)
+{
+    if (bench_options.rate > 0)
+    {
+        int64_t due = start_ns + (int64_t)(seq * 1000000000ULL / bench_options.rate);
+        int64_t wait;
+        while ((wait = due - bench_now_ns()) > 0)
+        {
+            if (wait > 100000)
+            {
+                struct timespec delay = {.tv_sec = 0, .tv_nsec = wait - 50000};
+                nanosleep(&delay, NULL);
+            }
+            else
+            {
+                sched_yield();
+            }
+        }
+        return;
+    }
+    // Frames the bridge drops without telling are given up on after a while, so a lost frame cannot stall the run
+    int64_t since = bench_now_ns();
+    while (bench_in_flight() >= bench_options.window)
+    {
+        if (bench_now_ns() - since > BENCH_STALL_NS)
+        {
+            atomic_fetch_add(&bench_stalls, 1);
+            return;
+        }
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Get the number of frames inside the bridge
+ * @param None
+ * @retval Frames sent by the generators that were neither delivered nor dropped yet
+ */
+static int64_t bench_in_flight(void)
+{
+    bridge_drop_stats_t drops;
+    bridge_get_drop_stats(&drops);
+    int64_t in_flight = 0;
+    for (uint32_t r = 0; r < BRIDGE_DROP_REASON_MAX; r++)
+    {
+        in_flight -= (int64_t)(drops.drops[r] - bench_drops_base.drops[r]);
+    }
+    for (uint32_t d = 0; d < TELEMETRY_DIR_MAX; d++)
+    {
+        in_flight += (int64_t)atomic_load(&bench_dirs[d].sent) - (int64_t)atomic_load(&bench_dirs[d].delivered);
+    }
+    return in_flight;
+}
+
+/**
+ * @brief Build the next frame of a generator, from the size mix or from the capture, and stamp it
+ * @param[out] frame Buffer of at least POOL_BUF_SIZE bytes
+ * @param[in] seq Sequence number of the frame
+ * @param[in] dir Direction stamped into the frame, TELEMETRY_DIR_MAX for frames that are not measured
+ * @param[in] dst Destination host
+ * @param[in] src Source host
+ * @retval Frame length
+ */
+static uint32_t bench_build_frame(uint8_t *frame, uint64_t seq, telemetry_dir_t dir, const uint8_t *dst, const uint8_t *src)
+{
+    uint32_t len;
+    if (bench_pcap.count > 0)
+    {
+        // The stamp is appended behind the captured frame, receivers take the IP length and ignore it
+        const bench_pcap_frame_t *captured = &bench_pcap.frames[seq % bench_pcap.count];
+        memcpy(frame, captured->data, captured->len);
+        len = captured->len + BENCH_STAMP_LEN;
+        len = len < BENCH_MIN_FRAME ? BENCH_MIN_FRAME : (len > BENCH_MAX_FRAME ? BENCH_MAX_FRAME : len);
+        memset(frame + captured->len, 0, len > captured->len ? len - captured->len : 0);
+        if ((frame[0] & 0x01) == 0)
+        {
+            memcpy(frame, dst, TUNNEL_ADDR_LEN);
+        }
+        memcpy(frame + TUNNEL_ADDR_LEN, src, TUNNEL_ADDR_LEN);
+    }
+    else
+    {
+        uint32_t pick = (uint32_t)(seq % bench_options.weight_total);
+        uint32_t s = 0;
+        while (pick >= bench_options.weights[s])
+        {
+            pick -= bench_options.weights[s++];
+        }
+        len = bench_options.sizes[s];
+        memset(frame, 0, len);
+        memcpy(frame, dst, TUNNEL_ADDR_LEN);
+        memcpy(frame + TUNNEL_ADDR_LEN, src, TUNNEL_ADDR_LEN);
+        uint8_t *ip = frame + TUNNEL_ETH_HEADER_LEN;
+        frame[12] = BRIDGE_ETH_TYPE_IPV4 >> 8;
+        frame[13] = BRIDGE_ETH_TYPE_IPV4 & 0xFF;
+        uint32_t ip_len = len - TUNNEL_ETH_HEADER_LEN;
+        ip[0] = 0x45;
+        ip[2] = (uint8_t)(ip_len >> 8);
+        ip[3] = (uint8_t)ip_len;
+        ip[8] = 64;
+        ip[9] = BRIDGE_IP_PROTO_UDP;
+        ip[12] = 10;
+        ip[15] = src[5];
+        ip[16] = 10;
+        ip[19] = dst[5];
+        uint8_t *udp = ip + 20;
+        udp[0] = 0x13;
+        udp[1] = 0x88; // 5000
+        udp[2] = 0x13;
+        udp[3] = 0x89; // 5001
+        udp[4] = (uint8_t)((ip_len - 20) >> 8);
+        udp[5] = (uint8_t)(ip_len - 20);
+        uint32_t checksum = 0;
+        for (uint32_t i = 0; i < 20; i += 2)
+        {
+            checksum += (uint32_t)(ip[i] << 8 | ip[i + 1]);
+        }
+        checksum = (checksum & 0xFFFF) + (checksum >> 16);
+        checksum = (checksum & 0xFFFF) + (checksum >> 16);
+        ip[10] = (uint8_t)(~checksum >> 8);
+        ip[11] = (uint8_t)~checksum;
+        uint32_t random = (uint32_t)seq * 2654435761u | 1;
+        for (uint32_t i = BENCH_HEADER_LEN; bench_options.random && i + 4 <= len - BENCH_STAMP_LEN; i += 4)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            memcpy(frame + i, &random, sizeof(random));
+        }
+    }
+    uint8_t *stamp = frame + len - BENCH_STAMP_LEN;
+    uint32_t magic = BENCH_STAMP_MAGIC;
+    int64_t now = bench_now_ns();
+    memcpy(stamp, &magic, sizeof(magic));
+    stamp[4] = (uint8_t)dir;
+    memcpy(stamp + 8, &now, sizeof(now));
+    return len;
+}
+
+/**
+ * @brief Take the stamp of a delivered frame
+ * @param[in] frame Ethernet frame
+ * @param[in] len Frame length
+ * @param[out] dir Direction the frame was sent in
+ * @param[out] sent_ns Time the frame was sent
+ * @retval true if the frame carries a stamp of a measured frame
+ */
+static bool bench_read_stamp(const uint8_t *frame, uint32_t len, telemetry_dir_t *dir, int64_t *sent_ns)
+{
+    if (len < BENCH_MIN_FRAME)
+    {
+        return false;
+    }
+    const uint8_t *stamp = frame + len - BENCH_STAMP_LEN;
+    uint32_t magic;
+    memcpy(&magic, stamp, sizeof(magic));
+    if (magic != BENCH_STAMP_MAGIC || stamp[4] >= TELEMETRY_DIR_MAX)
+    {
+        return false;
+    }
+    *dir = stamp[4];
+    memcpy(sent_ns, stamp + 8, sizeof(int64_t));
+    return true;
+}
+
+/**
+ * @brief Account a delivered frame
+ * @param[in] dir Direction the frame was delivered in
+ * @param[in] sent_ns Time the frame was sent
+ * @param[in] len Frame length
+ * @retval
+ */
+static void bench_record(telemetry_dir_t dir, int64_t sent_ns, uint32_t len)
+{
+    bench_dir_t *bench_dir = &bench_dirs[dir];
+    int64_t now = bench_now_ns();
+    if (sent_ns < bench_reset_ns)
+    {
+        // Sent before the measurement started
+        return;
+    }
+    uint64_t index = atomic_fetch_add(&bench_dir->latency_count, 1);
+    if (index < BENCH_LATENCY_MAX)
+    {
+        int64_t latency = now - sent_ns;
+        bench_dir->latency_ns[index] = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+    }
+    atomic_fetch_add(&bench_dir->delivered, 1);
+    atomic_fetch_add(&bench_dir->delivered_bytes, len);
+    atomic_store(&bench_dir->last_ns, now);
+    if (dir != TELEMETRY_DIR_WIFI_TO_ETH)
+    {
+        atomic_fetch_add(&bench_plain_airtime_us, bridge_airtime_us(len));
+    }
+}
+
+/**
+ * @brief Ethernet driver transmit hook, the wired side of the bridge
+ * @param[in] buffer Frame
+ * @param[in] len Frame length
+ * @retval ESP_OK
+ */
+static esp_err_t bench_eth_transmit(void *buffer, size_t len)
+{
+    telemetry_dir_t dir;
+    int64_t sent_ns;
+    if (bench_read_stamp(buffer, len, &dir, &sent_ns) && dir == TELEMETRY_DIR_WIFI_TO_ETH)
+    {
+        bench_record(dir, sent_ns, len);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Wifi driver transmit hook. The frame goes over the air to the addressed emulated peer, which decodes it
+ *        with its end of the tunnel
+ * @param[in] ifx Wifi interface
+ * @param[in] buffer Frame, copied like the wifi driver does
+ * @param[in] len Frame length
+ * @retval ESP_OK
+ */
+static esp_err_t bench_wifi_transmit(wifi_interface_t ifx, void *buffer, uint16_t len)
+{
+    (void)ifx;
+    if (len > BENCH_WIFI_MAX_FRAME)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    atomic_fetch_add(&bench_wire_frames, 1);
+    atomic_fetch_add(&bench_wire_bytes, len);
+    atomic_fetch_add(&bench_airtime_us, bridge_airtime_us(len));
+    for (uint32_t i = 0; i < bench_remote_count; i++)
+    {
+        bench_remote_t *remote = &bench_remotes[i];
+        if (memcmp(buffer, remote->addr, TUNNEL_ADDR_LEN) == 0)
+        {
+            memcpy(bench_air_frame, buffer, len);
+            tunnel_receive(&remote->tunnel, bench_air_frame, len, bench_remote_deliver, remote);
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief ESP-NOW transmit hook: rebuild the outer addresses the transport strips and put the frame on the air
+ * @param[in] peer_addr ESP-NOW peer, the outer destination
+ * @param[in] data Tunnel frame after the outer addresses
+ * @param[in] len Data length
+ * @retval Result of bench_wifi_transmit
+ */
+static esp_err_t bench_espnow_transmit(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    uint8_t frame[ESPNOW_MTU];
+    if (len > ESP_NOW_MAX_DATA_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    bool emulated = false;
+    for (uint32_t i = 0; i < bench_remote_count; i++)
+    {
+        emulated |= memcmp(peer_addr, bench_remotes[i].addr, TUNNEL_ADDR_LEN) == 0;
+    }
+    if (!emulated)
+    {
+        // A listed peer this run does not emulate, nobody acknowledges
+        return ESP_FAIL;
+    }
+    memcpy(frame, peer_addr, TUNNEL_ADDR_LEN);
+    memcpy(frame + TUNNEL_ADDR_LEN, bench_local_addr, TUNNEL_ADDR_LEN);
+    memcpy(frame + ESPNOW_ADDR_HEADER_LEN, data, len);
+    return bench_wifi_transmit(bench_ifx, frame, (uint16_t)(ESPNOW_ADDR_HEADER_LEN + len));
+}
+
+/**
+ * @brief Account a frame an emulated wifi peer decoded
+ * @param[in] ctx Emulated wifi peer
+ * @param[in] frame Ethernet frame
+ * @param[in] len Frame length
+ * @retval
+ */
+static void bench_remote_deliver(void *ctx, uint8_t *frame, uint32_t len)
+{
+    (void)ctx;
+    telemetry_dir_t dir;
+    int64_t sent_ns;
+    if (!bench_read_stamp(frame, len, &dir, &sent_ns))
+    {
+        return;
+    }
+    if (dir == TELEMETRY_DIR_ETH_TO_WIFI)
+    {
+        bench_record(dir, sent_ns, len);
+    }
+    else if (dir == TELEMETRY_DIR_WIFI_TO_ETH)
+    {
+        bench_record(TELEMETRY_DIR_WIFI_TO_WIFI, sent_ns, len);
+    }
+}
+
+/**
+ * @brief Send a frame from an emulated wifi peer to the bridge. Must only be called from the wifi driver thread,
+ *        which owns the encoder side of the emulated tunnels
+ * @param[in] remote Emulated wifi peer
+ * @param[in] frame Ethernet frame, with TUNNEL_MAX_OVERHEAD bytes of room behind it
+ * @param[in] len Frame length
+ * @retval
+ */
+static void bench_wifi_send(bench_remote_t *remote, const uint8_t *frame, uint32_t len)
+{
+    uint8_t air_frame[POOL_BUF_SIZE];
+    memcpy(air_frame, frame, len);
+    uint32_t wire_len = tunnel_encapsulate(&remote->tunnel, air_frame, len, bench_local_addr, remote->addr);
+    tunnel_send(&remote->tunnel, air_frame, wire_len, bench_wifi_inject, NULL);
+}
+
+/**
+ * @brief Hand a frame or fragment of an emulated wifi peer to the bridge, see tunnel_send
+ * @param[in] ctx
+ * @param[in] frame Wifi frame
+ * @param[in] len Frame length
+ * @retval true if the frame was taken, false if it is longer than the wifi driver carries
+ */
+static bool bench_wifi_inject(void *ctx, uint8_t *frame, uint32_t len)
+{
+    (void)ctx;
+    return bench_wifi_receive(frame, len) == ESP_OK;
+}
+
+/**
+ * @brief Pass a frame of an emulated wifi peer to the driver receive path of the transport in use
+ * @param[in] frame Wifi frame, starting with the outer destination and source addresses
+ * @param[in] len Frame length
+ * @retval ESP_OK if the frame was received, ESP_ERR_INVALID_SIZE if it is longer than the transport carries
+ */
+static esp_err_t bench_wifi_receive(const uint8_t *frame, uint32_t len)
+{
+    if (bench_options.espnow)
+    {
+        // The outer addresses travel in the ESP-NOW header
+        if (len <= ESPNOW_ADDR_HEADER_LEN || len > ESPNOW_MTU)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        return shim_espnow_receive(frame + TUNNEL_ADDR_LEN, frame, frame + ESPNOW_ADDR_HEADER_LEN, len - ESPNOW_ADDR_HEADER_LEN);
+    }
+    if (len > BENCH_WIFI_MAX_FRAME)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return shim_wifi_receive(bench_ifx, frame, (uint16_t)len);
+}
+
+/**
+ * @brief Ethernet side generator, plays the EMAC receive task
+ * @param[in] arg
+ * @retval NULL
+ */
+static void *bench_eth_thread(void *arg)
+{
+    (void)arg;
+    bench_dir_t *dir = &bench_dirs[TELEMETRY_DIR_ETH_TO_WIFI];
+    int64_t start = bench_now_ns();
+    atomic_store(&dir->first_ns, start);
+    for (uint64_t seq = 0; seq < bench_options.frames; seq++)
+    {
+        bench_pace(seq, start);
+        bench_remote_t *remote = &bench_remotes[seq % bench_remote_count];
+        // Like the EMAC driver, every frame gets a buffer of its exact length that the bridge frees
+        uint8_t frame[POOL_BUF_SIZE];
+        uint32_t len = bench_build_frame(frame, seq, TELEMETRY_DIR_ETH_TO_WIFI, remote->host, bench_eth_host);
+        uint8_t *buffer = malloc(len);
+        memcpy(buffer, frame, len);
+        atomic_fetch_add(&dir->sent, 1);
+        shim_eth_receive(buffer, len);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Wifi side of the benchmark, plays the wifi driver: answers the tunnel negotiation of the bridge and
+ *        generates the frames of the wifi peers when asked to
+ * @param[in] arg
+ * @retval NULL
+ */
+static void *bench_wifi_thread(void *arg)
+{
+    (void)arg;
+    bench_dir_t *dir = &bench_dirs[TELEMETRY_DIR_WIFI_TO_ETH];
+    uint8_t frame[POOL_BUF_SIZE];
+    uint64_t seq = 0;
+    int64_t start = 0;
+    while (true)
+    {
+        for (uint32_t i = 0; i < bench_remote_count; i++)
+        {
+            bench_remote_t *remote = &bench_remotes[i];
+            uint32_t len;
+            while ((len = tunnel_build_control(&remote->tunnel, frame, bench_local_addr, remote->addr)) > 0)
+            {
+                bench_wifi_receive(frame, len);
+            }
+        }
+        if (!atomic_load(&bench_wifi_generate))
+        {
+            seq = 0;
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+        if (seq == 0)
+        {
+            start = bench_now_ns();
+            atomic_store(&dir->first_ns, start);
+        }
+        bench_pace(seq, start);
+        bench_remote_t *remote = &bench_remotes[seq % bench_remote_count];
+        uint32_t len = bench_build_frame(frame, seq, TELEMETRY_DIR_WIFI_TO_ETH, bench_eth_host, remote->host);
+        atomic_fetch_add(&dir->sent, 1);
+        bench_wifi_send(remote, frame, len);
+        if (++seq == bench_options.frames)
+        {
+            atomic_store(&bench_wifi_generate, false);
+        }
+    }
+    return NULL;
+}
+
+static int bench_percentile_compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,78 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdbool.h>
+#include "bridge_bench.h"
+#include "wenet_codel.h"
+/* Private macro -------------------------------------------------------------*/
+/* Private typedef -----------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Check the CoDel controller against the behaviour RFC 8289 specifies, on synthetic sojourn times
+ * @param None
+ * @retval Process exit code
+ */
+int bench_mode_codel(void)
+{
+    const uint32_t target = 5000;
+    const uint32_t interval = 100000;
+    const uint32_t starts[] = {1000000, UINT32_MAX - 150000}; // The second run wraps the time base
+    int failures = 0;
+    for (uint32_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++)
+    {
+        codel_t codel;
+        uint32_t start = starts[s];
+        // A queue that stays below target is never dropped
+        codel_init(&codel, target, interval);
+        uint32_t drops = 0;
+        for (uint32_t t = 0; t < 10000000; t += 1000)
+        {
+            drops += codel_should_drop(&codel, start + t - target + 1, start + t, 10);
+        }
+        printf("codel start=%u below_target drops=%u\n", (unsigned)start, (unsigned)drops);
+        failures += drops != 0;
+        // The last frame of a queue is never dropped
+        codel_init(&codel, target, interval);
+        drops = 0;
+        for (uint32_t t = 0; t < 1000000; t += 1000)
+        {
+            drops += codel_should_drop(&codel, start + t - 4 * target, start + t, 0);
+        }
+        printf("codel start=%u empty_backlog drops=%u\n", (unsigned)start, (unsigned)drops);
+        failures += drops != 0;
+        // A standing queue is first dropped one interval after it went above target, then at interval / sqrt(count)
+        codel_init(&codel, target, interval);
+        uint32_t drop_times[5] = {0};
+        uint32_t count = 0;
+        for (uint32_t t = 0; t < 1000000 && count < 5; t += 100)
+        {
+            if (codel_should_drop(&codel, start + t - 4 * target, start + t, 10))
+            {
+                drop_times[count++] = t;
+            }
+        }
+        failures += count != 5;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t expected = i == 0 ? interval : (uint32_t)(interval / __builtin_sqrt(i));
+            uint32_t measured = i == 0 ? drop_times[0] : drop_times[i] - drop_times[i - 1];
+            bool ok = measured + 200 >= expected && measured <= expected + 200;
+            printf("codel start=%u drop=%u spacing_us=%u expected_us=%u%s\n", (unsigned)start, (unsigned)(i + 1), (unsigned)measured, (unsigned)expected, ok ? "" : " FAILED");
+            failures += !ok;
+        }
+        // Once the queue drains below target the controller stops dropping
+        uint32_t t = drop_times[count ? count - 1 : 0] + 100;
+        drops = 0;
+        for (uint32_t end = t + 1000000; t < end; t += 100)
+        {
+            drops += codel_should_drop(&codel, start + t - 1000, start + t, 10);
+        }
+        printf("codel start=%u after_drain drops=%u\n", (unsigned)start, (unsigned)drops);
+        failures += drops != 0;
+    }
+    printf("codel %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
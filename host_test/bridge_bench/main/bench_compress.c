@@ -0,0 +1,319 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bridge_bench.h"
+#include "wenet_bridge.h"
+#include "wenet_tunnel.h"
+#include "wenet_compress.h"
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_COMPRESS_TRACE 256  // Distinct frames of each synthetic payload, replayed in turn
+#define BENCH_COMPRESS_FUZZ 20000 // Malformed blocks given to the expander
+/* Private typedef -----------------------------------------------------------*/
+// Synthetic payloads of the compression benchmark
+typedef enum
+{
+    BENCH_PAYLOAD_MODBUS, // Modbus/TCP read holding registers responses
+    BENCH_PAYLOAD_JSON,   // JSON telemetry over UDP
+    BENCH_PAYLOAD_SYSLOG, // Syslog over UDP
+    BENCH_PAYLOAD_RANDOM, // Encrypted traffic, does not compress
+    BENCH_PAYLOAD_MAX,
+} bench_payload_t;
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void bench_compress_trace(bench_pcap_t *trace, bench_payload_t payload);
+static int bench_compress_replay(const char *name, const bench_pcap_t *trace, uint32_t frames, int32_t min_saving);
+static int bench_compress_fuzz(void);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Measure the tunnel compression: CPU time per frame to compress and to expand, and the bytes saved on
+ *        Modbus/TCP, JSON telemetry, syslog and encrypted payloads, and on a capture with --pcap. Checks that
+ *        every frame round trips, that the text payloads compress and that encrypted flows are bypassed
+ * @param[in] argc Option count
+ * @param[in] argv Options
+ * @retval Process exit code
+ */
+int bench_mode_compress(int argc, char **argv)
+{
+    if (bench_parse_options(argc, argv, &bench_options, "compress") != 0)
+    {
+        return 2;
+    }
+    static const char *const names[BENCH_PAYLOAD_MAX] = {"modbus", "json", "syslog", "random"};
+    // Least saving in percent expected of each payload, -1 for a payload that must be bypassed. A syslog line
+    // repeats too little within itself to pay off
+    static const int32_t min_saving[BENCH_PAYLOAD_MAX] = {25, 20, -1, -1};
+    int failures = 0;
+    for (uint32_t p = 0; p < BENCH_PAYLOAD_MAX; p++)
+    {
+        bench_pcap_t trace;
+        bench_compress_trace(&trace, (bench_payload_t)p);
+        failures += bench_compress_replay(names[p], &trace, bench_options.frames, min_saving[p]);
+        bench_pcap_free(&trace);
+    }
+    if (bench_pcap.count > 0)
+    {
+        failures += bench_compress_replay("pcap", &bench_pcap, bench_options.frames, 0);
+    }
+    failures += bench_compress_fuzz();
+    printf("compress %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
+
+/**
+ * @brief Build BENCH_COMPRESS_TRACE frames of one synthetic payload, from the ethernet host to the wifi side
+ * @param[out] trace Frames, freed with bench_pcap_free
+ * @param[in] payload Payload kind
+ * @retval
+ */
+static void bench_compress_trace(bench_pcap_t *trace, bench_payload_t payload)
+{
+    memset(trace, 0, sizeof(bench_pcap_t));
+    trace->frames = calloc(BENCH_COMPRESS_TRACE, sizeof(bench_pcap_frame_t));
+    if (trace->frames == NULL)
+    {
+        return;
+    }
+    static const uint8_t device[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x00, 0x03};
+    static const char *const syslog_text[] = {
+        "poll cycle complete: 12 devices, 0 errors",
+        "device 7 (inverter-east) responded after retry",
+        "register map reloaded from /etc/modbusd/map.conf",
+        "link to 10.0.1.2 is up, tunnel version 2",
+    };
+    uint32_t random = 0x2545F491;
+    for (uint32_t i = 0; i < BENCH_COMPRESS_TRACE; i++)
+    {
+        uint8_t *frame = calloc(1, BENCH_MAX_FRAME);
+        if (frame == NULL)
+        {
+            return;
+        }
+        memcpy(frame, bench_eth_host, TUNNEL_ADDR_LEN);
+        memcpy(frame + TUNNEL_ADDR_LEN, device, TUNNEL_ADDR_LEN);
+        bench_put16(frame + BRIDGE_ETH_TYPE_OFFSET, BRIDGE_ETH_TYPE_IPV4);
+        uint8_t *ip = frame + BRIDGE_ETH_TYPE_OFFSET + 2;
+        static const uint8_t addrs[8] = {10, 0, 0, 3, 10, 0, 1, 2};
+        ip[0] = 0x45;
+        bench_put16(ip + 4, (uint16_t)i);
+        ip[8] = 64;
+        memcpy(ip + 12, addrs, sizeof(addrs));
+        uint8_t *l4 = ip + 20;
+        uint8_t *data;
+        uint32_t data_len;
+        if (payload == BENCH_PAYLOAD_MODBUS)
+        {
+            ip[9] = BRIDGE_IP_PROTO_TCP;
+            bench_put16(l4, 502);
+            bench_put16(l4 + 2, 40100);
+            bench_put32(l4 + 4, 1 + i * 209);
+            bench_put32(l4 + 8, 1 + i * 12);
+            l4[12] = 5 << 4;
+            l4[13] = 0x18; // PSH, ACK
+            bench_put16(l4 + 14, 8192);
+            data = l4 + 20;
+            // MBAP header, then a full read of 125 holding registers: slowly moving measurements, status words
+            // that are mostly clear, set points, and reserved registers that read as zero
+            bench_put16(data, (uint16_t)i);
+            bench_put16(data + 4, 3 + 250);
+            data[6] = 1;
+            data[7] = 3;
+            data[8] = 250;
+            for (uint32_t r = 0; r < 125; r++)
+            {
+                uint16_t value = 0;
+                if (r < 32)
+                {
+                    value = (uint16_t)(r % 4 == 0 ? 2300 + (i + r) % 7 : 100 + r * 13 + (i * (r + 1)) % 5);
+                }
+                else if (r < 48)
+                {
+                    value = (uint16_t)((i + r) % 29 == 0 ? 0x0004 : 0);
+                }
+                else if (r < 80)
+                {
+                    value = (uint16_t)(r % 2 ? 500 : 1200);
+                }
+                bench_put16(data + 9 + r * 2, value);
+            }
+            data_len = 9 + 250;
+        }
+        else
+        {
+            ip[9] = BRIDGE_IP_PROTO_UDP;
+            data = l4 + 8;
+            if (payload == BENCH_PAYLOAD_JSON)
+            {
+                bench_put16(l4, 40200);
+                bench_put16(l4 + 2, 8086);
+                data_len = (uint32_t)snprintf((char *)data, BENCH_MAX_FRAME - 42,
+                                              "{\"device\":\"wenet-node-03\",\"ts\":%u,\"sensors\":["
+                                              "{\"id\":\"temp_inlet\",\"value\":%u.%u,\"unit\":\"C\"},"
+                                              "{\"id\":\"temp_outlet\",\"value\":%u.%u,\"unit\":\"C\"},"
+                                              "{\"id\":\"pressure\",\"value\":%u,\"unit\":\"hPa\"},"
+                                              "{\"id\":\"flow\",\"value\":%u.%u,\"unit\":\"l/min\"},"
+                                              "{\"id\":\"valve\",\"value\":%u,\"unit\":\"%%\"}],"
+                                              "\"status\":\"ok\",\"uptime\":%u}",
+                                              1760000000 + i, 21 + i % 3, i % 10, 34 + i % 2, (i * 7) % 10, 1013 - i % 5,
+                                              12 + i % 4, (i * 3) % 10, 40 + i % 20, 86400 + i * 10);
+            }
+            else if (payload == BENCH_PAYLOAD_SYSLOG)
+            {
+                bench_put16(l4, 40300);
+                bench_put16(l4 + 2, 514);
+                data_len = (uint32_t)snprintf((char *)data, BENCH_MAX_FRAME - 42,
+                                              "<134>1 2026-10-17T10:%02u:%02u.%03uZ gateway-03 modbusd 1187 - - %s",
+                                              (i / 60) % 60, i % 60, (i * 37) % 1000, syslog_text[i % 4]);
+            }
+            else
+            {
+                bench_put16(l4, 40400);
+                bench_put16(l4 + 2, 443);
+                data_len = 1200;
+                for (uint32_t b = 0; b < data_len; b++)
+                {
+                    random ^= random << 13;
+                    random ^= random >> 17;
+                    random ^= random << 5;
+                    data[b] = (uint8_t)random;
+                }
+            }
+            bench_put16(l4 + 4, (uint16_t)(8 + data_len));
+        }
+        uint32_t len = (uint32_t)(data - frame) + data_len;
+        bench_put16(ip + 2, (uint16_t)(len - BRIDGE_ETH_TYPE_OFFSET - 2));
+        trace->frames[trace->count].data = frame;
+        trace->frames[trace->count].len = len < BENCH_MIN_FRAME ? BENCH_MIN_FRAME : len;
+        trace->count++;
+    }
+}
+
+/**
+ * @brief Compress the frames of a trace in turn the way the wifi send task does, expand every compressed frame
+ *        and compare it with the original
+ * @param[in] name Trace name
+ * @param[in] trace Frames
+ * @param[in] frames Frames to compress, the trace is repeated
+ * @param[in] min_saving Least saving in percent of the frame bytes, -1 if the flow must be bypassed instead
+ * @retval 0 if the trace met the expectation, 1 otherwise
+ */
+static int bench_compress_replay(const char *name, const bench_pcap_t *trace, uint32_t frames, int32_t min_saving)
+{
+    static compress_t ctx;
+    static uint8_t work[BENCH_MAX_FRAME];
+    static uint8_t expanded[COMPRESS_BUF_LEN + TUNNEL_ETH_HEADER_LEN];
+    if (trace->count == 0)
+    {
+        return 1;
+    }
+    compress_init(&ctx);
+    compress_stats_t before;
+    compress_get_stats(&before);
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t mismatches = 0;
+    int64_t compress_ns = 0;
+    int64_t expand_ns = 0;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        const bench_pcap_frame_t *original = &trace->frames[i % trace->count];
+        uint32_t len = original->len > BENCH_MAX_FRAME ? BENCH_MAX_FRAME : original->len;
+        memcpy(work, original->data, len);
+        int64_t start = bench_now_ns();
+        uint32_t packed = compress_frame(&ctx, work, len);
+        int64_t middle = bench_now_ns();
+        compress_ns += middle - start;
+        bytes_in += len;
+        bytes_out += packed ? packed : len;
+        if (packed == 0)
+        {
+            continue;
+        }
+        int32_t restored = compress_expand_frame(work, packed, expanded);
+        expand_ns += bench_now_ns() - middle;
+        mismatches += restored != (int32_t)len || memcmp(expanded, original->data, len) != 0;
+    }
+    compress_stats_t after;
+    compress_get_stats(&after);
+    uint32_t compressed = after.compressed - before.compressed;
+    uint32_t bypassed = after.bypassed - before.bypassed;
+    double saving = bytes_in ? 100.0 * (double)(bytes_in - bytes_out) / (double)bytes_in : 0;
+    bool failed = mismatches > 0;
+    if (min_saving < 0)
+    {
+        failed |= compressed > 0 || bypassed < frames / 2;
+    }
+    else if (min_saving > 0)
+    {
+        failed |= saving < min_saving;
+    }
+    printf("compress %s frames=%u avg_len=%llu compressed=%u bypassed=%u bytes_in=%llu bytes_out=%llu saving=%.1f%% "
+           "compress_ns=%.0f expand_ns=%.0f mismatches=%llu%s\n",
+           name, (unsigned)frames, (unsigned long long)(bytes_in / frames), (unsigned)compressed, (unsigned)bypassed,
+           (unsigned long long)bytes_in, (unsigned long long)bytes_out, saving, (double)compress_ns / frames,
+           compressed ? (double)expand_ns / compressed : 0.0, (unsigned long long)mismatches, failed ? " FAILED" : "");
+    return failed ? 1 : 0;
+}
+
+/**
+ * @brief Give the expander random blocks and damaged compressed frames: it must refuse them or stay within
+ *        its buffer, never read or write past it
+ * @retval 0 if every block was handled, 1 otherwise
+ */
+static int bench_compress_fuzz(void)
+{
+    static compress_t ctx;
+    static uint8_t block[COMPRESS_BUF_LEN];
+    static uint8_t packed[COMPRESS_BUF_LEN];
+    // Leave no room behind the buffer, so an overrun shows up under a sanitizer
+    uint8_t *out = malloc(COMPRESS_BUF_LEN);
+    if (out == NULL)
+    {
+        return 1;
+    }
+    compress_init(&ctx);
+    uint32_t random = 0x9E3779B9;
+    uint32_t refused = 0;
+    uint32_t failures = 0;
+    for (uint32_t i = 0; i < BENCH_COMPRESS_FUZZ; i++)
+    {
+        uint32_t len = 1 + i % 600;
+        for (uint32_t b = 0; b < len; b++)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            // Every other block is text like, so it compresses and gets damaged rather than being pure noise
+            block[b] = (i & 1) ? (uint8_t)('a' + random % 4) : (uint8_t)random;
+        }
+        uint32_t packed_len = (i & 1) ? compress_block(&ctx, block, len, packed, sizeof(packed)) : 0;
+        if (packed_len > 0)
+        {
+            int32_t restored = compress_expand(packed, packed_len, out, COMPRESS_BUF_LEN);
+            failures += restored != (int32_t)len || memcmp(out, block, len) != 0;
+            // Flip a byte, or cut the block short
+            if (random & 1)
+            {
+                packed[random % packed_len] ^= (uint8_t)(1 + (random >> 8) % 255);
+            }
+            else
+            {
+                packed_len = 1 + (random >> 8) % packed_len;
+            }
+        }
+        else
+        {
+            memcpy(packed, block, len);
+            packed_len = len;
+        }
+        int32_t restored = compress_expand(packed, packed_len, out, COMPRESS_BUF_LEN);
+        refused += restored < 0;
+        failures += restored > COMPRESS_BUF_LEN;
+    }
+    free(out);
+    printf("compress fuzz blocks=%u refused=%u failures=%u%s\n", (unsigned)BENCH_COMPRESS_FUZZ, (unsigned)refused,
+           (unsigned)failures, failures ? " FAILED" : "");
+    return failures ? 1 : 0;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
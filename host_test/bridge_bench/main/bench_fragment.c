@@ -0,0 +1,278 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "bridge_bench.h"
+#include "wenet_tunnel.h"
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_FRAGMENT_MIN 60
+#define BENCH_FRAGMENT_MAX 1522    // VLAN tagged full size frame
+#define BENCH_FRAGMENT_SENT_MAX 15 // Fragments of one frame
+/* Private typedef -----------------------------------------------------------*/
+// Frames one tunnel end of the fragmentation check sent, and what the other end delivered
+typedef struct
+{
+    uint8_t frames[BENCH_FRAGMENT_SENT_MAX][TUNNEL_MTU];
+    uint32_t lens[BENCH_FRAGMENT_SENT_MAX];
+    uint32_t count;
+    const uint8_t *expected;
+    uint32_t expected_len;
+    uint32_t delivered;
+    uint32_t mismatches;
+} bench_fragment_link_t;
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void bench_fragment_negotiate(tunnel_peer_t *a, tunnel_peer_t *b, bench_fragment_link_t *link);
+static uint32_t bench_fragment_send(tunnel_peer_t *tx, bench_fragment_link_t *link, const uint8_t *frame, uint32_t len);
+static bool bench_fragment_sent(void *ctx, uint8_t *frame, uint32_t len);
+static uint32_t bench_fragment_deliver(tunnel_peer_t *rx, bench_fragment_link_t *link, uint32_t first, uint32_t end);
+static void bench_fragment_received(void *ctx, uint8_t *frame, uint32_t len);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Check the tunnel fragmentation between two tunnel ends: every frame length from a minimum frame to a
+ *        VLAN tagged full size frame, lost and reordered fragments, the reassembly timeout, and more frames in
+ *        progress than there are reassembly slots
+ * @param None
+ * @retval Process exit code
+ */
+int bench_mode_fragment(void)
+{
+    static bench_fragment_link_t link;
+    static tunnel_peer_t tx;
+    static tunnel_peer_t rx[TUNNEL_REASSEMBLY_SLOTS + 1];
+    static tunnel_reassembly_t reassembly;
+    static uint8_t frame[BENCH_FRAGMENT_MAX];
+    tunnel_reassembly_init(&reassembly);
+    tunnel_peer_init(&tx);
+    for (uint32_t i = 0; i <= TUNNEL_REASSEMBLY_SLOTS; i++)
+    {
+        tunnel_peer_init(&rx[i]);
+        tunnel_set_reassembly(&rx[i], &reassembly);
+    }
+    bench_fragment_negotiate(&tx, &rx[0], &link);
+    if (!atomic_load(&tx.peer_fragment) || tunnel_tx_version(&tx) != TUNNEL_VERSION_COMPACT)
+    {
+        printf("fragment negotiation FAILED\n");
+        return 1;
+    }
+    int failures = 0;
+    // Every length: frames that fit go whole, longer ones in fragments of at most TUNNEL_MTU bytes
+    uint32_t whole = 0;
+    uint32_t fragmented = 0;
+    uint32_t oversize = 0;
+    uint32_t random = 0x1234567;
+    for (uint32_t len = BENCH_FRAGMENT_MIN; len <= BENCH_FRAGMENT_MAX; len++)
+    {
+        for (uint32_t b = 0; b < len; b++)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            frame[b] = (uint8_t)random;
+        }
+        frame[0] &= 0xFE; // Unicast destination
+        uint32_t wire_len = bench_fragment_send(&tx, &link, frame, len);
+        whole += link.count == 1;
+        fragmented += link.count > 1;
+        for (uint32_t i = 0; i < link.count; i++)
+        {
+            oversize += link.lens[i] > TUNNEL_MTU;
+        }
+        if ((wire_len <= TUNNEL_MTU) != (link.count == 1) || bench_fragment_deliver(&rx[0], &link, 0, link.count) != 1)
+        {
+            printf("fragment len=%u wire_len=%u fragments=%u FAILED\n", (unsigned)len, (unsigned)wire_len, (unsigned)link.count);
+            failures++;
+        }
+    }
+    printf("fragment lengths=%u..%u whole=%u fragmented=%u oversize=%u mismatches=%u%s\n", BENCH_FRAGMENT_MIN,
+           BENCH_FRAGMENT_MAX, (unsigned)whole, (unsigned)fragmented, (unsigned)oversize, (unsigned)link.mismatches,
+           oversize || link.mismatches ? " FAILED" : "");
+    failures += oversize > 0 || link.mismatches > 0;
+    memset(frame + TUNNEL_ETH_HEADER_LEN, 0x5A, BENCH_FRAGMENT_MAX - TUNNEL_ETH_HEADER_LEN);
+    // A lost fragment loses its frame, the next frame goes through
+    uint32_t lost = 0;
+    for (uint32_t skip = 0; skip < 2; skip++)
+    {
+        bench_fragment_send(&tx, &link, frame, BENCH_FRAGMENT_MAX);
+        uint32_t delivered = skip == 0 ? bench_fragment_deliver(&rx[0], &link, 1, link.count) : bench_fragment_deliver(&rx[0], &link, 0, link.count - 1);
+        bench_fragment_send(&tx, &link, frame, BENCH_FRAGMENT_MAX);
+        lost += delivered == 0 && bench_fragment_deliver(&rx[0], &link, 0, link.count) == 1;
+    }
+    // Fragments out of order lose their frame too
+    bench_fragment_send(&tx, &link, frame, BENCH_FRAGMENT_MAX);
+    uint32_t reordered = bench_fragment_deliver(&rx[0], &link, 1, link.count) + bench_fragment_deliver(&rx[0], &link, 0, 1);
+    bench_fragment_send(&tx, &link, frame, BENCH_FRAGMENT_MAX);
+    reordered += bench_fragment_deliver(&rx[0], &link, 0, link.count) != 1;
+    printf("fragment loss recovered=%u/2 reordered_delivered=%u%s\n", (unsigned)lost, (unsigned)reordered,
+           lost == 2 && reordered == 0 ? "" : " FAILED");
+    failures += lost != 2 || reordered != 0;
+    // A fragment arriving after the timeout does not complete its frame
+    bench_fragment_send(&tx, &link, frame, BENCH_FRAGMENT_MAX);
+    bench_fragment_deliver(&rx[0], &link, 0, 1);
+    vTaskDelay(pdMS_TO_TICKS(TUNNEL_REASSEMBLY_TIMEOUT_MS + 10));
+    uint32_t late = bench_fragment_deliver(&rx[0], &link, 1, link.count);
+    printf("fragment timeout late_delivered=%u%s\n", (unsigned)late, late ? " FAILED" : "");
+    failures += late != 0;
+    // One frame in progress per slot, the frame of the peer beyond them is dropped until a slot times out
+    for (uint32_t i = 1; i <= TUNNEL_REASSEMBLY_SLOTS; i++)
+    {
+        bench_fragment_negotiate(&tx, &rx[i], &link);
+    }
+    static bench_fragment_link_t pending[TUNNEL_REASSEMBLY_SLOTS + 1];
+    for (uint32_t i = 0; i <= TUNNEL_REASSEMBLY_SLOTS; i++)
+    {
+        frame[TUNNEL_ETH_HEADER_LEN] = (uint8_t)i;
+        bench_fragment_send(&tx, &pending[i], frame, BENCH_FRAGMENT_MAX);
+        bench_fragment_deliver(&rx[i], &pending[i], 0, 1);
+    }
+    uint32_t completed = 0;
+    for (uint32_t i = 0; i <= TUNNEL_REASSEMBLY_SLOTS; i++)
+    {
+        completed += bench_fragment_deliver(&rx[i], &pending[i], 1, pending[i].count);
+    }
+    bool bounded = completed == TUNNEL_REASSEMBLY_SLOTS && pending[TUNNEL_REASSEMBLY_SLOTS].delivered == 0;
+    // A slot holding a stalled frame is taken over once the frame timed out
+    bench_fragment_send(&tx, &pending[0], frame, BENCH_FRAGMENT_MAX);
+    bench_fragment_deliver(&rx[0], &pending[0], 0, 1);
+    bench_fragment_send(&tx, &pending[1], frame, BENCH_FRAGMENT_MAX);
+    bench_fragment_deliver(&rx[1], &pending[1], 0, 1);
+    vTaskDelay(pdMS_TO_TICKS(TUNNEL_REASSEMBLY_TIMEOUT_MS + 10));
+    bench_fragment_send(&tx, &link, frame, BENCH_FRAGMENT_MAX);
+    bool reclaimed = bench_fragment_deliver(&rx[TUNNEL_REASSEMBLY_SLOTS], &link, 0, link.count) == 1;
+    tunnel_stats_t stats;
+    tunnel_get_stats(&rx[TUNNEL_REASSEMBLY_SLOTS], &stats);
+    printf("fragment slots=%u completed=%u reclaimed=%u dropped=%u%s\n", (unsigned)TUNNEL_REASSEMBLY_SLOTS,
+           (unsigned)completed, (unsigned)reclaimed, (unsigned)stats.rx_frag_dropped, bounded && reclaimed ? "" : " FAILED");
+    failures += !bounded || !reclaimed;
+    // A first fragment longer than a reassembly slot is rejected before it claims one
+    static uint8_t hostile[TUNNEL_REASSEMBLY_BUF_LEN + 64];
+    uint32_t hostile_len = sizeof(hostile);
+    memset(hostile, 0xA5, hostile_len);
+    memcpy(hostile, link.frames[0], TUNNEL_ETH_HEADER_LEN);
+    hostile[hostile_len - 3] = 0x77;
+    hostile[hostile_len - 2] = (0 << 4) | 2;
+    hostile[hostile_len - 1] = link.frames[0][link.lens[0] - 1];
+    tunnel_get_stats(&rx[0], &stats);
+    uint32_t invalid = stats.rx_invalid;
+    bool rejected = tunnel_is_fragment(hostile, hostile_len) && tunnel_receive(&rx[0], hostile, hostile_len, bench_fragment_received, &link) < 0;
+    tunnel_get_stats(&rx[0], &stats);
+    rejected = rejected && stats.rx_invalid == invalid + 1;
+    bench_fragment_send(&tx, &link, frame, BENCH_FRAGMENT_MAX);
+    bool recovered = bench_fragment_deliver(&rx[0], &link, 0, link.count) == 1;
+    printf("fragment oversized_first rejected=%u next_delivered=%u%s\n", (unsigned)rejected, (unsigned)recovered,
+           rejected && recovered ? "" : " FAILED");
+    failures += !rejected || !recovered;
+    printf("fragment %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
+
+/**
+ * @brief Exchange HELLOs between two tunnel ends until both have heard each other
+ * @param[in] a First tunnel end
+ * @param[in] b Second tunnel end
+ * @param[in] link Delivery context, control frames deliver nothing
+ * @retval
+ */
+static void bench_fragment_negotiate(tunnel_peer_t *a, tunnel_peer_t *b, bench_fragment_link_t *link)
+{
+    static const uint8_t addr_a[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x03, 0x01};
+    static const uint8_t addr_b[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x03, 0x02};
+    uint8_t control[TUNNEL_CONTROL_FRAME_LEN];
+    // A new end answers HELLOs right away, its own periodic HELLO is due at once as well
+    atomic_store(&a->hello_request, true);
+    for (uint32_t round = 0; round < 4; round++)
+    {
+        uint32_t len;
+        while ((len = tunnel_build_control(a, control, addr_b, addr_a)) > 0)
+        {
+            tunnel_receive(b, control, len, bench_fragment_received, link);
+        }
+        while ((len = tunnel_build_control(b, control, addr_a, addr_b)) > 0)
+        {
+            tunnel_receive(a, control, len, bench_fragment_received, link);
+        }
+    }
+}
+
+/**
+ * @brief Encapsulate a frame and collect what tunnel_send hands to the wifi driver
+ * @param[in] tx Sending tunnel end
+ * @param[out] link Sent frames or fragments, and the frame the other end has to deliver
+ * @param[in] frame Ethernet frame
+ * @param[in] len Ethernet frame length
+ * @retval Length of the encapsulated frame before it was fragmented
+ */
+static uint32_t bench_fragment_send(tunnel_peer_t *tx, bench_fragment_link_t *link, const uint8_t *frame, uint32_t len)
+{
+    static const uint8_t addr_a[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x03, 0x01};
+    static const uint8_t addr_b[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x03, 0x02};
+    uint8_t wire[BENCH_FRAGMENT_MAX + TUNNEL_MAX_OVERHEAD];
+    memcpy(wire, frame, len);
+    uint32_t wire_len = tunnel_encapsulate(tx, wire, len, addr_b, addr_a);
+    link->count = 0;
+    link->expected = frame;
+    link->expected_len = len;
+    link->delivered = 0;
+    tunnel_send(tx, wire, wire_len, bench_fragment_sent, link);
+    return wire_len;
+}
+
+/**
+ * @brief Keep a frame or fragment tunnel_send passed on, see tunnel_send
+ * @param[in] ctx Delivery context
+ * @param[in] frame Wifi frame
+ * @param[in] len Frame length
+ * @retval true if the frame was kept
+ */
+static bool bench_fragment_sent(void *ctx, uint8_t *frame, uint32_t len)
+{
+    bench_fragment_link_t *link = ctx;
+    if (link->count == BENCH_FRAGMENT_SENT_MAX || len > TUNNEL_MTU)
+    {
+        link->lens[link->count < BENCH_FRAGMENT_SENT_MAX ? link->count : 0] = len;
+        return false;
+    }
+    memcpy(link->frames[link->count], frame, len);
+    link->lens[link->count] = len;
+    link->count++;
+    return true;
+}
+
+/**
+ * @brief Pass a range of the collected frames or fragments to the receiving tunnel end
+ * @param[in] rx Receiving tunnel end
+ * @param[in,out] link Collected frames, their delivery is checked against the frame sent
+ * @param[in] first First fragment passed
+ * @param[in] end Fragment after the last one passed
+ * @retval Ethernet frames delivered
+ */
+static uint32_t bench_fragment_deliver(tunnel_peer_t *rx, bench_fragment_link_t *link, uint32_t first, uint32_t end)
+{
+    uint8_t air[TUNNEL_MTU];
+    uint32_t delivered = link->delivered;
+    for (uint32_t i = first; i < end && i < link->count; i++)
+    {
+        memcpy(air, link->frames[i], link->lens[i]);
+        tunnel_receive(rx, air, link->lens[i], bench_fragment_received, link);
+    }
+    return link->delivered - delivered;
+}
+
+/**
+ * @brief Compare a delivered ethernet frame with the frame sent
+ * @param[in] ctx Delivery context
+ * @param[in] frame Ethernet frame
+ * @param[in] len Ethernet frame length
+ * @retval
+ */
+static void bench_fragment_received(void *ctx, uint8_t *frame, uint32_t len)
+{
+    bench_fragment_link_t *link = ctx;
+    link->delivered++;
+    link->mismatches += len != link->expected_len || memcmp(frame, link->expected, len) != 0;
+}
+#endif /* CONFIG_WENET_TUNNEL_FRAGMENT */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,120 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "bench_pcap.h"
+/* Private macro -------------------------------------------------------------*/
+#define PCAP_MAGIC_US 0xA1B2C3D4
+#define PCAP_MAGIC_NS 0xA1B23C4D
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_HEADER_LEN 24
+#define PCAP_RECORD_HEADER_LEN 16
+#define PCAP_ETH_HEADER_LEN 14
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t bench_pcap_u32(const uint8_t *data, bool swapped);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Load the ethernet frames of a classic libpcap capture file. Timestamps are not kept, frames are replayed
+ *        at the benchmark rate
+ * @param[in] path Capture file
+ * @param[in] max_len Longest frame to keep, longer records are skipped
+ * @param[out] pcap Loaded frames, release with bench_pcap_free
+ * @retval 0 on success, -1 if the file cannot be read or is not an ethernet capture
+ */
+int bench_pcap_load(const char *path, uint32_t max_len, bench_pcap_t *pcap)
+{
+    memset(pcap, 0, sizeof(bench_pcap_t));
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+    uint8_t header[PCAP_HEADER_LEN];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header))
+    {
+        fprintf(stderr, "%s: truncated header\n", path);
+        fclose(file);
+        return -1;
+    }
+    uint32_t magic = bench_pcap_u32(header, false);
+    bool swapped = magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS;
+    magic = bench_pcap_u32(header, swapped);
+    if ((magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) || bench_pcap_u32(header + 20, swapped) != PCAP_LINKTYPE_ETHERNET)
+    {
+        fprintf(stderr, "%s: not a libpcap ethernet capture\n", path);
+        fclose(file);
+        return -1;
+    }
+    uint32_t capacity = 0;
+    uint8_t record[PCAP_RECORD_HEADER_LEN];
+    while (fread(record, 1, sizeof(record), file) == sizeof(record))
+    {
+        uint32_t len = bench_pcap_u32(record + 8, swapped);
+        uint8_t *data = malloc(len ? len : 1);
+        if (data == NULL || fread(data, 1, len, file) != len)
+        {
+            free(data);
+            break;
+        }
+        if (len < PCAP_ETH_HEADER_LEN || len > max_len)
+        {
+            free(data);
+            pcap->skipped++;
+            continue;
+        }
+        if (pcap->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            bench_pcap_frame_t *frames = realloc(pcap->frames, capacity * sizeof(bench_pcap_frame_t));
+            if (frames == NULL)
+            {
+                free(data);
+                break;
+            }
+            pcap->frames = frames;
+        }
+        pcap->frames[pcap->count].data = data;
+        pcap->frames[pcap->count].len = len;
+        pcap->count++;
+    }
+    fclose(file);
+    if (pcap->count == 0)
+    {
+        fprintf(stderr, "%s: no usable frame\n", path);
+        bench_pcap_free(pcap);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Release the frames of a loaded capture
+ * @param[in] pcap Loaded capture
+ * @retval
+ */
+void bench_pcap_free(bench_pcap_t *pcap)
+{
+    for (uint32_t i = 0; i < pcap->count; i++)
+    {
+        free(pcap->frames[i].data);
+    }
+    free(pcap->frames);
+    memset(pcap, 0, sizeof(bench_pcap_t));
+}
+
+/**
+ * @brief Read a 32 bit header field in the byte order of the capture
+ * @param[in] data Field
+ * @param[in] swapped The capture was written with the other byte order
+ * @retval Field value
+ */
+static uint32_t bench_pcap_u32(const uint8_t *data, bool swapped)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,25 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BENCH_PCAP_H
+#define __BENCH_PCAP_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+    uint8_t *data;
+    uint32_t len;
+} bench_pcap_frame_t;
+
+typedef struct
+{
+    bench_pcap_frame_t *frames;
+    uint32_t count;
+    uint32_t skipped; // Records that are not ethernet frames the bridge can carry
+} bench_pcap_t;
+/* Exported functions prototypes ---------------------------------------------*/
+int bench_pcap_load(const char *path, uint32_t max_len, bench_pcap_t *pcap);
+void bench_pcap_free(bench_pcap_t *pcap);
+#endif /* __BENCH_PCAP_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,160 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "bridge_bench.h"
+#include "wenet_pool.h"
+#include "wenet_ring.h"
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_RING_SIZE 64
+#define BENCH_RING_BURST 16
+/* Private typedef -----------------------------------------------------------*/
+// Producer and consumer of the ring comparison
+typedef struct
+{
+    raw_data_t **items;
+    uint64_t count;
+    ring_t ring;
+    raw_data_t *slots[BENCH_RING_SIZE];
+    pthread_mutex_t lock;
+    raw_data_t *queue[BENCH_RING_SIZE];
+    uint32_t queue_head;
+    uint32_t queue_count;
+    uint64_t errors;
+} bench_ring_t;
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void *bench_ring_producer(void *arg);
+static void *bench_ring_consumer(void *arg);
+static void *bench_queue_producer(void *arg);
+static void *bench_queue_consumer(void *arg);
+static int64_t bench_ring_pass(bench_ring_t *bench, void *(*producer)(void *), void *(*consumer)(void *));
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Compare the hand over cost of the lock free descriptor ring, drained in bursts, with a lock protected
+ *        queue that hands over one item per call the way xQueueSend / xQueueReceive do. Both consumers poll: how
+ *        fast a sleeping task is woken up depends on the scheduler and is not comparable to FreeRTOS on the host
+ * @param[in] argc Option count
+ * @param[in] argv Options
+ * @retval Process exit code
+ */
+int bench_mode_ring(int argc, char **argv)
+{
+    if (bench_parse_options(argc, argv, &bench_options, "ring") != 0)
+    {
+        return 2;
+    }
+    static bench_ring_t bench;
+    static raw_data_t descriptors[BENCH_RING_SIZE * 4];
+    bench.count = bench_options.frames;
+    bench.items = malloc(bench.count * sizeof(raw_data_t *));
+    if (bench.items == NULL)
+    {
+        return 2;
+    }
+    for (uint64_t i = 0; i < bench.count; i++)
+    {
+        bench.items[i] = &descriptors[i % (BENCH_RING_SIZE * 4)];
+    }
+    ring_init(&bench.ring, bench.slots, BENCH_RING_SIZE);
+    pthread_mutex_init(&bench.lock, NULL);
+    int64_t ring_ns = bench_ring_pass(&bench, bench_ring_producer, bench_ring_consumer);
+    int64_t queue_ns = bench_ring_pass(&bench, bench_queue_producer, bench_queue_consumer);
+    printf("ring frames=%llu ring_ns_per_frame=%.1f queue_ns_per_frame=%.1f speedup=%.2f errors=%llu\n",
+           (unsigned long long)bench.count, (double)ring_ns / bench.count, (double)queue_ns / bench.count,
+           (double)queue_ns / (ring_ns ? ring_ns : 1), (unsigned long long)bench.errors);
+    free(bench.items);
+    return bench.errors ? 1 : 0;
+}
+
+static void *bench_ring_producer(void *arg)
+{
+    bench_ring_t *bench = arg;
+    for (uint64_t i = 0; i < bench->count; i++)
+    {
+        while (ring_push(&bench->ring, bench->items[i]) == 0)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *bench_ring_consumer(void *arg)
+{
+    bench_ring_t *bench = arg;
+    raw_data_t *burst[BENCH_RING_BURST];
+    for (uint64_t received = 0; received < bench->count;)
+    {
+        uint32_t count = ring_pop_burst(&bench->ring, burst, BENCH_RING_BURST);
+        if (count == 0)
+        {
+            sched_yield();
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++, received++)
+        {
+            bench->errors += burst[i] != bench->items[received];
+        }
+    }
+    return NULL;
+}
+
+static void *bench_queue_producer(void *arg)
+{
+    bench_ring_t *bench = arg;
+    for (uint64_t i = 0; i < bench->count;)
+    {
+        pthread_mutex_lock(&bench->lock);
+        bool full = bench->queue_count == BENCH_RING_SIZE;
+        if (!full)
+        {
+            bench->queue[(bench->queue_head + bench->queue_count) % BENCH_RING_SIZE] = bench->items[i++];
+            bench->queue_count++;
+        }
+        pthread_mutex_unlock(&bench->lock);
+        if (full)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *bench_queue_consumer(void *arg)
+{
+    bench_ring_t *bench = arg;
+    for (uint64_t received = 0; received < bench->count;)
+    {
+        raw_data_t *item = NULL;
+        pthread_mutex_lock(&bench->lock);
+        if (bench->queue_count > 0)
+        {
+            item = bench->queue[bench->queue_head];
+            bench->queue_head = (bench->queue_head + 1) % BENCH_RING_SIZE;
+            bench->queue_count--;
+        }
+        pthread_mutex_unlock(&bench->lock);
+        if (item == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+        bench->errors += item != bench->items[received++];
+    }
+    return NULL;
+}
+
+static int64_t bench_ring_pass(bench_ring_t *bench, void *(*producer)(void *), void *(*consumer)(void *))
+{
+    pthread_t threads[2];
+    int64_t start = bench_now_ns();
+    pthread_create(&threads[1], NULL, consumer, bench);
+    pthread_create(&threads[0], NULL, producer, bench);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    return bench_now_ns() - start;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,336 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bridge_bench.h"
+#include "wenet_station.h"
+/* Private macro -------------------------------------------------------------*/
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+    const char *name;
+    uint32_t value_count;
+    const char *help;
+} bench_option_help_t;
+/* Private variables ---------------------------------------------------------*/
+const uint8_t bench_eth_host[TUNNEL_ADDR_LEN] = {0x02, 0x57, 0x00, 0x00, 0x00, 0x01};
+bench_options_t bench_options;
+bench_pcap_t bench_pcap;
+static const bench_option_help_t bench_option_help[] = {
+    {"--stations", 1, "wifi peers, 1 runs station mode, more run softAP mode (default 1)"},
+    {"--frames", 1, "frames per direction (default 100000, sweep: per hold time)"},
+    {"--rate", 1, "frames per second per direction, 0 keeps --window frames in flight (default 0)"},
+    {"--window", 1, "frames in flight when --rate is 0 (default 16)"},
+    {"--sizes", 1, "imix, or frame lengths with optional weights, e.g. 64,1500 or 64:7,590:4,1514:1"},
+    {"--pcap", 1, "replay the frames of a libpcap ethernet capture instead of --sizes"},
+    {"--direction", 1, "both, eth (ethernet to wifi) or wifi (wifi to ethernet) (default both, sweep: eth)"},
+    {"--hold", 1, "aggregation hold times in microseconds, sweep takes a list (default sdkconfig, sweep: 0,100,250,500,1000,2000)"},
+    {"--check", 0, "fail on heap allocations or realloc moves on the forwarding path, or on lost frames in closed loop"},
+    {"--random", 0, "fill synthetic payloads with random bytes, like encrypted traffic they do not compress"},
+    {"--espnow", 0, "reach the wifi peers over the ESP-NOW transport, as encrypted peers listed in bench_config.h"},
+};
+/* Private function prototypes -----------------------------------------------*/
+static int bench_parse_sizes(const char *text, bench_options_t *options);
+static int bench_parse_list(const char *text, uint32_t *values, uint32_t max_count, uint32_t *count);
+static void bench_usage(void);
+/* Private user code ---------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (argc < 2)
+    {
+        bench_usage();
+        return 2;
+    }
+    if (strcmp(argv[1], "run") == 0)
+    {
+        return bench_mode_run(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "sweep") == 0)
+    {
+        return bench_mode_sweep(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "codel") == 0)
+    {
+        return bench_mode_codel();
+    }
+    if (strcmp(argv[1], "ackfilter") == 0)
+    {
+        return bench_mode_ackfilter(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "compress") == 0)
+    {
+        return bench_mode_compress(argc - 2, argv + 2);
+    }
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    if (strcmp(argv[1], "fragment") == 0)
+    {
+        return bench_mode_fragment();
+    }
+#endif
+#if CONFIG_WENET_TUNNEL_COMPACT
+    if (strcmp(argv[1], "airtime") == 0)
+    {
+        return bench_mode_airtime(argc - 2, argv + 2);
+    }
+#endif
+    if (strcmp(argv[1], "ring") == 0)
+    {
+        return bench_mode_ring(argc - 2, argv + 2);
+    }
+    bench_usage();
+    return 2;
+}
+
+/**
+ * @brief Parse the command line options of a mode
+ * @param[in] argc Option count
+ * @param[in] argv Options
+ * @param[out] options Parsed options
+ * @param[in] mode Mode name, selects the defaults
+ * @retval 0 on success
+ */
+int bench_parse_options(int argc, char **argv, bench_options_t *options, const char *mode)
+{
+    bool sweep = strcmp(mode, "sweep") == 0;
+    memset(options, 0, sizeof(bench_options_t));
+    options->stations = 1;
+    options->frames = sweep ? 5000 : 100000;
+    options->rate = sweep ? 20000 : 0;
+    options->window = 16;
+    options->eth_dir = true;
+    options->wifi_dir = !sweep;
+    bench_parse_sizes(sweep ? "128" : "imix", options);
+    if (sweep)
+    {
+        bench_parse_list("0,100,250,500,1000,2000", options->holds, BENCH_HOLD_MAX, &options->hold_count);
+    }
+    for (int i = 0; i < argc; i++)
+    {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool known = false;
+        for (uint32_t h = 0; h < sizeof(bench_option_help) / sizeof(bench_option_help[0]); h++)
+        {
+            known |= strcmp(argv[i], bench_option_help[h].name) == 0 && (bench_option_help[h].value_count == 0 || value != NULL);
+        }
+        if (!known)
+        {
+            fprintf(stderr, "Unknown option or missing value: %s\n", argv[i]);
+            bench_usage();
+            return -1;
+        }
+        int ret = 0;
+        if (strcmp(argv[i], "--check") == 0)
+        {
+            options->check = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--random") == 0)
+        {
+            options->random = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--espnow") == 0)
+        {
+            options->espnow = true;
+            continue;
+        }
+        i++;
+        if (strcmp(argv[i - 1], "--stations") == 0)
+        {
+            options->stations = (uint32_t)strtoul(value, NULL, 0);
+            ret = options->stations < 1 || options->stations > STATION_MAX;
+        }
+        else if (strcmp(argv[i - 1], "--frames") == 0)
+        {
+            options->frames = strtoull(value, NULL, 0);
+            ret = options->frames == 0;
+        }
+        else if (strcmp(argv[i - 1], "--rate") == 0)
+        {
+            options->rate = (uint32_t)strtoul(value, NULL, 0);
+        }
+        else if (strcmp(argv[i - 1], "--window") == 0)
+        {
+            options->window = (uint32_t)strtoul(value, NULL, 0);
+            ret = options->window == 0;
+        }
+        else if (strcmp(argv[i - 1], "--sizes") == 0)
+        {
+            ret = bench_parse_sizes(value, options);
+        }
+        else if (strcmp(argv[i - 1], "--pcap") == 0)
+        {
+            options->pcap_path = value;
+        }
+        else if (strcmp(argv[i - 1], "--direction") == 0)
+        {
+            options->eth_dir = strcmp(value, "wifi") != 0;
+            options->wifi_dir = strcmp(value, "eth") != 0;
+            ret = strcmp(value, "both") != 0 && strcmp(value, "eth") != 0 && strcmp(value, "wifi") != 0;
+        }
+        else if (strcmp(argv[i - 1], "--hold") == 0)
+        {
+            ret = bench_parse_list(value, options->holds, BENCH_HOLD_MAX, &options->hold_count);
+        }
+        if (ret != 0)
+        {
+            fprintf(stderr, "Bad value for %s: %s\n", argv[i - 1], value);
+            return -1;
+        }
+    }
+    if (options->stations > 1 && STATION_MAX < 2)
+    {
+        fprintf(stderr, "CONFIG_WENET_AP_MAX_STATIONS allows a single wifi peer\n");
+        return -1;
+    }
+#if !CONFIG_WENET_ESPNOW
+    if (options->espnow)
+    {
+        fprintf(stderr, "CONFIG_WENET_ESPNOW is disabled\n");
+        return -1;
+    }
+#endif
+    if (options->pcap_path != NULL && bench_pcap_load(options->pcap_path, BENCH_MAX_FRAME, &bench_pcap) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse a frame size mix
+ * @param[in] text "imix", or comma separated lengths with optional ":weight"
+ * @param[out] options Options receiving the mix
+ * @retval 0 on success
+ */
+static int bench_parse_sizes(const char *text, bench_options_t *options)
+{
+    if (strcmp(text, "imix") == 0)
+    {
+        // Simple IMIX, 7:4:1 of 40, 576 and 1500 byte IP packets
+        text = "60:7,590:4,1514:1";
+    }
+    options->size_count = 0;
+    options->weight_total = 0;
+    while (*text != '\0' && options->size_count < BENCH_SIZE_MAX)
+    {
+        char *end;
+        uint32_t size = (uint32_t)strtoul(text, &end, 10);
+        uint32_t weight = 1;
+        if (*end == ':')
+        {
+            weight = (uint32_t)strtoul(end + 1, &end, 10);
+        }
+        if (end == text || size > BENCH_MAX_FRAME || weight == 0 || (*end != ',' && *end != '\0'))
+        {
+            return -1;
+        }
+        options->sizes[options->size_count] = size < BENCH_MIN_FRAME ? BENCH_MIN_FRAME : size;
+        options->weights[options->size_count] = weight;
+        options->weight_total += weight;
+        options->size_count++;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return *text == '\0' && options->size_count > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Parse a comma separated list of numbers
+ * @param[in] text List
+ * @param[out] values Parsed numbers
+ * @param[in] max_count Capacity of values
+ * @param[out] count Number of parsed values
+ * @retval 0 on success
+ */
+static int bench_parse_list(const char *text, uint32_t *values, uint32_t max_count, uint32_t *count)
+{
+    *count = 0;
+    while (*text != '\0' && *count < max_count)
+    {
+        char *end;
+        values[(*count)++] = (uint32_t)strtoul(text, &end, 10);
+        if (end == text || (*end != ',' && *end != '\0'))
+        {
+            return -1;
+        }
+        text = *end == ',' ? end + 1 : end;
+    }
+    return *text == '\0' ? 0 : -1;
+}
+
+static void bench_usage(void)
+{
+    fprintf(stderr, "usage: bridge_bench run|sweep|codel|ackfilter|compress|fragment|airtime|ring [options]\n"
+                    "  run    forward frames through the bridge core and report pps, Mbit/s, latency, heap use and frame copies\n"
+                    "  sweep  repeat a paced run for each aggregation hold time\n"
+                    "  codel  check the CoDel controller on synthetic sojourn times\n"
+                    "  ackfilter  check the TCP ACK filter on synthetic traces, and on a capture with --pcap\n"
+                    "  compress  measure tunnel compression cost and saving on synthetic payloads, and on a capture with --pcap\n"
+                    "  fragment  check tunnel fragmentation and reassembly at and around the wifi frame length limit\n"
+                    "  airtime  compare the wifi airtime of the legacy and the compact tunnel encapsulation on --sizes\n"
+                    "  ring   compare the descriptor ring with a locked one item queue\n");
+    for (uint32_t h = 0; h < sizeof(bench_option_help) / sizeof(bench_option_help[0]); h++)
+    {
+        fprintf(stderr, "  %-12s %s\n", bench_option_help[h].name, bench_option_help[h].help);
+    }
+}
+
+/**
+ * @brief Get the benchmark time base
+ * @param None
+ * @retval Monotonic time in nanoseconds
+ */
+int64_t bench_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Write a 16 bit value in network byte order
+ * @param[out] p Destination
+ * @param[in] value Value
+ * @retval
+ */
+void bench_put16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+/**
+ * @brief Write a 32 bit value in network byte order
+ * @param[out] p Destination
+ * @param[in] value Value
+ * @retval
+ */
+void bench_put32(uint8_t *p, uint32_t value)
+{
+    bench_put16(p, (uint16_t)(value >> 16));
+    bench_put16(p + 2, (uint16_t)value);
+}
+
+/**
+ * @brief Read a 16 bit value in network byte order
+ * @param[in] p Source
+ * @retval Value
+ */
+uint16_t bench_get16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief Read a 32 bit value in network byte order
+ * @param[in] p Source
+ * @retval Value
+ */
+uint32_t bench_get32(const uint8_t *p)
+{
+    return ((uint32_t)bench_get16(p) << 16) | bench_get16(p + 2);
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,63 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BRIDGE_BENCH_H
+#define __BRIDGE_BENCH_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "wenet_tunnel.h"
+#include "bench_pcap.h"
+/* Exported macro ------------------------------------------------------------*/
+#define BENCH_MIN_FRAME 60
+#define BENCH_MAX_FRAME 1514
+#define BENCH_SIZE_MAX 8
+#define BENCH_HOLD_MAX 16
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+    uint32_t stations;
+    uint64_t frames;
+    uint32_t rate;   // Frames per second per direction, 0 to send as fast as the window allows
+    uint32_t window; // Frames in flight through the bridge when rate is 0
+    uint32_t sizes[BENCH_SIZE_MAX];
+    uint32_t weights[BENCH_SIZE_MAX];
+    uint32_t size_count;
+    uint32_t weight_total;
+    uint32_t holds[BENCH_HOLD_MAX];
+    uint32_t hold_count;
+    const char *pcap_path;
+    bool eth_dir;
+    bool wifi_dir;
+    bool check;
+    bool random; // Synthetic payloads do not compress
+    bool espnow; // The wifi peers are reached over the ESP-NOW transport
+} bench_options_t;
+
+/* Exported constants --------------------------------------------------------*/
+extern const uint8_t bench_eth_host[TUNNEL_ADDR_LEN];
+extern bench_options_t bench_options;
+extern bench_pcap_t bench_pcap;
+/* Exported functions prototypes ---------------------------------------------*/
+int bench_parse_options(int argc, char **argv, bench_options_t *options, const char *mode);
+int64_t bench_now_ns(void);
+void bench_put16(uint8_t *p, uint16_t value);
+void bench_put32(uint8_t *p, uint32_t value);
+uint16_t bench_get16(const uint8_t *p);
+uint32_t bench_get32(const uint8_t *p);
+// Modes, one per module under test
+int bench_mode_run(int argc, char **argv);
+int bench_mode_sweep(int argc, char **argv);
+int bench_mode_codel(void);
+int bench_mode_ring(int argc, char **argv);
+int bench_mode_ackfilter(int argc, char **argv);
+int bench_mode_compress(int argc, char **argv);
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+int bench_mode_fragment(void);
+#endif
+#if CONFIG_WENET_TUNNEL_COMPACT
+int bench_mode_airtime(int argc, char **argv);
+#endif
+#endif /* __BRIDGE_BENCH_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,19 @@
+// Host shim: configuration the benchmark overrides on top of the project sdkconfig, included by sdkconfig.h
+#pragma once
+#include <stdint.h>
+
+// The periodic telemetry dump would interleave with the benchmark report
+#undef CONFIG_WENET_TELEMETRY_LOG_PERIOD_S
+#define CONFIG_WENET_TELEMETRY_LOG_PERIOD_S 0
+
+// The aggregation hold time is a run time variable so one run can sweep it
+extern uint32_t bench_aggregate_hold_us;
+#define CONFIG_WENET_AGGREGATE_HOLD_US bench_aggregate_hold_us
+
+// The ESP-NOW runs link with the emulated remotes as listed, encrypted peers, not by learning them
+#undef CONFIG_WENET_ESPNOW_PEERS
+#define CONFIG_WENET_ESPNOW_PEERS "02:57:00:00:02:01,02:57:00:00:02:02,02:57:00:00:02:03,02:57:00:00:02:04"
+#undef CONFIG_WENET_ESPNOW_PMK
+#define CONFIG_WENET_ESPNOW_PMK "bridge_bench_pmk"
+#undef CONFIG_WENET_ESPNOW_LMK
+#define CONFIG_WENET_ESPNOW_LMK "bridge_bench_lmk"
@@ -0,0 +1,8 @@
+// Host shim: GPIOs are accepted and ignored
+#pragma once
+#include "esp_err.h"
+#include <stdint.h>
+typedef struct { uint64_t pin_bit_mask; int mode; int pull_up_en; int pull_down_en; int intr_type; } gpio_config_t;
+#define GPIO_INTR_DISABLE 0
+#define GPIO_MODE_OUTPUT 2
+esp_err_t gpio_config(const gpio_config_t*); esp_err_t gpio_set_level(int, uint32_t);
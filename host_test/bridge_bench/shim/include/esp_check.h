@@ -0,0 +1,7 @@
+// Host shim: error check helpers
+#pragma once
+#include "esp_log.h"
+#define ESP_RETURN_ON_FALSE(a, e, t, f, ...) do{ if(!(a)) return e; }while(0)
+#define ESP_RETURN_ON_ERROR(x, t, f, ...) do{ esp_err_t e_=(x); if(e_!=ESP_OK) return e_; }while(0)
+#define ESP_GOTO_ON_ERROR(x, g, t, f, ...) do{ ret=(x); if(ret!=ESP_OK) goto g; }while(0)
+#define ESP_GOTO_ON_FALSE(a, e, g, t, f, ...) do{ if(!(a)){ ret=e; goto g;} }while(0)
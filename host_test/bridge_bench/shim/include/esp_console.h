@@ -0,0 +1,14 @@
+// Host shim: console commands are accepted and never run
+#pragma once
+#include "esp_err.h"
+typedef int (*esp_console_cmd_func_t)(int argc, char **argv);
+typedef struct { const char *command; const char *help; const char *hint; esp_console_cmd_func_t func; void *argtable; } esp_console_cmd_t;
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd);
+typedef struct esp_console_repl_s esp_console_repl_t;
+typedef struct { int max_history_len; const char *history_save_path; int task_stack_size; int task_priority; const char *prompt; int max_cmdline_length; } esp_console_repl_config_t;
+#define ESP_CONSOLE_REPL_CONFIG_DEFAULT() {0}
+typedef struct { int channel; int baud_rate; int tx_gpio_num; int rx_gpio_num; } esp_console_dev_uart_config_t;
+#define ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT() {0}
+esp_err_t esp_console_new_repl_uart(const esp_console_dev_uart_config_t *dev_config, const esp_console_repl_config_t *repl_config, esp_console_repl_t **ret_repl);
+esp_err_t esp_console_start_repl(esp_console_repl_t *repl);
+esp_err_t esp_console_register_help_command(void);
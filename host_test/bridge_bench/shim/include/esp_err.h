@@ -0,0 +1,27 @@
+// Host shim: error codes used by the bridge core, ESP_ERROR_CHECK aborts like on the target
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_WIFI_BASE 0x3000
+#define ESP_ERROR_CHECK(x)                                                                   \
+    do                                                                                       \
+    {                                                                                        \
+        esp_err_t shim_rc = (x);                                                             \
+        if (shim_rc != ESP_OK)                                                               \
+        {                                                                                    \
+            fprintf(stderr, "%s:%d: %s failed: 0x%x\n", __FILE__, __LINE__, #x, shim_rc);    \
+            abort();                                                                         \
+        }                                                                                    \
+    } while (0)
+const char *esp_err_to_name(esp_err_t code);
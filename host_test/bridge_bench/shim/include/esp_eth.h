@@ -0,0 +1,34 @@
+// Host shim: enough of the esp_eth driver API for the bridge core, see shim_esp.c
+#pragma once
+#include "esp_err.h"
+#include "esp_event.h"
+#include <stdint.h>
+#include <stdbool.h>
+typedef void *esp_eth_handle_t;
+typedef struct esp_eth_mac_s { esp_err_t (*del)(struct esp_eth_mac_s*); } esp_eth_mac_t;
+typedef struct esp_eth_phy_s { esp_err_t (*del)(struct esp_eth_phy_s*); } esp_eth_phy_t;
+typedef struct { int sw_reset_timeout_ms; int rx_task_stack_size; int rx_task_prio; int flags; } eth_mac_config_t;
+typedef struct { int phy_addr; int reset_gpio_num; unsigned autonego_timeout_ms; } eth_phy_config_t;
+typedef struct { int smi_mdc_gpio_num; int smi_mdio_gpio_num; struct { struct { int clock_mode; int clock_gpio; } rmii; } clock_config; } eth_esp32_emac_config_t;
+typedef struct { esp_eth_mac_t *mac; esp_eth_phy_t *phy; } esp_eth_config_t;
+#define ETH_MAC_DEFAULT_CONFIG() {0}
+#define ETH_MAC_FLAG_PIN_TO_CORE (1 << 1)
+#define ETH_PHY_DEFAULT_CONFIG() {0}
+#define ETH_ESP32_EMAC_DEFAULT_CONFIG() {0}
+#define ETH_DEFAULT_CONFIG(m,p) {m,p}
+#define ETH_MAX_PACKET_SIZE 1522
+#define EMAC_CLK_EXT_IN 0
+#define EMAC_CLK_IN_GPIO 0
+extern esp_event_base_t ETH_EVENT;
+typedef enum { ETHERNET_EVENT_START, ETHERNET_EVENT_STOP, ETHERNET_EVENT_CONNECTED, ETHERNET_EVENT_DISCONNECTED } eth_event_t;
+typedef enum { ETH_CMD_G_MAC_ADDR, ETH_CMD_S_MAC_ADDR, ETH_CMD_S_PROMISCUOUS, ETH_CMD_S_FLOW_CTRL, ETH_CMD_G_DUPLEX_MODE, ETH_CMD_S_PHY_LOOPBACK } esp_eth_io_cmd_t;
+esp_eth_mac_t *esp_eth_mac_new_esp32(const eth_esp32_emac_config_t*, const eth_mac_config_t*);
+esp_eth_mac_t *esp_eth_mac_new_openeth(const eth_mac_config_t*);
+esp_eth_phy_t *esp_eth_phy_new_lan87xx(const eth_phy_config_t*);
+esp_eth_phy_t *esp_eth_phy_new_dp83848(const eth_phy_config_t*);
+esp_err_t esp_eth_driver_install(const esp_eth_config_t*, esp_eth_handle_t*);
+esp_err_t esp_eth_driver_uninstall(esp_eth_handle_t);
+esp_err_t esp_eth_update_input_path(esp_eth_handle_t, esp_err_t (*)(esp_eth_handle_t, uint8_t*, uint32_t, void*), void*);
+esp_err_t esp_eth_ioctl(esp_eth_handle_t, esp_eth_io_cmd_t, void*);
+esp_err_t esp_eth_start(esp_eth_handle_t); esp_err_t esp_eth_stop(esp_eth_handle_t);
+esp_err_t esp_eth_transmit(esp_eth_handle_t, void*, size_t);
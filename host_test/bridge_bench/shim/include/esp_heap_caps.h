@@ -0,0 +1,10 @@
+// Host shim: heap_caps allocations come from the counted heap, see shim_alloc.c
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#define MALLOC_CAP_INTERNAL 1
+#define MALLOC_CAP_8BIT 2
+#define MALLOC_CAP_DMA 4
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void *heap_caps_calloc(size_t count, size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
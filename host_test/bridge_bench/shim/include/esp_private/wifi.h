@@ -0,0 +1,9 @@
+// Host shim: raw frame interface of the wifi driver, see shim_esp.c
+#pragma once
+#include "esp_wifi.h"
+typedef esp_err_t (*wifi_rxcb_t)(void *buffer, uint16_t len, void *eb);
+esp_err_t esp_wifi_internal_reg_rxcb(wifi_interface_t ifx, wifi_rxcb_t fn);
+int esp_wifi_internal_tx(wifi_interface_t wifi_if, void *buffer, uint16_t len);
+void esp_wifi_internal_free_rx_buffer(void *buffer);
+typedef void (*wifi_tx_done_cb_t)(uint8_t ifidx, uint8_t *data, uint16_t *data_len, bool txStatus);
+esp_err_t esp_wifi_set_tx_done_cb(wifi_tx_done_cb_t cb);
@@ -0,0 +1,7 @@
+// Host shim: there is no flash, mounting SPIFFS always fails
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+typedef struct { const char *base_path; const char *partition_label; size_t max_files; bool format_if_mount_failed; } esp_vfs_spiffs_conf_t;
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf);
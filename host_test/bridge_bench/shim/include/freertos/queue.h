@@ -0,0 +1,4 @@
+// Host shim: queues are not used by the bridge core, only the header is included
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef void *QueueHandle_t;
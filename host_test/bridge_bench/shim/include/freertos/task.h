@@ -0,0 +1,17 @@
+// Host shim: every task is a pthread, task notifications are a counter behind a condition variable
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef struct shim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+void xTaskNotifyGive(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+// No run time statistics on the host: the system state is always empty
+typedef struct { TaskHandle_t xHandle; const char *pcTaskName; UBaseType_t uxCurrentPriority; uint32_t ulRunTimeCounter; uint32_t usStackHighWaterMark; } TaskStatus_t;
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *task_status_array, UBaseType_t array_size, uint32_t *total_run_time);
+BaseType_t xTaskGetAffinity(TaskHandle_t task);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpuid);
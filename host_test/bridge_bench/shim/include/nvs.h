@@ -0,0 +1,17 @@
+// Host shim: in-memory NVS, see shim_esp.c
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+typedef uint32_t nvs_handle_t;
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_commit(nvs_handle_t handle);
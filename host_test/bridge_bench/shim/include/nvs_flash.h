@@ -0,0 +1,6 @@
+// Host shim: in-memory NVS, see shim_esp.c
+#pragma once
+#include "esp_err.h"
+#define ESP_ERR_NVS_NO_FREE_PAGES 0x1100
+#define ESP_ERR_NVS_NEW_VERSION_FOUND 0x1101
+esp_err_t nvs_flash_init(void);
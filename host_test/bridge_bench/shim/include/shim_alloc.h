@@ -0,0 +1,34 @@
+// Host shim: forced into every bridge core source so its heap use and frame copies can be counted per forwarded frame
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Shorter copies move addresses and headers, not frames
+#define SHIM_COPY_MIN_LEN 60
+
+typedef struct
+{
+    uint64_t allocs;        // malloc, calloc, realloc and heap_caps_malloc calls
+    uint64_t frees;         // free calls on non NULL pointers
+    uint64_t bytes;         // Bytes requested
+    uint64_t realloc_moves; // realloc calls that moved the block instead of resizing it in place
+    uint64_t copies;        // memcpy calls of at least SHIM_COPY_MIN_LEN bytes plus realloc moves
+    uint64_t copy_bytes;    // Bytes moved by those copies
+} shim_alloc_stats_t;
+
+void *shim_malloc(size_t size);
+void *shim_calloc(size_t count, size_t size);
+void *shim_realloc(void *ptr, size_t size);
+void shim_free(void *ptr);
+void *shim_memcpy(void *dst, const void *src, size_t len);
+void shim_alloc_get_stats(shim_alloc_stats_t *stats);
+
+#ifndef SHIM_ALLOC_NO_REDIRECT
+#define malloc(size) shim_malloc(size)
+#define calloc(count, size) shim_calloc(count, size)
+#define realloc(ptr, size) shim_realloc(ptr, size)
+#define free(ptr) shim_free(ptr)
+#define memcpy(dst, src, len) shim_memcpy(dst, src, len)
+#endif
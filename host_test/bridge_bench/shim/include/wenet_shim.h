@@ -0,0 +1,28 @@
+// Host shim: hooks the benchmark uses to stand in for the ethernet and wifi drivers
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+
+// Called for every frame the bridge hands to esp_eth_transmit
+typedef esp_err_t (*shim_eth_transmit_t)(void *buffer, size_t len);
+// Called for every frame the bridge hands to esp_wifi_internal_tx, the buffer is only valid during the call
+typedef esp_err_t (*shim_wifi_transmit_t)(wifi_interface_t ifx, void *buffer, uint16_t len);
+// Called for every frame the bridge hands to esp_now_send, the data is only valid during the call. ESP_OK means
+// the peer acknowledged it, ESP_ERR_NO_MEM that the ESP-NOW buffers are full
+typedef esp_err_t (*shim_espnow_transmit_t)(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+void shim_eth_set_transmit(shim_eth_transmit_t hook);
+// Pass a received frame to the ethernet input path, the malloc'd buffer is handed over like an EMAC buffer
+esp_err_t shim_eth_receive(uint8_t *buffer, uint32_t len);
+void shim_wifi_set_transmit(shim_wifi_transmit_t hook);
+// Pass a received frame to the wifi receive callback of the interface, the frame is copied to a driver buffer
+esp_err_t shim_wifi_receive(wifi_interface_t ifx, const uint8_t *frame, uint16_t len);
+// Access point address reported by esp_wifi_sta_get_ap_info
+void shim_wifi_set_ap_bssid(const uint8_t *bssid);
+void shim_espnow_set_transmit(shim_espnow_transmit_t hook);
+// Pass a received ESP-NOW frame to the receive callback, like the wifi driver task does
+esp_err_t shim_espnow_receive(const uint8_t *src_addr, const uint8_t *dst_addr, const uint8_t *data, size_t len);
+// ESP-NOW peers added with encryption
+uint32_t shim_espnow_encrypted_peers(void);
@@ -0,0 +1,89 @@
+/* Includes ------------------------------------------------------------------*/
+#define SHIM_ALLOC_NO_REDIRECT
+#include <malloc.h>
+#include <stdatomic.h>
+#include "shim_alloc.h"
+#include "esp_heap_caps.h"
+/* Private variables ---------------------------------------------------------*/
+static atomic_uint_fast64_t shim_allocs;
+static atomic_uint_fast64_t shim_frees;
+static atomic_uint_fast64_t shim_bytes;
+static atomic_uint_fast64_t shim_realloc_moves;
+static atomic_uint_fast64_t shim_copies;
+static atomic_uint_fast64_t shim_copy_bytes;
+/* Private user code ---------------------------------------------------------*/
+void *shim_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&shim_allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shim_bytes, size, memory_order_relaxed);
+    return malloc(size);
+}
+
+void *shim_calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&shim_allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shim_bytes, count * size, memory_order_relaxed);
+    return calloc(count, size);
+}
+
+void *shim_realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&shim_allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shim_bytes, size, memory_order_relaxed);
+    size_t old_size = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = realloc(ptr, size);
+    // A block that could not grow in place was copied to the new one
+    if (ptr != NULL && new_ptr != NULL && new_ptr != ptr)
+    {
+        atomic_fetch_add_explicit(&shim_realloc_moves, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shim_copies, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shim_copy_bytes, old_size < size ? old_size : size, memory_order_relaxed);
+    }
+    return new_ptr;
+}
+
+void shim_free(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        atomic_fetch_add_explicit(&shim_frees, 1, memory_order_relaxed);
+    }
+    free(ptr);
+}
+
+void *shim_memcpy(void *dst, const void *src, size_t len)
+{
+    if (len >= SHIM_COPY_MIN_LEN)
+    {
+        atomic_fetch_add_explicit(&shim_copies, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shim_copy_bytes, len, memory_order_relaxed);
+    }
+    return memcpy(dst, src, len);
+}
+
+void shim_alloc_get_stats(shim_alloc_stats_t *stats)
+{
+    stats->allocs = atomic_load_explicit(&shim_allocs, memory_order_relaxed);
+    stats->frees = atomic_load_explicit(&shim_frees, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&shim_bytes, memory_order_relaxed);
+    stats->realloc_moves = atomic_load_explicit(&shim_realloc_moves, memory_order_relaxed);
+    stats->copies = atomic_load_explicit(&shim_copies, memory_order_relaxed);
+    stats->copy_bytes = atomic_load_explicit(&shim_copy_bytes, memory_order_relaxed);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return shim_malloc(size);
+}
+
+void *heap_caps_calloc(size_t count, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return shim_calloc(count, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    shim_free(ptr);
+}
@@ -0,0 +1,763 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_eth.h"
+#include "esp_wifi.h"
+#include "esp_private/wifi.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_console.h"
+#include "esp_spiffs.h"
+#include "driver/gpio.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "wenet_shim.h"
+/* Private macro -------------------------------------------------------------*/
+#define SHIM_EVENT_HANDLER_NUM 16
+#define SHIM_NVS_ENTRY_NUM 16
+#define SHIM_NVS_KEY_LEN 16
+#define SHIM_NVS_BLOB_LEN 512
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} shim_event_handler_t;
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    int64_t deadline;
+    bool active;
+    struct esp_timer *next;
+};
+
+typedef struct
+{
+    char name_space[SHIM_NVS_KEY_LEN];
+    char key[SHIM_NVS_KEY_LEN];
+    uint8_t blob[SHIM_NVS_BLOB_LEN];
+    size_t len;
+    bool valid;
+} shim_nvs_entry_t;
+
+typedef struct
+{
+    esp_err_t (*input)(esp_eth_handle_t handle, uint8_t *buffer, uint32_t len, void *priv);
+    void *priv;
+} shim_eth_t;
+/* Private variables ---------------------------------------------------------*/
+esp_event_base_t ETH_EVENT = "ETH_EVENT";
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+static shim_event_handler_t shim_event_handlers[SHIM_EVENT_HANDLER_NUM];
+static uint32_t shim_event_handler_count;
+static pthread_mutex_t shim_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shim_timer_cond;
+static struct esp_timer *shim_timers;
+static bool shim_timer_running;
+static shim_nvs_entry_t shim_nvs[SHIM_NVS_ENTRY_NUM];
+static const char *shim_nvs_handles[SHIM_NVS_ENTRY_NUM];
+static uint32_t shim_nvs_handle_count;
+static pthread_mutex_t shim_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static shim_eth_t shim_eth;
+static shim_eth_transmit_t shim_eth_transmit;
+static wifi_rxcb_t shim_wifi_rxcb[2];
+static shim_wifi_transmit_t shim_wifi_transmit;
+static wifi_tx_done_cb_t shim_wifi_tx_done;
+static uint8_t shim_wifi_bssid[6];
+static pthread_mutex_t shim_espnow_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool shim_espnow_started;
+static esp_now_recv_cb_t shim_espnow_recv_cb;
+static esp_now_send_cb_t shim_espnow_send_cb;
+static uint8_t shim_espnow_peers[ESP_NOW_MAX_TOTAL_PEER_NUM][ESP_NOW_ETH_ALEN];
+static bool shim_espnow_peer_used[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static bool shim_espnow_peer_encrypt[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static bool shim_espnow_pmk_set;
+static shim_espnow_transmit_t shim_espnow_transmit;
+static esp_eth_mac_t shim_eth_mac;
+static esp_eth_phy_t shim_eth_phy;
+/* Private function prototypes -----------------------------------------------*/
+static void *shim_timer_task(void *arg);
+static shim_nvs_entry_t *shim_nvs_find(nvs_handle_t handle, const char *key, bool create);
+static int32_t shim_espnow_find(const uint8_t *peer_addr);
+/* Private user code ---------------------------------------------------------*/
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+/* Event loop ----------------------------------------------------------------*/
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if (shim_event_handler_count >= SHIM_EVENT_HANDLER_NUM)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    shim_event_handlers[shim_event_handler_count++] = (shim_event_handler_t){event_base, event_id, event_handler, event_handler_arg};
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    (void)event_data_size;
+    (void)ticks_to_wait;
+    for (uint32_t i = 0; i < shim_event_handler_count; i++)
+    {
+        shim_event_handler_t *entry = &shim_event_handlers[i];
+        if (entry->base == event_base && (entry->id == ESP_EVENT_ANY_ID || entry->id == event_id))
+        {
+            entry->handler(entry->arg, event_base, event_id, (void *)event_data);
+        }
+    }
+    return ESP_OK;
+}
+
+/* esp_timer -----------------------------------------------------------------*/
+int64_t esp_timer_get_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    pthread_mutex_lock(&shim_timer_lock);
+    if (!shim_timer_running)
+    {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&shim_timer_cond, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_t thread;
+        pthread_create(&thread, NULL, shim_timer_task, NULL);
+        pthread_detach(thread);
+        shim_timer_running = true;
+    }
+    timer->next = shim_timers;
+    shim_timers = timer;
+    pthread_mutex_unlock(&shim_timer_lock);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    pthread_mutex_lock(&shim_timer_lock);
+    if (timer->active)
+    {
+        pthread_mutex_unlock(&shim_timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deadline = esp_timer_get_time() + (int64_t)timeout_us;
+    timer->active = true;
+    pthread_cond_signal(&shim_timer_cond);
+    pthread_mutex_unlock(&shim_timer_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&shim_timer_lock);
+    bool active = timer->active;
+    timer->active = false;
+    pthread_mutex_unlock(&shim_timer_lock);
+    return active ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&shim_timer_lock);
+    bool active = timer->active;
+    pthread_mutex_unlock(&shim_timer_lock);
+    return active;
+}
+
+static void *shim_timer_task(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&shim_timer_lock);
+    while (true)
+    {
+        int64_t now = esp_timer_get_time();
+        int64_t next = INT64_MAX;
+        struct esp_timer *expired = NULL;
+        for (struct esp_timer *timer = shim_timers; timer != NULL; timer = timer->next)
+        {
+            if (!timer->active)
+            {
+                continue;
+            }
+            if (timer->deadline <= now)
+            {
+                expired = timer;
+                break;
+            }
+            next = timer->deadline < next ? timer->deadline : next;
+        }
+        if (expired != NULL)
+        {
+            // Like the esp_timer task, callbacks run one at a time and may restart their timer
+            expired->active = false;
+            pthread_mutex_unlock(&shim_timer_lock);
+            expired->callback(expired->arg);
+            pthread_mutex_lock(&shim_timer_lock);
+            continue;
+        }
+        if (next == INT64_MAX)
+        {
+            pthread_cond_wait(&shim_timer_cond, &shim_timer_lock);
+            continue;
+        }
+        struct timespec deadline = {.tv_sec = next / 1000000, .tv_nsec = (long)(next % 1000000) * 1000};
+        pthread_cond_timedwait(&shim_timer_cond, &shim_timer_lock, &deadline);
+    }
+    return NULL;
+}
+
+/* Ethernet driver -----------------------------------------------------------*/
+static esp_err_t shim_eth_del(void *object)
+{
+    (void)object;
+    return ESP_OK;
+}
+
+esp_eth_mac_t *esp_eth_mac_new_esp32(const eth_esp32_emac_config_t *esp32_config, const eth_mac_config_t *config)
+{
+    (void)esp32_config;
+    (void)config;
+    shim_eth_mac.del = (esp_err_t (*)(esp_eth_mac_t *))shim_eth_del;
+    return &shim_eth_mac;
+}
+
+esp_eth_phy_t *esp_eth_phy_new_lan87xx(const eth_phy_config_t *config)
+{
+    (void)config;
+    shim_eth_phy.del = (esp_err_t (*)(esp_eth_phy_t *))shim_eth_del;
+    return &shim_eth_phy;
+}
+
+esp_err_t esp_eth_driver_install(const esp_eth_config_t *config, esp_eth_handle_t *out_hdl)
+{
+    (void)config;
+    *out_hdl = &shim_eth;
+    return ESP_OK;
+}
+
+esp_err_t esp_eth_driver_uninstall(esp_eth_handle_t hdl)
+{
+    (void)hdl;
+    return ESP_OK;
+}
+
+esp_err_t esp_eth_update_input_path(esp_eth_handle_t hdl, esp_err_t (*stack_input)(esp_eth_handle_t, uint8_t *, uint32_t, void *), void *priv)
+{
+    (void)hdl;
+    shim_eth.input = stack_input;
+    shim_eth.priv = priv;
+    return ESP_OK;
+}
+
+esp_err_t esp_eth_ioctl(esp_eth_handle_t hdl, esp_eth_io_cmd_t cmd, void *data)
+{
+    (void)hdl;
+    (void)cmd;
+    (void)data;
+    return ESP_OK;
+}
+
+esp_err_t esp_eth_start(esp_eth_handle_t hdl)
+{
+    (void)hdl;
+    return ESP_OK;
+}
+
+esp_err_t esp_eth_transmit(esp_eth_handle_t hdl, void *buf, size_t length)
+{
+    (void)hdl;
+    return shim_eth_transmit != NULL ? shim_eth_transmit(buf, length) : ESP_OK;
+}
+
+void shim_eth_set_transmit(shim_eth_transmit_t hook)
+{
+    shim_eth_transmit = hook;
+}
+
+esp_err_t shim_eth_receive(uint8_t *buffer, uint32_t len)
+{
+    if (shim_eth.input == NULL)
+    {
+        free(buffer);
+        return ESP_ERR_INVALID_STATE;
+    }
+    return shim_eth.input(&shim_eth, buffer, len, shim_eth.priv);
+}
+
+/* Wifi driver ---------------------------------------------------------------*/
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(int storage)
+{
+    (void)storage;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    (void)interface;
+    (void)conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    // The benchmark posts the connection events itself once its peers are set up
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    (void)primary;
+    (void)second;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    memset(ap_info, 0, sizeof(wifi_ap_record_t));
+    memcpy(ap_info->bssid, shim_wifi_bssid, sizeof(shim_wifi_bssid));
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_internal_reg_rxcb(wifi_interface_t ifx, wifi_rxcb_t fn)
+{
+    shim_wifi_rxcb[ifx] = fn;
+    return ESP_OK;
+}
+
+int esp_wifi_internal_tx(wifi_interface_t wifi_if, void *buffer, uint16_t len)
+{
+    esp_err_t ret = shim_wifi_transmit != NULL ? shim_wifi_transmit(wifi_if, buffer, len) : ESP_OK;
+    // The hook puts the frame on the air right away, its buffer is free again before the call returns
+    wifi_tx_done_cb_t tx_done = shim_wifi_tx_done;
+    if (ret == ESP_OK && tx_done != NULL)
+    {
+        tx_done((uint8_t)wifi_if, buffer, &len, true);
+    }
+    return ret;
+}
+
+esp_err_t esp_wifi_set_tx_done_cb(wifi_tx_done_cb_t cb)
+{
+    shim_wifi_tx_done = cb;
+    return ESP_OK;
+}
+
+void esp_wifi_internal_free_rx_buffer(void *buffer)
+{
+    free(buffer);
+}
+
+void shim_wifi_set_transmit(shim_wifi_transmit_t hook)
+{
+    shim_wifi_transmit = hook;
+}
+
+esp_err_t shim_wifi_receive(wifi_interface_t ifx, const uint8_t *frame, uint16_t len)
+{
+    wifi_rxcb_t rxcb = shim_wifi_rxcb[ifx];
+    if (rxcb == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // The driver hands over its own buffer as both the frame and the buffer to free
+    uint8_t *eb = malloc(len);
+    if (eb == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(eb, frame, len);
+    return rxcb(eb, len, eb);
+}
+
+void shim_wifi_set_ap_bssid(const uint8_t *bssid)
+{
+    memcpy(shim_wifi_bssid, bssid, sizeof(shim_wifi_bssid));
+}
+
+/* ESP-NOW -------------------------------------------------------------------*/
+esp_err_t esp_now_init(void)
+{
+    pthread_mutex_lock(&shim_espnow_lock);
+    shim_espnow_started = true;
+    memset(shim_espnow_peer_used, 0, sizeof(shim_espnow_peer_used));
+    pthread_mutex_unlock(&shim_espnow_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void)
+{
+    pthread_mutex_lock(&shim_espnow_lock);
+    shim_espnow_started = false;
+    shim_espnow_pmk_set = false;
+    shim_espnow_recv_cb = NULL;
+    shim_espnow_send_cb = NULL;
+    memset(shim_espnow_peer_used, 0, sizeof(shim_espnow_peer_used));
+    pthread_mutex_unlock(&shim_espnow_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_set_pmk(const uint8_t *pmk)
+{
+    if (pmk == NULL)
+    {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    shim_espnow_pmk_set = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    shim_espnow_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_recv_cb(void)
+{
+    shim_espnow_recv_cb = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    shim_espnow_send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_send_cb(void)
+{
+    shim_espnow_send_cb = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    esp_err_t ret = ESP_ERR_ESPNOW_FULL;
+    pthread_mutex_lock(&shim_espnow_lock);
+    if (!shim_espnow_started)
+    {
+        ret = ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    else if (shim_espnow_find(peer->peer_addr) >= 0)
+    {
+        ret = ESP_ERR_ESPNOW_EXIST;
+    }
+    else if (peer->encrypt && !shim_espnow_pmk_set)
+    {
+        // The peer key is useless without the primary key that encrypts it
+        ret = ESP_ERR_ESPNOW_ARG;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++)
+        {
+            if (!shim_espnow_peer_used[i])
+            {
+                memcpy(shim_espnow_peers[i], peer->peer_addr, ESP_NOW_ETH_ALEN);
+                shim_espnow_peer_used[i] = true;
+                shim_espnow_peer_encrypt[i] = peer->encrypt;
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&shim_espnow_lock);
+    return ret;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    pthread_mutex_lock(&shim_espnow_lock);
+    int32_t index = shim_espnow_find(peer_addr);
+    if (index >= 0)
+    {
+        shim_espnow_peer_used[index] = false;
+    }
+    pthread_mutex_unlock(&shim_espnow_lock);
+    return index >= 0 ? ESP_OK : ESP_ERR_ESPNOW_NOT_FOUND;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    pthread_mutex_lock(&shim_espnow_lock);
+    bool exist = shim_espnow_find(peer_addr) >= 0;
+    pthread_mutex_unlock(&shim_espnow_lock);
+    return exist;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    if (!shim_espnow_started)
+    {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (len == 0 || len > ESP_NOW_MAX_DATA_LEN)
+    {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (!esp_now_is_peer_exist(peer_addr))
+    {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    esp_err_t ret = shim_espnow_transmit != NULL ? shim_espnow_transmit(peer_addr, data, len) : ESP_OK;
+    if (ret == ESP_ERR_NO_MEM)
+    {
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    // The peer acknowledges every frame the hook takes, right away
+    esp_now_send_cb_t send_cb = shim_espnow_send_cb;
+    if (send_cb != NULL)
+    {
+        send_cb(peer_addr, ret == ESP_OK ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL);
+    }
+    return ESP_OK;
+}
+
+void shim_espnow_set_transmit(shim_espnow_transmit_t hook)
+{
+    shim_espnow_transmit = hook;
+}
+
+esp_err_t shim_espnow_receive(const uint8_t *src_addr, const uint8_t *dst_addr, const uint8_t *data, size_t len)
+{
+    esp_now_recv_cb_t recv_cb = shim_espnow_recv_cb;
+    if (recv_cb == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len == 0 || len > ESP_NOW_MAX_DATA_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_now_recv_info_t info = {
+        .src_addr = (uint8_t *)src_addr,
+        .des_addr = (uint8_t *)dst_addr,
+    };
+    recv_cb(&info, data, (int)len);
+    return ESP_OK;
+}
+
+uint32_t shim_espnow_encrypted_peers(void)
+{
+    uint32_t count = 0;
+    pthread_mutex_lock(&shim_espnow_lock);
+    for (uint32_t i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++)
+    {
+        count += shim_espnow_peer_used[i] && shim_espnow_peer_encrypt[i];
+    }
+    pthread_mutex_unlock(&shim_espnow_lock);
+    return count;
+}
+
+// Called with shim_espnow_lock held
+static int32_t shim_espnow_find(const uint8_t *peer_addr)
+{
+    for (uint32_t i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++)
+    {
+        if (shim_espnow_peer_used[i] && memcmp(shim_espnow_peers[i], peer_addr, ESP_NOW_ETH_ALEN) == 0)
+        {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+/* Interface addresses -------------------------------------------------------*/
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    const uint8_t base[6] = {0x24, 0x0A, 0xC4, 0x57, 0x00, 0x00};
+    memcpy(mac, base, sizeof(base));
+    mac[5] = (uint8_t)(type + 1);
+    return ESP_OK;
+}
+
+/* GPIO ----------------------------------------------------------------------*/
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(int gpio_num, uint32_t level)
+{
+    (void)gpio_num;
+    (void)level;
+    return ESP_OK;
+}
+
+/* Console -------------------------------------------------------------------*/
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd)
+{
+    (void)cmd;
+    return ESP_OK;
+}
+
+/* SPIFFS --------------------------------------------------------------------*/
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+    (void)conf;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/* NVS -----------------------------------------------------------------------*/
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    (void)open_mode;
+    pthread_mutex_lock(&shim_nvs_lock);
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    for (uint32_t i = 0; i < shim_nvs_handle_count; i++)
+    {
+        if (strcmp(shim_nvs_handles[i], name_space) == 0)
+        {
+            *out_handle = i + 1;
+            ret = ESP_OK;
+        }
+    }
+    if (ret != ESP_OK && shim_nvs_handle_count < SHIM_NVS_ENTRY_NUM && strlen(name_space) < SHIM_NVS_KEY_LEN)
+    {
+        shim_nvs_handles[shim_nvs_handle_count] = name_space;
+        *out_handle = ++shim_nvs_handle_count;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&shim_nvs_lock);
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    pthread_mutex_lock(&shim_nvs_lock);
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+    shim_nvs_entry_t *entry = shim_nvs_find(handle, key, false);
+    if (entry != NULL)
+    {
+        ret = ESP_OK;
+        if (out_value != NULL && *length < entry->len)
+        {
+            ret = ESP_ERR_INVALID_SIZE;
+        }
+        else if (out_value != NULL)
+        {
+            memcpy(out_value, entry->blob, entry->len);
+        }
+        *length = entry->len;
+    }
+    pthread_mutex_unlock(&shim_nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (length > SHIM_NVS_BLOB_LEN || strlen(key) >= SHIM_NVS_KEY_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    pthread_mutex_lock(&shim_nvs_lock);
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    shim_nvs_entry_t *entry = shim_nvs_find(handle, key, true);
+    if (entry != NULL)
+    {
+        memcpy(entry->blob, value, length);
+        entry->len = length;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&shim_nvs_lock);
+    return ret;
+}
+
+static shim_nvs_entry_t *shim_nvs_find(nvs_handle_t handle, const char *key, bool create)
+{
+    if (handle == 0 || handle > shim_nvs_handle_count)
+    {
+        return NULL;
+    }
+    const char *name_space = shim_nvs_handles[handle - 1];
+    shim_nvs_entry_t *free_entry = NULL;
+    for (uint32_t i = 0; i < SHIM_NVS_ENTRY_NUM; i++)
+    {
+        shim_nvs_entry_t *entry = &shim_nvs[i];
+        if (!entry->valid)
+        {
+            free_entry = free_entry == NULL ? entry : free_entry;
+            continue;
+        }
+        if (strcmp(entry->name_space, name_space) == 0 && strcmp(entry->key, key) == 0)
+        {
+            return entry;
+        }
+    }
+    if (!create || free_entry == NULL)
+    {
+        return NULL;
+    }
+    strcpy(free_entry->name_space, name_space);
+    strcpy(free_entry->key, key);
+    free_entry->valid = true;
+    return free_entry;
+}
@@ -0,0 +1,164 @@
+/* Includes ------------------------------------------------------------------*/
+#include <errno.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+/* Private typedef -----------------------------------------------------------*/
+struct shim_task
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+    TaskFunction_t function;
+    void *params;
+    const char *name;
+};
+/* Private variables ---------------------------------------------------------*/
+static __thread struct shim_task *shim_current_task;
+/* Private function prototypes -----------------------------------------------*/
+static struct shim_task *shim_task_new(TaskFunction_t function, void *params, const char *name);
+static void *shim_task_entry(void *arg);
+/* Private user code ---------------------------------------------------------*/
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id)
+{
+    (void)stack_depth;
+    (void)priority;
+    (void)core_id;
+    struct shim_task *new_task = shim_task_new(task, params, name);
+    pthread_t thread;
+    if (new_task == NULL || pthread_create(&thread, NULL, shim_task_entry, new_task) != 0)
+    {
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    if (handle != NULL)
+    {
+        *handle = new_task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // Only a task ending itself is supported, the thread is detached and its handle may still be notified
+    if (task == NULL || task == shim_current_task)
+    {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec delay = {.tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000};
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR)
+    {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (TickType_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    struct shim_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ticks_to_wait / 1000;
+    deadline.tv_nsec += (long)(ticks_to_wait % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && ticks_to_wait > 0)
+    {
+        if (ticks_to_wait == portMAX_DELAY)
+        {
+            pthread_cond_wait(&task->cond, &task->lock);
+        }
+        else if (pthread_cond_timedwait(&task->cond, &task->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    uint32_t value = task->notify;
+    if (clear_on_exit)
+    {
+        task->notify = 0;
+    }
+    else if (value > 0)
+    {
+        task->notify--;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *task_status_array, UBaseType_t array_size, uint32_t *total_run_time)
+{
+    (void)task_status_array;
+    (void)array_size;
+    *total_run_time = 0;
+    return 0;
+}
+
+BaseType_t xTaskGetAffinity(TaskHandle_t task)
+{
+    (void)task;
+    return tskNO_AFFINITY;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpuid)
+{
+    (void)cpuid;
+    return NULL;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // Threads not started through xTaskCreatePinnedToCore, e.g. the benchmark main thread, get a handle on first use
+    if (shim_current_task == NULL)
+    {
+        shim_current_task = shim_task_new(NULL, NULL, "thread");
+    }
+    return shim_current_task;
+}
+
+static struct shim_task *shim_task_new(TaskFunction_t function, void *params, const char *name)
+{
+    struct shim_task *task = calloc(1, sizeof(struct shim_task));
+    if (task == NULL)
+    {
+        return NULL;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&task->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&task->lock, NULL);
+    task->function = function;
+    task->params = params;
+    task->name = name;
+    return task;
+}
+
+static void *shim_task_entry(void *arg)
+{
+    shim_current_task = arg;
+    shim_current_task->function(shim_current_task->params);
+    return NULL;
+}
@@ -0,0 +1,347 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <stdatomic.h>
+#include "wenet_ackfilter.h"
+#include "wenet_bridge.h"
+/* Private macro -------------------------------------------------------------*/
+#define ACK_FILTER_TCP_ACK 0x10
+#define ACK_FILTER_TCP_ECE 0x40
+#define ACK_FILTER_OPT_EOL 0
+#define ACK_FILTER_OPT_NOP 1
+#define ACK_FILTER_OPT_SACK 5
+#define ACK_FILTER_OPT_TIMESTAMP 8
+#define ACK_FILTER_OPT_TIMESTAMP_LEN 10
+#define ACK_FILTER_SACK_MAX 4
+// VLAN identifier, IPv6 source and destination addresses and TCP ports
+#define ACK_FILTER_KEY_LEN (2 + 32 + 4)
+// Wrap safe comparison of TCP sequence numbers
+#define ACK_FILTER_SEQ_AFTER(a, b) ((int32_t)((a) - (b)) > 0)
+#define ACK_FILTER_SEQ_AFTER_EQ(a, b) ((int32_t)((a) - (b)) >= 0)
+// Slot of a flow hash, folded because the low bits of FNV-1a only depend on the low bits of the key bytes
+#define ACK_FILTER_INDEX(hash) (((hash) ^ ((hash) >> 16)) % ACK_FILTER_FLOWS)
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+    ACK_FILTER_OTHER = 0, // Not a TCP segment the filter can parse
+    ACK_FILTER_SEGMENT,   // TCP segment with data, other flags or unknown options
+    ACK_FILTER_PURE_ACK,  // TCP segment that only acknowledges
+} ack_filter_frame_t;
+
+// Fields of a pure ACK the thinning decision depends on
+typedef struct
+{
+    uint8_t key[ACK_FILTER_KEY_LEN];
+    uint8_t key_len;
+    uint8_t flags;
+    bool ce; // IP header carries a congestion experienced mark
+    uint8_t sack_num;
+    uint32_t ack;
+    uint32_t sack[ACK_FILTER_SACK_MAX][2]; // Left and right edge of each SACK block
+} ack_filter_info_t;
+/* Private variables ---------------------------------------------------------*/
+static atomic_uint_fast32_t ack_filter_pure_acks;
+static atomic_uint_fast32_t ack_filter_thinned;
+static atomic_uint_fast32_t ack_filter_kept;
+static atomic_uint_fast32_t ack_filter_collisions;
+/* Private function prototypes -----------------------------------------------*/
+static ack_filter_frame_t ack_filter_parse(const uint8_t *frame, uint32_t len, ack_filter_info_t *info);
+static bool ack_filter_parse_options(const uint8_t *option, uint32_t len, ack_filter_info_t *info);
+static bool ack_filter_supersedes(const ack_filter_info_t *newer, const ack_filter_info_t *older);
+static uint32_t ack_filter_hash(const uint8_t *key, uint32_t len);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the ACK filter of a wifi peer
+ * @param[in] filter Filter state
+ * @retval
+ */
+void ack_filter_init(ack_filter_t *filter)
+{
+    memset(filter, 0, sizeof(ack_filter_t));
+}
+
+/**
+ * @brief Thin the pure TCP ACKs queued for a wifi peer. When the frame is a pure ACK that acknowledges more than
+ *        the ACK of the same flow still waiting in the queue, and carries everything the queued one tells the
+ *        sender (SACK blocks, ECN echo, congestion experienced), it takes the place of the queued one.
+ *        Duplicate ACKs and window updates never advance the cumulative ACK and are always kept.
+ *        Otherwise a pure ACK becomes the ACK of its flow hash slot and has to be queued by the caller, while
+ *        any other segment of the flow clears the slot so that no later ACK overtakes it.
+ * @param[in] filter Filter state of the destination wifi peer
+ * @param[in] flows Class queues of the destination wifi peer
+ * @param[in] raw_data Frame descriptor about to be queued, its class already assigned
+ * @retval true if the frame replaced a queued ACK, the caller then releases the descriptor which holds the
+ *         buffer of the older ACK
+ */
+bool ack_filter_merge(ack_filter_t *filter, drr_flow_t *flows, raw_data_t *raw_data)
+{
+    ack_filter_info_t info;
+    ack_filter_frame_t type = ack_filter_parse(raw_data->data, raw_data->data_length, &info);
+    if (type == ACK_FILTER_OTHER)
+    {
+        return false;
+    }
+    uint32_t hash = ack_filter_hash(info.key, info.key_len);
+    ack_filter_slot_t *slot = &filter->slots[ACK_FILTER_INDEX(hash)];
+    raw_data_t *queued = slot->raw_data;
+    if (type == ACK_FILTER_SEGMENT)
+    {
+        if (queued != NULL && slot->hash == hash)
+        {
+            queued->ack_slot = 0;
+            slot->raw_data = NULL;
+        }
+        return false;
+    }
+    atomic_fetch_add_explicit(&ack_filter_pure_acks, 1, memory_order_relaxed);
+    if (queued != NULL)
+    {
+        ack_filter_info_t queued_info;
+        if (slot->hash != hash || ack_filter_parse(queued->data, queued->data_length, &queued_info) != ACK_FILTER_PURE_ACK ||
+            queued_info.key_len != info.key_len || memcmp(queued_info.key, info.key, info.key_len) != 0 ||
+            queued->qos_class != raw_data->qos_class || queued->ingress_peer != raw_data->ingress_peer)
+        {
+            atomic_fetch_add_explicit(&ack_filter_collisions, 1, memory_order_relaxed);
+        }
+        else if (ack_filter_supersedes(&info, &queued_info))
+        {
+            // Swap the buffers, the newer ACK keeps the queue position and ingress time of the older one
+            drr_flow_t *flow = &flows[queued->qos_class];
+            flow->bytes += raw_data->data_length - queued->data_length;
+            void *data = queued->data;
+            uint32_t data_length = queued->data_length;
+            queued->data = raw_data->data;
+            queued->data_length = raw_data->data_length;
+            raw_data->data = data;
+            raw_data->data_length = data_length;
+            atomic_fetch_add_explicit(&ack_filter_thinned, 1, memory_order_relaxed);
+            return true;
+        }
+        else
+        {
+            atomic_fetch_add_explicit(&ack_filter_kept, 1, memory_order_relaxed);
+        }
+        queued->ack_slot = 0;
+    }
+    slot->raw_data = raw_data;
+    slot->hash = hash;
+    raw_data->ack_slot = (uint8_t)(ACK_FILTER_INDEX(hash) + 1);
+    return false;
+}
+
+/**
+ * @brief Remove a frame from the filter once it leaves the queue of its wifi peer, or is not queued after all
+ * @param[in] filter Filter state of the wifi peer
+ * @param[in] raw_data Frame descriptor
+ * @retval
+ */
+void ack_filter_forget(ack_filter_t *filter, raw_data_t *raw_data)
+{
+    if (raw_data->ack_slot != 0)
+    {
+        filter->slots[raw_data->ack_slot - 1].raw_data = NULL;
+        raw_data->ack_slot = 0;
+    }
+}
+
+/**
+ * @brief Get the ACK filter counters since boot, summed over all wifi peers
+ * @param[out] stats Counters
+ * @retval
+ */
+void ack_filter_get_stats(ack_filter_stats_t *stats)
+{
+    stats->pure_acks = atomic_load_explicit(&ack_filter_pure_acks, memory_order_relaxed);
+    stats->thinned = atomic_load_explicit(&ack_filter_thinned, memory_order_relaxed);
+    stats->kept = atomic_load_explicit(&ack_filter_kept, memory_order_relaxed);
+    stats->collisions = atomic_load_explicit(&ack_filter_collisions, memory_order_relaxed);
+}
+
+/**
+ * @brief Parse an ethernet frame carrying a TCP segment: an unfragmented IPv4 packet or an IPv6 packet without
+ *        extension headers, behind an optional VLAN tag. A pure ACK has no payload, no flag but ACK and ECE, and
+ *        no option but timestamps and SACK
+ * @param[in] frame Ethernet frame
+ * @param[in] len Frame length
+ * @param[out] info Flow key of a TCP segment, and the fields of a pure ACK
+ * @retval Kind of frame
+ */
+static ack_filter_frame_t ack_filter_parse(const uint8_t *frame, uint32_t len, ack_filter_info_t *info)
+{
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    if (len < offset + 2)
+    {
+        return ACK_FILTER_OTHER;
+    }
+    uint16_t eth_type = (frame[offset] << 8) | frame[offset + 1];
+    uint16_t vlan = 0;
+    offset += 2;
+    if (eth_type == BRIDGE_ETH_TYPE_VLAN && len >= offset + 4)
+    {
+        vlan = ((frame[offset] << 8) | frame[offset + 1]) & 0x0FFF;
+        eth_type = (frame[offset + 2] << 8) | frame[offset + 3];
+        offset += 4;
+    }
+    const uint8_t *ip = frame + offset;
+    uint32_t ip_payload;
+    uint32_t addr_len;
+    const uint8_t *addr;
+    if (eth_type == BRIDGE_ETH_TYPE_IPV4 && len >= offset + 20 && (ip[0] >> 4) == 4)
+    {
+        uint32_t header_len = (ip[0] & 0x0F) * 4;
+        uint32_t total_len = (ip[2] << 8) | ip[3];
+        // Fragments carry the TCP header in the first fragment only
+        if (ip[9] != BRIDGE_IP_PROTO_TCP || header_len < 20 || total_len < header_len || ((ip[6] & 0x3F) | ip[7]) != 0)
+        {
+            return ACK_FILTER_OTHER;
+        }
+        ip_payload = total_len - header_len;
+        info->ce = (ip[1] & 0x03) == 0x03;
+        addr = ip + 12;
+        addr_len = 8;
+        offset += header_len;
+    }
+    else if (eth_type == BRIDGE_ETH_TYPE_IPV6 && len >= offset + 40 && (ip[0] >> 4) == 6)
+    {
+        if (ip[6] != BRIDGE_IP_PROTO_TCP)
+        {
+            return ACK_FILTER_OTHER;
+        }
+        ip_payload = (ip[4] << 8) | ip[5];
+        info->ce = (ip[1] & 0x30) == 0x30;
+        addr = ip + 8;
+        addr_len = 32;
+        offset += 40;
+    }
+    else
+    {
+        return ACK_FILTER_OTHER;
+    }
+    const uint8_t *tcp = frame + offset;
+    if (len < offset + 20)
+    {
+        return ACK_FILTER_OTHER;
+    }
+    info->key[0] = (uint8_t)(vlan >> 8);
+    info->key[1] = (uint8_t)vlan;
+    memcpy(info->key + 2, addr, addr_len);
+    memcpy(info->key + 2 + addr_len, tcp, 4);
+    info->key_len = (uint8_t)(2 + addr_len + 4);
+    uint32_t header_len = (tcp[12] >> 4) * 4;
+    info->flags = tcp[13];
+    // Anything behind the TCP header of a pure ACK is ethernet padding
+    if (header_len < 20 || ip_payload != header_len || len < offset + header_len ||
+        (info->flags & ~ACK_FILTER_TCP_ECE) != ACK_FILTER_TCP_ACK)
+    {
+        return ACK_FILTER_SEGMENT;
+    }
+    info->ack = ((uint32_t)tcp[8] << 24) | (tcp[9] << 16) | (tcp[10] << 8) | tcp[11];
+    return ack_filter_parse_options(tcp + 20, header_len - 20, info) ? ACK_FILTER_PURE_ACK : ACK_FILTER_SEGMENT;
+}
+
+/**
+ * @brief Parse the TCP options of an ACK. Options the filter does not know may carry state of their own
+ *        (e.g. multipath data ACKs), such an ACK is not thinned
+ * @param[in] option First option
+ * @param[in] len Length of the options
+ * @param[out] info SACK blocks of the ACK
+ * @retval true if the options are only padding, timestamps and SACK blocks
+ */
+static bool ack_filter_parse_options(const uint8_t *option, uint32_t len, ack_filter_info_t *info)
+{
+    info->sack_num = 0;
+    while (len > 0)
+    {
+        if (option[0] == ACK_FILTER_OPT_EOL)
+        {
+            return true;
+        }
+        if (option[0] == ACK_FILTER_OPT_NOP)
+        {
+            option++;
+            len--;
+            continue;
+        }
+        if (len < 2 || option[1] < 2 || option[1] > len)
+        {
+            return false;
+        }
+        if (option[0] == ACK_FILTER_OPT_SACK)
+        {
+            uint32_t blocks = (option[1] - 2) / 8;
+            if (option[1] != 2 + blocks * 8 || blocks > ACK_FILTER_SACK_MAX)
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i < blocks; i++)
+            {
+                const uint8_t *edge = option + 2 + i * 8;
+                info->sack[i][0] = ((uint32_t)edge[0] << 24) | (edge[1] << 16) | (edge[2] << 8) | edge[3];
+                info->sack[i][1] = ((uint32_t)edge[4] << 24) | (edge[5] << 16) | (edge[6] << 8) | edge[7];
+            }
+            info->sack_num = (uint8_t)blocks;
+        }
+        else if (option[0] != ACK_FILTER_OPT_TIMESTAMP || option[1] != ACK_FILTER_OPT_TIMESTAMP_LEN)
+        {
+            return false;
+        }
+        len -= option[1];
+        option += option[1];
+    }
+    return true;
+}
+
+/**
+ * @brief Decide whether a newer ACK of a flow tells the sender everything an older one does
+ * @param[in] newer ACK being queued
+ * @param[in] older ACK waiting in the queue
+ * @retval true if the older ACK can be dropped
+ */
+static bool ack_filter_supersedes(const ack_filter_info_t *newer, const ack_filter_info_t *older)
+{
+    // Duplicate ACKs drive fast retransmit and window updates reopen the window, both keep the cumulative ACK
+    if (!ACK_FILTER_SEQ_AFTER(newer->ack, older->ack))
+    {
+        return false;
+    }
+    // The congestion signals must reach the sender even if a later ACK would no longer carry them
+    if (((older->flags & ~newer->flags) & ACK_FILTER_TCP_ECE) != 0 || (older->ce && !newer->ce))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < older->sack_num; i++)
+    {
+        if (ACK_FILTER_SEQ_AFTER_EQ(newer->ack, older->sack[i][1]))
+        {
+            // Block now covered by the cumulative ACK
+            continue;
+        }
+        bool covered = false;
+        for (uint32_t j = 0; j < newer->sack_num && !covered; j++)
+        {
+            covered = ACK_FILTER_SEQ_AFTER_EQ(older->sack[i][0], newer->sack[j][0]) && ACK_FILTER_SEQ_AFTER_EQ(newer->sack[j][1], older->sack[i][1]);
+        }
+        if (!covered)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Hash a flow key (FNV-1a)
+ * @param[in] key Flow key
+ * @param[in] len Key length
+ * @retval Hash value
+ */
+static uint32_t ack_filter_hash(const uint8_t *key, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,43 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ACKFILTER_H
+#define __ACKFILTER_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "wenet_pool.h"
+#include "wenet_drr.h"
+/* Exported macro ------------------------------------------------------------*/
+#define ACK_FILTER_FLOWS CONFIG_WENET_ACK_FILTER_FLOWS
+/* Exported types ------------------------------------------------------------*/
+// Last pure TCP ACK queued for each flow hash slot of one wifi peer. Owned by the wifi send task; a queued
+// descriptor refers back to its slot through raw_data_t.ack_slot.
+typedef struct
+{
+    raw_data_t *raw_data; // Queued ACK, NULL if none
+    uint32_t hash;        // Flow hash of the queued ACK
+} ack_filter_slot_t;
+
+typedef struct
+{
+    ack_filter_slot_t slots[ACK_FILTER_FLOWS];
+} ack_filter_t;
+
+typedef struct
+{
+    uint32_t pure_acks;  // Pure ACKs seen on the way into the wifi peer queues
+    uint32_t thinned;    // Queued ACKs replaced by a newer cumulative ACK of the same flow
+    uint32_t kept;       // Queued ACKs of the same flow kept because the newer one does not cover them
+    uint32_t collisions; // Queued ACKs of another flow evicted from their hash slot
+} ack_filter_stats_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void ack_filter_init(ack_filter_t *filter);
+bool ack_filter_merge(ack_filter_t *filter, drr_flow_t *flows, raw_data_t *raw_data);
+void ack_filter_forget(ack_filter_t *filter, raw_data_t *raw_data);
+void ack_filter_get_stats(ack_filter_stats_t *stats);
+#endif /* __ACKFILTER_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,339 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "wenet_arp.h"
+#include "wenet_bridge.h"
+/* Private macro -------------------------------------------------------------*/
+#define ARP_PACKET_LEN 28
+#define ARP_HTYPE_ETHERNET 1
+#define ARP_OPER_REQUEST 1
+#define ARP_OPER_REPLY 2
+#define ARP_SHA_OFFSET 8
+#define ARP_SPA_OFFSET 14
+#define ARP_THA_OFFSET 18
+#define ARP_TPA_OFFSET 24
+#define ARP_IPV4_LEN 4
+#define ARP_IPV6_HEADER_LEN 40
+#define ARP_ND_NS 135
+#define ARP_ND_NA 136
+#define ARP_ND_TARGET_OFFSET 8
+#define ARP_ND_OPTIONS_OFFSET 24
+#define ARP_ND_OPT_SOURCE_ADDR 1
+#define ARP_ND_OPT_TARGET_ADDR 2
+#define ARP_IS_GROUP(addr) (((addr)[0] & 0x01) != 0)
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+static portMUX_TYPE arp_lock = portMUX_INITIALIZER_UNLOCKED;
+static arp_entry_t arp_cache[ARP_CACHE_SIZE];
+static arp_stats_t arp_stats;
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t arp_payload_offset(const uint8_t *frame, uint32_t len, uint16_t *eth_type);
+static void arp_snoop_nd(const uint8_t *ip, uint32_t available, const uint8_t *src_addr);
+static void arp_learn(uint8_t family, const uint8_t *ip, const uint8_t *addr);
+static arp_entry_t *arp_find(uint8_t family, const uint8_t *ip, uint32_t now);
+static bool arp_alive(const arp_entry_t *entry, uint32_t now);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the neighbour cache
+ * @param None
+ * @retval
+ */
+void arp_init(void)
+{
+    portENTER_CRITICAL(&arp_lock);
+    memset(arp_cache, 0, sizeof(arp_cache));
+    memset(&arp_stats, 0, sizeof(arp_stats));
+    portEXIT_CRITICAL(&arp_lock);
+}
+
+/**
+ * @brief Learn the IPv4 and IPv6 neighbours announced by ARP packets and neighbour solicitations and advertisements
+ * @param[in] frame Ethernet frame starting at the destination address
+ * @param[in] len Frame length
+ * @retval
+ */
+void arp_snoop(const uint8_t *frame, uint32_t len)
+{
+    uint16_t eth_type;
+    uint32_t offset = arp_payload_offset(frame, len, &eth_type);
+    const uint8_t *payload = frame + offset;
+    if (eth_type == BRIDGE_ETH_TYPE_ARP && len >= offset + ARP_PACKET_LEN)
+    {
+        // Ethernet/IPv4 only, and no probes, their sender address is not in use yet
+        static const uint8_t arp_format[6] = {0, ARP_HTYPE_ETHERNET, BRIDGE_ETH_TYPE_IPV4 >> 8, BRIDGE_ETH_TYPE_IPV4 & 0xFF,
+                                              FDB_ADDR_LEN, ARP_IPV4_LEN};
+        static const uint8_t zero_ip[ARP_IPV4_LEN] = {0};
+        if (memcmp(payload, arp_format, sizeof(arp_format)) == 0 && memcmp(payload + ARP_SPA_OFFSET, zero_ip, ARP_IPV4_LEN) != 0 &&
+            !ARP_IS_GROUP(payload + ARP_SHA_OFFSET))
+        {
+            arp_learn(4, payload + ARP_SPA_OFFSET, payload + ARP_SHA_OFFSET);
+        }
+    }
+    else if (eth_type == BRIDGE_ETH_TYPE_IPV6 && len >= offset + ARP_IPV6_HEADER_LEN)
+    {
+        arp_snoop_nd(payload, len - offset, frame + FDB_ADDR_LEN);
+    }
+}
+
+/**
+ * @brief Answer an ARP request for a host the bridge knows to be on the other side, so the broadcast
+ *        request does not have to cross the wifi link
+ * @param[in,out] frame Ethernet frame starting at the destination address, rewritten into the reply when answered
+ * @param[in] len Frame length
+ * @param[in] port Port the request was received on
+ * @param[in] peer Wifi peer the request was received from, FDB_PEER_ANY for ethernet frames
+ * @retval Proxy result. A reply has the same length as the request and goes back out of the port it came from
+ */
+arp_proxy_result_t arp_proxy(uint8_t *frame, uint32_t len, fdb_port_t port, uint8_t peer)
+{
+    uint16_t eth_type;
+    uint32_t offset = arp_payload_offset(frame, len, &eth_type);
+    uint8_t *payload = frame + offset;
+    if (eth_type != BRIDGE_ETH_TYPE_ARP || len < offset + ARP_PACKET_LEN ||
+        ((payload[6] << 8) | payload[7]) != ARP_OPER_REQUEST || payload[4] != FDB_ADDR_LEN || payload[5] != ARP_IPV4_LEN)
+    {
+        return ARP_PROXY_FORWARD;
+    }
+    // Announcements carry their own address as the target and are meant to reach every host
+    if (memcmp(payload + ARP_SPA_OFFSET, payload + ARP_TPA_OFFSET, ARP_IPV4_LEN) == 0)
+    {
+        return ARP_PROXY_FORWARD;
+    }
+    uint8_t target_addr[FDB_ADDR_LEN];
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    portENTER_CRITICAL(&arp_lock);
+    arp_entry_t *entry = arp_find(4, payload + ARP_TPA_OFFSET, now);
+    if (entry != NULL)
+    {
+        memcpy(target_addr, entry->addr, FDB_ADDR_LEN);
+    }
+    portEXIT_CRITICAL(&arp_lock);
+    if (entry == NULL)
+    {
+        return ARP_PROXY_FORWARD;
+    }
+    // Only answer for a host the forwarding database still sees, a stale binding must not outlive the host
+    uint8_t target_peer;
+    fdb_port_t target_port = fdb_lookup(target_addr, &target_peer);
+    if (target_port == FDB_PORT_NONE)
+    {
+        return ARP_PROXY_FORWARD;
+    }
+    if (target_port == port && target_peer == peer)
+    {
+        portENTER_CRITICAL(&arp_lock);
+        arp_stats.local++;
+        portEXIT_CRITICAL(&arp_lock);
+        return ARP_PROXY_LOCAL;
+    }
+    uint8_t target_ip[ARP_IPV4_LEN];
+    memcpy(target_ip, payload + ARP_TPA_OFFSET, ARP_IPV4_LEN);
+    memcpy(frame, frame + FDB_ADDR_LEN, FDB_ADDR_LEN);
+    memcpy(frame + FDB_ADDR_LEN, target_addr, FDB_ADDR_LEN);
+    payload[7] = ARP_OPER_REPLY;
+    memcpy(payload + ARP_THA_OFFSET, payload + ARP_SHA_OFFSET, FDB_ADDR_LEN + ARP_IPV4_LEN);
+    memcpy(payload + ARP_SHA_OFFSET, target_addr, FDB_ADDR_LEN);
+    memcpy(payload + ARP_SPA_OFFSET, target_ip, ARP_IPV4_LEN);
+    portENTER_CRITICAL(&arp_lock);
+    arp_stats.proxied++;
+    portEXIT_CRITICAL(&arp_lock);
+    return ARP_PROXY_REPLIED;
+}
+
+/**
+ * @brief Account the airtime saved by a request that was answered or kept local instead of sent to the wifi peers
+ * @param[in] len Request length
+ * @param[in] copies Number of wifi peers the request would have been sent to
+ * @retval
+ */
+void arp_count_airtime(uint32_t len, uint32_t copies)
+{
+    uint32_t airtime_us = bridge_airtime_us(len) * copies;
+    portENTER_CRITICAL(&arp_lock);
+    arp_stats.airtime_us += airtime_us;
+    portEXIT_CRITICAL(&arp_lock);
+}
+
+/**
+ * @brief Get a snapshot of the neighbour cache counters
+ * @param[out] stats Neighbour cache counters
+ * @retval
+ */
+void arp_get_stats(arp_stats_t *stats)
+{
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    portENTER_CRITICAL(&arp_lock);
+    *stats = arp_stats;
+    stats->entries = 0;
+    for (uint32_t i = 0; i < ARP_CACHE_SIZE; i++)
+    {
+        if (arp_alive(&arp_cache[i], now))
+        {
+            stats->entries++;
+        }
+    }
+    portEXIT_CRITICAL(&arp_lock);
+}
+
+/**
+ * @brief Find the start of the network layer payload, behind an optional VLAN tag
+ * @param[in] frame Ethernet frame starting at the destination address
+ * @param[in] len Frame length
+ * @param[out] eth_type Ethertype of the payload, 0 if the frame is too short
+ * @retval Payload offset
+ */
+static uint32_t arp_payload_offset(const uint8_t *frame, uint32_t len, uint16_t *eth_type)
+{
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    *eth_type = 0;
+    if (len < offset + 2)
+    {
+        return offset;
+    }
+    *eth_type = (frame[offset] << 8) | frame[offset + 1];
+    offset += 2;
+    if (*eth_type == BRIDGE_ETH_TYPE_VLAN && len >= offset + 4)
+    {
+        *eth_type = (frame[offset + 2] << 8) | frame[offset + 3];
+        offset += 4;
+    }
+    return offset;
+}
+
+/**
+ * @brief Learn the neighbour announced by a neighbour solicitation or advertisement
+ * @param[in] ip IPv6 header
+ * @param[in] available Bytes available from the start of the IPv6 header
+ * @param[in] src_addr Ethernet source address of the frame
+ * @retval
+ */
+static void arp_snoop_nd(const uint8_t *ip, uint32_t available, const uint8_t *src_addr)
+{
+    if (ip[6] != BRIDGE_IP_PROTO_ICMPV6 || available < ARP_IPV6_HEADER_LEN + ARP_ND_OPTIONS_OFFSET)
+    {
+        return;
+    }
+    const uint8_t *icmp = ip + ARP_IPV6_HEADER_LEN;
+    uint32_t icmp_len = available - ARP_IPV6_HEADER_LEN;
+    const uint8_t *neighbour_ip;
+    uint8_t option_type;
+    static const uint8_t unspecified[ARP_IP_LEN] = {0};
+    if (icmp[0] == ARP_ND_NS)
+    {
+        // The source of a solicitation is the neighbour, unless it is a duplicate address detection probe
+        neighbour_ip = ip + 8;
+        option_type = ARP_ND_OPT_SOURCE_ADDR;
+        if (memcmp(neighbour_ip, unspecified, ARP_IP_LEN) == 0)
+        {
+            return;
+        }
+    }
+    else if (icmp[0] == ARP_ND_NA)
+    {
+        neighbour_ip = icmp + ARP_ND_TARGET_OFFSET;
+        option_type = ARP_ND_OPT_TARGET_ADDR;
+    }
+    else
+    {
+        return;
+    }
+    const uint8_t *addr = src_addr;
+    uint32_t pos = ARP_ND_OPTIONS_OFFSET;
+    while (pos + 2 <= icmp_len && icmp[pos + 1] != 0)
+    {
+        uint32_t option_len = icmp[pos + 1] * 8;
+        if (pos + option_len > icmp_len)
+        {
+            break;
+        }
+        if (icmp[pos] == option_type && option_len >= 2 + FDB_ADDR_LEN)
+        {
+            addr = icmp + pos + 2;
+            break;
+        }
+        pos += option_len;
+    }
+    if (!ARP_IS_GROUP(addr))
+    {
+        arp_learn(6, neighbour_ip, addr);
+    }
+}
+
+/**
+ * @brief Learn or refresh the link layer address of a neighbour
+ * @param[in] family 4 or 6
+ * @param[in] ip IP address, 4 or 16 bytes
+ * @param[in] addr Link layer address
+ * @retval
+ */
+static void arp_learn(uint8_t family, const uint8_t *ip, const uint8_t *addr)
+{
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    portENTER_CRITICAL(&arp_lock);
+    arp_entry_t *entry = arp_find(family, ip, now);
+    if (entry == NULL)
+    {
+        // Take a free or aged out entry, or replace the least recently seen one
+        for (uint32_t i = 0; i < ARP_CACHE_SIZE; i++)
+        {
+            arp_entry_t *candidate = &arp_cache[i];
+            if (!arp_alive(candidate, now))
+            {
+                entry = candidate;
+                break;
+            }
+            if (entry == NULL || (now - candidate->last_seen) > (now - entry->last_seen))
+            {
+                entry = candidate;
+            }
+        }
+        if (arp_alive(entry, now))
+        {
+            arp_stats.replaced++;
+        }
+        memset(entry->ip, 0, ARP_IP_LEN);
+        memcpy(entry->ip, ip, family == 4 ? ARP_IPV4_LEN : ARP_IP_LEN);
+        entry->family = family;
+        arp_stats.learned++;
+    }
+    memcpy(entry->addr, addr, FDB_ADDR_LEN);
+    entry->last_seen = now;
+    portEXIT_CRITICAL(&arp_lock);
+}
+
+/**
+ * @brief Find the live entry of an IP address. Must be called with arp_lock held
+ * @param[in] family 4 or 6
+ * @param[in] ip IP address, 4 or 16 bytes
+ * @param[in] now Current time in seconds
+ * @retval Entry, NULL if the address is unknown or aged out
+ */
+static arp_entry_t *arp_find(uint8_t family, const uint8_t *ip, uint32_t now)
+{
+    uint32_t ip_len = family == 4 ? ARP_IPV4_LEN : ARP_IP_LEN;
+    for (uint32_t i = 0; i < ARP_CACHE_SIZE; i++)
+    {
+        arp_entry_t *entry = &arp_cache[i];
+        // An aged out copy may be left behind when the address was learned again in another entry
+        if (entry->family == family && arp_alive(entry, now) && memcmp(entry->ip, ip, ip_len) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check whether an entry holds a live neighbour
+ * @param[in] entry Entry
+ * @param[in] now Current time in seconds
+ * @retval true if the entry is in use and not aged out
+ */
+static bool arp_alive(const arp_entry_t *entry, uint32_t now)
+{
+    return entry->family != 0 && (now - entry->last_seen) <= ARP_AGE_S;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,49 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ARP_H
+#define __ARP_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "wenet_fdb.h"
+/* Exported macro ------------------------------------------------------------*/
+#define ARP_CACHE_SIZE CONFIG_WENET_ARP_CACHE_SIZE
+#define ARP_AGE_S CONFIG_WENET_ARP_AGE_S
+#define ARP_IP_LEN 16
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    ARP_PROXY_FORWARD = 0, // Not an ARP request or the target is unknown, forward the request
+    ARP_PROXY_REPLIED,     // The frame was turned into the reply to the request
+    ARP_PROXY_LOCAL,       // The target is behind the port the request came from, it answers on its own
+} arp_proxy_result_t;
+
+typedef struct
+{
+    uint8_t ip[ARP_IP_LEN]; // IPv4 addresses use the first 4 bytes
+    uint8_t addr[FDB_ADDR_LEN];
+    uint8_t family; // 4 or 6, 0 for a free entry
+    uint32_t last_seen; // Seconds
+} arp_entry_t;
+
+typedef struct
+{
+    uint32_t entries;    // Live entries
+    uint32_t learned;    // New IPv4 and IPv6 neighbours learned
+    uint32_t replaced;   // Live entries replaced because the cache was full
+    uint32_t proxied;    // ARP requests answered by the bridge
+    uint32_t local;      // ARP requests kept on the side of their target
+    uint32_t airtime_us; // Estimated airtime saved by not sending the requests to the wifi peers
+} arp_stats_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void arp_init(void);
+void arp_snoop(const uint8_t *frame, uint32_t len);
+arp_proxy_result_t arp_proxy(uint8_t *frame, uint32_t len, fdb_port_t port, uint8_t peer);
+void arp_count_airtime(uint32_t len, uint32_t copies);
+void arp_get_stats(arp_stats_t *stats);
+#endif /* __ARP_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,166 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include "wenet_bridge.h"
+/* Private macro -------------------------------------------------------------*/
+// Airtime estimate of one unicast data frame: DIFS, mean backoff, preamble, SIFS and ACK at 802.11g OFDM
+// rates, and the 802.11 MAC header, LLC/SNAP and FCS sent at the data rate
+#define BRIDGE_AIRTIME_OVERHEAD_US 150
+#define BRIDGE_AIRTIME_MAC_OVERHEAD 36
+#define BRIDGE_AIRTIME_RATE_MBPS 24
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+// Every reason is bumped from a single context at a time, the atomics only keep readers consistent
+static atomic_uint_fast32_t bridge_drops[BRIDGE_DROP_REASON_MAX];
+static atomic_uint_fast32_t bridge_ecn_marks;
+static atomic_uint_fast32_t bridge_pause_frames;
+static const char *const bridge_drop_names[BRIDGE_DROP_REASON_MAX] = {
+    [BRIDGE_DROP_NO_DESC] = "no_desc",
+    [BRIDGE_DROP_NO_BUF] = "no_buf",
+    [BRIDGE_DROP_OVERSIZE] = "oversize",
+    [BRIDGE_DROP_QUEUE_FULL] = "queue_full",
+    [BRIDGE_DROP_HEAD] = "head",
+    [BRIDGE_DROP_CLASS] = "class",
+    [BRIDGE_DROP_LINK_DOWN] = "link_down",
+    [BRIDGE_DROP_FLUSH] = "flush",
+    [BRIDGE_DROP_AQM] = "aqm",
+    [BRIDGE_DROP_STATION] = "station_full",
+    [BRIDGE_DROP_WIFI_TX] = "wifi_tx",
+};
+/* Private function prototypes -----------------------------------------------*/
+
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Get the ingress drop policy selected in Kconfig
+ * @param None
+ * @retval Drop policy
+ */
+bridge_drop_policy_t bridge_get_drop_policy(void)
+{
+#if CONFIG_WENET_ETH_DROP_HEAD
+    return BRIDGE_DROP_POLICY_HEAD;
+#elif CONFIG_WENET_ETH_DROP_CLASS
+    return BRIDGE_DROP_POLICY_CLASS;
+#else
+    return BRIDGE_DROP_POLICY_TAIL;
+#endif
+}
+
+/**
+ * @brief Account a dropped frame
+ * @param[in] reason Drop reason
+ * @retval
+ */
+void bridge_count_drop(bridge_drop_reason_t reason)
+{
+    if (reason < BRIDGE_DROP_REASON_MAX)
+    {
+        atomic_fetch_add_explicit(&bridge_drops[reason], 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Get a snapshot of the drop counters
+ * @param[out] stats Drop counters indexed by bridge_drop_reason_t
+ * @retval
+ */
+void bridge_get_drop_stats(bridge_drop_stats_t *stats)
+{
+    for (uint32_t i = 0; i < BRIDGE_DROP_REASON_MAX; i++)
+    {
+        stats->drops[i] = atomic_load_explicit(&bridge_drops[i], memory_order_relaxed);
+    }
+    stats->ecn_marks = atomic_load_explicit(&bridge_ecn_marks, memory_order_relaxed);
+    stats->pause_frames = atomic_load_explicit(&bridge_pause_frames, memory_order_relaxed);
+}
+
+/**
+ * @brief Account an 802.3x PAUSE frame sent on ethernet
+ * @param None
+ * @retval
+ */
+void bridge_count_pause(void)
+{
+    atomic_fetch_add_explicit(&bridge_pause_frames, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Get the printable name of a drop reason
+ * @param[in] reason Drop reason
+ * @retval Reason name
+ */
+const char *bridge_drop_reason_name(bridge_drop_reason_t reason)
+{
+    return reason < BRIDGE_DROP_REASON_MAX ? bridge_drop_names[reason] : "unknown";
+}
+
+/**
+ * @brief Mark an ECN capable IPv4 or IPv6 frame as Congestion Experienced
+ * @param[in,out] frame Ethernet frame starting at the destination address
+ * @param[in] len Frame length
+ * @retval true if the frame is ECN capable and carries the CE mark now
+ */
+bool bridge_mark_ecn(uint8_t *frame, uint32_t len)
+{
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    if (len < offset + 2)
+    {
+        return false;
+    }
+    uint16_t eth_type = (frame[offset] << 8) | frame[offset + 1];
+    offset += 2;
+    if (eth_type == BRIDGE_ETH_TYPE_VLAN && len >= offset + 4)
+    {
+        eth_type = (frame[offset + 2] << 8) | frame[offset + 3];
+        offset += 4;
+    }
+    uint8_t *ip = frame + offset;
+    if (eth_type == BRIDGE_ETH_TYPE_IPV4 && len >= offset + 20)
+    {
+        uint8_t ecn = ip[1] & 0x03;
+        if (ecn == 0)
+        {
+            return false;
+        }
+        if (ecn != 0x03)
+        {
+            // Incremental checksum update (RFC 1624) of the version/IHL/TOS word
+            uint16_t old_word = (ip[0] << 8) | ip[1];
+            uint16_t new_word = old_word | 0x03;
+            uint32_t sum = (uint16_t)~((ip[10] << 8) | ip[11]) + (uint16_t)~old_word + new_word;
+            sum = (sum & 0xFFFF) + (sum >> 16);
+            sum = (sum & 0xFFFF) + (sum >> 16);
+            ip[1] |= 0x03;
+            ip[10] = (uint8_t)(~sum >> 8);
+            ip[11] = (uint8_t)~sum;
+        }
+    }
+    else if (eth_type == BRIDGE_ETH_TYPE_IPV6 && len >= offset + 40)
+    {
+        // The ECN field is the low two bits of the traffic class, bits 4 and 5 of the second byte
+        if ((ip[1] & 0x30) == 0)
+        {
+            return false;
+        }
+        ip[1] |= 0x30;
+    }
+    else
+    {
+        return false;
+    }
+    atomic_fetch_add_explicit(&bridge_ecn_marks, 1, memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Estimate the airtime one wifi peer needs to receive a frame over the tunnel
+ * @param[in] len Ethernet frame length
+ * @retval Airtime in microseconds
+ */
+uint32_t bridge_airtime_us(uint32_t len)
+{
+    return BRIDGE_AIRTIME_OVERHEAD_US + ((len + BRIDGE_AIRTIME_MAC_OVERHEAD) * 8) / BRIDGE_AIRTIME_RATE_MBPS;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,65 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BRIDGE_H
+#define __BRIDGE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+/* Exported macro ------------------------------------------------------------*/
+#define BRIDGE_ETH_TYPE_OFFSET 12
+#define BRIDGE_ETH_TYPE_VLAN 0x8100
+#define BRIDGE_ETH_TYPE_ARP 0x0806
+#define BRIDGE_ETH_TYPE_EAPOL 0x888E
+#define BRIDGE_ETH_TYPE_LLDP 0x88CC
+#define BRIDGE_ETH_TYPE_PTP 0x88F7
+#define BRIDGE_ETH_TYPE_IPV4 0x0800
+#define BRIDGE_ETH_TYPE_IPV6 0x86DD
+#define BRIDGE_IP_PROTO_TCP 6
+#define BRIDGE_IP_PROTO_ICMPV6 58
+#define BRIDGE_IP_PROTO_UDP 17
+// Core of a forwarding task from its Kconfig setting, where -1 stands for no affinity
+#define BRIDGE_TASK_CORE(core) ((core) < 0 ? tskNO_AFFINITY : (core))
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    BRIDGE_DROP_NO_DESC = 0, // Frame pool has no free descriptor
+    BRIDGE_DROP_NO_BUF,      // Frame pool has no free buffer
+    BRIDGE_DROP_OVERSIZE,    // Frame does not fit a pool buffer
+    BRIDGE_DROP_QUEUE_FULL,  // Tail drop, the ring is full
+    BRIDGE_DROP_HEAD,        // Head drop, oldest frame dropped to honour the queue limit
+    BRIDGE_DROP_CLASS,       // Bulk frame dropped to keep room for control frames
+    BRIDGE_DROP_LINK_DOWN,   // Egress link down or wifi peer not connected
+    BRIDGE_DROP_FLUSH,       // Queue flushed on an ethernet link change
+    BRIDGE_DROP_AQM,         // Dropped by the active queue management
+    BRIDGE_DROP_STATION,     // Queue of the destination wifi peer is full
+    BRIDGE_DROP_WIFI_TX,     // Wifi driver did not take the frame, e.g. still out of transmit buffers after the retries
+    BRIDGE_DROP_REASON_MAX,
+} bridge_drop_reason_t;
+
+typedef enum
+{
+    BRIDGE_DROP_POLICY_TAIL = 0,
+    BRIDGE_DROP_POLICY_HEAD,
+    BRIDGE_DROP_POLICY_CLASS,
+} bridge_drop_policy_t;
+
+typedef struct
+{
+    uint32_t drops[BRIDGE_DROP_REASON_MAX];
+    uint32_t ecn_marks;    // Frames marked Congestion Experienced instead of dropped
+    uint32_t pause_frames; // 802.3x PAUSE frames sent on ethernet, pauses and resumes
+} bridge_drop_stats_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+bridge_drop_policy_t bridge_get_drop_policy(void);
+void bridge_count_drop(bridge_drop_reason_t reason);
+void bridge_get_drop_stats(bridge_drop_stats_t *stats);
+const char *bridge_drop_reason_name(bridge_drop_reason_t reason);
+bool bridge_mark_ecn(uint8_t *frame, uint32_t len);
+void bridge_count_pause(void);
+uint32_t bridge_airtime_us(uint32_t len);
+#endif /* __BRIDGE_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,656 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+#include "esp_spiffs.h"
+#include "nvs.h"
+#include "wenet_capture.h"
+#include "wenet_bridge.h"
+/* Private macro -------------------------------------------------------------*/
+#define CAPTURE_LOG "CAPTURE"
+#define CAPTURE_TASK_STACK 4096
+#define CAPTURE_BASE_PATH "/spiffs"
+// Partition reserved in partitions.csv
+#define CAPTURE_PARTITION_LABEL "spiffs"
+#define CAPTURE_NVS_NAMESPACE "wenet"
+#define CAPTURE_NVS_KEY "capture_seq"
+#define CAPTURE_NO_TRIGGER (-1)
+#define CAPTURE_TRIGGER_POLL_MS 100
+#define CAPTURE_PCAP_MAGIC 0xA1B2C3D4
+#define CAPTURE_PCAP_LINKTYPE_ETHERNET 1
+#define CAPTURE_IP_PROTO_TCP 6
+#if (CAPTURE_RECORDS & (CAPTURE_RECORDS - 1)) != 0
+#error "CONFIG_WENET_CAPTURE_RECORDS must be a power of two"
+#endif
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+    atomic_uint_fast32_t seq; // Ring index of the record plus one, 0 while it is written
+    uint32_t timestamp;       // Microseconds, esp_timer truncated to 32 bits
+    uint16_t len;             // Original frame length
+    uint16_t caplen;          // Bytes kept
+    uint8_t point;            // capture_point_t
+    uint8_t data[CAPTURE_SNAPLEN];
+} capture_record_t;
+
+// Classic libpcap file format, written in the native byte order as the magic number tells readers
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} capture_pcap_header_t;
+
+typedef struct
+{
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} capture_pcap_record_t;
+/* Private variables ---------------------------------------------------------*/
+// Flight recorder: the receive paths claim records with one atomic add and overwrite the oldest ones
+static capture_record_t capture_ring[CAPTURE_RECORDS];
+static atomic_uint_fast32_t capture_head;
+static atomic_bool capture_enabled;
+// Set while a flush reads the ring, frames received meanwhile are not captured
+static atomic_bool capture_frozen;
+static atomic_uint_fast32_t capture_filtered;
+static portMUX_TYPE capture_lock = portMUX_INITIALIZER_UNLOCKED;
+// Read without the lock on the fast path, a frame filtered during an update sees the old or the new rule
+static capture_rule_t capture_rules[CAPTURE_RULE_NUM];
+static atomic_uint_fast32_t capture_rule_count;
+static atomic_int capture_trigger_reason = CAPTURE_NO_TRIGGER;
+static atomic_bool capture_flush_request;
+static TaskHandle_t capture_taskHandler = NULL;
+// Only used by the capture task, the status fields are read under capture_lock
+static bool capture_mounted = false;
+static uint32_t capture_flushes;
+static uint32_t capture_flush_errors;
+static char capture_last_file[32];
+static const char *const capture_point_names[CAPTURE_POINT_MAX] = {
+    [CAPTURE_POINT_ETH_RX] = "eth",
+    [CAPTURE_POINT_WIFI_RX] = "wifi",
+};
+/* Private function prototypes -----------------------------------------------*/
+static bool capture_match(capture_point_t point, const uint8_t *frame, uint32_t len);
+static void capture_task(void *pvParameters);
+static esp_err_t capture_flush(void);
+static esp_err_t capture_write_ring(FILE *file);
+static esp_err_t capture_next_file(char *path, size_t size);
+static int capture_console(int argc, char **argv);
+static int capture_console_rule(int argc, char **argv);
+static bool capture_parse_addr(const char *text, uint8_t *addr);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Start capturing and the task that writes the captures to SPIFFS
+ * @param None
+ * @retval
+ */
+void capture_init(void)
+{
+    atomic_store(&capture_enabled, true);
+    if (capture_taskHandler == NULL)
+    {
+        xTaskCreatePinnedToCore(capture_task, "capture_task", CAPTURE_TASK_STACK, NULL, 0, &capture_taskHandler, tskNO_AFFINITY);
+    }
+}
+
+/**
+ * @brief Record the head of a received frame. Called from the receive paths, never blocks
+ * @param[in] point Capture point
+ * @param[in] frame Frame starting at the destination address
+ * @param[in] len Frame length
+ * @param[in] timestamp_us Receive time, esp_timer microseconds truncated to 32 bits
+ * @retval
+ */
+void capture_frame(capture_point_t point, const uint8_t *frame, uint32_t len, uint32_t timestamp_us)
+{
+    if (!atomic_load_explicit(&capture_enabled, memory_order_relaxed) || atomic_load_explicit(&capture_frozen, memory_order_relaxed))
+    {
+        return;
+    }
+    if (atomic_load_explicit(&capture_rule_count, memory_order_relaxed) > 0 && !capture_match(point, frame, len))
+    {
+        atomic_fetch_add_explicit(&capture_filtered, 1, memory_order_relaxed);
+        return;
+    }
+    uint32_t index = atomic_fetch_add_explicit(&capture_head, 1, memory_order_relaxed);
+    capture_record_t *record = &capture_ring[index & (CAPTURE_RECORDS - 1)];
+    // Readers skip the record until it carries its new index
+    atomic_store_explicit(&record->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    uint32_t caplen = len < CAPTURE_SNAPLEN ? len : CAPTURE_SNAPLEN;
+    record->timestamp = timestamp_us;
+    record->len = (uint16_t)len;
+    record->caplen = (uint16_t)caplen;
+    record->point = point;
+    memcpy(record->data, frame, caplen);
+    atomic_store_explicit(&record->seq, index + 1, memory_order_release);
+}
+
+/**
+ * @brief Pause or resume capturing
+ * @param[in] enabled true to capture
+ * @retval
+ */
+void capture_set_enabled(bool enabled)
+{
+    atomic_store(&capture_enabled, enabled);
+}
+
+/**
+ * @brief Change a capture rule
+ * @param[in] index Rule index
+ * @param[in] rule New rule, points 0 disables it
+ * @retval ESP_OK, ESP_ERR_INVALID_ARG for a bad index or capture point mask
+ */
+esp_err_t capture_set_rule(uint32_t index, const capture_rule_t *rule)
+{
+    if (index >= CAPTURE_RULE_NUM || rule->points >= (1u << CAPTURE_POINT_MAX))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&capture_lock);
+    capture_rules[index] = *rule;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < CAPTURE_RULE_NUM; i++)
+    {
+        count += capture_rules[i].points != 0;
+    }
+    atomic_store(&capture_rule_count, count);
+    portEXIT_CRITICAL(&capture_lock);
+    return ESP_OK;
+}
+
+/**
+ * @brief Get the capture rules
+ * @param[out] rules CAPTURE_RULE_NUM rules
+ * @retval
+ */
+void capture_get_rules(capture_rule_t *rules)
+{
+    portENTER_CRITICAL(&capture_lock);
+    memcpy(rules, capture_rules, sizeof(capture_rules));
+    portEXIT_CRITICAL(&capture_lock);
+}
+
+/**
+ * @brief Arm the trigger that writes the ring to SPIFFS when the bridge drops a frame for a reason. The trigger
+ *        fires once, so a drop storm leaves the frames that led up to it instead of wearing the flash
+ * @param[in] reason bridge_drop_reason_t, -1 to disarm
+ * @retval
+ */
+void capture_set_trigger(int32_t reason)
+{
+    atomic_store(&capture_trigger_reason, reason >= 0 && reason < BRIDGE_DROP_REASON_MAX ? reason : CAPTURE_NO_TRIGGER);
+    if (capture_taskHandler != NULL)
+    {
+        xTaskNotifyGive(capture_taskHandler);
+    }
+}
+
+/**
+ * @brief Ask the capture task to write the ring to SPIFFS. Safe to call from any task
+ * @param None
+ * @retval
+ */
+void capture_trigger(void)
+{
+    atomic_store(&capture_flush_request, true);
+    if (capture_taskHandler != NULL)
+    {
+        xTaskNotifyGive(capture_taskHandler);
+    }
+}
+
+/**
+ * @brief Get the capture state and counters
+ * @param[out] status Status
+ * @retval
+ */
+void capture_get_status(capture_status_t *status)
+{
+    status->enabled = atomic_load(&capture_enabled);
+    status->captured = atomic_load_explicit(&capture_head, memory_order_relaxed);
+    status->filtered = atomic_load_explicit(&capture_filtered, memory_order_relaxed);
+    status->trigger = atomic_load(&capture_trigger_reason);
+    portENTER_CRITICAL(&capture_lock);
+    status->flushes = capture_flushes;
+    status->flush_errors = capture_flush_errors;
+    memcpy(status->last_file, capture_last_file, sizeof(status->last_file));
+    portEXIT_CRITICAL(&capture_lock);
+}
+
+/**
+ * @brief Register the "capture" console command
+ * @param None
+ * @retval Result of esp_console_cmd_register
+ */
+esp_err_t capture_register_console(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "capture",
+        .help = "Show the packet capture state. \"capture on|off\" pauses it, \"capture flush\" writes the ring to SPIFFS "
+                "as pcap, \"capture trigger <drop reason>|off\" writes it on the next such drop, \"capture rule <n> "
+                "eth|wifi|any [type=<ethertype>] [proto=<ip proto>] [port=<port>] [addr=<mac>]\" or \"capture rule <n> off\" "
+                "selects the frames",
+        .hint = "[on|off|flush|trigger|rule]",
+        .func = capture_console,
+    };
+    return esp_console_cmd_register(&command);
+}
+
+/**
+ * @brief Check a frame against the capture rules
+ * @param[in] point Capture point
+ * @param[in] frame Frame starting at the destination address
+ * @param[in] len Frame length
+ * @retval true if a rule matches
+ */
+static bool capture_match(capture_point_t point, const uint8_t *frame, uint32_t len)
+{
+    uint16_t eth_type = 0;
+    uint8_t ip_proto = 0;
+    uint16_t src_port = 0;
+    uint16_t dst_port = 0;
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    if (len >= offset + 2)
+    {
+        eth_type = (frame[offset] << 8) | frame[offset + 1];
+        offset += 2;
+        if (eth_type == BRIDGE_ETH_TYPE_VLAN && len >= offset + 4)
+        {
+            eth_type = (frame[offset + 2] << 8) | frame[offset + 3];
+            offset += 4;
+        }
+    }
+    const uint8_t *ip = frame + offset;
+    uint32_t header_len = 0;
+    if (eth_type == BRIDGE_ETH_TYPE_IPV4 && len >= offset + 20)
+    {
+        ip_proto = ip[9];
+        // Only the first fragment carries the ports
+        header_len = (((ip[6] & 0x1F) << 8) | ip[7]) == 0 ? (ip[0] & 0x0F) * 4 : 0;
+    }
+    else if (eth_type == BRIDGE_ETH_TYPE_IPV6 && len >= offset + 40)
+    {
+        ip_proto = ip[6];
+        header_len = 40;
+    }
+    if ((ip_proto == BRIDGE_IP_PROTO_UDP || ip_proto == CAPTURE_IP_PROTO_TCP) && header_len > 0 && len >= offset + header_len + 4)
+    {
+        src_port = (ip[header_len] << 8) | ip[header_len + 1];
+        dst_port = (ip[header_len + 2] << 8) | ip[header_len + 3];
+    }
+    static const uint8_t any_addr[CAPTURE_ADDR_LEN] = {0};
+    for (uint32_t i = 0; i < CAPTURE_RULE_NUM; i++)
+    {
+        const capture_rule_t *rule = &capture_rules[i];
+        if ((rule->points & (1u << point)) != 0 && (rule->eth_type == 0 || rule->eth_type == eth_type) &&
+            (rule->ip_proto == 0 || rule->ip_proto == ip_proto) &&
+            (rule->port == 0 || rule->port == src_port || rule->port == dst_port) &&
+            (memcmp(rule->addr, any_addr, CAPTURE_ADDR_LEN) == 0 || (len >= 2 * CAPTURE_ADDR_LEN &&
+             (memcmp(rule->addr, frame, CAPTURE_ADDR_LEN) == 0 || memcmp(rule->addr, frame + CAPTURE_ADDR_LEN, CAPTURE_ADDR_LEN) == 0))))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Capture task: writes the ring to SPIFFS when asked to, and watches the drop counters while a trigger is armed
+ * @param[in] pvParameters
+ * @retval
+ */
+static void capture_task(void *pvParameters)
+{
+    (void)pvParameters;
+    int32_t watched_reason = CAPTURE_NO_TRIGGER;
+    uint32_t watched_drops = 0;
+    while (true)
+    {
+        int32_t reason = atomic_load(&capture_trigger_reason);
+        ulTaskNotifyTake(pdTRUE, reason == CAPTURE_NO_TRIGGER ? portMAX_DELAY : pdMS_TO_TICKS(CAPTURE_TRIGGER_POLL_MS));
+        bool flush = atomic_exchange(&capture_flush_request, false);
+        reason = atomic_load(&capture_trigger_reason);
+        if (reason != CAPTURE_NO_TRIGGER)
+        {
+            bridge_drop_stats_t drop_stats;
+            bridge_get_drop_stats(&drop_stats);
+            if (reason == watched_reason && drop_stats.drops[reason] != watched_drops)
+            {
+                ESP_LOGW(CAPTURE_LOG, "Triggered by a %s drop", bridge_drop_reason_name(reason));
+                atomic_compare_exchange_strong(&capture_trigger_reason, &reason, CAPTURE_NO_TRIGGER);
+                flush = true;
+            }
+            watched_drops = drop_stats.drops[reason];
+        }
+        watched_reason = reason;
+        if (flush)
+        {
+            capture_flush();
+        }
+    }
+}
+
+/**
+ * @brief Write the ring to the next capture file on SPIFFS
+ * @param None
+ * @retval ESP_OK on success
+ */
+static esp_err_t capture_flush(void)
+{
+    esp_err_t ret = ESP_OK;
+    if (!capture_mounted)
+    {
+        // Mounted on first use, formatting the partition the first time takes a while
+        const esp_vfs_spiffs_conf_t conf = {
+            .base_path = CAPTURE_BASE_PATH,
+            .partition_label = CAPTURE_PARTITION_LABEL,
+            .max_files = 2,
+            .format_if_mount_failed = true,
+        };
+        ret = esp_vfs_spiffs_register(&conf);
+        capture_mounted = ret == ESP_OK;
+    }
+    char path[sizeof(capture_last_file)];
+    if (ret == ESP_OK)
+    {
+        ret = capture_next_file(path, sizeof(path));
+    }
+    FILE *file = ret == ESP_OK ? fopen(path, "wb") : NULL;
+    if (file != NULL)
+    {
+        ret = capture_write_ring(file);
+        if (fclose(file) != 0)
+        {
+            ret = ESP_FAIL;
+        }
+    }
+    else if (ret == ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+    portENTER_CRITICAL(&capture_lock);
+    if (ret == ESP_OK)
+    {
+        capture_flushes++;
+        memcpy(capture_last_file, path, sizeof(capture_last_file));
+    }
+    else
+    {
+        capture_flush_errors++;
+    }
+    portEXIT_CRITICAL(&capture_lock);
+    if (ret == ESP_OK)
+    {
+        ESP_LOGI(CAPTURE_LOG, "Capture written to %s", path);
+    }
+    else
+    {
+        ESP_LOGE(CAPTURE_LOG, "Capture could not be written: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**
+ * @brief Write the records in the ring to a pcap file, oldest first. Capturing pauses meanwhile
+ * @param[in] file Open file
+ * @retval ESP_OK on success, ESP_FAIL on a write error
+ */
+static esp_err_t capture_write_ring(FILE *file)
+{
+    atomic_store(&capture_frozen, true);
+    // Let the receive paths that already passed the check finish their record. One that is still slower is
+    // caught by the sequence check below
+    vTaskDelay(1);
+    uint32_t head = atomic_load(&capture_head);
+    uint32_t count = head < CAPTURE_RECORDS ? head : CAPTURE_RECORDS;
+    // The records carry 32 bit esp_timer stamps, anchor them to the wall clock
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t wall_now_us = (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+    const capture_pcap_header_t header = {
+        .magic = CAPTURE_PCAP_MAGIC,
+        .version_major = 2,
+        .version_minor = 4,
+        .snaplen = CAPTURE_SNAPLEN,
+        .linktype = CAPTURE_PCAP_LINKTYPE_ETHERNET,
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint32_t index = head - count; ok && index != head; index++)
+    {
+        const capture_record_t *record = &capture_ring[index & (CAPTURE_RECORDS - 1)];
+        if (atomic_load_explicit(&record->seq, memory_order_acquire) != index + 1)
+        {
+            continue;
+        }
+        // Copy the record, then check that no receive path claimed it meanwhile, or the copy may be torn
+        uint32_t timestamp = record->timestamp;
+        uint16_t len = record->len;
+        uint16_t caplen = record->caplen;
+        uint8_t data[CAPTURE_SNAPLEN];
+        memcpy(data, record->data, caplen <= CAPTURE_SNAPLEN ? caplen : CAPTURE_SNAPLEN);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&record->seq, memory_order_relaxed) != index + 1 || caplen > CAPTURE_SNAPLEN)
+        {
+            continue;
+        }
+        int64_t wall_us = wall_now_us - (uint32_t)(now_us - timestamp);
+        const capture_pcap_record_t pcap_record = {
+            .ts_sec = (uint32_t)(wall_us / 1000000),
+            .ts_usec = (uint32_t)(wall_us % 1000000),
+            .incl_len = caplen,
+            .orig_len = len,
+        };
+        ok = fwrite(&pcap_record, sizeof(pcap_record), 1, file) == 1 && fwrite(data, 1, caplen, file) == caplen;
+    }
+    atomic_store(&capture_frozen, false);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * @brief Pick the file of the next capture. The files are used in turn, a sequence number in NVS survives reboots
+ *        so the oldest capture is overwritten first
+ * @param[out] path File path
+ * @param[in] size Size of path
+ * @retval ESP_OK on success
+ */
+static esp_err_t capture_next_file(char *path, size_t size)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(CAPTURE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    uint32_t seq = 0;
+    size_t length = sizeof(seq);
+    if (nvs_get_blob(handle, CAPTURE_NVS_KEY, &seq, &length) != ESP_OK || length != sizeof(seq))
+    {
+        seq = 0;
+    }
+    uint32_t next = seq + 1;
+    ret = nvs_set_blob(handle, CAPTURE_NVS_KEY, &next, sizeof(next));
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    snprintf(path, size, CAPTURE_BASE_PATH "/capture%lu.pcap", (unsigned long)(seq % CAPTURE_FILES));
+    return ret;
+}
+
+/**
+ * @brief "capture" console command
+ * @param[in] argc Argument count
+ * @param[in] argv Arguments
+ * @retval 0 on success
+ */
+static int capture_console(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        if (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0)
+        {
+            capture_set_enabled(strcmp(argv[1], "on") == 0);
+            return 0;
+        }
+        if (strcmp(argv[1], "flush") == 0)
+        {
+            capture_trigger();
+            return 0;
+        }
+        if (strcmp(argv[1], "trigger") == 0 && argc == 3)
+        {
+            for (int32_t reason = 0; reason < BRIDGE_DROP_REASON_MAX; reason++)
+            {
+                if (strcmp(argv[2], bridge_drop_reason_name(reason)) == 0)
+                {
+                    capture_set_trigger(reason);
+                    return 0;
+                }
+            }
+            if (strcmp(argv[2], "off") == 0)
+            {
+                capture_set_trigger(CAPTURE_NO_TRIGGER);
+                return 0;
+            }
+            printf("unknown drop reason %s\n", argv[2]);
+            return 1;
+        }
+        if (strcmp(argv[1], "rule") == 0)
+        {
+            return capture_console_rule(argc, argv);
+        }
+        printf("usage: capture [on|off|flush|trigger <drop reason>|off|rule <n> ...]\n");
+        return 1;
+    }
+    capture_status_t status;
+    capture_get_status(&status);
+    printf("capture %s, %lu frames captured, %lu filtered out, ring %u records of %u bytes\n", status.enabled ? "on" : "off",
+           (unsigned long)status.captured, (unsigned long)status.filtered, CAPTURE_RECORDS, CAPTURE_SNAPLEN);
+    printf("trigger %s, %lu flushes %lu errors, last file %s\n",
+           status.trigger == CAPTURE_NO_TRIGGER ? "off" : bridge_drop_reason_name(status.trigger),
+           (unsigned long)status.flushes, (unsigned long)status.flush_errors, status.last_file[0] != '\0' ? status.last_file : "none");
+    capture_rule_t rules[CAPTURE_RULE_NUM];
+    capture_get_rules(rules);
+    for (uint32_t i = 0; i < CAPTURE_RULE_NUM; i++)
+    {
+        const capture_rule_t *rule = &rules[i];
+        if (rule->points == 0)
+        {
+            continue;
+        }
+        printf("rule %lu: %s type 0x%04x proto %u port %u addr %02x:%02x:%02x:%02x:%02x:%02x\n", (unsigned long)i,
+               rule->points == (1u << CAPTURE_POINT_MAX) - 1 ? "any" : capture_point_names[rule->points >> 1],
+               rule->eth_type, rule->ip_proto, rule->port, rule->addr[0], rule->addr[1], rule->addr[2], rule->addr[3], rule->addr[4], rule->addr[5]);
+    }
+    return 0;
+}
+
+/**
+ * @brief "capture rule" console command
+ * @param[in] argc Argument count
+ * @param[in] argv Arguments, argv[2] is the rule index
+ * @retval 0 on success
+ */
+static int capture_console_rule(int argc, char **argv)
+{
+    capture_rule_t rule = {0};
+    char *end = NULL;
+    uint32_t index = argc > 3 ? strtoul(argv[2], &end, 0) : CAPTURE_RULE_NUM;
+    bool ok = end != NULL && *end == '\0' && index < CAPTURE_RULE_NUM;
+    if (ok && strcmp(argv[3], "off") != 0)
+    {
+        for (uint32_t point = 0; point < CAPTURE_POINT_MAX; point++)
+        {
+            if (strcmp(argv[3], capture_point_names[point]) == 0 || strcmp(argv[3], "any") == 0)
+            {
+                rule.points |= 1u << point;
+            }
+        }
+        ok = rule.points != 0;
+        for (int i = 4; ok && i < argc; i++)
+        {
+            char *value = strchr(argv[i], '=');
+            ok = value != NULL;
+            if (!ok)
+            {
+                break;
+            }
+            *value++ = '\0';
+            if (strcmp(argv[i], "addr") == 0)
+            {
+                ok = capture_parse_addr(value, rule.addr);
+                continue;
+            }
+            unsigned long number = strtoul(value, &end, 0);
+            ok = *end == '\0' && number <= UINT16_MAX;
+            if (strcmp(argv[i], "type") == 0)
+            {
+                rule.eth_type = (uint16_t)number;
+            }
+            else if (strcmp(argv[i], "proto") == 0 && number <= UINT8_MAX)
+            {
+                rule.ip_proto = (uint8_t)number;
+            }
+            else if (strcmp(argv[i], "port") == 0)
+            {
+                rule.port = (uint16_t)number;
+            }
+            else
+            {
+                ok = false;
+            }
+        }
+    }
+    if (!ok || capture_set_rule(index, &rule) != ESP_OK)
+    {
+        printf("usage: capture rule <0-%u> eth|wifi|any [type=<ethertype>] [proto=<ip proto>] [port=<port>] [addr=<mac>]\n"
+               "       capture rule <0-%u> off\n", CAPTURE_RULE_NUM - 1, CAPTURE_RULE_NUM - 1);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse a colon separated MAC address
+ * @param[in] text Address text
+ * @param[out] addr Address
+ * @retval true if the text is a valid address
+ */
+static bool capture_parse_addr(const char *text, uint8_t *addr)
+{
+    unsigned int bytes[CAPTURE_ADDR_LEN];
+    char extra;
+    if (sscanf(text, "%x:%x:%x:%x:%x:%x%c", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5], &extra) != CAPTURE_ADDR_LEN)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < CAPTURE_ADDR_LEN; i++)
+    {
+        if (bytes[i] > UINT8_MAX)
+        {
+            return false;
+        }
+        addr[i] = (uint8_t)bytes[i];
+    }
+    return true;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,59 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+/* Exported macro ------------------------------------------------------------*/
+#define CAPTURE_RECORDS CONFIG_WENET_CAPTURE_RECORDS
+#define CAPTURE_SNAPLEN CONFIG_WENET_CAPTURE_SNAPLEN
+#define CAPTURE_FILES CONFIG_WENET_CAPTURE_FILES
+#define CAPTURE_RULE_NUM 4
+#define CAPTURE_ADDR_LEN 6
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    CAPTURE_POINT_ETH_RX = 0, // Frame received on ethernet, before it is admitted
+    CAPTURE_POINT_WIFI_RX,    // Frame received from a wifi peer as sent over the air, with its tunnel header
+    CAPTURE_POINT_MAX,
+} capture_point_t;
+
+// A rule matches a frame when every non zero field matches. Without enabled rules every frame is captured,
+// otherwise the frames matching one of them
+typedef struct
+{
+    uint8_t points;                  // Mask of the capture points, bit n for capture_point_t n, 0 disables the rule
+    uint8_t ip_proto;                // IPv4 protocol or IPv6 next header, 0 for any
+    uint16_t eth_type;               // Ethertype behind an optional VLAN tag, 0 for any
+    uint16_t port;                   // TCP or UDP source or destination port, 0 for any
+    uint8_t addr[CAPTURE_ADDR_LEN];  // Source or destination address, all zero for any
+} capture_rule_t;
+
+typedef struct
+{
+    bool enabled;
+    uint32_t captured;     // Frames written to the ring since boot
+    uint32_t filtered;     // Frames no rule matched
+    uint32_t flushes;      // Captures written to SPIFFS
+    uint32_t flush_errors; // Captures that could not be written
+    int32_t trigger;       // Drop reason that flushes the ring, -1 for none
+    char last_file[32];    // File written by the last flush
+} capture_status_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void capture_init(void);
+void capture_frame(capture_point_t point, const uint8_t *frame, uint32_t len, uint32_t timestamp_us);
+void capture_set_enabled(bool enabled);
+esp_err_t capture_set_rule(uint32_t index, const capture_rule_t *rule);
+void capture_get_rules(capture_rule_t *rules);
+void capture_set_trigger(int32_t reason);
+void capture_trigger(void);
+void capture_get_status(capture_status_t *status);
+esp_err_t capture_register_console(void);
+#endif /* __CAPTURE_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,146 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "wenet_codel.h"
+/* Private macro -------------------------------------------------------------*/
+// Wrap safe comparison of microsecond timestamps
+#define CODEL_TIME_AFTER_EQ(a, b) ((int32_t)((a) - (b)) >= 0)
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+static bool codel_ok_to_drop(codel_t *codel, uint32_t sojourn, uint32_t now, uint32_t backlog);
+static uint32_t codel_control_law(const codel_t *codel, uint32_t t);
+static uint32_t codel_isqrt(uint64_t value);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize a CoDel controller
+ * @param[in] codel Controller state
+ * @param[in] target_us Target sojourn time
+ * @param[in] interval_us Control interval
+ * @retval
+ */
+void codel_init(codel_t *codel, uint32_t target_us, uint32_t interval_us)
+{
+    memset(codel, 0, sizeof(codel_t));
+    codel->target_us = target_us;
+    codel->interval_us = interval_us;
+}
+
+/**
+ * @brief Decide whether a dequeued frame has to be dropped (or ECN marked)
+ * @param[in] codel Controller state
+ * @param[in] enqueue_time Time the frame was queued
+ * @param[in] now Current time
+ * @param[in] backlog Number of frames still waiting behind this one
+ * @retval true if the frame has to be dropped
+ */
+bool codel_should_drop(codel_t *codel, uint32_t enqueue_time, uint32_t now, uint32_t backlog)
+{
+    bool ok_to_drop = codel_ok_to_drop(codel, now - enqueue_time, now, backlog);
+    if (codel->dropping)
+    {
+        if (!ok_to_drop)
+        {
+            // Sojourn time went below target, leave the dropping state
+            codel->dropping = false;
+            return false;
+        }
+        if (CODEL_TIME_AFTER_EQ(now, codel->drop_next))
+        {
+            codel->count++;
+            codel->drop_next = codel_control_law(codel, codel->drop_next);
+            codel->drops++;
+            return true;
+        }
+        return false;
+    }
+    if (ok_to_drop)
+    {
+        codel->dropping = true;
+        // Resume near the previous drop rate if the last dropping state ended recently
+        uint32_t delta = codel->count - codel->last_count;
+        if (delta > 1 && !CODEL_TIME_AFTER_EQ(now, codel->drop_next + 16 * codel->interval_us))
+        {
+            codel->count = delta;
+        }
+        else
+        {
+            codel->count = 1;
+        }
+        codel->last_count = codel->count;
+        codel->drop_next = codel_control_law(codel, now);
+        codel->drops++;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Check whether the queue delay has stayed above target for a whole interval
+ * @param[in] codel Controller state
+ * @param[in] sojourn Time the frame spent in the queue
+ * @param[in] now Current time
+ * @param[in] backlog Number of frames still waiting
+ * @retval true if the controller may drop
+ */
+static bool codel_ok_to_drop(codel_t *codel, uint32_t sojourn, uint32_t now, uint32_t backlog)
+{
+    // Never drop the last queued frame, there is no standing queue to control
+    if (sojourn < codel->target_us || backlog == 0)
+    {
+        codel->first_above_valid = false;
+        return false;
+    }
+    if (!codel->first_above_valid)
+    {
+        codel->first_above_time = now + codel->interval_us;
+        codel->first_above_valid = true;
+        return false;
+    }
+    return CODEL_TIME_AFTER_EQ(now, codel->first_above_time);
+}
+
+/**
+ * @brief Compute the next drop time, interval / sqrt(count) after t
+ * @param[in] codel Controller state
+ * @param[in] t Reference time
+ * @retval Next drop time
+ */
+static uint32_t codel_control_law(const codel_t *codel, uint32_t t)
+{
+    // interval / sqrt(count) == interval * 2^16 / sqrt(count * 2^32)
+    uint32_t root = codel_isqrt((uint64_t)codel->count << 32);
+    return t + (uint32_t)(((uint64_t)codel->interval_us << 16) / (root ? root : 1));
+}
+
+/**
+ * @brief Integer square root
+ * @param[in] value Radicand
+ * @retval floor(sqrt(value))
+ */
+static uint32_t codel_isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
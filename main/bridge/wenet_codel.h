@@ -0,0 +1,31 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CODEL_H
+#define __CODEL_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported types ------------------------------------------------------------*/
+// CoDel controller state (RFC 8289). All times are in microseconds and may wrap.
+typedef struct
+{
+    uint32_t target_us;   // Acceptable standing queue delay
+    uint32_t interval_us; // Window the delay has to stay above target before dropping starts
+    uint32_t first_above_time;
+    uint32_t drop_next;
+    uint32_t count;
+    uint32_t last_count;
+    bool first_above_valid;
+    bool dropping;
+    uint32_t drops; // Frames the controller asked to drop or mark
+} codel_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void codel_init(codel_t *codel, uint32_t target_us, uint32_t interval_us);
+bool codel_should_drop(codel_t *codel, uint32_t enqueue_time, uint32_t now, uint32_t backlog);
+#endif /* __CODEL_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,183 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "wenet_drr.h"
+/* Private macro -------------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+static void drr_deactivate(drr_t *drr, drr_flow_t *flow);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize a scheduler without flows
+ * @param[in] drr Scheduler
+ * @retval
+ */
+void drr_init(drr_t *drr)
+{
+    memset(drr, 0, sizeof(drr_t));
+}
+
+/**
+ * @brief Initialize an empty flow
+ * @param[in] flow Flow
+ * @param[in] quantum Bytes the flow may send per round, at least one maximum sized frame
+ * @retval
+ */
+void drr_flow_init(drr_flow_t *flow, uint32_t quantum)
+{
+    memset(flow, 0, sizeof(drr_flow_t));
+    flow->quantum = quantum;
+}
+
+/**
+ * @brief Append a frame to a flow. A flow that was empty joins the end of the round
+ * @param[in] drr Scheduler
+ * @param[in] flow Flow
+ * @param[in] raw_data Frame
+ * @retval
+ */
+void drr_enqueue(drr_t *drr, drr_flow_t *flow, raw_data_t *raw_data)
+{
+    raw_data->next = NULL;
+    if (flow->tail != NULL)
+    {
+        flow->tail->next = raw_data;
+    }
+    else
+    {
+        flow->head = raw_data;
+    }
+    flow->tail = raw_data;
+    flow->count++;
+    flow->bytes += raw_data->data_length;
+    drr->count++;
+    if (!flow->active)
+    {
+        flow->active = true;
+        flow->deficit = flow->quantum;
+        flow->next_active = NULL;
+        if (drr->active_tail != NULL)
+        {
+            drr->active_tail->next_active = flow;
+        }
+        else
+        {
+            drr->active_head = flow;
+        }
+        drr->active_tail = flow;
+    }
+}
+
+/**
+ * @brief Get the frame the scheduler sends next without taking it. Flows out of credit are moved to the
+ *        end of the round, exactly as drr_dequeue would do
+ * @param[in] drr Scheduler
+ * @param[out] flow Flow the frame belongs to
+ * @retval Frame, NULL if every flow is empty
+ */
+raw_data_t *drr_peek(drr_t *drr, drr_flow_t **flow)
+{
+    while (drr->active_head != NULL)
+    {
+        drr_flow_t *current = drr->active_head;
+        if ((int32_t)current->head->data_length <= current->deficit)
+        {
+            *flow = current;
+            return current->head;
+        }
+        // Out of credit for this round, move the flow to the end with a new quantum
+        current->deficit += current->quantum;
+        if (current->next_active != NULL)
+        {
+            drr->active_head = current->next_active;
+            current->next_active = NULL;
+            drr->active_tail->next_active = current;
+            drr->active_tail = current;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Take the next frame according to the deficit round robin order
+ * @param[in] drr Scheduler
+ * @param[out] flow Flow the frame was taken from
+ * @retval Frame, NULL if every flow is empty
+ */
+raw_data_t *drr_dequeue(drr_t *drr, drr_flow_t **flow)
+{
+    raw_data_t *raw_data = drr_peek(drr, flow);
+    if (raw_data == NULL)
+    {
+        return NULL;
+    }
+    (*flow)->deficit -= raw_data->data_length;
+    return drr_flow_pop(drr, *flow);
+}
+
+/**
+ * @brief Take the oldest frame of a flow regardless of the round robin order, e.g. to flush it
+ * @param[in] drr Scheduler
+ * @param[in] flow Flow
+ * @retval Frame, NULL if the flow is empty
+ */
+raw_data_t *drr_flow_pop(drr_t *drr, drr_flow_t *flow)
+{
+    raw_data_t *raw_data = flow->head;
+    if (raw_data == NULL)
+    {
+        return NULL;
+    }
+    flow->head = raw_data->next;
+    if (flow->head == NULL)
+    {
+        flow->tail = NULL;
+    }
+    raw_data->next = NULL;
+    flow->count--;
+    flow->bytes -= raw_data->data_length;
+    drr->count--;
+    if (flow->count == 0)
+    {
+        drr_deactivate(drr, flow);
+    }
+    return raw_data;
+}
+
+/**
+ * @brief Remove an empty flow from the active list
+ * @param[in] drr Scheduler
+ * @param[in] flow Flow
+ * @retval
+ */
+static void drr_deactivate(drr_t *drr, drr_flow_t *flow)
+{
+    drr_flow_t *previous = NULL;
+    for (drr_flow_t *current = drr->active_head; current != NULL; current = current->next_active)
+    {
+        if (current == flow)
+        {
+            if (previous != NULL)
+            {
+                previous->next_active = current->next_active;
+            }
+            else
+            {
+                drr->active_head = current->next_active;
+            }
+            if (drr->active_tail == current)
+            {
+                drr->active_tail = previous;
+            }
+            break;
+        }
+        previous = current;
+    }
+    flow->active = false;
+    flow->next_active = NULL;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,43 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DRR_H
+#define __DRR_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "wenet_pool.h"
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported types ------------------------------------------------------------*/
+// FIFO of frames linked through raw_data_t.next, scheduled by deficit round robin
+typedef struct drr_flow
+{
+    raw_data_t *head;
+    raw_data_t *tail;
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t quantum; // Bytes the flow may send per round
+    int32_t deficit;
+    bool active;
+    struct drr_flow *next_active;
+} drr_flow_t;
+
+// Deficit round robin scheduler (Shreedhar and Varghese) over the flows that have frames queued
+typedef struct
+{
+    drr_flow_t *active_head;
+    drr_flow_t *active_tail;
+    uint32_t count; // Frames queued over all flows
+} drr_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void drr_init(drr_t *drr);
+void drr_flow_init(drr_flow_t *flow, uint32_t quantum);
+void drr_enqueue(drr_t *drr, drr_flow_t *flow, raw_data_t *raw_data);
+raw_data_t *drr_peek(drr_t *drr, drr_flow_t **flow);
+raw_data_t *drr_dequeue(drr_t *drr, drr_flow_t **flow);
+raw_data_t *drr_flow_pop(drr_t *drr, drr_flow_t *flow);
+#endif /* __DRR_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,252 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "wenet_fdb.h"
+/* Private macro -------------------------------------------------------------*/
+#define FDB_PROBE_LEN 16
+#define FDB_IS_GROUP(addr) (((addr)[0] & 0x01) != 0)
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+static portMUX_TYPE fdb_lock = portMUX_INITIALIZER_UNLOCKED;
+static fdb_entry_t fdb_table[FDB_SIZE];
+static fdb_stats_t fdb_stats;
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t fdb_hash(const uint8_t *addr);
+static fdb_entry_t *fdb_find(const uint8_t *addr, uint32_t now);
+static void fdb_learn(const uint8_t *addr, fdb_port_t port, uint8_t peer, uint32_t now);
+static bool fdb_alive(const fdb_entry_t *entry, uint32_t now);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the forwarding database
+ * @param None
+ * @retval
+ */
+void fdb_init(void)
+{
+    portENTER_CRITICAL(&fdb_lock);
+    memset(fdb_table, 0, sizeof(fdb_table));
+    memset(&fdb_stats, 0, sizeof(fdb_stats));
+    portEXIT_CRITICAL(&fdb_lock);
+}
+
+/**
+ * @brief Forget every address learned on a port, e.g. when its link goes down or a wifi peer leaves
+ * @param[in] port Port to flush, FDB_PORT_NONE flushes all ports
+ * @param[in] peer Wifi peer to flush, FDB_PEER_ANY flushes all peers of the port
+ * @retval
+ */
+void fdb_flush(fdb_port_t port, uint8_t peer)
+{
+    portENTER_CRITICAL(&fdb_lock);
+    for (uint32_t i = 0; i < FDB_SIZE; i++)
+    {
+        if (port == FDB_PORT_NONE || (fdb_table[i].port == port && (peer == FDB_PEER_ANY || fdb_table[i].peer == peer)))
+        {
+            // Keep the slot marked as used so probe sequences running through it stay intact
+            fdb_table[i].port = FDB_PORT_NONE;
+        }
+    }
+    portEXIT_CRITICAL(&fdb_lock);
+}
+
+/**
+ * @brief Learn the source address of a frame and decide where it has to be forwarded
+ * @param[in] frame Ethernet frame starting at the destination address
+ * @param[in] ingress_port Port the frame was received on
+ * @param[in] ingress_peer Wifi peer the frame was received from, FDB_PEER_ANY for ethernet frames
+ * @param[out] egress_port Port of the destination, FDB_PORT_NONE if the frame has to be flooded
+ * @param[out] egress_peer Wifi peer of the destination, FDB_PEER_ANY if the frame has to be flooded
+ * @retval false if the destination is known to be behind the ingress port and the frame must be filtered
+ */
+bool fdb_forward(const uint8_t *frame, fdb_port_t ingress_port, uint8_t ingress_peer, fdb_port_t *egress_port, uint8_t *egress_peer)
+{
+    const uint8_t *dst = frame;
+    const uint8_t *src = frame + FDB_ADDR_LEN;
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    bool forward = true;
+    *egress_port = FDB_PORT_NONE;
+    *egress_peer = FDB_PEER_ANY;
+    portENTER_CRITICAL(&fdb_lock);
+    if (!FDB_IS_GROUP(src))
+    {
+        fdb_learn(src, ingress_port, ingress_peer, now);
+    }
+    if (!FDB_IS_GROUP(dst))
+    {
+        fdb_entry_t *entry = fdb_find(dst, now);
+        if (entry != NULL)
+        {
+            if (entry->port == ingress_port && entry->peer == ingress_peer)
+            {
+                fdb_stats.filtered[ingress_port]++;
+                forward = false;
+            }
+            else
+            {
+                *egress_port = entry->port;
+                *egress_peer = entry->peer;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&fdb_lock);
+    return forward;
+}
+
+/**
+ * @brief Look up the port an address was learned on
+ * @param[in] addr Address
+ * @param[out] peer Wifi peer the address is behind, FDB_PEER_ANY if it is not behind a wifi peer
+ * @retval Port, FDB_PORT_NONE if the address is unknown, aged out or a group address
+ */
+fdb_port_t fdb_lookup(const uint8_t *addr, uint8_t *peer)
+{
+    *peer = FDB_PEER_ANY;
+    if (FDB_IS_GROUP(addr))
+    {
+        return FDB_PORT_NONE;
+    }
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    fdb_port_t port = FDB_PORT_NONE;
+    portENTER_CRITICAL(&fdb_lock);
+    fdb_entry_t *entry = fdb_find(addr, now);
+    if (entry != NULL)
+    {
+        port = entry->port;
+        *peer = entry->peer;
+    }
+    portEXIT_CRITICAL(&fdb_lock);
+    return port;
+}
+
+/**
+ * @brief Get a snapshot of the forwarding database counters
+ * @param[out] stats Forwarding database counters
+ * @retval
+ */
+void fdb_get_stats(fdb_stats_t *stats)
+{
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    portENTER_CRITICAL(&fdb_lock);
+    *stats = fdb_stats;
+    stats->entries = 0;
+    for (uint32_t i = 0; i < FDB_SIZE; i++)
+    {
+        if (fdb_alive(&fdb_table[i], now))
+        {
+            stats->entries++;
+        }
+    }
+    portEXIT_CRITICAL(&fdb_lock);
+}
+
+/**
+ * @brief Hash an address to its first probe slot
+ * @param[in] addr Address
+ * @retval Slot index
+ */
+static uint32_t fdb_hash(const uint8_t *addr)
+{
+    // The vendor part is shared by many hosts, the low bytes carry most of the entropy
+    uint32_t hash = ((uint32_t)addr[3] << 16) | ((uint32_t)addr[4] << 8) | addr[5];
+    hash ^= (uint32_t)(addr[0] ^ addr[1] ^ addr[2]) << 7;
+    hash *= 2654435761u;
+    return (hash >> 8) % FDB_SIZE;
+}
+
+/**
+ * @brief Check whether an entry holds a live address
+ * @param[in] entry Entry
+ * @param[in] now Current time in seconds
+ * @retval true if the entry is valid and not aged out
+ */
+static bool fdb_alive(const fdb_entry_t *entry, uint32_t now)
+{
+    return entry->used && entry->port != FDB_PORT_NONE && (now - entry->last_seen) <= FDB_AGE_S;
+}
+
+/**
+ * @brief Find the live entry of an address. Must be called with fdb_lock held
+ * @param[in] addr Address
+ * @param[in] now Current time in seconds
+ * @retval Entry, NULL if the address is unknown or aged out
+ */
+static fdb_entry_t *fdb_find(const uint8_t *addr, uint32_t now)
+{
+    uint32_t slot = fdb_hash(addr);
+    for (uint32_t probe = 0; probe < FDB_PROBE_LEN; probe++)
+    {
+        fdb_entry_t *entry = &fdb_table[(slot + probe) % FDB_SIZE];
+        if (!entry->used)
+        {
+            return NULL;
+        }
+        if (memcmp(entry->addr, addr, FDB_ADDR_LEN) == 0)
+        {
+            return fdb_alive(entry, now) ? entry : NULL;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Learn or refresh the port of a source address. Must be called with fdb_lock held
+ * @param[in] addr Source address
+ * @param[in] port Port the address was seen on
+ * @param[in] peer Wifi peer the address was seen behind, FDB_PEER_ANY for ethernet hosts
+ * @param[in] now Current time in seconds
+ * @retval
+ */
+static void fdb_learn(const uint8_t *addr, fdb_port_t port, uint8_t peer, uint32_t now)
+{
+    uint32_t slot = fdb_hash(addr);
+    fdb_entry_t *reuse = NULL;
+    for (uint32_t probe = 0; probe < FDB_PROBE_LEN; probe++)
+    {
+        fdb_entry_t *entry = &fdb_table[(slot + probe) % FDB_SIZE];
+        if (!entry->used)
+        {
+            if (reuse == NULL)
+            {
+                reuse = entry;
+            }
+            break;
+        }
+        if (memcmp(entry->addr, addr, FDB_ADDR_LEN) == 0)
+        {
+            if (entry->port != port || entry->peer != peer)
+            {
+                if (fdb_alive(entry, now))
+                {
+                    fdb_stats.moved++;
+                }
+                else
+                {
+                    fdb_stats.learned++;
+                }
+                entry->port = port;
+                entry->peer = peer;
+            }
+            entry->last_seen = now;
+            return;
+        }
+        if (reuse == NULL && !fdb_alive(entry, now))
+        {
+            reuse = entry;
+        }
+    }
+    if (reuse == NULL)
+    {
+        fdb_stats.table_full++;
+        return;
+    }
+    memcpy(reuse->addr, addr, FDB_ADDR_LEN);
+    reuse->port = port;
+    reuse->peer = peer;
+    reuse->used = true;
+    reuse->last_seen = now;
+    fdb_stats.learned++;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
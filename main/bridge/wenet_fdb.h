@@ -0,0 +1,50 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FDB_H
+#define __FDB_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+/* Exported macro ------------------------------------------------------------*/
+#define FDB_ADDR_LEN 6
+#define FDB_SIZE CONFIG_WENET_FDB_SIZE
+#define FDB_AGE_S CONFIG_WENET_FDB_AGE_S
+// Any wifi peer, same value as RAW_DATA_PEER_ALL
+#define FDB_PEER_ANY 0xFF
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    FDB_PORT_NONE = 0, // Destination unknown or group address, the frame is flooded
+    FDB_PORT_ETH,      // Host on the wired segment
+    FDB_PORT_WIFI,     // Host behind one of the wifi peers
+} fdb_port_t;
+
+typedef struct
+{
+    uint8_t addr[FDB_ADDR_LEN];
+    uint8_t port;
+    uint8_t peer;       // Wifi peer the host is behind
+    bool used;          // Slot was ever used, ends a probe sequence when false
+    uint32_t last_seen; // Seconds
+} fdb_entry_t;
+
+typedef struct
+{
+    uint32_t entries;         // Live entries
+    uint32_t learned;         // New addresses learned
+    uint32_t moved;           // Addresses that moved to another port or wifi peer
+    uint32_t table_full;      // Addresses that found no slot
+    uint32_t filtered[3];     // Frames not forwarded because the destination is behind the ingress port, by ingress port
+} fdb_stats_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void fdb_init(void);
+void fdb_flush(fdb_port_t port, uint8_t peer);
+bool fdb_forward(const uint8_t *frame, fdb_port_t ingress_port, uint8_t ingress_peer, fdb_port_t *egress_port, uint8_t *egress_peer);
+fdb_port_t fdb_lookup(const uint8_t *addr, uint8_t *peer);
+void fdb_get_stats(fdb_stats_t *stats);
+#endif /* __FDB_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,604 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "wenet_filter.h"
+#include "wenet_bridge.h"
+/* Private macro -------------------------------------------------------------*/
+#define FILTER_LOG "FILTER"
+#define FILTER_NVS_NAMESPACE "wenet"
+#define FILTER_NVS_KEY "filter"
+#define FILTER_ADDR_LEN 6
+#define FILTER_NO_PEER 0xFF
+#define FILTER_TOKEN 1000 // Token bucket resolution, in thousandths of a frame
+#define FILTER_IP_PROTO_HOP_BY_HOP 0
+#define FILTER_IP_PROTO_IGMP 2
+#define FILTER_IGMP_V1_REPORT 0x12
+#define FILTER_IGMP_V2_REPORT 0x16
+#define FILTER_IGMP_LEAVE 0x17
+#define FILTER_IGMP_V3_REPORT 0x22
+#define FILTER_MLD_V1_REPORT 131
+#define FILTER_MLD_DONE 132
+#define FILTER_MLD_V2_REPORT 143
+// Group record types shared by IGMPv3 and MLDv2
+#define FILTER_RECORD_IS_INCLUDE 1
+#define FILTER_RECORD_TO_INCLUDE 3
+#define FILTER_RECORD_BLOCK_OLD 6
+/* Private typedef -----------------------------------------------------------*/
+// Membership of one wifi peer in one group, keyed by the group address the frames are sent to
+typedef struct
+{
+    uint8_t addr[FILTER_ADDR_LEN];
+    uint8_t peer; // FILTER_NO_PEER for a free entry
+    uint32_t last_seen; // Seconds
+} filter_group_t;
+
+typedef struct
+{
+    uint32_t tokens; // Thousandths of a frame
+    uint32_t last_refill; // Microseconds
+} filter_bucket_t;
+/* Private variables ---------------------------------------------------------*/
+static portMUX_TYPE filter_lock = portMUX_INITIALIZER_UNLOCKED;
+// Read without the lock on the fast path, a frame filtered during an update sees either the old or the new rule
+static filter_config_t filter_config;
+// Only used by the wifi send task
+static filter_bucket_t filter_buckets[FILTER_RULE_NUM];
+static filter_rule_stats_t filter_stats[FILTER_RULE_NUM];
+// Written by the wifi receive callback, read by the wifi send task, both under filter_lock
+static filter_group_t filter_groups[FILTER_GROUP_SIZE];
+static filter_group_stats_t filter_group_stats;
+/* Private function prototypes -----------------------------------------------*/
+static int32_t filter_match(const uint8_t *frame, uint32_t len, uint8_t *dest);
+static bool filter_take_token(uint32_t rule_index);
+static uint32_t filter_group_peers(const uint8_t *addr);
+static void filter_snoop_igmp(const uint8_t *igmp, uint32_t available, uint8_t peer);
+static void filter_snoop_mld(const uint8_t *icmp, uint32_t available, uint8_t peer);
+static void filter_group_update(uint8_t family, const uint8_t *group, uint8_t peer, bool join);
+static void filter_default_config(filter_config_t *config);
+static bool filter_valid_config(const filter_config_t *config);
+static esp_err_t filter_load_config(filter_config_t *config);
+static esp_err_t filter_save_config(const filter_config_t *config);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the broadcast and multicast rules from the configuration stored in NVS, or from the defaults
+ * @param None
+ * @retval
+ */
+void filter_init(void)
+{
+    filter_config_t config;
+    if (filter_load_config(&config) != ESP_OK)
+    {
+        filter_default_config(&config);
+    }
+    portENTER_CRITICAL(&filter_lock);
+    filter_config = config;
+    memset(filter_buckets, 0, sizeof(filter_buckets));
+    memset(filter_stats, 0, sizeof(filter_stats));
+    memset(filter_groups, FILTER_NO_PEER, sizeof(filter_groups));
+    memset(&filter_group_stats, 0, sizeof(filter_group_stats));
+    portEXIT_CRITICAL(&filter_lock);
+}
+
+/**
+ * @brief Select the wifi peers a flooded frame is sent to. Must only be called from the wifi send task
+ * @param[in] frame Ethernet frame starting at the destination address
+ * @param[in] len Frame length
+ * @param[in] peers Mask of the wifi peers the frame would be flooded to, bit n for peer n
+ * @retval Mask of the wifi peers to send the frame to, peers unchanged for unicast frames and frames no rule matches
+ */
+uint32_t filter_flood(const uint8_t *frame, uint32_t len, uint32_t peers)
+{
+    if ((frame[0] & 0x01) == 0)
+    {
+        return peers;
+    }
+    uint8_t dest;
+    int32_t rule_index = filter_match(frame, len, &dest);
+    if (rule_index < 0)
+    {
+        return peers;
+    }
+    uint32_t selected = peers;
+    switch (filter_config.rules[rule_index].action)
+    {
+    case FILTER_ACTION_DROP:
+        selected = 0;
+        break;
+    case FILTER_ACTION_LIMIT:
+        selected = filter_take_token(rule_index) ? peers : 0;
+        break;
+    case FILTER_ACTION_SUBSCRIBED:
+        // Link local groups (224.0.0.x, ff02::x) are not reported by every host, they always reach every peer
+        if (dest == FILTER_DEST_MULTICAST &&
+            !(frame[0] == 0x01 && frame[1] == 0x00 && frame[2] == 0x5E && frame[3] == 0 && frame[4] == 0) &&
+            !(frame[0] == 0x33 && frame[1] == 0x33 && frame[2] == 0 && frame[3] == 0 && frame[4] == 0))
+        {
+            selected = peers & filter_group_peers(frame);
+        }
+        break;
+    default:
+        break;
+    }
+    uint32_t suppressed = __builtin_popcount(peers & ~selected);
+    filter_rule_stats_t *stats = &filter_stats[rule_index];
+    stats->matched++;
+    stats->suppressed += suppressed;
+    stats->suppressed_bytes += suppressed * len;
+    stats->airtime_us += suppressed * bridge_airtime_us(len);
+    return selected;
+}
+
+/**
+ * @brief Learn the group memberships of the hosts behind a wifi peer from their IGMP and MLD reports
+ * @param[in] frame Ethernet frame received from the wifi peer
+ * @param[in] len Frame length
+ * @param[in] peer Wifi peer the frame was received from
+ * @retval
+ */
+void filter_snoop(const uint8_t *frame, uint32_t len, uint8_t peer)
+{
+    // Reports are sent to group addresses
+    if ((frame[0] & 0x01) == 0 || len < BRIDGE_ETH_TYPE_OFFSET + 2 || peer >= 32)
+    {
+        return;
+    }
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    uint16_t eth_type = (frame[offset] << 8) | frame[offset + 1];
+    offset += 2;
+    if (eth_type == BRIDGE_ETH_TYPE_VLAN && len >= offset + 4)
+    {
+        eth_type = (frame[offset + 2] << 8) | frame[offset + 3];
+        offset += 4;
+    }
+    const uint8_t *ip = frame + offset;
+    if (eth_type == BRIDGE_ETH_TYPE_IPV4 && len >= offset + 20 && ip[9] == FILTER_IP_PROTO_IGMP)
+    {
+        uint32_t header_len = (ip[0] & 0x0F) * 4;
+        if (len > offset + header_len)
+        {
+            filter_snoop_igmp(ip + header_len, len - offset - header_len, peer);
+        }
+    }
+    else if (eth_type == BRIDGE_ETH_TYPE_IPV6 && len >= offset + 40)
+    {
+        // MLD messages carry a router alert in a hop-by-hop options header
+        uint32_t header_len = 40;
+        uint8_t next_header = ip[6];
+        if (next_header == FILTER_IP_PROTO_HOP_BY_HOP && len >= offset + header_len + 2)
+        {
+            next_header = ip[header_len];
+            header_len += (ip[header_len + 1] + 1) * 8;
+        }
+        if (next_header == BRIDGE_IP_PROTO_ICMPV6 && len > offset + header_len)
+        {
+            filter_snoop_mld(ip + header_len, len - offset - header_len, peer);
+        }
+    }
+}
+
+/**
+ * @brief Forget the group memberships of a wifi peer that left
+ * @param[in] peer Wifi peer
+ * @retval
+ */
+void filter_flush_peer(uint8_t peer)
+{
+    portENTER_CRITICAL(&filter_lock);
+    for (uint32_t i = 0; i < FILTER_GROUP_SIZE; i++)
+    {
+        if (filter_groups[i].peer == peer)
+        {
+            filter_groups[i].peer = FILTER_NO_PEER;
+        }
+    }
+    portEXIT_CRITICAL(&filter_lock);
+}
+
+/**
+ * @brief Get the current broadcast and multicast rules
+ * @param[out] config Rules
+ * @retval
+ */
+void filter_get_config(filter_config_t *config)
+{
+    portENTER_CRITICAL(&filter_lock);
+    *config = filter_config;
+    portEXIT_CRITICAL(&filter_lock);
+}
+
+/**
+ * @brief Apply new broadcast and multicast rules and store them in NVS
+ * @param[in] config Rules
+ * @retval ESP_ERR_INVALID_ARG if a rule has an unknown destination class or action, or a limit rule has no rate
+ *         or burst, otherwise the result of storing the rules. The rules are applied even if storing fails
+ */
+esp_err_t filter_set_config(const filter_config_t *config)
+{
+    if (!filter_valid_config(config))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&filter_lock);
+    filter_config = *config;
+    portEXIT_CRITICAL(&filter_lock);
+    return filter_save_config(config);
+}
+
+/**
+ * @brief Get a snapshot of the rule and group membership counters
+ * @param[out] stats FILTER_RULE_NUM rule counters
+ * @param[out] group_stats Group membership counters
+ * @retval
+ */
+void filter_get_stats(filter_rule_stats_t *stats, filter_group_stats_t *group_stats)
+{
+    memcpy(stats, filter_stats, sizeof(filter_stats));
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    portENTER_CRITICAL(&filter_lock);
+    *group_stats = filter_group_stats;
+    group_stats->groups = 0;
+    for (uint32_t i = 0; i < FILTER_GROUP_SIZE; i++)
+    {
+        if (filter_groups[i].peer != FILTER_NO_PEER && (now - filter_groups[i].last_seen) <= FILTER_GROUP_AGE_S)
+        {
+            group_stats->groups++;
+        }
+    }
+    portEXIT_CRITICAL(&filter_lock);
+}
+
+/**
+ * @brief Find the first rule matching a broadcast or multicast frame
+ * @param[in] frame Ethernet frame starting at the destination address
+ * @param[in] len Frame length
+ * @param[out] dest FILTER_DEST_BROADCAST or FILTER_DEST_MULTICAST
+ * @retval Rule index, -1 if no rule matches
+ */
+static int32_t filter_match(const uint8_t *frame, uint32_t len, uint8_t *dest)
+{
+    static const uint8_t broadcast[FILTER_ADDR_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    *dest = memcmp(frame, broadcast, FILTER_ADDR_LEN) == 0 ? FILTER_DEST_BROADCAST : FILTER_DEST_MULTICAST;
+    uint16_t eth_type = 0;
+    uint8_t ip_proto = 0;
+    uint16_t dst_port = 0;
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    if (len >= offset + 2)
+    {
+        eth_type = (frame[offset] << 8) | frame[offset + 1];
+        offset += 2;
+        if (eth_type == BRIDGE_ETH_TYPE_VLAN && len >= offset + 4)
+        {
+            eth_type = (frame[offset + 2] << 8) | frame[offset + 3];
+            offset += 4;
+        }
+    }
+    const uint8_t *ip = frame + offset;
+    uint32_t header_len = 0;
+    if (eth_type == BRIDGE_ETH_TYPE_IPV4 && len >= offset + 20)
+    {
+        ip_proto = ip[9];
+        // Only the first fragment carries the UDP header
+        header_len = (((ip[6] & 0x1F) << 8) | ip[7]) == 0 ? (ip[0] & 0x0F) * 4 : 0;
+    }
+    else if (eth_type == BRIDGE_ETH_TYPE_IPV6 && len >= offset + 40)
+    {
+        ip_proto = ip[6];
+        header_len = 40;
+    }
+    if (ip_proto == BRIDGE_IP_PROTO_UDP && header_len > 0 && len >= offset + header_len + 4)
+    {
+        dst_port = (ip[header_len + 2] << 8) | ip[header_len + 3];
+    }
+    for (uint32_t i = 0; i < FILTER_RULE_NUM; i++)
+    {
+        const filter_rule_t *rule = &filter_config.rules[i];
+        if ((rule->dest & *dest) != 0 && (rule->eth_type == 0 || rule->eth_type == eth_type) &&
+            (rule->ip_proto == 0 || rule->ip_proto == ip_proto) && (rule->dst_port == 0 || rule->dst_port == dst_port))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Take one frame from the token bucket of a limit rule
+ * @param[in] rule_index Rule index
+ * @retval true if the frame is within the rate of the rule
+ */
+static bool filter_take_token(uint32_t rule_index)
+{
+    const filter_rule_t *rule = &filter_config.rules[rule_index];
+    filter_bucket_t *bucket = &filter_buckets[rule_index];
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint64_t tokens = bucket->tokens + (uint64_t)(now - bucket->last_refill) * rule->rate * FILTER_TOKEN / 1000000;
+    uint64_t burst = (uint64_t)rule->burst * FILTER_TOKEN;
+    bucket->tokens = (uint32_t)(tokens < burst ? tokens : burst);
+    bucket->last_refill = now;
+    if (bucket->tokens < FILTER_TOKEN)
+    {
+        return false;
+    }
+    bucket->tokens -= FILTER_TOKEN;
+    return true;
+}
+
+/**
+ * @brief Get the wifi peers with a live member of a group
+ * @param[in] addr Group address
+ * @retval Mask of the wifi peers, bit n for peer n
+ */
+static uint32_t filter_group_peers(const uint8_t *addr)
+{
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    uint32_t peers = 0;
+    portENTER_CRITICAL(&filter_lock);
+    for (uint32_t i = 0; i < FILTER_GROUP_SIZE; i++)
+    {
+        const filter_group_t *group = &filter_groups[i];
+        if (group->peer != FILTER_NO_PEER && (now - group->last_seen) <= FILTER_GROUP_AGE_S &&
+            memcmp(group->addr, addr, FILTER_ADDR_LEN) == 0)
+        {
+            peers |= 1u << group->peer;
+        }
+    }
+    portEXIT_CRITICAL(&filter_lock);
+    return peers;
+}
+
+/**
+ * @brief Learn the memberships announced by an IGMP message
+ * @param[in] igmp IGMP header
+ * @param[in] available Bytes available from the start of the IGMP header
+ * @param[in] peer Wifi peer the message was received from
+ * @retval
+ */
+static void filter_snoop_igmp(const uint8_t *igmp, uint32_t available, uint8_t peer)
+{
+    if (available < 8)
+    {
+        return;
+    }
+    switch (igmp[0])
+    {
+    case FILTER_IGMP_V1_REPORT:
+    case FILTER_IGMP_V2_REPORT:
+        filter_group_update(4, igmp + 4, peer, true);
+        break;
+    case FILTER_IGMP_LEAVE:
+        filter_group_update(4, igmp + 4, peer, false);
+        break;
+    case FILTER_IGMP_V3_REPORT:
+    {
+        uint32_t records = (igmp[6] << 8) | igmp[7];
+        uint32_t pos = 8;
+        for (uint32_t i = 0; i < records && pos + 8 <= available; i++)
+        {
+            const uint8_t *record = igmp + pos;
+            uint32_t sources = (record[2] << 8) | record[3];
+            if (record[0] != FILTER_RECORD_BLOCK_OLD)
+            {
+                // Including no source at all is how IGMPv3 leaves a group
+                bool leave = (record[0] == FILTER_RECORD_IS_INCLUDE || record[0] == FILTER_RECORD_TO_INCLUDE) && sources == 0;
+                filter_group_update(4, record + 4, peer, !leave);
+            }
+            pos += 8 + sources * 4 + record[1] * 4;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Learn the memberships announced by an MLD message
+ * @param[in] icmp ICMPv6 header
+ * @param[in] available Bytes available from the start of the ICMPv6 header
+ * @param[in] peer Wifi peer the message was received from
+ * @retval
+ */
+static void filter_snoop_mld(const uint8_t *icmp, uint32_t available, uint8_t peer)
+{
+    if (available < 8)
+    {
+        return;
+    }
+    switch (icmp[0])
+    {
+    case FILTER_MLD_V1_REPORT:
+    case FILTER_MLD_DONE:
+        if (available >= 24)
+        {
+            filter_group_update(6, icmp + 8, peer, icmp[0] == FILTER_MLD_V1_REPORT);
+        }
+        break;
+    case FILTER_MLD_V2_REPORT:
+    {
+        uint32_t records = (icmp[6] << 8) | icmp[7];
+        uint32_t pos = 8;
+        for (uint32_t i = 0; i < records && pos + 20 <= available; i++)
+        {
+            const uint8_t *record = icmp + pos;
+            uint32_t sources = (record[2] << 8) | record[3];
+            if (record[0] != FILTER_RECORD_BLOCK_OLD)
+            {
+                bool leave = (record[0] == FILTER_RECORD_IS_INCLUDE || record[0] == FILTER_RECORD_TO_INCLUDE) && sources == 0;
+                filter_group_update(6, record + 4, peer, !leave);
+            }
+            pos += 20 + sources * 16 + record[1] * 4;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Add, refresh or remove the membership of a wifi peer in a group
+ * @param[in] family 4 or 6
+ * @param[in] group IPv4 or IPv6 group address
+ * @param[in] peer Wifi peer
+ * @param[in] join true to join the group, false to leave it
+ * @retval
+ */
+static void filter_group_update(uint8_t family, const uint8_t *group, uint8_t peer, bool join)
+{
+    // Frames are matched by the group address they are sent to, which is derived from the low group bits
+    uint8_t addr[FILTER_ADDR_LEN];
+    if (family == 4)
+    {
+        addr[0] = 0x01;
+        addr[1] = 0x00;
+        addr[2] = 0x5E;
+        addr[3] = group[1] & 0x7F;
+        addr[4] = group[2];
+        addr[5] = group[3];
+    }
+    else
+    {
+        addr[0] = 0x33;
+        addr[1] = 0x33;
+        memcpy(addr + 2, group + 12, 4);
+    }
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+    filter_group_t *entry = NULL;
+    filter_group_t *reuse = NULL;
+    portENTER_CRITICAL(&filter_lock);
+    for (uint32_t i = 0; i < FILTER_GROUP_SIZE; i++)
+    {
+        filter_group_t *candidate = &filter_groups[i];
+        if (candidate->peer == peer && memcmp(candidate->addr, addr, FILTER_ADDR_LEN) == 0)
+        {
+            entry = candidate;
+            break;
+        }
+        if (reuse == NULL && (candidate->peer == FILTER_NO_PEER || (now - candidate->last_seen) > FILTER_GROUP_AGE_S))
+        {
+            reuse = candidate;
+        }
+    }
+    if (!join)
+    {
+        if (entry != NULL)
+        {
+            entry->peer = FILTER_NO_PEER;
+        }
+        filter_group_stats.leaves++;
+    }
+    else
+    {
+        if (entry == NULL && reuse != NULL)
+        {
+            entry = reuse;
+            memcpy(entry->addr, addr, FILTER_ADDR_LEN);
+            entry->peer = peer;
+        }
+        if (entry != NULL)
+        {
+            entry->last_seen = now;
+            filter_group_stats.joins++;
+        }
+        else
+        {
+            filter_group_stats.table_full++;
+        }
+    }
+    portEXIT_CRITICAL(&filter_lock);
+}
+
+/**
+ * @brief Fill in the default rules: mDNS and SSDP rate limited, DHCP passed, other UDP broadcasts rate limited
+ *        and IPv4 multicast sent only to the wifi peers with group members
+ * @param[out] config Rules
+ * @retval
+ */
+static void filter_default_config(filter_config_t *config)
+{
+    memset(config, 0, sizeof(filter_config_t));
+    config->rules[0] = (filter_rule_t){.dest = FILTER_DEST_MULTICAST, .action = FILTER_ACTION_LIMIT,
+                                       .ip_proto = BRIDGE_IP_PROTO_UDP, .dst_port = 5353, .rate = 20, .burst = 40};
+    config->rules[1] = (filter_rule_t){.dest = FILTER_DEST_MULTICAST, .action = FILTER_ACTION_LIMIT,
+                                       .ip_proto = BRIDGE_IP_PROTO_UDP, .dst_port = 1900, .rate = 10, .burst = 20};
+    config->rules[2] = (filter_rule_t){.dest = FILTER_DEST_BROADCAST, .action = FILTER_ACTION_PASS,
+                                       .ip_proto = BRIDGE_IP_PROTO_UDP, .eth_type = BRIDGE_ETH_TYPE_IPV4, .dst_port = 67};
+    config->rules[3] = (filter_rule_t){.dest = FILTER_DEST_BROADCAST, .action = FILTER_ACTION_LIMIT,
+                                       .ip_proto = BRIDGE_IP_PROTO_UDP, .eth_type = BRIDGE_ETH_TYPE_IPV4, .rate = 20, .burst = 40};
+    config->rules[4] = (filter_rule_t){.dest = FILTER_DEST_MULTICAST, .action = FILTER_ACTION_SUBSCRIBED,
+                                       .eth_type = BRIDGE_ETH_TYPE_IPV4};
+}
+
+/**
+ * @brief Check a rule set
+ * @param[in] config Rules
+ * @retval true if every rule has a known destination class and action, and every limit rule a rate and a burst
+ */
+static bool filter_valid_config(const filter_config_t *config)
+{
+    for (uint32_t i = 0; i < FILTER_RULE_NUM; i++)
+    {
+        const filter_rule_t *rule = &config->rules[i];
+        if ((rule->dest & ~(FILTER_DEST_BROADCAST | FILTER_DEST_MULTICAST)) != 0 || rule->action >= FILTER_ACTION_MAX)
+        {
+            return false;
+        }
+        if (rule->action == FILTER_ACTION_LIMIT && (rule->rate == 0 || rule->burst == 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Read the broadcast and multicast rules from NVS
+ * @param[out] config Rules
+ * @retval ESP_OK if a valid rule set was found
+ */
+static esp_err_t filter_load_config(filter_config_t *config)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(FILTER_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    size_t length = sizeof(filter_config_t);
+    ret = nvs_get_blob(handle, FILTER_NVS_KEY, config, &length);
+    nvs_close(handle);
+    if (ret == ESP_OK && (length != sizeof(filter_config_t) || !filter_valid_config(config)))
+    {
+        ESP_LOGW(FILTER_LOG, "Ignoring invalid broadcast rules in NVS");
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    return ret;
+}
+
+/**
+ * @brief Write the broadcast and multicast rules to NVS
+ * @param[in] config Rules
+ * @retval ESP_OK on success
+ */
+static esp_err_t filter_save_config(const filter_config_t *config)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(FILTER_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_set_blob(handle, FILTER_NVS_KEY, config, sizeof(filter_config_t));
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,72 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FILTER_H
+#define __FILTER_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+/* Exported macro ------------------------------------------------------------*/
+#define FILTER_RULE_NUM 8
+#define FILTER_GROUP_SIZE CONFIG_WENET_FILTER_GROUP_SIZE
+#define FILTER_GROUP_AGE_S CONFIG_WENET_FILTER_GROUP_AGE_S
+// Destination classes a rule applies to
+#define FILTER_DEST_BROADCAST 0x01
+#define FILTER_DEST_MULTICAST 0x02
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    FILTER_ACTION_PASS = 0,   // Send to every wifi peer
+    FILTER_ACTION_DROP,       // Send to no wifi peer
+    FILTER_ACTION_LIMIT,      // Send to every wifi peer up to rate frames per second, drop the excess
+    FILTER_ACTION_SUBSCRIBED, // Send a multicast frame only to the wifi peers with a member of its group
+    FILTER_ACTION_MAX,
+} filter_action_t;
+
+// A rule matches a broadcast or multicast frame when every non zero field matches, the first matching rule applies
+typedef struct
+{
+    uint8_t dest;      // FILTER_DEST_* mask, 0 disables the rule
+    uint8_t action;    // filter_action_t
+    uint8_t ip_proto;  // IPv4 protocol or IPv6 next header, 0 for any
+    uint8_t reserved;
+    uint16_t eth_type; // Ethertype behind an optional VLAN tag, 0 for any
+    uint16_t dst_port; // UDP destination port, 0 for any
+    uint16_t rate;     // Frames per second of a limit rule
+    uint16_t burst;    // Frames a limit rule lets through back to back
+} filter_rule_t;
+
+typedef struct
+{
+    filter_rule_t rules[FILTER_RULE_NUM];
+} filter_config_t;
+
+typedef struct
+{
+    uint32_t matched;          // Frames that matched the rule
+    uint32_t suppressed;       // Copies to wifi peers the rule did not send
+    uint32_t suppressed_bytes; // Bytes of these copies
+    uint32_t airtime_us;       // Estimated airtime saved
+} filter_rule_stats_t;
+
+typedef struct
+{
+    uint32_t groups;     // Live group memberships of wifi peers
+    uint32_t joins;      // Memberships reported by wifi peers
+    uint32_t leaves;     // Memberships left by wifi peers
+    uint32_t table_full; // Memberships that found no entry
+} filter_group_stats_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void filter_init(void);
+uint32_t filter_flood(const uint8_t *frame, uint32_t len, uint32_t peers);
+void filter_snoop(const uint8_t *frame, uint32_t len, uint8_t peer);
+void filter_flush_peer(uint8_t peer);
+void filter_get_config(filter_config_t *config);
+esp_err_t filter_set_config(const filter_config_t *config);
+void filter_get_stats(filter_rule_stats_t *stats, filter_group_stats_t *group_stats);
+#endif /* __FILTER_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,217 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "wenet_pool.h"
+/* Private macro -------------------------------------------------------------*/
+#define POOL_LOG "POOL"
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static raw_data_t pool_descs[POOL_DESC_NUM];
+static raw_data_t *desc_free_list[POOL_DESC_NUM];
+static uint8_t *pool_bufs = NULL;
+static uint8_t *buf_free_list[POOL_BUF_NUM];
+static pool_stats_t pool_stats;
+/* Private function prototypes -----------------------------------------------*/
+static bool pool_owns_buf(const void *buffer);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the frame pool. Descriptors are static and buffers are taken from internal RAM once
+ * @param None
+ * @retval
+ *          - ESP_OK on success
+ *          - ESP_ERR_NO_MEM if the buffer area could not be allocated
+ */
+esp_err_t pool_init(void)
+{
+    if (pool_bufs == NULL)
+    {
+        pool_bufs = heap_caps_malloc(POOL_BUF_NUM * POOL_BUF_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (pool_bufs == NULL)
+        {
+            ESP_LOGE(POOL_LOG, "Unable to allocate %d frame buffers", POOL_BUF_NUM);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    portENTER_CRITICAL(&pool_lock);
+    for (uint32_t i = 0; i < POOL_DESC_NUM; i++)
+    {
+        desc_free_list[i] = &pool_descs[i];
+    }
+    for (uint32_t i = 0; i < POOL_BUF_NUM; i++)
+    {
+        buf_free_list[i] = pool_bufs + (i * POOL_BUF_SIZE);
+    }
+    memset(&pool_stats, 0, sizeof(pool_stats));
+    pool_stats.desc_free = pool_stats.desc_min_free = POOL_DESC_NUM;
+    pool_stats.buf_free = pool_stats.buf_min_free = POOL_BUF_NUM;
+    portEXIT_CRITICAL(&pool_lock);
+    ESP_LOGI(POOL_LOG, "Frame pool ready, %d descriptors, %d buffers of %d bytes", POOL_DESC_NUM, POOL_BUF_NUM, POOL_BUF_SIZE);
+    return ESP_OK;
+}
+
+/**
+ * @brief Take a frame descriptor from the pool
+ * @param None
+ * @retval Cleared descriptor, NULL if the pool is exhausted
+ */
+raw_data_t *pool_alloc_desc(void)
+{
+    raw_data_t *raw_data = NULL;
+    portENTER_CRITICAL(&pool_lock);
+    if (pool_stats.desc_free > 0)
+    {
+        raw_data = desc_free_list[--pool_stats.desc_free];
+        if (pool_stats.desc_free < pool_stats.desc_min_free)
+        {
+            pool_stats.desc_min_free = pool_stats.desc_free;
+        }
+    }
+    else
+    {
+        pool_stats.desc_exhausted++;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+    if (raw_data != NULL)
+    {
+        memset(raw_data, 0, sizeof(raw_data_t));
+        raw_data->peer = RAW_DATA_PEER_ALL;
+        raw_data->ingress_peer = RAW_DATA_PEER_ALL;
+    }
+    return raw_data;
+}
+
+/**
+ * @brief Return a frame descriptor to the pool. The frame buffer is not touched
+ * @param[in] raw_data Descriptor taken with pool_alloc_desc
+ * @retval
+ */
+void pool_free_desc(raw_data_t *raw_data)
+{
+    if (raw_data == NULL)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&pool_lock);
+    desc_free_list[pool_stats.desc_free++] = raw_data;
+    portEXIT_CRITICAL(&pool_lock);
+}
+
+/**
+ * @brief Take a POOL_BUF_SIZE frame buffer from the pool
+ * @param None
+ * @retval Frame buffer, NULL if the pool is exhausted
+ */
+uint8_t *pool_alloc_buf(void)
+{
+    uint8_t *buffer = NULL;
+    portENTER_CRITICAL(&pool_lock);
+    if (pool_stats.buf_free > 0)
+    {
+        buffer = buf_free_list[--pool_stats.buf_free];
+        if (pool_stats.buf_free < pool_stats.buf_min_free)
+        {
+            pool_stats.buf_min_free = pool_stats.buf_free;
+        }
+    }
+    else
+    {
+        pool_stats.buf_exhausted++;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+    return buffer;
+}
+
+/**
+ * @brief Release a frame buffer. Buffers which do not belong to the pool are returned to the heap
+ * @param[in] buffer Frame buffer
+ * @retval
+ */
+void pool_free_buf(void *buffer)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+    if (!pool_owns_buf(buffer))
+    {
+        free(buffer);
+        return;
+    }
+    portENTER_CRITICAL(&pool_lock);
+    buf_free_list[pool_stats.buf_free++] = buffer;
+    portEXIT_CRITICAL(&pool_lock);
+}
+
+/**
+ * @brief Release a frame descriptor together with its frame buffer
+ * @param[in] raw_data Descriptor taken with pool_alloc_desc
+ * @retval
+ */
+void pool_release(raw_data_t *raw_data)
+{
+    if (raw_data == NULL)
+    {
+        return;
+    }
+    pool_free_buf(raw_data->data);
+    pool_free_desc(raw_data);
+}
+
+/**
+ * @brief Copy a frame into a new pool descriptor and buffer, e.g. to send it to several wifi peers
+ * @param[in] raw_data Frame to copy
+ * @retval Copy of the frame, NULL if the pool is exhausted or the frame does not fit a pool buffer
+ */
+raw_data_t *pool_clone(const raw_data_t *raw_data)
+{
+    if (raw_data->data_length > POOL_BUF_SIZE)
+    {
+        return NULL;
+    }
+    raw_data_t *clone = pool_alloc_desc();
+    if (clone == NULL)
+    {
+        return NULL;
+    }
+    uint8_t *buffer = pool_alloc_buf();
+    if (buffer == NULL)
+    {
+        pool_free_desc(clone);
+        return NULL;
+    }
+    memcpy(buffer, raw_data->data, raw_data->data_length);
+    *clone = *raw_data;
+    clone->data = buffer;
+    clone->eb = NULL;
+    clone->next = NULL;
+    return clone;
+}
+
+/**
+ * @brief Get a snapshot of the pool usage counters
+ * @param[out] stats Pool counters
+ * @retval
+ */
+void pool_get_stats(pool_stats_t *stats)
+{
+    portENTER_CRITICAL(&pool_lock);
+    *stats = pool_stats;
+    portEXIT_CRITICAL(&pool_lock);
+}
+
+/**
+ * @brief Check whether a buffer lies inside the pool buffer area
+ * @param[in] buffer Frame buffer
+ * @retval true if the buffer was taken from the pool
+ */
+static bool pool_owns_buf(const void *buffer)
+{
+    const uint8_t *ptr = buffer;
+    return pool_bufs != NULL && ptr >= pool_bufs && ptr < pool_bufs + (POOL_BUF_NUM * POOL_BUF_SIZE);
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
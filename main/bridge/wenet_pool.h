@@ -0,0 +1,53 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __POOL_H
+#define __POOL_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+/* Exported macro ------------------------------------------------------------*/
+// Largest ethernet frame (VLAN tagged, without FCS) plus the worst case tunnel encapsulation, rounded to a word
+#define POOL_BUF_SIZE 1544
+#define POOL_DESC_NUM CONFIG_WENET_POOL_DESC_NUM
+#define POOL_BUF_NUM CONFIG_WENET_POOL_BUF_NUM
+// Peer value of a frame that is flooded to every wifi peer, or that was not received from a wifi peer
+#define RAW_DATA_PEER_ALL 0xFF
+/* Exported types ------------------------------------------------------------*/
+typedef struct raw_data
+{
+    void *data;
+    void *eb;
+    uint32_t data_length;
+    uint32_t timestamp;    // Ingress time in microseconds
+    struct raw_data *next; // Link in the queue currently holding the frame
+    uint8_t peer;          // Egress wifi peer, RAW_DATA_PEER_ALL to flood
+    uint8_t ingress_peer;  // Wifi peer the frame came from, RAW_DATA_PEER_ALL for ethernet frames
+    uint8_t qos_class;     // Traffic class assigned by the classifier
+    uint8_t ack_slot;      // ACK filter slot of a queued pure TCP ACK plus one, 0 if the filter does not track it
+} raw_data_t;
+
+typedef struct
+{
+    uint32_t desc_free;      // Descriptors currently free
+    uint32_t desc_min_free;  // Lowest number of free descriptors seen
+    uint32_t desc_exhausted; // Descriptor allocations that failed
+    uint32_t buf_free;       // Buffers currently free
+    uint32_t buf_min_free;   // Lowest number of free buffers seen
+    uint32_t buf_exhausted;  // Buffer allocations that failed
+} pool_stats_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+esp_err_t pool_init(void);
+raw_data_t *pool_alloc_desc(void);
+void pool_free_desc(raw_data_t *raw_data);
+uint8_t *pool_alloc_buf(void);
+void pool_free_buf(void *buffer);
+void pool_release(raw_data_t *raw_data);
+raw_data_t *pool_clone(const raw_data_t *raw_data);
+void pool_get_stats(pool_stats_t *stats);
+#endif /* __POOL_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,400 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "wenet_qos.h"
+#include "wenet_bridge.h"
+/* Private macro -------------------------------------------------------------*/
+#define QOS_LOG "QOS"
+#define QOS_NVS_NAMESPACE "wenet"
+#define QOS_NVS_KEY "qos"
+#define QOS_IP_PROTO_UDP 17
+#define QOS_PTP_EVENT_PORT 319
+#define QOS_PTP_GENERAL_PORT 320
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+static portMUX_TYPE qos_lock = portMUX_INITIALIZER_UNLOCKED;
+// Read without the lock on the fast paths, a frame classified during an update gets either the old or the new class
+static qos_config_t qos_config;
+// Only written by the wifi send task
+static qos_class_stats_t qos_stats[QOS_CLASS_NUM];
+static const char *const qos_class_names[QOS_CLASS_NUM] = {
+    [QOS_CLASS_CONTROL] = "control",
+    [QOS_CLASS_REALTIME] = "realtime",
+    [QOS_CLASS_BEST_EFFORT] = "best_effort",
+    [QOS_CLASS_BACKGROUND] = "background",
+};
+/* Private function prototypes -----------------------------------------------*/
+static void qos_default_config(qos_config_t *config);
+static bool qos_valid_config(const qos_config_t *config);
+static esp_err_t qos_load_config(qos_config_t *config);
+static esp_err_t qos_save_config(const qos_config_t *config);
+static bool qos_is_ptp_port(const uint8_t *udp, uint32_t available);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the traffic classes from the configuration stored in NVS, or from the defaults
+ * @param None
+ * @retval
+ */
+void qos_init(void)
+{
+    qos_config_t config;
+    if (qos_load_config(&config) != ESP_OK)
+    {
+        qos_default_config(&config);
+    }
+    portENTER_CRITICAL(&qos_lock);
+    qos_config = config;
+    memset(qos_stats, 0, sizeof(qos_stats));
+    portEXIT_CRITICAL(&qos_lock);
+}
+
+/**
+ * @brief Classify an ethernet frame by its control ethertype, 802.1p priority and IP DSCP.
+ *        A tagged IP frame gets the higher priority class of its PCP and its DSCP
+ * @param[in] frame Ethernet frame starting at the destination address
+ * @param[in] len Frame length
+ * @retval Traffic class
+ */
+qos_class_t qos_classify(const uint8_t *frame, uint32_t len)
+{
+    uint32_t offset = BRIDGE_ETH_TYPE_OFFSET;
+    if (len < offset + 2)
+    {
+        return QOS_CLASS_BEST_EFFORT;
+    }
+    qos_class_t qos_class = QOS_CLASS_BEST_EFFORT;
+    bool tagged = false;
+    uint16_t eth_type = (frame[offset] << 8) | frame[offset + 1];
+    offset += 2;
+    if (eth_type == BRIDGE_ETH_TYPE_VLAN && len >= offset + 4)
+    {
+        qos_class = qos_config.pcp_map[frame[offset] >> 5];
+        tagged = true;
+        eth_type = (frame[offset + 2] << 8) | frame[offset + 3];
+        offset += 4;
+    }
+    const uint8_t *ip = frame + offset;
+    uint8_t dscp;
+    switch (eth_type)
+    {
+    case BRIDGE_ETH_TYPE_ARP:
+    case BRIDGE_ETH_TYPE_EAPOL:
+    case BRIDGE_ETH_TYPE_LLDP:
+    case BRIDGE_ETH_TYPE_PTP:
+        return QOS_CLASS_CONTROL;
+    case BRIDGE_ETH_TYPE_IPV4:
+    {
+        if (len < offset + 20)
+        {
+            return qos_class;
+        }
+        uint32_t header_len = (ip[0] & 0x0F) * 4;
+        // PTP over UDP, only the first fragment carries the UDP header
+        if (ip[9] == QOS_IP_PROTO_UDP && (((ip[6] & 0x1F) << 8) | ip[7]) == 0 && len >= offset + header_len &&
+            qos_is_ptp_port(ip + header_len, len - offset - header_len))
+        {
+            return QOS_CLASS_CONTROL;
+        }
+        dscp = ip[1] >> 2;
+        break;
+    }
+    case BRIDGE_ETH_TYPE_IPV6:
+        if (len < offset + 40)
+        {
+            return qos_class;
+        }
+        if (ip[6] == QOS_IP_PROTO_UDP && qos_is_ptp_port(ip + 40, len - offset - 40))
+        {
+            return QOS_CLASS_CONTROL;
+        }
+        dscp = ((ip[0] & 0x0F) << 2) | (ip[1] >> 6);
+        break;
+    default:
+        return qos_class;
+    }
+    qos_class_t ip_class = qos_config.dscp_map[dscp];
+    return (!tagged || ip_class < qos_class) ? ip_class : qos_class;
+}
+
+/**
+ * @brief Get the current traffic class configuration
+ * @param[out] config Traffic class configuration
+ * @retval
+ */
+void qos_get_config(qos_config_t *config)
+{
+    portENTER_CRITICAL(&qos_lock);
+    *config = qos_config;
+    portEXIT_CRITICAL(&qos_lock);
+}
+
+/**
+ * @brief Apply a new traffic class configuration and store it in NVS
+ * @param[in] config Traffic class configuration
+ * @retval ESP_ERR_INVALID_ARG if a map entry names an unknown class or a weight or limit is zero,
+ *         otherwise the result of storing the configuration. The configuration is applied even if storing fails
+ */
+esp_err_t qos_set_config(const qos_config_t *config)
+{
+    if (!qos_valid_config(config))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&qos_lock);
+    qos_config = *config;
+    portEXIT_CRITICAL(&qos_lock);
+    return qos_save_config(config);
+}
+
+/**
+ * @brief Get the printable name of a traffic class
+ * @param[in] qos_class Traffic class
+ * @retval Class name
+ */
+const char *qos_class_name(qos_class_t qos_class)
+{
+    return qos_class < QOS_CLASS_NUM ? qos_class_names[qos_class] : "unknown";
+}
+
+/**
+ * @brief Initialize an egress scheduler without queued frames
+ * @param[in] sched Scheduler
+ * @retval
+ */
+void qos_sched_init(qos_sched_t *sched)
+{
+    memset(sched, 0, sizeof(qos_sched_t));
+    for (uint32_t i = 0; i < QOS_CLASS_NUM; i++)
+    {
+        drr_init(&sched->classes[i]);
+    }
+}
+
+/**
+ * @brief Queue a frame in the flow of its traffic class, unless the class limit is reached
+ * @param[in] sched Scheduler
+ * @param[in] flows The QOS_CLASS_NUM flows of the destination wifi peer, indexed by class
+ * @param[in] raw_data Frame descriptor, classified in qos_class
+ * @retval false if the frame has to be dropped
+ */
+bool qos_sched_enqueue(qos_sched_t *sched, drr_flow_t *flows, raw_data_t *raw_data)
+{
+    uint8_t qos_class = raw_data->qos_class < QOS_CLASS_NUM ? raw_data->qos_class : QOS_CLASS_BEST_EFFORT;
+    raw_data->qos_class = qos_class;
+    if (flows[qos_class].count >= qos_config.classes[qos_class].limit)
+    {
+        qos_stats[qos_class].drops++;
+        return false;
+    }
+    drr_enqueue(&sched->classes[qos_class], &flows[qos_class], raw_data);
+    if (sched->classes[qos_class].count > qos_stats[qos_class].max_depth)
+    {
+        qos_stats[qos_class].max_depth = sched->classes[qos_class].count;
+    }
+    return true;
+}
+
+/**
+ * @brief Take the next frame to send. Strict classes are served in class order, the weighted classes
+ *        share the remaining capacity in proportion to their weights
+ * @param[in] sched Scheduler
+ * @param[out] flow Flow the frame was taken from, the frame class tells its index in the wifi peer flows
+ * @retval Frame, NULL if nothing is queued
+ */
+raw_data_t *qos_sched_dequeue(qos_sched_t *sched, drr_flow_t **flow)
+{
+    raw_data_t *raw_data = NULL;
+    for (uint32_t i = 0; i < QOS_CLASS_NUM && raw_data == NULL; i++)
+    {
+        if (qos_config.classes[i].strict && sched->classes[i].count > 0)
+        {
+            raw_data = drr_dequeue(&sched->classes[i], flow);
+        }
+    }
+    uint32_t weighted_count = 0;
+    for (uint32_t i = 0; i < QOS_CLASS_NUM && raw_data == NULL; i++)
+    {
+        if (!qos_config.classes[i].strict)
+        {
+            weighted_count += sched->classes[i].count;
+        }
+    }
+    while (raw_data == NULL && weighted_count > 0)
+    {
+        uint8_t current = sched->current;
+        drr_t *drr = &sched->classes[current];
+        if (qos_config.classes[current].strict || drr->count == 0)
+        {
+            // An idle class does not save up credit
+            sched->deficit[current] = 0;
+        }
+        else
+        {
+            raw_data_t *next = drr_peek(drr, flow);
+            if ((int32_t)next->data_length <= sched->deficit[current])
+            {
+                sched->deficit[current] -= next->data_length;
+                raw_data = drr_dequeue(drr, flow);
+                break;
+            }
+            sched->deficit[current] += (int32_t)qos_config.classes[current].weight * QOS_QUANTUM;
+        }
+        sched->current = (current + 1) % QOS_CLASS_NUM;
+    }
+    if (raw_data != NULL)
+    {
+        qos_stats[raw_data->qos_class].frames++;
+        qos_stats[raw_data->qos_class].bytes += raw_data->data_length;
+    }
+    return raw_data;
+}
+
+/**
+ * @brief Get the number of frames queued over all classes
+ * @param[in] sched Scheduler
+ * @retval Number of queued frames
+ */
+uint32_t qos_sched_count(const qos_sched_t *sched)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < QOS_CLASS_NUM; i++)
+    {
+        count += sched->classes[i].count;
+    }
+    return count;
+}
+
+/**
+ * @brief Get a snapshot of the per class counters
+ * @param[out] stats QOS_CLASS_NUM class counters
+ * @retval
+ */
+void qos_get_stats(qos_class_stats_t *stats)
+{
+    memcpy(stats, qos_stats, sizeof(qos_stats));
+}
+
+/**
+ * @brief Fill in the default configuration: 802.1p and DSCP class selectors mapped to the four classes,
+ *        control as the only strict class
+ * @param[out] config Traffic class configuration
+ * @retval
+ */
+static void qos_default_config(qos_config_t *config)
+{
+    static const uint8_t pcp_map[QOS_PCP_NUM] = {
+        QOS_CLASS_BEST_EFFORT, QOS_CLASS_BACKGROUND, QOS_CLASS_BACKGROUND, QOS_CLASS_BEST_EFFORT,
+        QOS_CLASS_REALTIME, QOS_CLASS_REALTIME, QOS_CLASS_CONTROL, QOS_CLASS_CONTROL};
+    // Class selector (the 3 high DSCP bits) to class, CS1 and lower effort are background, CS4, CS5 and EF realtime
+    static const uint8_t selector_map[8] = {
+        QOS_CLASS_BEST_EFFORT, QOS_CLASS_BACKGROUND, QOS_CLASS_BEST_EFFORT, QOS_CLASS_BEST_EFFORT,
+        QOS_CLASS_REALTIME, QOS_CLASS_REALTIME, QOS_CLASS_CONTROL, QOS_CLASS_CONTROL};
+    memcpy(config->pcp_map, pcp_map, sizeof(pcp_map));
+    for (uint32_t dscp = 0; dscp < QOS_DSCP_NUM; dscp++)
+    {
+        config->dscp_map[dscp] = selector_map[dscp >> 3];
+    }
+    config->dscp_map[1] = QOS_CLASS_BACKGROUND; // Lower effort (RFC 8622)
+    config->classes[QOS_CLASS_CONTROL] = (qos_class_config_t){.strict = 1, .weight = 1, .limit = 8};
+    config->classes[QOS_CLASS_REALTIME] = (qos_class_config_t){.strict = 0, .weight = 8, .limit = 16};
+    config->classes[QOS_CLASS_BEST_EFFORT] = (qos_class_config_t){.strict = 0, .weight = 4, .limit = 32};
+    config->classes[QOS_CLASS_BACKGROUND] = (qos_class_config_t){.strict = 0, .weight = 1, .limit = 16};
+}
+
+/**
+ * @brief Check a traffic class configuration
+ * @param[in] config Traffic class configuration
+ * @retval true if every map entry names a class and every weight and limit is non zero
+ */
+static bool qos_valid_config(const qos_config_t *config)
+{
+    for (uint32_t i = 0; i < QOS_PCP_NUM; i++)
+    {
+        if (config->pcp_map[i] >= QOS_CLASS_NUM)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < QOS_DSCP_NUM; i++)
+    {
+        if (config->dscp_map[i] >= QOS_CLASS_NUM)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < QOS_CLASS_NUM; i++)
+    {
+        if (config->classes[i].weight == 0 || config->classes[i].limit == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Read the traffic class configuration from NVS
+ * @param[out] config Traffic class configuration
+ * @retval ESP_OK if a valid configuration was found
+ */
+static esp_err_t qos_load_config(qos_config_t *config)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(QOS_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    size_t length = sizeof(qos_config_t);
+    ret = nvs_get_blob(handle, QOS_NVS_KEY, config, &length);
+    nvs_close(handle);
+    if (ret == ESP_OK && (length != sizeof(qos_config_t) || !qos_valid_config(config)))
+    {
+        ESP_LOGW(QOS_LOG, "Ignoring invalid traffic class configuration in NVS");
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    return ret;
+}
+
+/**
+ * @brief Write the traffic class configuration to NVS
+ * @param[in] config Traffic class configuration
+ * @retval ESP_OK on success
+ */
+static esp_err_t qos_save_config(const qos_config_t *config)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(QOS_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_set_blob(handle, QOS_NVS_KEY, config, sizeof(qos_config_t));
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
+
+/**
+ * @brief Check whether a UDP header is addressed to a PTP event or general port
+ * @param[in] udp UDP header
+ * @param[in] available Bytes available from the start of the UDP header
+ * @retval true for PTP over UDP
+ */
+static bool qos_is_ptp_port(const uint8_t *udp, uint32_t available)
+{
+    if (available < 8)
+    {
+        return false;
+    }
+    uint16_t dst_port = (udp[2] << 8) | udp[3];
+    return dst_port == QOS_PTP_EVENT_PORT || dst_port == QOS_PTP_GENERAL_PORT;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
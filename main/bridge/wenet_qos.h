@@ -0,0 +1,71 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __QOS_H
+#define __QOS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "wenet_drr.h"
+/* Exported macro ------------------------------------------------------------*/
+#define QOS_CLASS_NUM 4
+#define QOS_PCP_NUM 8
+#define QOS_DSCP_NUM 64
+#define QOS_QUANTUM CONFIG_WENET_QOS_QUANTUM
+/* Exported types ------------------------------------------------------------*/
+// Traffic classes, a lower number is a higher priority
+typedef enum
+{
+    QOS_CLASS_CONTROL = 0, // Network control, ARP, EAPOL, LLDP and PTP
+    QOS_CLASS_REALTIME,    // Voice, video and other latency sensitive traffic
+    QOS_CLASS_BEST_EFFORT, // Unmarked traffic
+    QOS_CLASS_BACKGROUND,  // Bulk transfers marked as lower effort
+} qos_class_t;
+
+typedef struct
+{
+    uint8_t strict;  // Served before every weighted class, strict classes are served in class order
+    uint8_t weight;  // Share of a weighted class in quanta per round, at least 1
+    uint16_t limit;  // Frames of the class that may be queued for one wifi peer
+} qos_class_config_t;
+
+typedef struct
+{
+    uint8_t pcp_map[QOS_PCP_NUM];   // Class of each 802.1p priority code point
+    uint8_t dscp_map[QOS_DSCP_NUM]; // Class of each IPv4/IPv6 differentiated services code point
+    qos_class_config_t classes[QOS_CLASS_NUM];
+} qos_config_t;
+
+typedef struct
+{
+    uint32_t frames;    // Frames sent
+    uint32_t bytes;     // Bytes sent
+    uint32_t drops;     // Frames dropped because the class limit was reached
+    uint32_t max_depth; // Highest number of frames queued in the class over all wifi peers
+} qos_class_stats_t;
+
+// Egress scheduler: strict priority classes first, then deficit round robin over the weighted classes.
+// Each class holds one flow per wifi peer and shares it fairly among them with its own round robin.
+typedef struct
+{
+    drr_t classes[QOS_CLASS_NUM];
+    int32_t deficit[QOS_CLASS_NUM];
+    uint8_t current; // Weighted class currently served
+} qos_sched_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void qos_init(void);
+qos_class_t qos_classify(const uint8_t *frame, uint32_t len);
+void qos_get_config(qos_config_t *config);
+esp_err_t qos_set_config(const qos_config_t *config);
+const char *qos_class_name(qos_class_t qos_class);
+void qos_sched_init(qos_sched_t *sched);
+bool qos_sched_enqueue(qos_sched_t *sched, drr_flow_t *flows, raw_data_t *raw_data);
+raw_data_t *qos_sched_dequeue(qos_sched_t *sched, drr_flow_t **flow);
+uint32_t qos_sched_count(const qos_sched_t *sched);
+void qos_get_stats(qos_class_stats_t *stats);
+#endif /* __QOS_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,90 @@
+/* Includes ------------------------------------------------------------------*/
+#include "wenet_ring.h"
+/* Private macro -------------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Private function prototypes -----------------------------------------------*/
+
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize a ring on caller provided slot storage
+ * @param[in] ring Ring to initialize
+ * @param[in] slots Slot storage, size entries
+ * @param[in] size Number of slots, must be a power of two
+ * @retval
+ *          - ESP_OK on success
+ *          - ESP_ERR_INVALID_SIZE if size is not a power of two
+ */
+esp_err_t ring_init(ring_t *ring, raw_data_t **slots, uint32_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ring->slots = slots;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief Add a frame to the ring. Must only be called from the producer
+ * @param[in] ring Ring
+ * @param[in] raw_data Frame descriptor
+ * @retval Number of queued frames including the new one, 0 if the ring is full.
+ *         A return value of 1 means the ring was empty and the consumer may be sleeping.
+ */
+uint32_t ring_push(ring_t *ring, raw_data_t *raw_data)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail > ring->mask)
+    {
+        return 0;
+    }
+    ring->slots[head & ring->mask] = raw_data;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return head + 1 - tail;
+}
+
+/**
+ * @brief Take up to max_count frames from the ring in one go. Must only be called from the consumer
+ * @param[in] ring Ring
+ * @param[out] raw_data Dequeued frame descriptors, oldest first
+ * @param[in] max_count Capacity of raw_data
+ * @retval Number of dequeued frames
+ */
+uint32_t ring_pop_burst(ring_t *ring, raw_data_t **raw_data, uint32_t max_count)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t count = head - tail;
+    if (count > max_count)
+    {
+        count = max_count;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        raw_data[i] = ring->slots[(tail + i) & ring->mask];
+    }
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+/**
+ * @brief Get the number of queued frames. The value is a snapshot when called from a third context
+ * @param[in] ring Ring
+ * @retval Number of queued frames
+ */
+uint32_t ring_count(ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
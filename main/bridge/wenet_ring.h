@@ -0,0 +1,32 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __RING_H
+#define __RING_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "wenet_pool.h"
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported types ------------------------------------------------------------*/
+// Single producer single consumer ring of frame descriptors. Only the producer writes head and only
+// the consumer writes tail, so neither side needs a lock.
+typedef struct
+{
+    raw_data_t **slots;
+    uint32_t mask;
+    atomic_uint_fast32_t head;
+    atomic_uint_fast32_t tail;
+} ring_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+esp_err_t ring_init(ring_t *ring, raw_data_t **slots, uint32_t size);
+uint32_t ring_push(ring_t *ring, raw_data_t *raw_data);
+uint32_t ring_pop_burst(ring_t *ring, raw_data_t **raw_data, uint32_t max_count);
+uint32_t ring_count(ring_t *ring);
+#endif /* __RING_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,586 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "wenet_telemetry.h"
+#include "wenet_bridge.h"
+#include "wenet_pool.h"
+#if CONFIG_WENET_ACK_FILTER
+#include "wenet_ackfilter.h"
+#endif
+#if CONFIG_WENET_TUNNEL_COMPRESS
+#include "wenet_compress.h"
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+#include "wenet_station.h"
+#endif
+/* Private macro -------------------------------------------------------------*/
+#define TELEMETRY_LOG "TELEMETRY"
+#define TELEMETRY_TASK_STACK 3072
+#if CONFIG_WENET_TELEMETRY_CPU
+// Tasks the cpu command can show, the bridge, the drivers and the system tasks of a dual core build
+#define TELEMETRY_CPU_TASK_NUM 32
+#define TELEMETRY_CPU_PERIOD_MS 1000
+#endif
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+    atomic_uint_fast32_t rx_frames;
+    atomic_uint_fast32_t rx_bytes;
+    atomic_uint_fast32_t tx_frames;
+    atomic_uint_fast32_t tx_bytes;
+    atomic_uint_fast32_t tx_errors;
+    atomic_uint_fast32_t latency[TELEMETRY_HIST_BUCKETS];
+} telemetry_dir_counters_t;
+/* Private variables ---------------------------------------------------------*/
+// Relaxed atomics: every update is a single uncontended add, readers only need each counter to be consistent
+static telemetry_dir_counters_t telemetry_dirs[TELEMETRY_DIR_MAX];
+static atomic_uint_fast32_t telemetry_queue_max[TELEMETRY_QUEUE_MAX];
+// Milliseconds since boot when each direction sent its first frame, 0 until then. Not cleared by telemetry_reset
+static atomic_uint_fast32_t telemetry_first_tx_ms[TELEMETRY_DIR_MAX];
+// esp_timer microseconds truncated to 32 bits when the wifi link was lost, 0 while forwarding works
+static atomic_uint_fast32_t telemetry_link_down_us;
+static atomic_uint_fast32_t telemetry_outages;
+static atomic_uint_fast32_t telemetry_outage_last_ms;
+static atomic_uint_fast32_t telemetry_outage_max_ms;
+static TaskHandle_t telemetry_taskHandler = NULL;
+static const char *const telemetry_dir_names[TELEMETRY_DIR_MAX] = {
+    [TELEMETRY_DIR_ETH_TO_WIFI] = "eth>wifi",
+    [TELEMETRY_DIR_WIFI_TO_ETH] = "wifi>eth",
+    [TELEMETRY_DIR_WIFI_TO_WIFI] = "wifi>wifi",
+};
+static const char *const telemetry_queue_names[TELEMETRY_QUEUE_MAX] = {
+    [TELEMETRY_QUEUE_ETH_RECEIVE] = "eth_rx",
+    [TELEMETRY_QUEUE_WIFI_RELAY] = "relay",
+    [TELEMETRY_QUEUE_WIFI_PEERS] = "peers",
+    [TELEMETRY_QUEUE_ETH_TRANSMIT] = "eth_tx",
+};
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t telemetry_bucket(uint32_t latency_us);
+static void telemetry_first_tx(telemetry_dir_t dir);
+static void telemetry_link_recovered(uint32_t ingress_us);
+static void telemetry_task(void *pvParameters);
+static int telemetry_console_stats(int argc, char **argv);
+#if CONFIG_WENET_TELEMETRY_CPU
+static int telemetry_console_cpu(int argc, char **argv);
+static uint32_t telemetry_cpu_share(const TaskStatus_t *before, UBaseType_t count, const TaskStatus_t *task, uint32_t elapsed);
+#endif
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Clear the counters and start the periodic log dump when it is enabled
+ * @param None
+ * @retval
+ */
+void telemetry_init(void)
+{
+    telemetry_reset();
+    if (TELEMETRY_LOG_PERIOD_S > 0 && telemetry_taskHandler == NULL)
+    {
+        xTaskCreatePinnedToCore(telemetry_task, "telemetry_task", TELEMETRY_TASK_STACK, NULL, 0, &telemetry_taskHandler, tskNO_AFFINITY);
+    }
+}
+
+/**
+ * @brief Account a frame taken in by the bridge
+ * @param[in] dir Direction
+ * @param[in] len Frame length
+ * @retval
+ */
+void telemetry_count_rx(telemetry_dir_t dir, uint32_t len)
+{
+    atomic_fetch_add_explicit(&telemetry_dirs[dir].rx_frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&telemetry_dirs[dir].rx_bytes, len, memory_order_relaxed);
+}
+
+/**
+ * @brief Account a frame handed to the egress driver and its latency through the bridge
+ * @param[in] dir Direction
+ * @param[in] len Frame length
+ * @param[in] ingress_us Time the frame was received, in esp_timer microseconds truncated to 32 bits
+ * @retval
+ */
+void telemetry_count_tx(telemetry_dir_t dir, uint32_t len, uint32_t ingress_us)
+{
+    uint32_t latency_us = (uint32_t)esp_timer_get_time() - ingress_us;
+    atomic_fetch_add_explicit(&telemetry_dirs[dir].tx_frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&telemetry_dirs[dir].tx_bytes, len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&telemetry_dirs[dir].latency[telemetry_bucket(latency_us)], 1, memory_order_relaxed);
+    if (atomic_load_explicit(&telemetry_first_tx_ms[dir], memory_order_relaxed) == 0)
+    {
+        telemetry_first_tx(dir);
+    }
+    if (atomic_load_explicit(&telemetry_link_down_us, memory_order_relaxed) != 0)
+    {
+        telemetry_link_recovered(ingress_us);
+    }
+}
+
+/**
+ * @brief Account frames the egress driver refused
+ * @param[in] dir Direction
+ * @param[in] frames Number of frames, an aggregate counts all the frames it carries
+ * @retval
+ */
+void telemetry_count_tx_error(telemetry_dir_t dir, uint32_t frames)
+{
+    atomic_fetch_add_explicit(&telemetry_dirs[dir].tx_errors, frames, memory_order_relaxed);
+}
+
+/**
+ * @brief Record the depth of a queue, only a new high-water mark costs a write
+ * @param[in] queue Queue
+ * @param[in] depth Current depth
+ * @retval
+ */
+void telemetry_queue_depth(telemetry_queue_t queue, uint32_t depth)
+{
+    uint_fast32_t max = atomic_load_explicit(&telemetry_queue_max[queue], memory_order_relaxed);
+    while (depth > max && !atomic_compare_exchange_weak_explicit(&telemetry_queue_max[queue], &max, depth, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * @brief Record that the wifi link was lost. The outage ends with the first frame forwarded that was
+ *        received after this point, so frames still queued from before do not end it early
+ * @param None
+ * @retval
+ */
+void telemetry_link_down(void)
+{
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    uint_fast32_t expected = 0;
+    // A second loss before forwarding recovered belongs to the same outage, 0 is reserved for none
+    atomic_compare_exchange_strong(&telemetry_link_down_us, &expected, now_us != 0 ? now_us : 1);
+}
+
+/**
+ * @brief Get a snapshot of the counters
+ * @param[out] stats Counters
+ * @retval
+ */
+void telemetry_get_stats(telemetry_stats_t *stats)
+{
+    for (uint32_t dir = 0; dir < TELEMETRY_DIR_MAX; dir++)
+    {
+        telemetry_dir_counters_t *counters = &telemetry_dirs[dir];
+        telemetry_dir_stats_t *dir_stats = &stats->dirs[dir];
+        dir_stats->rx_frames = atomic_load_explicit(&counters->rx_frames, memory_order_relaxed);
+        dir_stats->rx_bytes = atomic_load_explicit(&counters->rx_bytes, memory_order_relaxed);
+        dir_stats->tx_frames = atomic_load_explicit(&counters->tx_frames, memory_order_relaxed);
+        dir_stats->tx_bytes = atomic_load_explicit(&counters->tx_bytes, memory_order_relaxed);
+        dir_stats->tx_errors = atomic_load_explicit(&counters->tx_errors, memory_order_relaxed);
+        dir_stats->first_tx_ms = atomic_load_explicit(&telemetry_first_tx_ms[dir], memory_order_relaxed);
+        for (uint32_t i = 0; i < TELEMETRY_HIST_BUCKETS; i++)
+        {
+            dir_stats->latency[i] = atomic_load_explicit(&counters->latency[i], memory_order_relaxed);
+        }
+    }
+    for (uint32_t i = 0; i < TELEMETRY_QUEUE_MAX; i++)
+    {
+        stats->queue_max[i] = atomic_load_explicit(&telemetry_queue_max[i], memory_order_relaxed);
+    }
+    stats->outages = atomic_load_explicit(&telemetry_outages, memory_order_relaxed);
+    stats->outage_last_ms = atomic_load_explicit(&telemetry_outage_last_ms, memory_order_relaxed);
+    stats->outage_max_ms = atomic_load_explicit(&telemetry_outage_max_ms, memory_order_relaxed);
+}
+
+/**
+ * @brief Clear the counters, histograms and high-water marks
+ * @param None
+ * @retval
+ */
+void telemetry_reset(void)
+{
+    for (uint32_t dir = 0; dir < TELEMETRY_DIR_MAX; dir++)
+    {
+        telemetry_dir_counters_t *counters = &telemetry_dirs[dir];
+        atomic_store_explicit(&counters->rx_frames, 0, memory_order_relaxed);
+        atomic_store_explicit(&counters->rx_bytes, 0, memory_order_relaxed);
+        atomic_store_explicit(&counters->tx_frames, 0, memory_order_relaxed);
+        atomic_store_explicit(&counters->tx_bytes, 0, memory_order_relaxed);
+        atomic_store_explicit(&counters->tx_errors, 0, memory_order_relaxed);
+        for (uint32_t i = 0; i < TELEMETRY_HIST_BUCKETS; i++)
+        {
+            atomic_store_explicit(&counters->latency[i], 0, memory_order_relaxed);
+        }
+    }
+    for (uint32_t i = 0; i < TELEMETRY_QUEUE_MAX; i++)
+    {
+        atomic_store_explicit(&telemetry_queue_max[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&telemetry_outages, 0, memory_order_relaxed);
+    atomic_store_explicit(&telemetry_outage_last_ms, 0, memory_order_relaxed);
+    atomic_store_explicit(&telemetry_outage_max_ms, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Estimate a latency percentile from a histogram
+ * @param[in] histogram TELEMETRY_HIST_BUCKETS buckets
+ * @param[in] percent Percentile, 1 to 100
+ * @retval Exclusive upper bound of the bucket holding the percentile in microseconds, 0 if the histogram is empty
+ */
+uint32_t telemetry_percentile(const uint32_t *histogram, uint32_t percent)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < TELEMETRY_HIST_BUCKETS; i++)
+    {
+        total += histogram[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (total * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < TELEMETRY_HIST_BUCKETS; i++)
+    {
+        seen += histogram[i];
+        if (seen >= rank)
+        {
+            return 1u << i;
+        }
+    }
+    return 1u << (TELEMETRY_HIST_BUCKETS - 1);
+}
+
+/**
+ * @brief Get the printable name of a direction
+ * @param[in] dir Direction
+ * @retval Direction name
+ */
+const char *telemetry_dir_name(telemetry_dir_t dir)
+{
+    return dir < TELEMETRY_DIR_MAX ? telemetry_dir_names[dir] : "unknown";
+}
+
+/**
+ * @brief Get the printable name of a queue
+ * @param[in] queue Queue
+ * @retval Queue name
+ */
+const char *telemetry_queue_name(telemetry_queue_t queue)
+{
+    return queue < TELEMETRY_QUEUE_MAX ? telemetry_queue_names[queue] : "unknown";
+}
+
+/**
+ * @brief Write a compact summary of the counters to the log: one line per direction, one for the queues and the
+ *        frame pool, and one for the drops that happened
+ * @param None
+ * @retval
+ */
+void telemetry_log(void)
+{
+    telemetry_stats_t stats;
+    telemetry_get_stats(&stats);
+    for (uint32_t dir = 0; dir < TELEMETRY_DIR_MAX; dir++)
+    {
+        const telemetry_dir_stats_t *dir_stats = &stats.dirs[dir];
+        ESP_LOGI(TELEMETRY_LOG, "%s rx %lu/%luB tx %lu/%luB err %lu p50 %luus p99 %luus", telemetry_dir_names[dir],
+                 (unsigned long)dir_stats->rx_frames, (unsigned long)dir_stats->rx_bytes,
+                 (unsigned long)dir_stats->tx_frames, (unsigned long)dir_stats->tx_bytes, (unsigned long)dir_stats->tx_errors,
+                 (unsigned long)telemetry_percentile(dir_stats->latency, 50), (unsigned long)telemetry_percentile(dir_stats->latency, 99));
+    }
+    pool_stats_t pool_stats;
+    pool_get_stats(&pool_stats);
+    ESP_LOGI(TELEMETRY_LOG, "max %s %lu %s %lu %s %lu, pool min free desc %lu buf %lu",
+             telemetry_queue_names[TELEMETRY_QUEUE_ETH_RECEIVE], (unsigned long)stats.queue_max[TELEMETRY_QUEUE_ETH_RECEIVE],
+             telemetry_queue_names[TELEMETRY_QUEUE_WIFI_RELAY], (unsigned long)stats.queue_max[TELEMETRY_QUEUE_WIFI_RELAY],
+             telemetry_queue_names[TELEMETRY_QUEUE_WIFI_PEERS], (unsigned long)stats.queue_max[TELEMETRY_QUEUE_WIFI_PEERS],
+             (unsigned long)pool_stats.desc_min_free, (unsigned long)pool_stats.buf_min_free);
+    bridge_drop_stats_t drop_stats;
+    bridge_get_drop_stats(&drop_stats);
+    char line[160];
+    int pos = snprintf(line, sizeof(line), "drops");
+    for (uint32_t i = 0; i < BRIDGE_DROP_REASON_MAX && pos < (int)sizeof(line); i++)
+    {
+        if (drop_stats.drops[i] > 0)
+        {
+            pos += snprintf(line + pos, sizeof(line) - pos, " %s %lu", bridge_drop_reason_name(i), (unsigned long)drop_stats.drops[i]);
+        }
+    }
+    ESP_LOGI(TELEMETRY_LOG, "%s, ecn %lu, pause %lu", line, (unsigned long)drop_stats.ecn_marks, (unsigned long)drop_stats.pause_frames);
+}
+
+/**
+ * @brief Register the "stats" console command
+ * @param None
+ * @retval Result of esp_console_cmd_register
+ */
+esp_err_t telemetry_register_console(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "stats",
+        .help = "Show the bridge counters, latency histograms and queue high-water marks. \"stats reset\" clears them",
+        .hint = "[reset]",
+        .func = telemetry_console_stats,
+    };
+    esp_err_t ret = esp_console_cmd_register(&command);
+#if CONFIG_WENET_TELEMETRY_CPU
+    const esp_console_cmd_t cpu_command = {
+        .command = "cpu",
+        .help = "Sample the run time of every task for a period (default 1000 ms) and show its CPU share, core, "
+                "priority and free stack, and the load of each core",
+        .hint = "[period ms]",
+        .func = telemetry_console_cpu,
+    };
+    if (ret == ESP_OK)
+    {
+        ret = esp_console_cmd_register(&cpu_command);
+    }
+#endif
+    return ret;
+}
+
+/**
+ * @brief Get the histogram bucket of a latency
+ * @param[in] latency_us Latency in microseconds
+ * @retval Bucket index
+ */
+static uint32_t telemetry_bucket(uint32_t latency_us)
+{
+    uint32_t bucket = latency_us == 0 ? 0 : 32 - __builtin_clz(latency_us);
+    return bucket < TELEMETRY_HIST_BUCKETS ? bucket : TELEMETRY_HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief Record when a direction sent its first frame since boot, the startup time the bridge is judged by
+ * @param[in] dir Direction
+ * @retval
+ */
+static void telemetry_first_tx(telemetry_dir_t dir)
+{
+    uint_fast32_t expected = 0;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (atomic_compare_exchange_strong_explicit(&telemetry_first_tx_ms[dir], &expected, now_ms, memory_order_relaxed, memory_order_relaxed))
+    {
+        ESP_LOGI(TELEMETRY_LOG, "First %s frame forwarded %lu ms after boot", telemetry_dir_names[dir], (unsigned long)now_ms);
+    }
+}
+
+/**
+ * @brief End the running outage when the frame was received after the link was lost, and record how long
+ *        forwarding was interrupted
+ * @param[in] ingress_us Time the forwarded frame was received, in esp_timer microseconds truncated to 32 bits
+ * @retval
+ */
+static void telemetry_link_recovered(uint32_t ingress_us)
+{
+    uint_fast32_t down_us = atomic_load_explicit(&telemetry_link_down_us, memory_order_relaxed);
+    if (down_us == 0 || (int32_t)(ingress_us - (uint32_t)down_us) < 0)
+    {
+        return;
+    }
+    if (!atomic_compare_exchange_strong_explicit(&telemetry_link_down_us, &down_us, 0, memory_order_relaxed, memory_order_relaxed))
+    {
+        return;
+    }
+    uint32_t outage_ms = ((uint32_t)esp_timer_get_time() - (uint32_t)down_us) / 1000;
+    atomic_fetch_add_explicit(&telemetry_outages, 1, memory_order_relaxed);
+    atomic_store_explicit(&telemetry_outage_last_ms, outage_ms, memory_order_relaxed);
+    uint_fast32_t max = atomic_load_explicit(&telemetry_outage_max_ms, memory_order_relaxed);
+    while (outage_ms > max && !atomic_compare_exchange_weak_explicit(&telemetry_outage_max_ms, &max, outage_ms, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    ESP_LOGI(TELEMETRY_LOG, "Forwarding resumed %lu ms after the wifi link was lost", (unsigned long)outage_ms);
+}
+
+/**
+ * @brief Periodic log dump task
+ * @param[in] pvParameters
+ * @retval
+ */
+static void telemetry_task(void *pvParameters)
+{
+    (void)pvParameters;
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_LOG_PERIOD_S * 1000));
+        telemetry_log();
+    }
+}
+
+/**
+ * @brief "stats" console command
+ * @param[in] argc Argument count
+ * @param[in] argv Arguments
+ * @retval 0 on success
+ */
+static int telemetry_console_stats(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        if (strcmp(argv[1], "reset") != 0)
+        {
+            printf("usage: stats [reset]\n");
+            return 1;
+        }
+        telemetry_reset();
+        return 0;
+    }
+    telemetry_stats_t stats;
+    telemetry_get_stats(&stats);
+    for (uint32_t dir = 0; dir < TELEMETRY_DIR_MAX; dir++)
+    {
+        const telemetry_dir_stats_t *dir_stats = &stats.dirs[dir];
+        printf("%s: rx %lu frames %lu bytes, tx %lu frames %lu bytes, tx errors %lu, first tx %lu ms after boot\n", telemetry_dir_names[dir],
+               (unsigned long)dir_stats->rx_frames, (unsigned long)dir_stats->rx_bytes, (unsigned long)dir_stats->tx_frames,
+               (unsigned long)dir_stats->tx_bytes, (unsigned long)dir_stats->tx_errors, (unsigned long)dir_stats->first_tx_ms);
+        for (uint32_t i = 0; i < TELEMETRY_HIST_BUCKETS; i++)
+        {
+            if (dir_stats->latency[i] > 0)
+            {
+                printf("  < %8lu us %lu\n", (unsigned long)(1u << i), (unsigned long)dir_stats->latency[i]);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < TELEMETRY_QUEUE_MAX; i++)
+    {
+        printf("queue %s max depth %lu\n", telemetry_queue_names[i], (unsigned long)stats.queue_max[i]);
+    }
+    pool_stats_t pool_stats;
+    pool_get_stats(&pool_stats);
+    printf("pool: desc free %lu min %lu exhausted %lu, buf free %lu min %lu exhausted %lu\n",
+           (unsigned long)pool_stats.desc_free, (unsigned long)pool_stats.desc_min_free, (unsigned long)pool_stats.desc_exhausted,
+           (unsigned long)pool_stats.buf_free, (unsigned long)pool_stats.buf_min_free, (unsigned long)pool_stats.buf_exhausted);
+    bridge_drop_stats_t drop_stats;
+    bridge_get_drop_stats(&drop_stats);
+    for (uint32_t i = 0; i < BRIDGE_DROP_REASON_MAX; i++)
+    {
+        printf("drop %s %lu\n", bridge_drop_reason_name(i), (unsigned long)drop_stats.drops[i]);
+    }
+    printf("ecn marks %lu\n", (unsigned long)drop_stats.ecn_marks);
+    printf("pause frames %lu\n", (unsigned long)drop_stats.pause_frames);
+#if CONFIG_WENET_ACK_FILTER
+    ack_filter_stats_t ack_stats;
+    ack_filter_get_stats(&ack_stats);
+    printf("tcp acks %lu, thinned %lu, kept %lu, collisions %lu\n", (unsigned long)ack_stats.pure_acks,
+           (unsigned long)ack_stats.thinned, (unsigned long)ack_stats.kept, (unsigned long)ack_stats.collisions);
+#endif
+#if CONFIG_WENET_TUNNEL_COMPRESS
+    compress_stats_t compress_stats;
+    compress_get_stats(&compress_stats);
+    printf("compression: tried %lu, compressed %lu (%lu -> %lu bytes), bypassed %lu, expanded %lu, invalid %lu\n",
+           (unsigned long)compress_stats.tried, (unsigned long)compress_stats.compressed, (unsigned long)compress_stats.bytes_in,
+           (unsigned long)compress_stats.bytes_out, (unsigned long)compress_stats.bypassed, (unsigned long)compress_stats.expanded,
+           (unsigned long)compress_stats.invalid);
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    // Summed over the connected peers, the counters of a peer start over when it joins
+    tunnel_stats_t fragment_stats = {0};
+    for (uint8_t i = 0; i < STATION_MAX; i++)
+    {
+        station_t *station = station_get(i);
+        if (station != NULL)
+        {
+            tunnel_stats_t tunnel_stats;
+            tunnel_get_stats(&station->tunnel, &tunnel_stats);
+            fragment_stats.tx_fragmented += tunnel_stats.tx_fragmented;
+            fragment_stats.tx_fragments += tunnel_stats.tx_fragments;
+            fragment_stats.rx_reassembled += tunnel_stats.rx_reassembled;
+            fragment_stats.rx_frag_dropped += tunnel_stats.rx_frag_dropped;
+        }
+    }
+    printf("fragmentation: sent %lu frames in %lu fragments, reassembled %lu, fragments dropped %lu\n",
+           (unsigned long)fragment_stats.tx_fragmented, (unsigned long)fragment_stats.tx_fragments,
+           (unsigned long)fragment_stats.rx_reassembled, (unsigned long)fragment_stats.rx_frag_dropped);
+#endif
+    printf("wifi outages %lu, last %lu ms, max %lu ms\n", (unsigned long)stats.outages, (unsigned long)stats.outage_last_ms,
+           (unsigned long)stats.outage_max_ms);
+    return 0;
+}
+
+#if CONFIG_WENET_TELEMETRY_CPU
+/**
+ * @brief "cpu" console command
+ * @param[in] argc Argument count
+ * @param[in] argv Arguments
+ * @retval 0 on success
+ */
+static int telemetry_console_cpu(int argc, char **argv)
+{
+    // Static, the console task stack is small and only the console runs this command
+    static TaskStatus_t before[TELEMETRY_CPU_TASK_NUM];
+    static TaskStatus_t after[TELEMETRY_CPU_TASK_NUM];
+    uint32_t period_ms = argc > 1 ? strtoul(argv[1], NULL, 0) : TELEMETRY_CPU_PERIOD_MS;
+    if (period_ms == 0)
+    {
+        printf("usage: cpu [period ms]\n");
+        return 1;
+    }
+    uint32_t start_time;
+    uint32_t end_time;
+    UBaseType_t before_count = uxTaskGetSystemState(before, TELEMETRY_CPU_TASK_NUM, &start_time);
+    vTaskDelay(pdMS_TO_TICKS(period_ms));
+    UBaseType_t after_count = uxTaskGetSystemState(after, TELEMETRY_CPU_TASK_NUM, &end_time);
+    uint32_t elapsed = end_time - start_time;
+    if (before_count == 0 || after_count == 0 || elapsed == 0)
+    {
+        printf("more than %u tasks\n", TELEMETRY_CPU_TASK_NUM);
+        return 1;
+    }
+    // Shares are of one core in tenths of a percent, the tasks of a dual core build add up to 200%
+    printf("%-16s %4s %4s %7s %6s\n", "task", "core", "prio", "cpu %", "stack");
+    for (UBaseType_t i = 0; i < after_count; i++)
+    {
+        const TaskStatus_t *task = &after[i];
+        uint32_t share = telemetry_cpu_share(before, before_count, task, elapsed);
+        BaseType_t core = xTaskGetAffinity(task->xHandle);
+        char core_name[12] = "any";
+        if (core != tskNO_AFFINITY)
+        {
+            snprintf(core_name, sizeof(core_name), "%d", (int)core);
+        }
+        printf("%-16s %4s %4u %5lu.%lu %6lu\n", task->pcTaskName, core_name, (unsigned)task->uxCurrentPriority,
+               (unsigned long)(share / 10), (unsigned long)(share % 10), (unsigned long)task->usStackHighWaterMark);
+    }
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        // A core is busy whenever its idle task does not run
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(core);
+        uint32_t idle_share = 0;
+        for (UBaseType_t i = 0; i < after_count; i++)
+        {
+            if (after[i].xHandle == idle)
+            {
+                idle_share = telemetry_cpu_share(before, before_count, &after[i], elapsed);
+            }
+        }
+        idle_share = idle_share > 1000 ? 1000 : idle_share;
+        printf("core %d load %lu.%lu%%\n", (int)core, (unsigned long)((1000 - idle_share) / 10), (unsigned long)((1000 - idle_share) % 10));
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the share of one core a task used between two samples
+ * @param[in] before First sample
+ * @param[in] count Number of tasks in the first sample
+ * @param[in] task Task in the second sample
+ * @param[in] elapsed Run time counter ticks between the samples
+ * @retval Share in tenths of a percent
+ */
+static uint32_t telemetry_cpu_share(const TaskStatus_t *before, UBaseType_t count, const TaskStatus_t *task, uint32_t elapsed)
+{
+    uint32_t run_time = task->ulRunTimeCounter;
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        if (before[i].xHandle == task->xHandle)
+        {
+            run_time -= before[i].ulRunTimeCounter;
+            break;
+        }
+    }
+    // A task created between the samples counts from zero
+    return (uint32_t)((uint64_t)run_time * 1000 / elapsed);
+}
+#endif
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
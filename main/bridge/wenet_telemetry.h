@@ -0,0 +1,69 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+/* Exported macro ------------------------------------------------------------*/
+// Bucket 0 counts latencies below 1 us, bucket n latencies from 2^(n-1) to 2^n - 1 us, the last bucket the rest
+#define TELEMETRY_HIST_BUCKETS 24
+#define TELEMETRY_LOG_PERIOD_S CONFIG_WENET_TELEMETRY_LOG_PERIOD_S
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    TELEMETRY_DIR_ETH_TO_WIFI = 0, // Received on ethernet, sent to the wifi peers
+    TELEMETRY_DIR_WIFI_TO_ETH,     // Received from a wifi peer, sent on ethernet
+    TELEMETRY_DIR_WIFI_TO_WIFI,    // Received from a wifi peer, relayed to the other wifi peers
+    TELEMETRY_DIR_MAX,
+} telemetry_dir_t;
+
+typedef enum
+{
+    TELEMETRY_QUEUE_ETH_RECEIVE = 0, // Ethernet receive ring
+    TELEMETRY_QUEUE_WIFI_RELAY,      // Wifi relay ring
+    TELEMETRY_QUEUE_WIFI_PEERS,      // Frames queued for all wifi peers
+    TELEMETRY_QUEUE_ETH_TRANSMIT,    // Ethernet transmit ring
+    TELEMETRY_QUEUE_MAX,
+} telemetry_queue_t;
+
+typedef struct
+{
+    uint32_t rx_frames;  // Frames taken in for this direction
+    uint32_t rx_bytes;
+    uint32_t tx_frames;  // Frames handed to the egress driver, once per wifi peer for flooded frames
+    uint32_t tx_bytes;
+    uint32_t tx_errors;  // Frames the egress driver refused
+    uint32_t first_tx_ms; // Milliseconds since boot when the first frame was sent, 0 if none yet
+    uint32_t latency[TELEMETRY_HIST_BUCKETS]; // Ingress to egress driver latency of the sent frames
+} telemetry_dir_stats_t;
+
+typedef struct
+{
+    telemetry_dir_stats_t dirs[TELEMETRY_DIR_MAX];
+    uint32_t queue_max[TELEMETRY_QUEUE_MAX]; // Queue depth high-water marks
+    uint32_t outages;        // Wifi link losses forwarding recovered from
+    uint32_t outage_last_ms; // Link loss to first frame forwarded again, for the last one
+    uint32_t outage_max_ms;  // Same, for the longest one
+} telemetry_stats_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void telemetry_init(void);
+void telemetry_count_rx(telemetry_dir_t dir, uint32_t len);
+void telemetry_count_tx(telemetry_dir_t dir, uint32_t len, uint32_t ingress_us);
+void telemetry_count_tx_error(telemetry_dir_t dir, uint32_t frames);
+void telemetry_queue_depth(telemetry_queue_t queue, uint32_t depth);
+void telemetry_link_down(void);
+void telemetry_get_stats(telemetry_stats_t *stats);
+void telemetry_reset(void);
+uint32_t telemetry_percentile(const uint32_t *histogram, uint32_t percent);
+const char *telemetry_dir_name(telemetry_dir_t dir);
+const char *telemetry_queue_name(telemetry_queue_t queue);
+void telemetry_log(void);
+esp_err_t telemetry_register_console(void);
+#endif /* __TELEMETRY_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -1,4 +1,5 @@
 /* Includes ------------------------------------------------------------------*/
+#include <string.h>
 #include "esp_log.h"
 #include "esp_check.h"
 #include "driver/gpio.h"
@@ -6,27 +7,121 @@
 #include "wenet_ethernet.h"
 #include "wenet_wifi.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
+#include "wenet_ring.h"
+#include "wenet_bridge.h"
+#include "wenet_tunnel.h"
+#include "wenet_fdb.h"
+#include "wenet_qos.h"
+#include "wenet_arp.h"
+#include "wenet_telemetry.h"
+#include "wenet_capture.h"
 /* Private macro -------------------------------------------------------------*/
 #define ETH_LOG "ETHERNET"
-#define ETH_RECEIVE_QUEUE_SIZE 50
-#define ETH_WAIT_TO_SEND_RAW_TIMOUT 100 // ms
+#define ETH_RECEIVE_RING_SIZE CONFIG_WENET_ETH_RING_SIZE
+#if (ETH_RECEIVE_RING_SIZE & (ETH_RECEIVE_RING_SIZE - 1)) != 0
+#error "CONFIG_WENET_ETH_RING_SIZE must be a power of two"
+#endif
+#define ETH_RECEIVE_QUEUE_LIMIT CONFIG_WENET_ETH_QUEUE_LIMIT
+#if ETH_RECEIVE_QUEUE_LIMIT > ETH_RECEIVE_RING_SIZE
+#error "CONFIG_WENET_ETH_QUEUE_LIMIT must not exceed CONFIG_WENET_ETH_RING_SIZE"
+#endif
+#define ETH_TRANSMIT_RING_SIZE CONFIG_WENET_ETH_TX_RING_SIZE
+#if (ETH_TRANSMIT_RING_SIZE & (ETH_TRANSMIT_RING_SIZE - 1)) != 0
+#error "CONFIG_WENET_ETH_TX_RING_SIZE must be a power of two"
+#endif
+#define ETH_TRANSMIT_BURST 8
+// Frames the bridge answers itself, e.g. ARP proxy replies, only a few are ever in flight
+#define ETH_REPLY_RING_SIZE 8
+#if (ETH_REPLY_RING_SIZE & (ETH_REPLY_RING_SIZE - 1)) != 0
+#error "ETH_REPLY_RING_SIZE must be a power of two"
+#endif
+#define ETH_TRANSMIT_TASK_STACK CONFIG_WENET_ETH_TX_TASK_STACK
+#define ETH_TRANSMIT_TASK_PRIORITY CONFIG_WENET_ETH_TX_TASK_PRIORITY
+#define ETH_TRANSMIT_TASK_CORE BRIDGE_TASK_CORE(CONFIG_WENET_ETH_TX_TASK_CORE)
+#define ETH_RECEIVE_TASK_STACK CONFIG_WENET_ETH_RX_TASK_STACK
+#define ETH_RECEIVE_TASK_PRIORITY CONFIG_WENET_ETH_RX_TASK_PRIORITY
+#define ETH_RECEIVE_TASK_CORE CONFIG_WENET_ETH_RX_TASK_CORE
+#define ETH_CREATE_TASK_STACK 4096
+#if CONFIG_WENET_ETH_PAUSE
+#define ETH_PAUSE_HIGH CONFIG_WENET_ETH_PAUSE_HIGH
+#define ETH_PAUSE_LOW CONFIG_WENET_ETH_PAUSE_LOW
+#if ETH_PAUSE_LOW >= ETH_PAUSE_HIGH
+#error "CONFIG_WENET_ETH_PAUSE_LOW must be below CONFIG_WENET_ETH_PAUSE_HIGH"
+#endif
+#define ETH_PAUSE_QUANTA CONFIG_WENET_ETH_PAUSE_QUANTA
+#define ETH_PAUSE_FRAME_LEN 60
+#define ETH_PAUSE_ETHERTYPE 0x8808
+#define ETH_PAUSE_OPCODE 0x0001
+// A quantum is 512 bit times, 5.12 us at 100 Mbit/s. The pause is renewed at half its length, slower links
+// pause for longer so the renewal comes early enough for every link speed
+#define ETH_PAUSE_RENEW_MS (ETH_PAUSE_QUANTA * 512u / 100u / 1000u / 2u)
+#define ETH_PAUSE_RENEW_TICKS (pdMS_TO_TICKS(ETH_PAUSE_RENEW_MS) > 0 ? pdMS_TO_TICKS(ETH_PAUSE_RENEW_MS) : 1)
+#endif
 #define ETH_PHY_RST_GPIO 33
 #define ETH_MDC_GPIO 23
 #define ETH_MDIO_GPIO 18
 #define ETH_OCS_POWER_GPIO 32
 /* Private typedef -----------------------------------------------------------*/
-
+#if ETH_RECEIVE_TASK_CORE >= 0
+// Driver creation handed to a task on the EMAC receive task core
+typedef struct
+{
+    TaskHandle_t caller;
+    esp_err_t ret;
+} eth_create_job_t;
+#endif
 /* Private variables ---------------------------------------------------------*/
-QueueHandle_t eth_receive_queue = NULL;
+static raw_data_t *eth_receive_slots[ETH_RECEIVE_RING_SIZE];
+static ring_t eth_receive_ring;
+static TaskHandle_t eth_receive_consumer = NULL;
+static atomic_bool eth_receive_flush_request = false;
+static raw_data_t *eth_transmit_slots[ETH_TRANSMIT_RING_SIZE];
+static ring_t eth_transmit_ring;
+// Second producer, the wifi send task: the rings have one producer each
+static raw_data_t *eth_reply_slots[ETH_REPLY_RING_SIZE];
+static ring_t eth_reply_ring;
+static TaskHandle_t eth_transmit_taskHandler = NULL;
+#if CONFIG_WENET_ETH_PAUSE
+// Frames waiting in the wifi peer queues, reported by the wifi send task
+static atomic_uint_fast32_t eth_wifi_backlog;
+// Whether the link partner should be paused, the transmit task sends the PAUSE frames to match
+static atomic_bool eth_paused = false;
+// State last sent to the link partner and when to renew it, only used by the transmit task
+static bool eth_pause_sent = false;
+static TickType_t eth_pause_renew;
+// MAC control multicast address PAUSE frames are sent to
+static const uint8_t eth_pause_addr[6] = {0x01, 0x80, 0xC2, 0x00, 0x00, 0x01};
+#endif
 bool eth_connected = false;
 esp_eth_handle_t eth_handle;
 uint8_t eth_esp_addr[6] = {0};
 uint8_t eth_device_addr[6] = {0};
 /* Private function prototypes -----------------------------------------------*/
 static esp_err_t ethernet_input_path(esp_eth_handle_t eth_handle, uint8_t *buffer, uint32_t len, void *priv);
+static esp_err_t ethernet_create_driver(void);
+static esp_err_t ethernet_create_board_driver(void);
+#if ETH_RECEIVE_TASK_CORE >= 0
+static void ethernet_create_task(void *pvParameters);
+#endif
 static void ethernet_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static esp_err_t ethernet_init_LAN8720(esp_eth_mac_t **mac_out, esp_eth_phy_t **phy_out);
+#if CONFIG_WENET_ETH_OPENETH
+static esp_err_t ethernet_init_openeth(esp_eth_mac_t **mac_out, esp_eth_phy_t **phy_out);
+#endif
+static esp_err_t ethernet_install_driver(esp_eth_mac_t *mac, esp_eth_phy_t *phy, esp_eth_mac_t **mac_out, esp_eth_phy_t **phy_out);
 static void ethernet_uninit_LAN8720(void);
+static void ethernet_drain_receive_ring(void);
+static esp_err_t ethernet_transmit_push(ring_t *ring, raw_data_t *raw_data);
+static void ethernet_transmit_task(void *pvParameters);
+static void ethernet_transmit_drain(ring_t *ring);
+static void ethernet_transmit_release(raw_data_t *raw_data);
+static esp_err_t ethernet_drop_frame(uint8_t *buffer, raw_data_t *raw_data, bridge_drop_reason_t reason);
+#if CONFIG_WENET_ETH_PAUSE
+static void ethernet_pause_update(uint32_t backlog);
+static TickType_t ethernet_pause_service(void);
+static void ethernet_send_pause(uint16_t quanta);
+#endif
 /* Private user code ---------------------------------------------------------*/
 /**
  * @brief Initialize the ehternet module
@@ -35,6 +130,7 @@ static void ethernet_uninit_LAN8720(void);
  */
 void ethernet_init(void)
 {
+#if !CONFIG_WENET_ETH_OPENETH
     // Initialize oscillator power gpio.
     gpio_config_t oscillator_power = {};
     oscillator_power.intr_type = GPIO_INTR_DISABLE;
@@ -43,7 +139,8 @@ void ethernet_init(void)
     oscillator_power.pull_down_en = 0;
     oscillator_power.pull_up_en = 0;
     gpio_config(&oscillator_power);
-    ESP_ERROR_CHECK(ethernet_init_LAN8720(NULL, NULL));
+#endif
+    ESP_ERROR_CHECK(ethernet_create_driver());
     // Log ethernet MAC address
     esp_read_mac(eth_esp_addr, ESP_MAC_ETH);
     ESP_LOGI(ETH_LOG, "ESP32 ethernet addr:%02x:%02x:%02x:%02x:%02x:%02x", eth_esp_addr[0], eth_esp_addr[1], eth_esp_addr[2], eth_esp_addr[3], eth_esp_addr[4], eth_esp_addr[5]);
@@ -56,7 +153,10 @@ void ethernet_init(void)
     // Enable flow control mechanism
     bool flow_ctrl_enable = true;
     ESP_ERROR_CHECK(esp_eth_ioctl(eth_handle, ETH_CMD_S_FLOW_CTRL, &flow_ctrl_enable));
-    eth_receive_queue = xQueueCreate(ETH_RECEIVE_QUEUE_SIZE, sizeof(raw_data_t *));
+    ESP_ERROR_CHECK(ring_init(&eth_receive_ring, eth_receive_slots, ETH_RECEIVE_RING_SIZE));
+    ESP_ERROR_CHECK(ring_init(&eth_transmit_ring, eth_transmit_slots, ETH_TRANSMIT_RING_SIZE));
+    ESP_ERROR_CHECK(ring_init(&eth_reply_ring, eth_reply_slots, ETH_REPLY_RING_SIZE));
+    xTaskCreatePinnedToCore(ethernet_transmit_task, "eth_transmit_task", ETH_TRANSMIT_TASK_STACK, NULL, ETH_TRANSMIT_TASK_PRIORITY, &eth_transmit_taskHandler, ETH_TRANSMIT_TASK_CORE);
     ESP_ERROR_CHECK(esp_eth_start(eth_handle));
 }
 
@@ -70,6 +170,153 @@ void ethernet_uninit(void)
     ethernet_uninit_LAN8720();
 }
 
+/**
+ * @brief Register the task that consumes the ethernet receive ring. It is notified with a task
+ *        notification whenever the ring turns from empty to non-empty
+ * @param[in] consumer Consumer task handle, NULL to detach
+ * @retval
+ */
+void ethernet_set_receive_consumer(TaskHandle_t consumer)
+{
+    eth_receive_consumer = consumer;
+}
+
+/**
+ * @brief Take a burst of received frames. Must only be called from the registered consumer task
+ * @param[out] frames Dequeued frame descriptors, oldest first
+ * @param[in] max_count Capacity of frames
+ * @retval Number of dequeued frames
+ */
+uint32_t ethernet_receive_burst(raw_data_t **frames, uint32_t max_count)
+{
+    if (atomic_exchange(&eth_receive_flush_request, false))
+    {
+        ethernet_drain_receive_ring();
+    }
+#if CONFIG_WENET_ETH_DROP_HEAD
+    // Head drop: the producer fills the whole ring, the consumer discards the oldest frames above the limit
+    uint32_t backlog = ring_count(&eth_receive_ring);
+    while (backlog > ETH_RECEIVE_QUEUE_LIMIT)
+    {
+        uint32_t excess = backlog - ETH_RECEIVE_QUEUE_LIMIT;
+        uint32_t count = ring_pop_burst(&eth_receive_ring, frames, excess < max_count ? excess : max_count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bridge_count_drop(BRIDGE_DROP_HEAD);
+            pool_release(frames[i]);
+        }
+        backlog -= count;
+    }
+#endif
+    return ring_pop_burst(&eth_receive_ring, frames, max_count);
+}
+
+/**
+ * @brief Get the number of frames waiting in the ethernet receive ring
+ * @param None
+ * @retval Number of queued frames
+ */
+uint32_t ethernet_receive_backlog(void)
+{
+    return ring_count(&eth_receive_ring);
+}
+
+/**
+ * @brief Drop every frame waiting in the ethernet receive ring and return it to the frame pool.
+ *        Only the consumer may pop from the ring, so the consumer is asked to do it when one is registered
+ * @param None
+ * @retval
+ */
+void ethernet_flush_receive_queue(void)
+{
+    TaskHandle_t consumer = eth_receive_consumer;
+    if (consumer == NULL)
+    {
+        ethernet_drain_receive_ring();
+        return;
+    }
+    if (consumer == xTaskGetCurrentTaskHandle())
+    {
+        atomic_store(&eth_receive_flush_request, false);
+        ethernet_drain_receive_ring();
+        return;
+    }
+    atomic_store(&eth_receive_flush_request, true);
+    xTaskNotifyGive(consumer);
+}
+
+/**
+ * @brief Queue a frame received from a wifi peer for the ethernet transmit task. Never blocks, the frame is
+ *        dropped when the link is down or the ring is full. Must only be called from the wifi receive callback
+ * @param[in] raw_data Frame, its wifi driver buffer in eb if the descriptor holds one. Released by the
+ *                     ethernet module in every case
+ * @retval ESP_OK if the frame was queued, ESP_FAIL if it was dropped
+ */
+esp_err_t ethernet_transmit_enqueue(raw_data_t *raw_data)
+{
+    return ethernet_transmit_push(&eth_transmit_ring, raw_data);
+}
+
+/**
+ * @brief Queue a frame the bridge answers an ethernet frame with, e.g. an ARP proxy reply, for the ethernet
+ *        transmit task. Never blocks. Must only be called from the wifi send task
+ * @param[in] raw_data Frame, released by the ethernet module in every case
+ * @retval ESP_OK if the frame was queued, ESP_FAIL if it was dropped
+ */
+esp_err_t ethernet_transmit_reply(raw_data_t *raw_data)
+{
+    return ethernet_transmit_push(&eth_reply_ring, raw_data);
+}
+
+/**
+ * @brief Queue a frame on a transmit ring and wake the transmit task up if the ring was empty
+ * @param[in] ring Transmit ring, owned by the calling task as its only producer
+ * @param[in] raw_data Frame, released in every case
+ * @retval ESP_OK if the frame was queued, ESP_FAIL if it was dropped
+ */
+static esp_err_t ethernet_transmit_push(ring_t *ring, raw_data_t *raw_data)
+{
+    if (!eth_connected)
+    {
+        bridge_count_drop(BRIDGE_DROP_LINK_DOWN);
+        ethernet_transmit_release(raw_data);
+        return ESP_FAIL;
+    }
+    uint32_t queued = ring_push(ring, raw_data);
+    if (queued == 0)
+    {
+        bridge_count_drop(BRIDGE_DROP_QUEUE_FULL);
+        ethernet_transmit_release(raw_data);
+        return ESP_FAIL;
+    }
+    if (ring == &eth_transmit_ring)
+    {
+        telemetry_queue_depth(TELEMETRY_QUEUE_ETH_TRANSMIT, queued);
+    }
+    // Like the receive ring, the task drains the ring before it sleeps
+    if (queued == 1 && eth_transmit_taskHandler != NULL)
+    {
+        xTaskNotifyGive(eth_transmit_taskHandler);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Report how many frames wait in the wifi peer queues, so the link partner is paused while the
+ *        frames waiting for the wifi side pile up. Called by the wifi send task
+ * @param[in] backlog Frames queued for the wifi peers
+ * @retval
+ */
+void ethernet_set_wifi_backlog(uint32_t backlog)
+{
+#if CONFIG_WENET_ETH_PAUSE
+    atomic_store_explicit(&eth_wifi_backlog, backlog, memory_order_relaxed);
+    ethernet_pause_update(ring_count(&eth_receive_ring) + backlog);
+#else
+    (void)backlog;
+#endif
+}
+
 /**
  * @brief Ethernet input path function. This function will be called when new data is received by ethernet mac
  * @param[in] eth_handle Ethernet handler
@@ -80,22 +327,257 @@ void ethernet_uninit(void)
  */
 static esp_err_t ethernet_input_path(esp_eth_handle_t eth_handle, uint8_t *buffer, uint32_t len, void *priv)
 {
-    raw_data_t *new_data = malloc(sizeof(raw_data_t));
-    new_data->data = buffer;
-    new_data->data_length = len;
-    if (xQueueSend(eth_receive_queue, &new_data, pdMS_TO_TICKS(ETH_WAIT_TO_SEND_RAW_TIMOUT)) == pdTRUE)
+    (void)eth_handle;
+    (void)priv;
+    // This runs in the EMAC receive task, it must never block or the driver DMA ring stalls.
+    // Frames are admitted or dropped before anything is allocated for them.
+    fdb_port_t egress_port = FDB_PORT_NONE;
+    uint8_t egress_peer = FDB_PEER_ANY;
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    telemetry_count_rx(TELEMETRY_DIR_ETH_TO_WIFI, len);
+#if CONFIG_WENET_CAPTURE
+    capture_frame(CAPTURE_POINT_ETH_RX, buffer, len, now);
+#endif
+    arp_snoop(buffer, len);
+#if CONFIG_WENET_FDB
+    // Frames between two wired hosts never need to cross the bridge
+    if (!fdb_forward(buffer, FDB_PORT_ETH, FDB_PEER_ANY, &egress_port, &egress_peer))
     {
+        free(buffer);
         return ESP_OK;
     }
-    else
+#endif
+    qos_class_t qos_class = qos_classify(buffer, len);
+    uint32_t backlog = ring_count(&eth_receive_ring);
+    if (backlog >= ETH_RECEIVE_RING_SIZE)
     {
-        ESP_LOGE(ETH_LOG, "ethernet queue is full!!");
-        free(buffer);
+        return ethernet_drop_frame(buffer, NULL, BRIDGE_DROP_QUEUE_FULL);
+    }
+#if CONFIG_WENET_ETH_DROP_CLASS
+    if (backlog >= ETH_RECEIVE_QUEUE_LIMIT && qos_class != QOS_CLASS_CONTROL)
+    {
+        return ethernet_drop_frame(buffer, NULL, BRIDGE_DROP_CLASS);
+    }
+#endif
+    raw_data_t *new_data = pool_alloc_desc();
+    if (new_data == NULL)
+    {
+        return ethernet_drop_frame(buffer, NULL, BRIDGE_DROP_NO_DESC);
+    }
+    // Move the frame to a pool buffer, which already has room for the tunnel encapsulation, and give the
+    // driver buffer back to the heap right away so queued frames never hold heap memory. This is the one
+    // copy a frame costs on its way to the wifi hop, growing the exact size driver buffer instead would
+    // depend on the heap finding free memory right behind it
+    if (len + TUNNEL_MAX_OVERHEAD > POOL_BUF_SIZE)
+    {
+        return ethernet_drop_frame(buffer, new_data, BRIDGE_DROP_OVERSIZE);
+    }
+    uint8_t *frame = pool_alloc_buf();
+    if (frame == NULL)
+    {
+        return ethernet_drop_frame(buffer, new_data, BRIDGE_DROP_NO_BUF);
+    }
+    memcpy(frame, buffer, len);
+    free(buffer);
+    new_data->data = frame;
+    new_data->data_length = len;
+    new_data->timestamp = now;
+    // Frames to a known host go to the wifi peer it is behind, the others are flooded to all peers
+    new_data->peer = egress_port == FDB_PORT_WIFI ? egress_peer : RAW_DATA_PEER_ALL;
+    new_data->qos_class = qos_class;
+    uint32_t queued = ring_push(&eth_receive_ring, new_data);
+    if (queued == 0)
+    {
+        bridge_count_drop(BRIDGE_DROP_QUEUE_FULL);
+        pool_release(new_data);
         return ESP_FAIL;
     }
+    telemetry_queue_depth(TELEMETRY_QUEUE_ETH_RECEIVE, queued);
+#if CONFIG_WENET_ETH_PAUSE
+    ethernet_pause_update(queued + atomic_load_explicit(&eth_wifi_backlog, memory_order_relaxed));
+#endif
+    // The consumer drains the ring until it is empty before it sleeps, so it only needs waking up
+    // when this frame is the first one
+    TaskHandle_t consumer = eth_receive_consumer;
+    if (queued == 1 && consumer != NULL)
+    {
+        xTaskNotifyGive(consumer);
+    }
     return ESP_OK;
 }
 
+/**
+ * @brief Drop a received frame before it is queued and account the reason
+ * @param[in] buffer Driver frame buffer
+ * @param[in] raw_data Frame descriptor already taken for the frame, NULL if none
+ * @param[in] reason Drop reason
+ * @retval ESP_ERR_NO_MEM for pool exhaustion, ESP_FAIL otherwise
+ */
+static esp_err_t ethernet_drop_frame(uint8_t *buffer, raw_data_t *raw_data, bridge_drop_reason_t reason)
+{
+    free(buffer);
+    pool_free_desc(raw_data);
+    bridge_count_drop(reason);
+    return (reason == BRIDGE_DROP_NO_DESC || reason == BRIDGE_DROP_NO_BUF) ? ESP_ERR_NO_MEM : ESP_FAIL;
+}
+
+/**
+ * @brief Release every frame waiting in the ethernet receive ring
+ * @param None
+ * @retval
+ */
+static void ethernet_drain_receive_ring(void)
+{
+    raw_data_t *frames[CONFIG_WENET_ETH_RX_BURST];
+    uint32_t count;
+    while ((count = ring_pop_burst(&eth_receive_ring, frames, CONFIG_WENET_ETH_RX_BURST)) > 0)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bridge_count_drop(BRIDGE_DROP_FLUSH);
+            pool_release(frames[i]);
+        }
+    }
+}
+
+/**
+ * @brief Ethernet transmit task: sends the frames received from the wifi peers and the replies of the bridge,
+ *        so an EMAC transmit stall never blocks the wifi driver task that runs the receive callback
+ * @param[in] pvParameters
+ * @retval
+ */
+static void ethernet_transmit_task(void *pvParameters)
+{
+    (void)pvParameters;
+    TickType_t wait_ticks = portMAX_DELAY;
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, wait_ticks);
+#if CONFIG_WENET_ETH_PAUSE
+        // PAUSE frames go out from here too, ahead of the data, so the EMAC is only fed by one task
+        wait_ticks = ethernet_pause_service();
+#endif
+        ethernet_transmit_drain(&eth_reply_ring);
+        ethernet_transmit_drain(&eth_transmit_ring);
+    }
+}
+
+/**
+ * @brief Send every frame queued on a transmit ring. Must only be called from the transmit task
+ * @param[in] ring Transmit ring
+ * @retval
+ */
+static void ethernet_transmit_drain(ring_t *ring)
+{
+    raw_data_t *frames[ETH_TRANSMIT_BURST];
+    uint32_t count;
+    while ((count = ring_pop_burst(ring, frames, ETH_TRANSMIT_BURST)) > 0)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            raw_data_t *raw_data = frames[i];
+            if (!eth_connected)
+            {
+                // Link lost while the frame was queued
+                bridge_count_drop(BRIDGE_DROP_LINK_DOWN);
+            }
+            else
+            {
+                telemetry_count_tx(TELEMETRY_DIR_WIFI_TO_ETH, raw_data->data_length, raw_data->timestamp);
+                if (esp_eth_transmit(eth_handle, raw_data->data, raw_data->data_length) != ESP_OK)
+                {
+                    telemetry_count_tx_error(TELEMETRY_DIR_WIFI_TO_ETH, 1);
+                }
+            }
+            ethernet_transmit_release(raw_data);
+        }
+    }
+}
+
+#if CONFIG_WENET_ETH_PAUSE
+/**
+ * @brief Decide whether the link partner must be paused, with hysteresis between the two watermarks,
+ *        and wake the transmit task up when that changes
+ * @param[in] backlog Frames waiting for the wifi side, in the receive ring and the wifi peer queues
+ * @retval
+ */
+static void ethernet_pause_update(uint32_t backlog)
+{
+    bool paused = atomic_load_explicit(&eth_paused, memory_order_relaxed);
+    if (paused ? backlog > ETH_PAUSE_LOW : backlog < ETH_PAUSE_HIGH)
+    {
+        return;
+    }
+    // The receive task and the wifi send task both report, only the one that flips the state notifies
+    if (atomic_compare_exchange_strong(&eth_paused, &paused, !paused) && eth_transmit_taskHandler != NULL)
+    {
+        xTaskNotifyGive(eth_transmit_taskHandler);
+    }
+}
+
+/**
+ * @brief Send the PAUSE frame that brings the link partner to the wanted state, or renews a running pause
+ *        before it expires. Must only be called from the transmit task
+ * @param None
+ * @retval Ticks until the pause must be renewed, portMAX_DELAY when the partner is not paused
+ */
+static TickType_t ethernet_pause_service(void)
+{
+    bool paused = atomic_load_explicit(&eth_paused, memory_order_relaxed);
+    TickType_t now = xTaskGetTickCount();
+    if (paused != eth_pause_sent || (paused && (int32_t)(now - eth_pause_renew) >= 0))
+    {
+        if (eth_connected)
+        {
+            ethernet_send_pause(paused ? ETH_PAUSE_QUANTA : 0);
+        }
+        eth_pause_sent = paused;
+        eth_pause_renew = now + ETH_PAUSE_RENEW_TICKS;
+    }
+    return paused ? eth_pause_renew - now : portMAX_DELAY;
+}
+
+/**
+ * @brief Send an 802.3x PAUSE frame. The EMAC driver has no call to send one, it is built like any other frame
+ * @param[in] quanta Pause time in units of 512 bit times, 0 lets the link partner resume at once
+ * @retval
+ */
+static void ethernet_send_pause(uint16_t quanta)
+{
+    uint8_t frame[ETH_PAUSE_FRAME_LEN] = {0};
+    memcpy(frame, eth_pause_addr, sizeof(eth_pause_addr));
+    memcpy(frame + 6, eth_esp_addr, sizeof(eth_esp_addr));
+    frame[12] = ETH_PAUSE_ETHERTYPE >> 8;
+    frame[13] = ETH_PAUSE_ETHERTYPE & 0xFF;
+    frame[14] = ETH_PAUSE_OPCODE >> 8;
+    frame[15] = ETH_PAUSE_OPCODE & 0xFF;
+    frame[16] = quanta >> 8;
+    frame[17] = quanta & 0xFF;
+    if (esp_eth_transmit(eth_handle, frame, sizeof(frame)) == ESP_OK)
+    {
+        bridge_count_pause();
+    }
+}
+#endif
+
+/**
+ * @brief Release a frame queued for transmission. esp_eth_transmit copies the frame to the DMA buffers,
+ *        so the wifi driver buffer can go back as soon as it returns
+ * @param[in] raw_data Frame descriptor
+ * @retval
+ */
+static void ethernet_transmit_release(raw_data_t *raw_data)
+{
+    if (raw_data->eb != NULL)
+    {
+        // The frame lives in the wifi driver buffer
+        wifi_free_rx_buffer(raw_data->eb);
+        pool_free_desc(raw_data);
+        return;
+    }
+    pool_release(raw_data);
+}
+
 /**
  * @brief Uinitialize the ehternet module
  * @param[in] arg extra event arguments
@@ -106,18 +588,30 @@ static esp_err_t ethernet_input_path(esp_eth_handle_t eth_handle, uint8_t *buffe
  */
 static void ethernet_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
+    (void)arg;
+    (void)event_base;
+    (void)event_data;
     switch (event_id)
     {
     case ETHERNET_EVENT_CONNECTED:
         ESP_LOGI(ETH_LOG, "Link Up");
 
-        xQueueReset(eth_receive_queue);
+        ethernet_flush_receive_queue();
         eth_connected = true;
         break;
     case ETHERNET_EVENT_DISCONNECTED:
         eth_connected = false;
+#if CONFIG_WENET_ETH_PAUSE
+        // A new link partner starts unpaused, the transmit task forgets the pause without sending anything
+        atomic_store(&eth_paused, false);
+        if (eth_transmit_taskHandler != NULL)
+        {
+            xTaskNotifyGive(eth_transmit_taskHandler);
+        }
+#endif
         ESP_LOGI(ETH_LOG, "Link Down");
-        xQueueReset(eth_receive_queue);
+        ethernet_flush_receive_queue();
+        fdb_flush(FDB_PORT_ETH, FDB_PEER_ANY);
         break;
     case ETHERNET_EVENT_START:
         ESP_LOGI(ETH_LOG, "Started");
@@ -130,6 +624,60 @@ static void ethernet_event_handler(void *arg, esp_event_base_t event_base, int32
     }
 }
 
+/**
+ * @brief Create the MAC and PHY and install the driver. The MAC creates the EMAC receive task and allocates the
+ *        EMAC interrupt on the core it is created on, so with a configured core the creation runs in a short
+ *        lived task pinned to it
+ * @param None
+ * @retval ESP_OK if the driver was installed
+ */
+static esp_err_t ethernet_create_driver(void)
+{
+#if ETH_RECEIVE_TASK_CORE >= 0
+    eth_create_job_t job = {
+        .caller = xTaskGetCurrentTaskHandle(),
+        .ret = ESP_FAIL,
+    };
+    if (xTaskCreatePinnedToCore(ethernet_create_task, "eth_create_task", ETH_CREATE_TASK_STACK, &job, ETH_RECEIVE_TASK_PRIORITY, NULL, ETH_RECEIVE_TASK_CORE) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return job.ret;
+#else
+    return ethernet_create_board_driver();
+#endif
+}
+
+#if ETH_RECEIVE_TASK_CORE >= 0
+/**
+ * @brief Create the driver on the core the task is pinned to, then report back and end
+ * @param[in] pvParameters Creation job
+ * @retval
+ */
+static void ethernet_create_task(void *pvParameters)
+{
+    eth_create_job_t *job = pvParameters;
+    job->ret = ethernet_create_board_driver();
+    xTaskNotifyGive(job->caller);
+    vTaskDelete(NULL);
+}
+#endif
+
+/**
+ * @brief Create the driver for the MAC and PHY the build targets
+ * @param None
+ * @retval ESP_OK if the driver was installed
+ */
+static esp_err_t ethernet_create_board_driver(void)
+{
+#if CONFIG_WENET_ETH_OPENETH
+    return ethernet_init_openeth(NULL, NULL);
+#else
+    return ethernet_init_LAN8720(NULL, NULL);
+#endif
+}
+
 /**
  * @brief Initialize LAN8720 with ESP32 internal MAC
  *
@@ -146,6 +694,12 @@ static esp_err_t ethernet_init_LAN8720(esp_eth_mac_t **mac_out, esp_eth_phy_t **
     // Init common MAC and PHY configs to the default configs
     eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
     eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    // The driver receive task runs the ethernet input path
+    mac_config.rx_task_stack_size = ETH_RECEIVE_TASK_STACK;
+    mac_config.rx_task_prio = ETH_RECEIVE_TASK_PRIORITY;
+#if ETH_RECEIVE_TASK_CORE >= 0
+    mac_config.flags |= ETH_MAC_FLAG_PIN_TO_CORE;
+#endif
     // Update PHY config
     phy_config.phy_addr = -1; // Set -1 to enable auto address detection in initialization
     phy_config.reset_gpio_num = ETH_PHY_RST_GPIO;
@@ -160,6 +714,51 @@ static esp_err_t ethernet_init_LAN8720(esp_eth_mac_t **mac_out, esp_eth_phy_t **
     esp_eth_mac_t *mac = esp_eth_mac_new_esp32(&esp32_emac_config, &mac_config);
     // Create new LAN8720 PHY instance
     esp_eth_phy_t *phy = esp_eth_phy_new_lan87xx(&phy_config);
+    return ethernet_install_driver(mac, phy, mac_out, phy_out);
+}
+
+#if CONFIG_WENET_ETH_OPENETH
+/**
+ * @brief Initialize the OpenCores Ethernet MAC and the DP83848 PHY emulated by QEMU
+ *
+ * @param[out] mac_out optionally returns Ethernet MAC object
+ * @param[out] phy_out optionally returns Ethernet PHY object
+ * @return
+ *          - ESP_OK if init succeeded
+ *          - ESP_FAIL if init failed
+ */
+static esp_err_t ethernet_init_openeth(esp_eth_mac_t **mac_out, esp_eth_phy_t **phy_out)
+{
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    mac_config.rx_task_stack_size = ETH_RECEIVE_TASK_STACK;
+    mac_config.rx_task_prio = ETH_RECEIVE_TASK_PRIORITY;
+#if ETH_RECEIVE_TASK_CORE >= 0
+    mac_config.flags |= ETH_MAC_FLAG_PIN_TO_CORE;
+#endif
+    // The emulated PHY sits at address 1, has no reset line and reports the link up at once
+    phy_config.phy_addr = 1;
+    phy_config.reset_gpio_num = -1;
+    phy_config.autonego_timeout_ms = 100;
+    esp_eth_mac_t *mac = esp_eth_mac_new_openeth(&mac_config);
+    esp_eth_phy_t *phy = esp_eth_phy_new_dp83848(&phy_config);
+    return ethernet_install_driver(mac, phy, mac_out, phy_out);
+}
+#endif
+
+/**
+ * @brief Install the Ethernet driver on a MAC and PHY, the objects are deleted if it fails
+ *
+ * @param[in] mac Ethernet MAC object
+ * @param[in] phy Ethernet PHY object
+ * @param[out] mac_out optionally returns Ethernet MAC object
+ * @param[out] phy_out optionally returns Ethernet PHY object
+ * @return
+ *          - ESP_OK if install succeeded
+ *          - ESP_FAIL if install failed
+ */
+static esp_err_t ethernet_install_driver(esp_eth_mac_t *mac, esp_eth_phy_t *phy, esp_eth_mac_t **mac_out, esp_eth_phy_t **phy_out)
+{
     // Init Ethernet driver to default and install it
     esp_eth_config_t config = ETH_DEFAULT_CONFIG(mac, phy);
     if (esp_eth_driver_install(&config, &eth_handle) == ESP_OK)
@@ -7,16 +7,24 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_eth.h"
+#include "wenet_pool.h"
 /* Exported macro ------------------------------------------------------------*/
+#define ETH_RECEIVE_BURST CONFIG_WENET_ETH_RX_BURST
 
 /* Exported types ------------------------------------------------------------*/
 
 /* Exported constants --------------------------------------------------------*/
 extern bool eth_connected;
-extern QueueHandle_t eth_receive_queue;
 extern esp_eth_handle_t eth_handle;
 /* Exported functions prototypes ---------------------------------------------*/
 void ethernet_init(void);
+void ethernet_set_receive_consumer(TaskHandle_t consumer);
+uint32_t ethernet_receive_burst(raw_data_t **frames, uint32_t max_count);
+uint32_t ethernet_receive_backlog(void);
+void ethernet_flush_receive_queue(void);
+esp_err_t ethernet_transmit_enqueue(raw_data_t *raw_data);
+esp_err_t ethernet_transmit_reply(raw_data_t *raw_data);
+void ethernet_set_wifi_backlog(uint32_t backlog);
 #endif /* __ETHERNET_H */
 
 /************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
\ No newline at end of file
@@ -4,6 +4,14 @@
 #include "nvs_flash.h"
 #include "wenet_ethernet.h"
 #include "wenet_wifi.h"
+#include "wenet_pool.h"
+#include "wenet_fdb.h"
+#include "wenet_qos.h"
+#include "wenet_arp.h"
+#include "wenet_filter.h"
+#include "wenet_telemetry.h"
+#include "wenet_capture.h"
+#include "esp_console.h"
 #include "esp_private/wifi.h"
 /* Private macro -------------------------------------------------------------*/
 #define ETH_LOG "MANAGER"
@@ -34,20 +42,52 @@ void system_manager_init(void)
     // Create default event loop that running in background
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+    // Initialize the frame pool shared by the ethernet and wifi modules
+    ESP_ERROR_CHECK(pool_init());
+    fdb_init();
+    // Restore the traffic classes stored in NVS
+    qos_init();
+    // Restore the broadcast and multicast rules stored in NVS
+    arp_init();
+    filter_init();
+    telemetry_init();
+#if CONFIG_WENET_CAPTURE
+    capture_init();
+#endif
+
     // // Initialize the ethernet module
     ethernet_init();
 
-    // Initialize the wifi module
+    // Initialize the wifi module, it comes back in the mode stored in NVS. A stored "off" stays off
     wifi_init();
-    wifi_change_ssid_pass("WeNet", "diplomatic10");
-    wifi_set_raw_mode(true);
+    if (!wifi_has_stored_config())
+    {
+        // First boot, nothing stored yet
+        wifi_change_ssid_pass("WeNet", "diplomatic10");
+        wifi_set_raw_mode(true);
 
-    // // Change the wifi mode to access point
-    // wifi_change_mode(WIFI_MODE_AP);
+        // // Change the wifi mode to access point
+        // wifi_change_mode(WIFI_MODE_AP);
+
+        // Change the wifi mode to access point
+        wifi_change_mode(WIFI_MODE_STA);
+    }
 
-    
-    // Change the wifi mode to access point
-    wifi_change_mode(WIFI_MODE_STA);
+#if CONFIG_WENET_TELEMETRY_CONSOLE
+    // Serial console with the "stats" command
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "wenet>";
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_uart(&uart_config, &repl_config, &repl));
+    ESP_ERROR_CHECK(esp_console_register_help_command());
+    ESP_ERROR_CHECK(telemetry_register_console());
+    ESP_ERROR_CHECK(wifi_register_console());
+#if CONFIG_WENET_CAPTURE
+    ESP_ERROR_CHECK(capture_register_console());
+#endif
+    ESP_ERROR_CHECK(esp_console_start_repl(repl));
+#endif
 }
 
 /************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
\ No newline at end of file
@@ -0,0 +1,395 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <stdatomic.h>
+#include "wenet_compress.h"
+/* Private macro -------------------------------------------------------------*/
+#define COMPRESS_ETH_HEADER_LEN 14
+#define COMPRESS_ETH_TYPE_VLAN 0x8100
+#define COMPRESS_ETH_TYPE_IPV4 0x0800
+#define COMPRESS_ETH_TYPE_IPV6 0x86DD
+// LZ4 block format: a match is at least 4 bytes, the last 5 bytes are literals and the last match starts
+// at least 12 bytes before the end
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_LAST_LITERALS 5
+#define COMPRESS_MF_LIMIT 12
+#define COMPRESS_RUN_MASK 15
+// Frames of a flow that miss the saving in a row before the flow is bypassed, and how long it is bypassed
+#define COMPRESS_MISS_LIMIT 4
+#define COMPRESS_SKIP_MIN 16
+#define COMPRESS_BACKOFF_MAX 6
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+static atomic_uint_fast32_t compress_tried;
+static atomic_uint_fast32_t compress_compressed;
+static atomic_uint_fast32_t compress_bypassed;
+static atomic_uint_fast32_t compress_bytes_in;
+static atomic_uint_fast32_t compress_bytes_out;
+static atomic_uint_fast32_t compress_expanded;
+static atomic_uint_fast32_t compress_invalid;
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t compress_flow_hash(const uint8_t *frame, uint32_t len);
+static uint8_t *compress_put_sequence(uint8_t *op, const uint8_t *op_end, const uint8_t *literals, uint32_t literal_len, uint32_t offset, uint32_t match_len);
+static uint8_t *compress_put_length(uint8_t *op, uint32_t len);
+static uint32_t compress_read32(const uint8_t *p);
+static uint32_t compress_hash(uint32_t sequence);
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the compressor state of a task
+ * @param[in] ctx Compressor state
+ * @retval
+ */
+void compress_init(compress_t *ctx)
+{
+    memset(ctx, 0, sizeof(compress_t));
+}
+
+/**
+ * @brief Compress the payload of an ethernet frame in place, unless its flow does not compress. A flow whose
+ *        frames miss COMPRESS_MIN_SAVING percent a few times in a row is sent without trying for a while,
+ *        and for twice as long each time it misses again
+ * @param[in] ctx Compressor state
+ * @param[in,out] frame Ethernet frame, the header is kept and the payload behind it is replaced
+ * @param[in] len Frame length
+ * @retval Length of the compressed frame, 0 if the frame is left as it is
+ */
+uint32_t compress_frame(compress_t *ctx, uint8_t *frame, uint32_t len)
+{
+    if (len < COMPRESS_MIN_LEN || len - COMPRESS_ETH_HEADER_LEN > COMPRESS_BUF_LEN)
+    {
+        return 0;
+    }
+    uint32_t hash = compress_flow_hash(frame, len);
+    compress_flow_t *flow = &ctx->flows[hash % COMPRESS_FLOWS];
+    if (flow->hash != hash)
+    {
+        memset(flow, 0, sizeof(compress_flow_t));
+        flow->hash = hash;
+    }
+    if (flow->skip > 0)
+    {
+        flow->skip--;
+        atomic_fetch_add_explicit(&compress_bypassed, 1, memory_order_relaxed);
+        return 0;
+    }
+    atomic_fetch_add_explicit(&compress_tried, 1, memory_order_relaxed);
+    uint32_t payload_len = len - COMPRESS_ETH_HEADER_LEN;
+    uint32_t capacity = payload_len - (payload_len * COMPRESS_MIN_SAVING + 99) / 100;
+    uint32_t packed = compress_block(ctx, frame + COMPRESS_ETH_HEADER_LEN, payload_len, ctx->out, capacity);
+    if (packed == 0 || packed >= payload_len)
+    {
+        if (++flow->misses >= COMPRESS_MISS_LIMIT)
+        {
+            flow->misses = 0;
+            flow->skip = COMPRESS_SKIP_MIN << flow->backoff;
+            flow->backoff += flow->backoff < COMPRESS_BACKOFF_MAX;
+        }
+        return 0;
+    }
+    flow->misses = 0;
+    flow->backoff = 0;
+    memcpy(frame + COMPRESS_ETH_HEADER_LEN, ctx->out, packed);
+    atomic_fetch_add_explicit(&compress_compressed, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&compress_bytes_in, payload_len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&compress_bytes_out, packed, memory_order_relaxed);
+    return COMPRESS_ETH_HEADER_LEN + packed;
+}
+
+/**
+ * @brief Restore an ethernet frame compressed by compress_frame
+ * @param[in] frame Compressed frame
+ * @param[in] len Compressed frame length
+ * @param[out] out Buffer of COMPRESS_ETH_HEADER_LEN + COMPRESS_BUF_LEN bytes for the restored frame
+ * @retval Length of the restored frame, negative if the frame is malformed
+ */
+int32_t compress_expand_frame(const uint8_t *frame, uint32_t len, uint8_t *out)
+{
+    int32_t payload_len = len > COMPRESS_ETH_HEADER_LEN ? compress_expand(frame + COMPRESS_ETH_HEADER_LEN, len - COMPRESS_ETH_HEADER_LEN, out + COMPRESS_ETH_HEADER_LEN, COMPRESS_BUF_LEN) : -1;
+    if (payload_len < 0)
+    {
+        atomic_fetch_add_explicit(&compress_invalid, 1, memory_order_relaxed);
+        return -1;
+    }
+    memcpy(out, frame, COMPRESS_ETH_HEADER_LEN);
+    atomic_fetch_add_explicit(&compress_expanded, 1, memory_order_relaxed);
+    return COMPRESS_ETH_HEADER_LEN + payload_len;
+}
+
+/**
+ * @brief Compress a block in the LZ4 block format with a single pass greedy parse. Runs without matches
+ *        make the search skip ahead faster, so incompressible data costs little more than a copy
+ * @param[in] ctx Compressor state
+ * @param[in] src Data
+ * @param[in] len Data length, at most 65535 bytes so every match offset fits
+ * @param[out] dst Compressed block
+ * @param[in] capacity Size of dst
+ * @retval Length of the compressed block, 0 if it does not fit in capacity
+ */
+uint32_t compress_block(compress_t *ctx, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t capacity)
+{
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    const uint8_t *op_end = dst + capacity;
+    if (len > COMPRESS_MF_LIMIT)
+    {
+        const uint8_t *match_start_limit = end - COMPRESS_MF_LIMIT;
+        const uint8_t *match_end_limit = end - COMPRESS_LAST_LITERALS;
+        while (ip <= match_start_limit)
+        {
+            uint32_t sequence = compress_read32(ip);
+            uint16_t *slot = &ctx->table[compress_hash(sequence)];
+            uint32_t candidate = *slot;
+            uint32_t pos = (uint32_t)(ip - src);
+            *slot = (uint16_t)pos;
+            if (candidate >= pos || compress_read32(src + candidate) != sequence)
+            {
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            const uint8_t *ref = src + candidate;
+            const uint8_t *match_end = ip + COMPRESS_MIN_MATCH;
+            ref += COMPRESS_MIN_MATCH;
+            while (match_end < match_end_limit && *match_end == *ref)
+            {
+                match_end++;
+                ref++;
+            }
+            op = compress_put_sequence(op, op_end, anchor, (uint32_t)(ip - anchor), pos - candidate, (uint32_t)(match_end - ip));
+            if (op == NULL)
+            {
+                return 0;
+            }
+            ip = match_end;
+            anchor = ip;
+        }
+    }
+    op = compress_put_sequence(op, op_end, anchor, (uint32_t)(end - anchor), 0, 0);
+    return op == NULL ? 0 : (uint32_t)(op - dst);
+}
+
+/**
+ * @brief Expand a block in the LZ4 block format, checking every length and offset against the buffers
+ * @param[in] src Compressed block
+ * @param[in] len Compressed block length
+ * @param[out] dst Expanded data
+ * @param[in] capacity Size of dst
+ * @retval Length of the expanded data, negative if the block is malformed or does not fit
+ */
+int32_t compress_expand(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t capacity)
+{
+    const uint8_t *ip = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    uint32_t room = capacity;
+    while (ip < end)
+    {
+        uint8_t token = *ip++;
+        uint32_t literal_len = token >> 4;
+        if (literal_len == COMPRESS_RUN_MASK)
+        {
+            uint8_t byte;
+            do
+            {
+                if (ip >= end)
+                {
+                    return -1;
+                }
+                byte = *ip++;
+                literal_len += byte;
+            } while (byte == 255);
+        }
+        if (literal_len > (uint32_t)(end - ip) || literal_len > room)
+        {
+            return -1;
+        }
+        memcpy(op, ip, literal_len);
+        op += literal_len;
+        ip += literal_len;
+        room -= literal_len;
+        if (ip == end)
+        {
+            // The last sequence has no match
+            break;
+        }
+        if (end - ip < 2)
+        {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - dst))
+        {
+            return -1;
+        }
+        uint32_t match_len = token & COMPRESS_RUN_MASK;
+        if (match_len == COMPRESS_RUN_MASK)
+        {
+            uint8_t byte;
+            do
+            {
+                if (ip >= end)
+                {
+                    return -1;
+                }
+                byte = *ip++;
+                match_len += byte;
+            } while (byte == 255);
+        }
+        match_len += COMPRESS_MIN_MATCH;
+        if (match_len > room)
+        {
+            return -1;
+        }
+        // Byte by byte, a match may overlap the bytes it produces
+        const uint8_t *ref = op - offset;
+        for (uint32_t i = 0; i < match_len; i++)
+        {
+            op[i] = ref[i];
+        }
+        op += match_len;
+        room -= match_len;
+    }
+    return (int32_t)(op - dst);
+}
+
+/**
+ * @brief Get the compression counters since boot, over every compressor
+ * @param[out] stats Counters
+ * @retval
+ */
+void compress_get_stats(compress_stats_t *stats)
+{
+    stats->tried = atomic_load_explicit(&compress_tried, memory_order_relaxed);
+    stats->compressed = atomic_load_explicit(&compress_compressed, memory_order_relaxed);
+    stats->bypassed = atomic_load_explicit(&compress_bypassed, memory_order_relaxed);
+    stats->bytes_in = atomic_load_explicit(&compress_bytes_in, memory_order_relaxed);
+    stats->bytes_out = atomic_load_explicit(&compress_bytes_out, memory_order_relaxed);
+    stats->expanded = atomic_load_explicit(&compress_expanded, memory_order_relaxed);
+    stats->invalid = atomic_load_explicit(&compress_invalid, memory_order_relaxed);
+}
+
+/**
+ * @brief Hash the flow of an ethernet frame: its addresses and EtherType, and for IP the protocol and the
+ *        ports (or whatever the first four bytes of another protocol hold)
+ * @param[in] frame Ethernet frame
+ * @param[in] len Frame length
+ * @retval Flow hash (FNV-1a)
+ */
+static uint32_t compress_flow_hash(const uint8_t *frame, uint32_t len)
+{
+    uint32_t offset = 12;
+    uint16_t eth_type = (frame[offset] << 8) | frame[offset + 1];
+    offset += 2;
+    if (eth_type == COMPRESS_ETH_TYPE_VLAN && len >= offset + 4)
+    {
+        eth_type = (frame[offset + 2] << 8) | frame[offset + 3];
+        offset += 4;
+    }
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < offset; i++)
+    {
+        hash = (hash ^ frame[i]) * 16777619u;
+    }
+    const uint8_t *ip = frame + offset;
+    uint32_t l4 = 0;
+    uint8_t proto = 0;
+    if (eth_type == COMPRESS_ETH_TYPE_IPV4 && len >= offset + 20 && ((ip[6] & 0x1F) | ip[7]) == 0)
+    {
+        proto = ip[9];
+        l4 = offset + (ip[0] & 0x0F) * 4;
+    }
+    else if (eth_type == COMPRESS_ETH_TYPE_IPV6 && len >= offset + 40)
+    {
+        proto = ip[6];
+        l4 = offset + 40;
+    }
+    hash = (hash ^ proto) * 16777619u;
+    for (uint32_t i = l4; l4 > 0 && i < l4 + 4 && i < len; i++)
+    {
+        hash = (hash ^ frame[i]) * 16777619u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+/**
+ * @brief Append an LZ4 sequence: literals, then a match unless it is the last sequence
+ * @param[in] op Write position
+ * @param[in] op_end End of the output buffer
+ * @param[in] literals Literal bytes
+ * @param[in] literal_len Number of literal bytes
+ * @param[in] offset Match distance
+ * @param[in] match_len Match length, 0 for the last sequence
+ * @retval New write position, NULL if the sequence does not fit
+ */
+static uint8_t *compress_put_sequence(uint8_t *op, const uint8_t *op_end, const uint8_t *literals, uint32_t literal_len, uint32_t offset, uint32_t match_len)
+{
+    // Token, offset and both length extensions at their worst
+    if ((uint32_t)(op_end - op) < 1 + literal_len + literal_len / 255 + 1 + 2 + match_len / 255 + 1)
+    {
+        return NULL;
+    }
+    uint8_t *token = op++;
+    *token = (uint8_t)((literal_len < COMPRESS_RUN_MASK ? literal_len : COMPRESS_RUN_MASK) << 4);
+    if (literal_len >= COMPRESS_RUN_MASK)
+    {
+        op = compress_put_length(op, literal_len - COMPRESS_RUN_MASK);
+    }
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+    if (match_len == 0)
+    {
+        return op;
+    }
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    match_len -= COMPRESS_MIN_MATCH;
+    *token |= (uint8_t)(match_len < COMPRESS_RUN_MASK ? match_len : COMPRESS_RUN_MASK);
+    if (match_len >= COMPRESS_RUN_MASK)
+    {
+        op = compress_put_length(op, match_len - COMPRESS_RUN_MASK);
+    }
+    return op;
+}
+
+/**
+ * @brief Append the extension bytes of a literal or match length
+ * @param[in] op Write position
+ * @param[in] len Length beyond the 15 the token holds
+ * @retval New write position
+ */
+static uint8_t *compress_put_length(uint8_t *op, uint32_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/**
+ * @brief Read 4 bytes from an unaligned address
+ * @param[in] p Address
+ * @retval Value
+ */
+static uint32_t compress_read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Hash table slot of a 4 byte sequence
+ * @param[in] sequence Sequence
+ * @retval Slot index
+ */
+static uint32_t compress_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
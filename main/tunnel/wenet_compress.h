@@ -0,0 +1,56 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __COMPRESS_H
+#define __COMPRESS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+/* Exported macro ------------------------------------------------------------*/
+// Largest ethernet payload (behind the 14 byte header) that is compressed or expanded
+#define COMPRESS_BUF_LEN 1536
+#define COMPRESS_HASH_BITS 10
+#define COMPRESS_FLOWS 32
+#define COMPRESS_MIN_LEN CONFIG_WENET_TUNNEL_COMPRESS_MIN_LEN
+#define COMPRESS_MIN_SAVING CONFIG_WENET_TUNNEL_COMPRESS_MIN_SAVING
+/* Exported types ------------------------------------------------------------*/
+// Compression outcome of one flow, to stop trying on flows that do not compress
+typedef struct
+{
+    uint32_t hash;
+    uint16_t skip;   // Frames still sent without trying
+    uint8_t misses;  // Frames in a row that did not compress enough
+    uint8_t backoff; // Doubles the skip count on every bypass in a row
+} compress_flow_t;
+
+// Compressor state of one task. The hash table is not cleared between frames, positions left over from
+// earlier frames are checked against the data like any other candidate.
+typedef struct
+{
+    uint16_t table[1 << COMPRESS_HASH_BITS];
+    compress_flow_t flows[COMPRESS_FLOWS];
+    uint8_t out[COMPRESS_BUF_LEN];
+} compress_t;
+
+typedef struct
+{
+    uint32_t tried;      // Frames given to the compressor
+    uint32_t compressed; // Frames sent compressed
+    uint32_t bypassed;   // Frames of flows that did not compress, sent without trying
+    uint32_t bytes_in;   // Payload bytes of the compressed frames
+    uint32_t bytes_out;  // The same payloads compressed
+    uint32_t expanded;   // Compressed frames received and expanded
+    uint32_t invalid;    // Compressed frames received that could not be expanded
+} compress_stats_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void compress_init(compress_t *ctx);
+uint32_t compress_frame(compress_t *ctx, uint8_t *frame, uint32_t len);
+int32_t compress_expand_frame(const uint8_t *frame, uint32_t len, uint8_t *out);
+uint32_t compress_block(compress_t *ctx, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t capacity);
+int32_t compress_expand(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t capacity);
+void compress_get_stats(compress_stats_t *stats);
+#endif /* __COMPRESS_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
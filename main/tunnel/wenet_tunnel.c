@@ -0,0 +1,1001 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "esp_timer.h"
+#include "wenet_tunnel.h"
+/* Private macro -------------------------------------------------------------*/
+#if CONFIG_WENET_TUNNEL_COMPACT
+#define TUNNEL_MAX_VERSION TUNNEL_VERSION_COMPACT
+#else
+#define TUNNEL_MAX_VERSION TUNNEL_VERSION_LEGACY
+#endif
+// Last byte of a version 1 frame: version (7..6), kind (5..4), flags (3..0)
+#define TUNNEL_HEADER(version, kind, flags) (uint8_t)(((version) << 6) | ((kind) << 4) | ((flags) & 0x0F))
+#define TUNNEL_HEADER_VERSION(header) ((header) >> 6)
+#define TUNNEL_HEADER_KIND(header) (((header) >> 4) & 0x03)
+#define TUNNEL_KIND_DATA 0
+#define TUNNEL_KIND_CONTROL 1
+#define TUNNEL_KIND_AGGREGATE 2
+#define TUNNEL_KIND_FRAGMENT 3
+// Data frame flags
+#define TUNNEL_FLAG_COMPRESSED 0x01 // Payload behind the outer header is an LZ4 block, see wenet_compress.c
+// Address field encodings, destination in bits 1..0 and source in bits 3..2 of the mode byte
+#define TUNNEL_ADDR_FULL 0  // 6 byte address
+#define TUNNEL_ADDR_INDEX 1 // 1 byte index learned from an earlier binding
+#define TUNNEL_ADDR_BIND 2  // 6 byte address followed by the index it is bound to
+#define TUNNEL_BIND_REPEAT 4
+#define TUNNEL_ADDR_AGE_S 300
+#define TUNNEL_PROBE_LEN 8
+#define TUNNEL_HELLO_MIN_MS 1000
+#define TUNNEL_HELLO_MAX_MS 30000
+#define TUNNEL_CTRL_HELLO 1
+#define TUNNEL_CTRL_RESYNC 2
+#define TUNNEL_CTRL_FLAG_PEER_HEARD 0x01
+#define TUNNEL_CTRL_FLAG_AGGREGATE 0x02 // Sender decodes aggregate frames
+#define TUNNEL_CTRL_FLAG_COMPRESS 0x04  // Sender expands compressed data frames
+#define TUNNEL_CTRL_FLAG_FRAGMENT 0x08  // Sender reassembles fragmented frames
+// Fragment index in bits 7..4 and fragment count in bits 3..0 of the second trailer byte
+#define TUNNEL_FRAGMENT_MAX 15
+#define TUNNEL_CTRL_PAYLOAD_LEN 14
+#define TUNNEL_TIME_AFTER_EQ(a, b) ((int32_t)((a) - (b)) >= 0)
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+// A legacy peer takes the last 12 bytes of a control frame as the original addresses. They decode as a
+// link local destination, so the frame the legacy peer puts on its wire is never forwarded by a switch.
+static const uint8_t tunnel_legacy_guard_addr[TUNNEL_ADDR_LEN] = {0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E};
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t tunnel_now_ms(void);
+static void tunnel_tx_service(tunnel_peer_t *peer);
+static uint32_t tunnel_encapsulate_compact(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, const uint8_t *dst_addr, const uint8_t *src_addr);
+static int32_t tunnel_decode_data(tunnel_peer_t *peer, uint8_t *frame, uint32_t len);
+static int32_t tunnel_deliver_data(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, tunnel_deliver_t deliver, void *ctx);
+static uint8_t tunnel_put_addr(tunnel_peer_t *peer, uint8_t **tail, const uint8_t *addr, uint32_t now_s);
+static const uint8_t *tunnel_get_addr(tunnel_peer_t *peer, const uint8_t *frame, uint32_t *pos, uint8_t mode);
+static void tunnel_handle_control(tunnel_peer_t *peer, const uint8_t *payload, uint32_t len);
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+static int32_t tunnel_reassemble(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, tunnel_deliver_t deliver, void *ctx);
+static tunnel_reassembly_slot_t *tunnel_reassembly_claim(tunnel_reassembly_t *reassembly, uint32_t now);
+static void tunnel_reassembly_drop(tunnel_reassembly_slot_t *slot);
+#endif
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the tunnel state towards a peer. The peer starts in legacy mode
+ * @param[in] peer Peer state
+ * @retval
+ */
+void tunnel_peer_init(tunnel_peer_t *peer)
+{
+    memset(peer, 0, sizeof(tunnel_peer_t));
+    atomic_init(&peer->peer_version, TUNNEL_VERSION_LEGACY);
+    atomic_init(&peer->peer_heard, false);
+    atomic_init(&peer->peer_acked, false);
+    atomic_init(&peer->peer_aggregate, false);
+    atomic_init(&peer->peer_compress, false);
+    atomic_init(&peer->peer_fragment, false);
+    atomic_init(&peer->hello_request, false);
+    atomic_init(&peer->resync_request, false);
+    atomic_init(&peer->rebind_request, false);
+    atomic_init(&peer->tx_reset_request, false);
+    atomic_init(&peer->rx_reset_request, false);
+    peer->tx_hello_interval = TUNNEL_HELLO_MIN_MS;
+    peer->tx_hello_next = tunnel_now_ms();
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    peer->tx_mtu = TUNNEL_MTU;
+#endif
+}
+
+/**
+ * @brief Restart the negotiation with a peer, e.g. after the wifi link was re-established.
+ *        Safe to call from any task, the tables are cleared by their owners on next use
+ * @param[in] peer Peer state
+ * @retval
+ */
+void tunnel_peer_reset(tunnel_peer_t *peer)
+{
+    atomic_store(&peer->peer_heard, false);
+    atomic_store(&peer->peer_acked, false);
+    atomic_store(&peer->peer_aggregate, false);
+    atomic_store(&peer->peer_compress, false);
+    atomic_store(&peer->peer_fragment, false);
+    atomic_store(&peer->peer_version, TUNNEL_VERSION_LEGACY);
+    atomic_store(&peer->tx_reset_request, true);
+    atomic_store(&peer->rx_reset_request, true);
+    atomic_store(&peer->hello_request, TUNNEL_MAX_VERSION > TUNNEL_VERSION_LEGACY);
+}
+
+/**
+ * @brief Get the tunnel version used towards a peer
+ * @param[in] peer Peer state
+ * @retval Negotiated version, legacy until the peer announced a newer one
+ */
+uint8_t tunnel_tx_version(tunnel_peer_t *peer)
+{
+    if (!atomic_load(&peer->peer_heard))
+    {
+        return TUNNEL_VERSION_LEGACY;
+    }
+    uint8_t version = atomic_load(&peer->peer_version);
+    return version > TUNNEL_MAX_VERSION ? TUNNEL_MAX_VERSION : version;
+}
+
+/**
+ * @brief Encapsulate an ethernet frame in place for the wifi hop
+ * @param[in] peer Peer state
+ * @param[in,out] frame Ethernet frame, the buffer must have TUNNEL_MAX_OVERHEAD bytes of room behind it
+ * @param[in] len Ethernet frame length
+ * @param[in] dst_addr Wifi peer address
+ * @param[in] src_addr Local wifi address
+ * @retval Length of the encapsulated frame
+ */
+uint32_t tunnel_encapsulate(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, const uint8_t *dst_addr, const uint8_t *src_addr)
+{
+    tunnel_tx_service(peer);
+    if (tunnel_tx_version(peer) == TUNNEL_VERSION_LEGACY || len < TUNNEL_ETH_HEADER_LEN)
+    {
+        // Move the original destination and source addresses to the trailer and rewrite the header
+        memcpy(frame + len, frame, TUNNEL_LEGACY_TRAILER_LEN);
+        memcpy(frame, dst_addr, TUNNEL_ADDR_LEN);
+        memcpy(frame + TUNNEL_ADDR_LEN, src_addr, TUNNEL_ADDR_LEN);
+        peer->stats.tx_frames++;
+        peer->stats.tx_legacy_frames++;
+        peer->stats.tx_overhead += TUNNEL_LEGACY_TRAILER_LEN;
+        return len + TUNNEL_LEGACY_TRAILER_LEN;
+    }
+    return tunnel_encapsulate_compact(peer, frame, len, dst_addr, src_addr);
+}
+
+/**
+ * @brief Check whether frames to a peer may be packed into aggregate frames
+ * @param[in] peer Peer state
+ * @retval true if the compact version is in use and the peer announced it decodes aggregates
+ */
+bool tunnel_aggregate_supported(tunnel_peer_t *peer)
+{
+    return tunnel_tx_version(peer) == TUNNEL_VERSION_COMPACT && atomic_load(&peer->peer_aggregate);
+}
+
+/**
+ * @brief Encapsulate an ethernet frame and append it to an aggregate frame. Must only be used when
+ *        tunnel_aggregate_supported is true
+ * @param[in] peer Peer state
+ * @param[in,out] aggregate Aggregate frame buffer, it needs TUNNEL_AGGREGATE_ROOM(len) bytes of room behind
+ *                aggregate_len plus one byte for tunnel_aggregate_finish
+ * @param[in] aggregate_len Current aggregate length, 0 to start a new aggregate
+ * @param[in,out] frame Ethernet frame of at least TUNNEL_ETH_HEADER_LEN bytes, encapsulated in place so the
+ *                buffer must have TUNNEL_MAX_OVERHEAD bytes of room behind it
+ * @param[in] len Ethernet frame length
+ * @param[in] dst_addr Wifi peer address
+ * @param[in] src_addr Local wifi address
+ * @retval New aggregate length
+ */
+uint32_t tunnel_aggregate_append(tunnel_peer_t *peer, uint8_t *aggregate, uint32_t aggregate_len, uint8_t *frame, uint32_t len, const uint8_t *dst_addr, const uint8_t *src_addr)
+{
+    if (aggregate_len == 0)
+    {
+        memcpy(aggregate, dst_addr, TUNNEL_ADDR_LEN);
+        memcpy(aggregate + TUNNEL_ADDR_LEN, src_addr, TUNNEL_ADDR_LEN);
+        aggregate[12] = (uint8_t)(TUNNEL_ETH_TYPE >> 8);
+        aggregate[13] = (uint8_t)TUNNEL_ETH_TYPE;
+        aggregate_len = TUNNEL_ETH_HEADER_LEN;
+    }
+    tunnel_tx_service(peer);
+    uint32_t body_len = tunnel_encapsulate_compact(peer, frame, len, dst_addr, src_addr) - TUNNEL_ETH_HEADER_LEN;
+    aggregate[aggregate_len] = (uint8_t)(body_len >> 8);
+    aggregate[aggregate_len + 1] = (uint8_t)body_len;
+    memcpy(aggregate + aggregate_len + 2, frame + TUNNEL_ETH_HEADER_LEN, body_len);
+    // The length field replaces one of the outer headers saved by packing the frames together
+    peer->stats.tx_overhead += 2;
+    return aggregate_len + 2 + body_len;
+}
+
+/**
+ * @brief Terminate an aggregate frame with its tunnel header
+ * @param[in] peer Peer state
+ * @param[in,out] aggregate Aggregate frame buffer
+ * @param[in] aggregate_len Aggregate length returned by the last tunnel_aggregate_append
+ * @retval Length of the aggregate frame to send
+ */
+uint32_t tunnel_aggregate_finish(tunnel_peer_t *peer, uint8_t *aggregate, uint32_t aggregate_len)
+{
+    aggregate[aggregate_len] = TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_AGGREGATE, 0);
+    peer->stats.tx_aggregates++;
+    return aggregate_len + 1;
+}
+
+/**
+ * @brief Encapsulate an ethernet frame in place with the compact (version 1) trailer
+ * @param[in] peer Peer state
+ * @param[in,out] frame Ethernet frame of at least TUNNEL_ETH_HEADER_LEN bytes, the buffer must have
+ *                TUNNEL_MAX_OVERHEAD bytes of room behind it
+ * @param[in] len Ethernet frame length
+ * @param[in] dst_addr Wifi peer address
+ * @param[in] src_addr Local wifi address
+ * @retval Length of the encapsulated frame, its payload compressed when the peer expands compressed frames
+ *         and the frame compresses
+ */
+static uint32_t tunnel_encapsulate_compact(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, const uint8_t *dst_addr, const uint8_t *src_addr)
+{
+    uint8_t original[TUNNEL_ETH_HEADER_LEN];
+    memcpy(original, frame, TUNNEL_ETH_HEADER_LEN);
+    uint8_t flags = 0;
+#if CONFIG_WENET_TUNNEL_COMPRESS
+    if (peer->tx_compress != NULL && atomic_load(&peer->peer_compress))
+    {
+        uint32_t packed_len = compress_frame(peer->tx_compress, frame, len);
+        if (packed_len > 0)
+        {
+            len = packed_len;
+            flags = TUNNEL_FLAG_COMPRESSED;
+            peer->stats.tx_compressed++;
+        }
+    }
+#endif
+    uint32_t now_s = tunnel_now_ms() / 1000;
+    // Trailer: source field, destination field, original EtherType, address modes, tunnel header
+    uint8_t *tail = frame + len;
+    uint8_t src_mode = tunnel_put_addr(peer, &tail, original + TUNNEL_ADDR_LEN, now_s);
+    uint8_t dst_mode = tunnel_put_addr(peer, &tail, original, now_s);
+    *tail++ = original[12];
+    *tail++ = original[13];
+    *tail++ = (uint8_t)((src_mode << 2) | dst_mode);
+    *tail++ = TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_DATA, flags);
+    memcpy(frame, dst_addr, TUNNEL_ADDR_LEN);
+    memcpy(frame + TUNNEL_ADDR_LEN, src_addr, TUNNEL_ADDR_LEN);
+    frame[12] = (uint8_t)(TUNNEL_ETH_TYPE >> 8);
+    frame[13] = (uint8_t)TUNNEL_ETH_TYPE;
+    uint32_t wire_len = tail - frame;
+    peer->stats.tx_frames++;
+    peer->stats.tx_overhead += wire_len - len;
+    return wire_len;
+}
+
+/**
+ * @brief Decapsulate a frame received from the wifi hop in place. Frames of a legacy peer are recognised
+ *        by their EtherType, which is the original one instead of TUNNEL_ETH_TYPE
+ * @param[in] peer Peer state
+ * @param[in,out] frame Received frame
+ * @param[in] len Received frame length
+ * @retval Length of the restored ethernet frame, 0 if the frame was a control frame consumed by the
+ *         tunnel, negative if the frame is invalid and has to be dropped
+ */
+int32_t tunnel_decapsulate(tunnel_peer_t *peer, uint8_t *frame, uint32_t len)
+{
+    if (atomic_exchange(&peer->rx_reset_request, false))
+    {
+        memset(peer->rx_table, 0, sizeof(peer->rx_table));
+    }
+    if (len < TUNNEL_ETH_HEADER_LEN + 1)
+    {
+        peer->stats.rx_invalid++;
+        return -1;
+    }
+    uint16_t eth_type = (frame[12] << 8) | frame[13];
+    if (eth_type != TUNNEL_ETH_TYPE)
+    {
+        if (len < TUNNEL_ETH_HEADER_LEN + TUNNEL_LEGACY_TRAILER_LEN)
+        {
+            peer->stats.rx_invalid++;
+            return -1;
+        }
+        memcpy(frame, frame + (len - TUNNEL_LEGACY_TRAILER_LEN), TUNNEL_LEGACY_TRAILER_LEN);
+        peer->stats.rx_frames++;
+        return len - TUNNEL_LEGACY_TRAILER_LEN;
+    }
+    uint8_t header = frame[len - 1];
+    if (TUNNEL_HEADER_VERSION(header) != TUNNEL_VERSION_COMPACT)
+    {
+        peer->stats.rx_invalid++;
+        return -1;
+    }
+    if (TUNNEL_HEADER_KIND(header) == TUNNEL_KIND_CONTROL)
+    {
+        tunnel_handle_control(peer, frame + TUNNEL_ETH_HEADER_LEN, len - TUNNEL_ETH_HEADER_LEN - 1);
+        return 0;
+    }
+    if (header != TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_DATA, 0))
+    {
+        // Aggregates carry several frames, compressed frames do not fit in place and fragments are only part
+        // of a frame, they are only accepted by tunnel_receive
+        peer->stats.rx_invalid++;
+        return -1;
+    }
+    return tunnel_decode_data(peer, frame, len);
+}
+
+/**
+ * @brief Check whether a frame received from the wifi hop is an aggregate. The frames of an aggregate are
+ *        restored over the end of the one before, so only the frame being delivered is intact
+ * @param[in] frame Received frame
+ * @param[in] len Received frame length
+ * @retval true for an aggregate frame
+ */
+bool tunnel_is_aggregate(const uint8_t *frame, uint32_t len)
+{
+    return len > TUNNEL_AGGREGATE_EMPTY_LEN && ((frame[12] << 8) | frame[13]) == TUNNEL_ETH_TYPE &&
+           frame[len - 1] == TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_AGGREGATE, 0);
+}
+
+/**
+ * @brief Check whether a frame received from the wifi hop is a data frame with a compressed payload. It is
+ *        restored to the expansion buffer instead of in place
+ * @param[in] frame Received frame
+ * @param[in] len Received frame length
+ * @retval true for a compressed data frame
+ */
+bool tunnel_is_compressed(const uint8_t *frame, uint32_t len)
+{
+    return len > TUNNEL_ETH_HEADER_LEN + 4 && ((frame[12] << 8) | frame[13]) == TUNNEL_ETH_TYPE &&
+           frame[len - 1] == TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_DATA, TUNNEL_FLAG_COMPRESSED);
+}
+
+/**
+ * @brief Check whether a frame received from the wifi hop is a fragment. The frame it belongs to is restored
+ *        in a reassembly slot
+ * @param[in] frame Received frame
+ * @param[in] len Received frame length
+ * @retval true for a fragment
+ */
+bool tunnel_is_fragment(const uint8_t *frame, uint32_t len)
+{
+    return len > TUNNEL_ETH_HEADER_LEN + TUNNEL_FRAGMENT_TRAILER_LEN && ((frame[12] << 8) | frame[13]) == TUNNEL_ETH_TYPE &&
+           frame[len - 1] == TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_FRAGMENT, 0);
+}
+
+/**
+ * @brief Decapsulate a frame received from the wifi hop in place and deliver the ethernet frames it carries,
+ *        one for a data frame or several for an aggregate frame. A fragment is kept until its frame is complete
+ * @param[in] peer Peer state
+ * @param[in,out] frame Received frame
+ * @param[in] len Received frame length
+ * @param[in] deliver Called for every restored ethernet frame
+ * @param[in] ctx Passed to deliver
+ * @retval Number of ethernet frames delivered, negative if the frame is invalid
+ */
+int32_t tunnel_receive(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, tunnel_deliver_t deliver, void *ctx)
+{
+    bool compressed = tunnel_is_compressed(frame, len);
+    bool fragment = tunnel_is_fragment(frame, len);
+    if (!compressed && !fragment && !tunnel_is_aggregate(frame, len))
+    {
+        int32_t eth_len = tunnel_decapsulate(peer, frame, len);
+        if (eth_len <= 0)
+        {
+            return eth_len;
+        }
+        deliver(ctx, frame, eth_len);
+        return 1;
+    }
+    if (atomic_exchange(&peer->rx_reset_request, false))
+    {
+        memset(peer->rx_table, 0, sizeof(peer->rx_table));
+    }
+    if (compressed)
+    {
+        return tunnel_deliver_data(peer, frame, len, deliver, ctx);
+    }
+    if (fragment)
+    {
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+        return tunnel_reassemble(peer, frame, len, deliver, ctx);
+#else
+        peer->stats.rx_invalid++;
+        return -1;
+#endif
+    }
+    peer->stats.rx_aggregates++;
+    int32_t count = 0;
+    uint32_t pos = TUNNEL_ETH_HEADER_LEN;
+    uint32_t end = len - 1;
+    while (pos + 2 <= end)
+    {
+        uint32_t body_len = (frame[pos] << 8) | frame[pos + 1];
+        pos += 2;
+        if (body_len > end - pos || body_len < 4 || (frame[pos + body_len - 1] & ~TUNNEL_FLAG_COMPRESSED) != TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_DATA, 0))
+        {
+            peer->stats.rx_invalid++;
+            return count > 0 ? count : -1;
+        }
+        // Decode the frame in place as if its outer header preceded it. That header space holds the end of
+        // the previous frame, which was already delivered, and the length field that was just read.
+        uint8_t *inner = frame + pos - TUNNEL_ETH_HEADER_LEN;
+        count += tunnel_deliver_data(peer, inner, body_len + TUNNEL_ETH_HEADER_LEN, deliver, ctx) > 0;
+        pos += body_len;
+    }
+    return count;
+}
+
+/**
+ * @brief Send an encapsulated frame, split into fragments when it is longer than the transport carries and
+ *        the peer reassembles them. Each fragment is built in place over the end of the one sent before it
+ * @param[in] peer Peer state
+ * @param[in,out] frame Encapsulated frame, overwritten by the fragments. The buffer must have
+ *                TUNNEL_FRAGMENT_TRAILER_LEN bytes of room behind it
+ * @param[in] len Encapsulated frame length
+ * @param[in] send Called for the frame, or for every fragment in order
+ * @param[in] ctx Passed to send
+ * @retval true if the frame or all of its fragments were taken
+ */
+bool tunnel_send(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, tunnel_send_t send, void *ctx)
+{
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    if (len <= peer->tx_mtu || !atomic_load(&peer->peer_fragment) || ((frame[12] << 8) | frame[13]) != TUNNEL_ETH_TYPE)
+    {
+        return send(ctx, frame, len);
+    }
+    // Equal fragments, so the last one is not a sliver that costs a whole airtime slot for a few bytes
+    uint32_t body_len = len - TUNNEL_ETH_HEADER_LEN;
+    uint32_t room = peer->tx_mtu - TUNNEL_ETH_HEADER_LEN - TUNNEL_FRAGMENT_TRAILER_LEN;
+    uint32_t count = (body_len + room - 1) / room;
+    uint32_t chunk = (body_len + count - 1) / count;
+    uint8_t header[TUNNEL_ETH_HEADER_LEN];
+    memcpy(header, frame, TUNNEL_ETH_HEADER_LEN);
+    uint8_t id = peer->tx_fragment_id++;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t start = TUNNEL_ETH_HEADER_LEN + i * chunk;
+        uint32_t part = len - start < chunk ? len - start : chunk;
+        uint8_t *fragment = frame + start - TUNNEL_ETH_HEADER_LEN;
+        uint8_t *tail = frame + start + part;
+        // The trailer covers the start of the next fragment until this one is sent
+        uint8_t saved[TUNNEL_FRAGMENT_TRAILER_LEN];
+        memcpy(saved, tail, TUNNEL_FRAGMENT_TRAILER_LEN);
+        memcpy(fragment, header, TUNNEL_ETH_HEADER_LEN);
+        tail[0] = id;
+        tail[1] = (uint8_t)((i << 4) | count);
+        tail[2] = TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_FRAGMENT, 0);
+        bool sent = send(ctx, fragment, TUNNEL_ETH_HEADER_LEN + part + TUNNEL_FRAGMENT_TRAILER_LEN);
+        memcpy(tail, saved, TUNNEL_FRAGMENT_TRAILER_LEN);
+        if (!sent)
+        {
+            // The peer cannot restore the frame without this fragment, the rest is not worth the airtime
+            return false;
+        }
+        peer->stats.tx_fragments++;
+    }
+    peer->stats.tx_fragmented++;
+    peer->stats.tx_overhead += (count - 1) * TUNNEL_ETH_HEADER_LEN + count * TUNNEL_FRAGMENT_TRAILER_LEN;
+    return true;
+#else
+    (void)peer;
+    return send(ctx, frame, len);
+#endif
+}
+
+/**
+ * @brief Restore an ethernet frame from a compact data frame and deliver it. A compressed payload is expanded
+ *        to the expansion buffer of the peer
+ * @param[in] peer Peer state
+ * @param[in,out] frame Data frame, the outer header is overwritten with the restored one
+ * @param[in] len Data frame length
+ * @param[in] deliver Called with the restored ethernet frame
+ * @param[in] ctx Passed to deliver
+ * @retval 1 if the frame was delivered, negative if the frame is invalid
+ */
+static int32_t tunnel_deliver_data(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, tunnel_deliver_t deliver, void *ctx)
+{
+    bool compressed = (frame[len - 1] & TUNNEL_FLAG_COMPRESSED) != 0;
+    int32_t eth_len = tunnel_decode_data(peer, frame, len);
+    if (eth_len <= 0)
+    {
+        return -1;
+    }
+    if (compressed)
+    {
+#if CONFIG_WENET_TUNNEL_COMPRESS
+        eth_len = peer->rx_expand != NULL ? compress_expand_frame(frame, eth_len, peer->rx_expand) : -1;
+        frame = peer->rx_expand;
+#else
+        eth_len = -1;
+#endif
+        if (eth_len < 0)
+        {
+            peer->stats.rx_invalid++;
+            return -1;
+        }
+        peer->stats.rx_compressed++;
+    }
+    deliver(ctx, frame, eth_len);
+    return 1;
+}
+
+/**
+ * @brief Restore an ethernet frame from a compact data frame in place
+ * @param[in] peer Peer state
+ * @param[in,out] frame Data frame, the outer header is overwritten with the restored one
+ * @param[in] len Data frame length
+ * @retval Length of the restored ethernet frame, negative if the frame is invalid
+ */
+static int32_t tunnel_decode_data(tunnel_peer_t *peer, uint8_t *frame, uint32_t len)
+{
+    if (len < TUNNEL_ETH_HEADER_LEN + 4)
+    {
+        peer->stats.rx_invalid++;
+        return -1;
+    }
+    uint8_t modes = frame[len - 2];
+    uint8_t restored[TUNNEL_ETH_HEADER_LEN];
+    restored[12] = frame[len - 4];
+    restored[13] = frame[len - 3];
+    uint32_t pos = len - 4;
+    const uint8_t *dst = tunnel_get_addr(peer, frame, &pos, modes & 0x03);
+    if (dst == NULL)
+    {
+        return -1;
+    }
+    // The destination field has to be copied before the source field is parsed, a binding may overwrite it
+    memcpy(restored, dst, TUNNEL_ADDR_LEN);
+    const uint8_t *src = tunnel_get_addr(peer, frame, &pos, (modes >> 2) & 0x03);
+    if (src == NULL)
+    {
+        return -1;
+    }
+    memcpy(restored + TUNNEL_ADDR_LEN, src, TUNNEL_ADDR_LEN);
+    memcpy(frame, restored, TUNNEL_ETH_HEADER_LEN);
+    peer->stats.rx_frames++;
+    return pos;
+}
+
+/**
+ * @brief Check whether a control frame is waiting to be sent right away
+ * @param[in] peer Peer state
+ * @retval true if the wifi send task should call tunnel_build_control now
+ */
+bool tunnel_control_pending(tunnel_peer_t *peer)
+{
+    return atomic_load(&peer->hello_request) || atomic_load(&peer->resync_request);
+}
+
+/**
+ * @brief Get the time until the next periodic control frame is due
+ * @param[in] peer Peer state
+ * @retval Milliseconds, UINT32_MAX if no periodic control frame is needed
+ */
+uint32_t tunnel_control_delay_ms(tunnel_peer_t *peer)
+{
+    if (tunnel_control_pending(peer))
+    {
+        return 0;
+    }
+    if (TUNNEL_MAX_VERSION == TUNNEL_VERSION_LEGACY || atomic_load(&peer->peer_acked))
+    {
+        return UINT32_MAX;
+    }
+    int32_t delay = (int32_t)(peer->tx_hello_next - tunnel_now_ms());
+    return delay > 0 ? (uint32_t)delay : 0;
+}
+
+/**
+ * @brief Build the next due control frame. Must only be called from the wifi send task
+ * @param[in] peer Peer state
+ * @param[out] frame Buffer of at least TUNNEL_CONTROL_FRAME_LEN bytes
+ * @param[in] dst_addr Wifi peer address
+ * @param[in] src_addr Local wifi address
+ * @retval Length of the control frame, 0 if no control frame is due
+ */
+uint32_t tunnel_build_control(tunnel_peer_t *peer, uint8_t *frame, const uint8_t *dst_addr, const uint8_t *src_addr)
+{
+    tunnel_tx_service(peer);
+    uint32_t now = tunnel_now_ms();
+    uint8_t type;
+    if (atomic_exchange(&peer->resync_request, false))
+    {
+        type = TUNNEL_CTRL_RESYNC;
+    }
+    else if (atomic_exchange(&peer->hello_request, false))
+    {
+        type = TUNNEL_CTRL_HELLO;
+    }
+    else if (TUNNEL_MAX_VERSION > TUNNEL_VERSION_LEGACY && !atomic_load(&peer->peer_acked) && TUNNEL_TIME_AFTER_EQ(now, peer->tx_hello_next))
+    {
+        // Keep announcing until the peer confirms, backing off for peers that do not speak the tunnel protocol
+        type = TUNNEL_CTRL_HELLO;
+        peer->tx_hello_next = now + peer->tx_hello_interval;
+        peer->tx_hello_interval = peer->tx_hello_interval * 2 > TUNNEL_HELLO_MAX_MS ? TUNNEL_HELLO_MAX_MS : peer->tx_hello_interval * 2;
+    }
+    else
+    {
+        return 0;
+    }
+    memcpy(frame, dst_addr, TUNNEL_ADDR_LEN);
+    memcpy(frame + TUNNEL_ADDR_LEN, src_addr, TUNNEL_ADDR_LEN);
+    frame[12] = (uint8_t)(TUNNEL_ETH_TYPE >> 8);
+    frame[13] = (uint8_t)TUNNEL_ETH_TYPE;
+    uint8_t *payload = frame + TUNNEL_ETH_HEADER_LEN;
+    memset(payload, 0, TUNNEL_CTRL_PAYLOAD_LEN);
+    payload[0] = type;
+    payload[1] = TUNNEL_MAX_VERSION;
+    payload[2] = (atomic_load(&peer->peer_heard) ? TUNNEL_CTRL_FLAG_PEER_HEARD : 0) | TUNNEL_CTRL_FLAG_AGGREGATE;
+#if CONFIG_WENET_TUNNEL_COMPRESS
+    payload[2] |= peer->rx_expand != NULL ? TUNNEL_CTRL_FLAG_COMPRESS : 0;
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    payload[2] |= peer->rx_reassembly != NULL ? TUNNEL_CTRL_FLAG_FRAGMENT : 0;
+#endif
+    memcpy(payload + 3, tunnel_legacy_guard_addr, TUNNEL_ADDR_LEN);
+    payload[TUNNEL_CTRL_PAYLOAD_LEN] = TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_CONTROL, 0);
+    return TUNNEL_ETH_HEADER_LEN + TUNNEL_CTRL_PAYLOAD_LEN + 1;
+}
+
+/**
+ * @brief Get a snapshot of the tunnel counters of a peer
+ * @param[in] peer Peer state
+ * @param[out] stats Tunnel counters
+ * @retval
+ */
+void tunnel_get_stats(tunnel_peer_t *peer, tunnel_stats_t *stats)
+{
+    *stats = peer->stats;
+}
+
+#if CONFIG_WENET_TUNNEL_COMPRESS
+/**
+ * @brief Let the tunnel towards a peer compress the frames it sends and expand the frames it receives. The
+ *        peer is told it may compress in the next HELLO. Both buffers belong to the task using that side of
+ *        the tunnel and may be shared by all the peers it serves
+ * @param[in] peer Peer state
+ * @param[in] tx_compress Compressor of the sending task, NULL to send uncompressed
+ * @param[in] rx_expand TUNNEL_EXPAND_BUF_LEN bytes of the receiving task, NULL to refuse compressed frames
+ * @retval
+ */
+void tunnel_set_compression(tunnel_peer_t *peer, compress_t *tx_compress, uint8_t *rx_expand)
+{
+    peer->tx_compress = tx_compress;
+    peer->rx_expand = rx_expand;
+}
+#endif
+
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+/**
+ * @brief Initialize the reassembly slots of a receiving task
+ * @param[in] reassembly Reassembly slots
+ * @retval
+ */
+void tunnel_reassembly_init(tunnel_reassembly_t *reassembly)
+{
+    memset(reassembly, 0, sizeof(tunnel_reassembly_t));
+}
+
+/**
+ * @brief Let a peer send frames longer than TUNNEL_MTU in fragments, restored in the reassembly slots of the
+ *        receiving task. The peer is told in the next HELLO
+ * @param[in] peer Peer state
+ * @param[in] reassembly Reassembly slots of the receiving task, NULL to refuse fragments
+ * @retval
+ */
+void tunnel_set_reassembly(tunnel_peer_t *peer, tunnel_reassembly_t *reassembly)
+{
+    peer->rx_reassembly = reassembly;
+}
+
+/**
+ * @brief Set the longest frame the transport to a peer carries, longer frames are sent in fragments
+ * @param[in] peer Peer state
+ * @param[in] mtu Transport MTU, outer header included. TUNNEL_MTU still applies when it is lower
+ * @retval
+ */
+void tunnel_set_mtu(tunnel_peer_t *peer, uint32_t mtu)
+{
+    peer->tx_mtu = mtu < TUNNEL_MTU ? (uint16_t)mtu : TUNNEL_MTU;
+}
+#endif
+
+/**
+ * @brief Get the time base of the tunnel
+ * @param None
+ * @retval Milliseconds since boot, wrapping
+ */
+static uint32_t tunnel_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/**
+ * @brief Apply reset and rebind requests to the encoder state
+ * @param[in] peer Peer state
+ * @retval
+ */
+static void tunnel_tx_service(tunnel_peer_t *peer)
+{
+    if (atomic_exchange(&peer->tx_reset_request, false))
+    {
+        memset(peer->tx_table, 0, sizeof(peer->tx_table));
+        peer->tx_hello_interval = TUNNEL_HELLO_MIN_MS;
+        peer->tx_hello_next = tunnel_now_ms();
+    }
+    if (atomic_exchange(&peer->rebind_request, false))
+    {
+        for (uint32_t i = 0; i < TUNNEL_TX_INDEX_NUM; i++)
+        {
+            peer->tx_table[i].bind_left = TUNNEL_BIND_REPEAT;
+        }
+    }
+}
+
+/**
+ * @brief Append an address field to the trailer. Known addresses are replaced by their index, new ones
+ *        are bound to a free or aged index and sent with the binding a few times so the peer learns it
+ * @param[in] peer Peer state
+ * @param[in,out] tail Trailer write position
+ * @param[in] addr Address
+ * @param[in] now_s Current time in seconds
+ * @retval Address field encoding
+ */
+static uint8_t tunnel_put_addr(tunnel_peer_t *peer, uint8_t **tail, const uint8_t *addr, uint32_t now_s)
+{
+    uint32_t hash = (addr[0] ^ addr[2] ^ addr[4]) * 31 + (addr[1] ^ addr[3] ^ addr[5]);
+    int32_t victim = -1;
+    for (uint32_t probe = 0; probe < TUNNEL_PROBE_LEN && probe < TUNNEL_TX_INDEX_NUM; probe++)
+    {
+        uint32_t slot = (hash + probe) % TUNNEL_TX_INDEX_NUM;
+        tunnel_tx_entry_t *entry = &peer->tx_table[slot];
+        if (!entry->valid)
+        {
+            if (victim < 0)
+            {
+                victim = slot;
+            }
+            break;
+        }
+        if (memcmp(entry->addr, addr, TUNNEL_ADDR_LEN) == 0)
+        {
+            entry->last_used = now_s;
+            victim = slot;
+            break;
+        }
+        if (victim < 0 && now_s - entry->last_used > TUNNEL_ADDR_AGE_S)
+        {
+            victim = slot;
+        }
+    }
+    uint8_t *out = *tail;
+    if (victim < 0)
+    {
+        memcpy(out, addr, TUNNEL_ADDR_LEN);
+        *tail = out + TUNNEL_ADDR_LEN;
+        return TUNNEL_ADDR_FULL;
+    }
+    tunnel_tx_entry_t *entry = &peer->tx_table[victim];
+    if (!entry->valid || memcmp(entry->addr, addr, TUNNEL_ADDR_LEN) != 0)
+    {
+        memcpy(entry->addr, addr, TUNNEL_ADDR_LEN);
+        entry->last_used = now_s;
+        entry->bind_left = TUNNEL_BIND_REPEAT;
+        entry->valid = true;
+    }
+    if (entry->bind_left > 0)
+    {
+        entry->bind_left--;
+        memcpy(out, addr, TUNNEL_ADDR_LEN);
+        out[TUNNEL_ADDR_LEN] = (uint8_t)victim;
+        *tail = out + TUNNEL_ADDR_LEN + 1;
+        return TUNNEL_ADDR_BIND;
+    }
+    out[0] = (uint8_t)victim;
+    *tail = out + 1;
+    return TUNNEL_ADDR_INDEX;
+}
+
+/**
+ * @brief Parse an address field backwards from the end of the trailer
+ * @param[in] peer Peer state
+ * @param[in] frame Received frame
+ * @param[in,out] pos End of the field, moved to its start
+ * @param[in] mode Address field encoding
+ * @retval Address, NULL if the field is malformed or refers to an unknown index
+ */
+static const uint8_t *tunnel_get_addr(tunnel_peer_t *peer, const uint8_t *frame, uint32_t *pos, uint8_t mode)
+{
+    uint32_t field_len = (mode == TUNNEL_ADDR_FULL) ? TUNNEL_ADDR_LEN : (mode == TUNNEL_ADDR_INDEX) ? 1 : TUNNEL_ADDR_LEN + 1;
+    if (mode > TUNNEL_ADDR_BIND || *pos < TUNNEL_ETH_HEADER_LEN + field_len)
+    {
+        peer->stats.rx_invalid++;
+        return NULL;
+    }
+    *pos -= field_len;
+    const uint8_t *field = frame + *pos;
+    if (mode == TUNNEL_ADDR_FULL)
+    {
+        return field;
+    }
+    uint8_t index = field[field_len - 1];
+    if (index >= TUNNEL_RX_INDEX_NUM)
+    {
+        peer->stats.rx_invalid++;
+        return NULL;
+    }
+    tunnel_rx_entry_t *entry = &peer->rx_table[index];
+    if (mode == TUNNEL_ADDR_BIND)
+    {
+        memcpy(entry->addr, field, TUNNEL_ADDR_LEN);
+        entry->valid = true;
+        return field;
+    }
+    if (!entry->valid)
+    {
+        // The binding was lost on the air, ask the peer to send its bindings again
+        peer->stats.rx_unknown_index++;
+        atomic_store(&peer->resync_request, true);
+        return NULL;
+    }
+    return entry->addr;
+}
+
+/**
+ * @brief Process a received control frame
+ * @param[in] peer Peer state
+ * @param[in] payload Control payload
+ * @param[in] len Control payload length
+ * @retval
+ */
+static void tunnel_handle_control(tunnel_peer_t *peer, const uint8_t *payload, uint32_t len)
+{
+    if (len < 3)
+    {
+        peer->stats.rx_invalid++;
+        return;
+    }
+    peer->stats.rx_control++;
+    switch (payload[0])
+    {
+    case TUNNEL_CTRL_HELLO:
+    {
+        atomic_store(&peer->peer_version, payload[1]);
+        bool was_heard = atomic_exchange(&peer->peer_heard, true);
+        bool acked = (payload[2] & TUNNEL_CTRL_FLAG_PEER_HEARD) != 0;
+        atomic_store(&peer->peer_aggregate, (payload[2] & TUNNEL_CTRL_FLAG_AGGREGATE) != 0);
+        atomic_store(&peer->peer_compress, (payload[2] & TUNNEL_CTRL_FLAG_COMPRESS) != 0);
+        atomic_store(&peer->peer_fragment, (payload[2] & TUNNEL_CTRL_FLAG_FRAGMENT) != 0);
+        if (acked)
+        {
+            atomic_store(&peer->peer_acked, true);
+        }
+        // Answer right away when the peer has not heard us yet, or when this is the first HELLO we got,
+        // so the peer learns that we have heard it
+        if (!acked || !was_heard)
+        {
+            atomic_store(&peer->hello_request, true);
+        }
+        break;
+    }
+    case TUNNEL_CTRL_RESYNC:
+        atomic_store(&peer->rebind_request, true);
+        break;
+    default:
+        break;
+    }
+}
+
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+/**
+ * @brief Add a received fragment to its frame, and deliver the frame once its last fragment arrived
+ * @param[in] peer Peer state
+ * @param[in] frame Received fragment
+ * @param[in] len Received fragment length
+ * @param[in] deliver Called with the restored ethernet frame
+ * @param[in] ctx Passed to deliver
+ * @retval 1 if the frame was completed and delivered, 0 if it is still incomplete or was dropped, negative if the
+ *         fragment or the restored frame is invalid
+ */
+static int32_t tunnel_reassemble(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, tunnel_deliver_t deliver, void *ctx)
+{
+    uint8_t id = frame[len - 3];
+    uint8_t index = frame[len - 2] >> 4;
+    uint8_t count = frame[len - 2] & 0x0F;
+    uint32_t part = len - TUNNEL_ETH_HEADER_LEN - TUNNEL_FRAGMENT_TRAILER_LEN;
+    if (peer->rx_reassembly == NULL || count < 2 || index >= count ||
+        (index == 0 && TUNNEL_ETH_HEADER_LEN + part > TUNNEL_REASSEMBLY_BUF_LEN))
+    {
+        // A first fragment longer than a slot holds comes from a broken or hostile peer, it never started a frame
+        peer->stats.rx_invalid++;
+        return -1;
+    }
+    uint32_t now = tunnel_now_ms();
+    tunnel_reassembly_slot_t *slot = NULL;
+    for (uint32_t i = 0; i < TUNNEL_REASSEMBLY_SLOTS; i++)
+    {
+        if (peer->rx_reassembly->slots[i].owner == peer)
+        {
+            slot = &peer->rx_reassembly->slots[i];
+            break;
+        }
+    }
+    if (index == 0)
+    {
+        if (slot != NULL)
+        {
+            // A peer sends one frame at a time, the frame in progress lost its last fragments
+            tunnel_reassembly_drop(slot);
+        }
+        else
+        {
+            slot = tunnel_reassembly_claim(peer->rx_reassembly, now);
+        }
+        if (slot == NULL)
+        {
+            // Every slot holds a frame of another peer that may still complete
+            peer->stats.rx_frag_dropped++;
+            return 0;
+        }
+        slot->owner = peer;
+        slot->started = now;
+        slot->id = id;
+        slot->count = count;
+        slot->next = 1;
+        slot->len = (uint16_t)(TUNNEL_ETH_HEADER_LEN + part);
+        memcpy(slot->data, frame, slot->len);
+        return 0;
+    }
+    if (slot == NULL || slot->id != id || slot->count != count || slot->next != index ||
+        now - slot->started > TUNNEL_REASSEMBLY_TIMEOUT_MS || slot->len + part > TUNNEL_REASSEMBLY_BUF_LEN)
+    {
+        // Not the fragment the frame in progress expects: it starts a frame whose first fragment was lost, or
+        // a fragment in between was lost
+        if (slot != NULL)
+        {
+            tunnel_reassembly_drop(slot);
+        }
+        peer->stats.rx_frag_dropped++;
+        return 0;
+    }
+    memcpy(slot->data + slot->len, frame + TUNNEL_ETH_HEADER_LEN, part);
+    slot->len += part;
+    if (++slot->next < count)
+    {
+        return 0;
+    }
+    // The slot is free again, the frame stays in it until deliver returns
+    slot->owner = NULL;
+    if ((slot->data[slot->len - 1] & ~TUNNEL_FLAG_COMPRESSED) != TUNNEL_HEADER(TUNNEL_VERSION_COMPACT, TUNNEL_KIND_DATA, 0))
+    {
+        peer->stats.rx_invalid++;
+        return -1;
+    }
+    peer->stats.rx_reassembled++;
+    return tunnel_deliver_data(peer, slot->data, slot->len, deliver, ctx);
+}
+
+/**
+ * @brief Find a slot for a new frame: a free one, else the oldest one once its frame timed out
+ * @param[in] reassembly Reassembly slots
+ * @param[in] now Current time in milliseconds
+ * @retval Slot, NULL if every slot holds a frame that has not timed out yet
+ */
+static tunnel_reassembly_slot_t *tunnel_reassembly_claim(tunnel_reassembly_t *reassembly, uint32_t now)
+{
+    tunnel_reassembly_slot_t *oldest = &reassembly->slots[0];
+    for (uint32_t i = 0; i < TUNNEL_REASSEMBLY_SLOTS; i++)
+    {
+        tunnel_reassembly_slot_t *slot = &reassembly->slots[i];
+        if (slot->owner == NULL)
+        {
+            return slot;
+        }
+        if (now - slot->started > now - oldest->started)
+        {
+            oldest = slot;
+        }
+    }
+    if (now - oldest->started <= TUNNEL_REASSEMBLY_TIMEOUT_MS)
+    {
+        return NULL;
+    }
+    tunnel_reassembly_drop(oldest);
+    return oldest;
+}
+
+/**
+ * @brief Drop the frame in progress in a slot, counting its fragments against the peer they came from
+ * @param[in] slot Reassembly slot
+ * @retval
+ */
+static void tunnel_reassembly_drop(tunnel_reassembly_slot_t *slot)
+{
+    if (slot->owner != NULL)
+    {
+        slot->owner->stats.rx_frag_dropped += slot->next;
+        slot->owner = NULL;
+    }
+}
+#endif
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,176 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TUNNEL_H
+#define __TUNNEL_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#if CONFIG_WENET_TUNNEL_COMPRESS
+#include "wenet_compress.h"
+#endif
+/* Exported macro ------------------------------------------------------------*/
+#define TUNNEL_ADDR_LEN 6
+#define TUNNEL_ETH_HEADER_LEN 14
+// Legacy (version 0) trailer: original destination and source addresses
+#define TUNNEL_LEGACY_TRAILER_LEN (2 * TUNNEL_ADDR_LEN)
+// Worst case growth of a frame by the encapsulation, both addresses sent with their index binding
+#define TUNNEL_ENCAP_OVERHEAD (2 * (TUNNEL_ADDR_LEN + 1) + 4)
+// Fragment trailer: frame id, fragment index and count, tunnel header
+#define TUNNEL_FRAGMENT_TRAILER_LEN 3
+// Room a frame buffer needs behind the frame: the encapsulation, then the trailer of the last fragment
+#define TUNNEL_MAX_OVERHEAD (TUNNEL_ENCAP_OVERHEAD + TUNNEL_FRAGMENT_TRAILER_LEN)
+// EtherType of version 1 tunnel frames (IEEE local experimental EtherType 1)
+#define TUNNEL_ETH_TYPE 0x88B5
+#define TUNNEL_VERSION_LEGACY 0
+#define TUNNEL_VERSION_COMPACT 1
+#define TUNNEL_RX_INDEX_NUM 255
+#if CONFIG_WENET_TUNNEL_COMPACT
+#define TUNNEL_TX_INDEX_NUM CONFIG_WENET_TUNNEL_MAC_TABLE_SIZE
+#else
+#define TUNNEL_TX_INDEX_NUM 1
+#endif
+// Aggregate frame: outer header, then per frame a 2 byte length and the frame encapsulated without its outer
+// header, then the tunnel header byte
+#define TUNNEL_AGGREGATE_EMPTY_LEN (TUNNEL_ETH_HEADER_LEN + 1)
+// Worst case space an ethernet frame of len bytes takes in an aggregate
+#define TUNNEL_AGGREGATE_ROOM(len) (2 + (len) - TUNNEL_ETH_HEADER_LEN + TUNNEL_ENCAP_OVERHEAD)
+// Largest control frame built by tunnel_build_control
+#define TUNNEL_CONTROL_FRAME_LEN 64
+#if CONFIG_WENET_TUNNEL_COMPRESS
+// Buffer a compressed frame is expanded to, see tunnel_set_compression
+#define TUNNEL_EXPAND_BUF_LEN (TUNNEL_ETH_HEADER_LEN + COMPRESS_BUF_LEN)
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+// Longest frame the wifi driver carries, longer tunnel frames are sent in fragments
+#define TUNNEL_MTU CONFIG_WENET_TUNNEL_MTU
+#define TUNNEL_REASSEMBLY_SLOTS CONFIG_WENET_TUNNEL_REASSEMBLY_SLOTS
+#define TUNNEL_REASSEMBLY_TIMEOUT_MS CONFIG_WENET_TUNNEL_REASSEMBLY_TIMEOUT_MS
+// Longest tunnel frame that is reassembled, a VLAN tagged frame of the largest pool buffer plus its trailer
+#define TUNNEL_REASSEMBLY_BUF_LEN 1600
+#endif
+/* Exported types ------------------------------------------------------------*/
+typedef struct tunnel_reassembly tunnel_reassembly_t;
+
+typedef struct
+{
+    uint8_t addr[TUNNEL_ADDR_LEN];
+    uint32_t last_used; // Seconds
+    uint8_t bind_left;  // Frames that still carry the full address with the index binding
+    bool valid;
+} tunnel_tx_entry_t;
+
+typedef struct
+{
+    uint8_t addr[TUNNEL_ADDR_LEN];
+    bool valid;
+} tunnel_rx_entry_t;
+
+typedef struct
+{
+    uint32_t tx_frames;        // Data frames encapsulated
+    uint32_t tx_legacy_frames; // Data frames sent with the legacy trailer
+    uint32_t tx_overhead;      // Bytes added by the encapsulation
+    uint32_t tx_aggregates;    // Aggregate frames sent, their frames are counted in tx_frames
+    uint32_t tx_compressed;    // Data frames sent with a compressed payload
+    uint32_t tx_fragmented;    // Frames sent in fragments
+    uint32_t tx_fragments;     // Fragments sent
+    uint32_t rx_frames;        // Data frames decapsulated
+    uint32_t rx_aggregates;    // Aggregate frames received, their frames are counted in rx_frames
+    uint32_t rx_compressed;    // Data frames received with a compressed payload
+    uint32_t rx_reassembled;   // Frames restored from their fragments
+    uint32_t rx_frag_dropped;  // Fragments dropped: their frame missed a fragment, timed out or lost its slot
+    uint32_t rx_control;       // Control frames received
+    uint32_t rx_unknown_index; // Frames dropped because of an unknown address index
+    uint32_t rx_invalid;       // Malformed frames dropped
+} tunnel_stats_t;
+
+// Called for every ethernet frame restored from a received frame. The frame lives in the receive buffer and is
+// overwritten once the callback returns
+typedef void (*tunnel_deliver_t)(void *ctx, uint8_t *frame, uint32_t len);
+
+// Called for every frame, or fragment, ready to be handed to the wifi driver. Returns true if it was taken
+typedef bool (*tunnel_send_t)(void *ctx, uint8_t *frame, uint32_t len);
+
+// Tunnel state towards one wifi peer. The encoder side (tx_*) is only used from the wifi send task and
+// the decoder side (rx_*) only from the wifi receive callback, negotiation flags are shared atomics.
+typedef struct
+{
+    tunnel_tx_entry_t tx_table[TUNNEL_TX_INDEX_NUM];
+    uint32_t tx_hello_next;     // Milliseconds
+    uint32_t tx_hello_interval; // Milliseconds
+    tunnel_rx_entry_t rx_table[TUNNEL_RX_INDEX_NUM];
+    atomic_uint_fast8_t peer_version; // Highest version announced by the peer
+    atomic_bool peer_heard;           // A HELLO of the peer was received
+    atomic_bool peer_acked;           // The peer confirmed it has heard our HELLO
+    atomic_bool peer_aggregate;       // The peer decodes aggregate frames
+    atomic_bool peer_compress;        // The peer expands compressed frames
+    atomic_bool peer_fragment;        // The peer reassembles fragmented frames
+    atomic_bool hello_request;        // Send a HELLO as soon as possible
+    atomic_bool resync_request;       // Ask the peer to send its index bindings again
+    atomic_bool rebind_request;       // The peer asked for our index bindings
+    atomic_bool tx_reset_request;
+    atomic_bool rx_reset_request;
+#if CONFIG_WENET_TUNNEL_COMPRESS
+    compress_t *tx_compress; // Compressor of the sending task, NULL to send uncompressed
+    uint8_t *rx_expand;      // TUNNEL_EXPAND_BUF_LEN bytes of the receiving task, NULL to refuse compressed frames
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    uint8_t tx_fragment_id;             // Id of the next fragmented frame
+    uint16_t tx_mtu;                    // Longest frame the transport to the peer carries, at most TUNNEL_MTU
+    tunnel_reassembly_t *rx_reassembly; // Reassembly slots of the receiving task, NULL to refuse fragments
+#endif
+    tunnel_stats_t stats;
+} tunnel_peer_t;
+
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+// Frame being restored from its fragments. The fragments of a frame are sent back to back and arrive in order
+typedef struct
+{
+    tunnel_peer_t *owner; // Peer the fragments come from, NULL for a free slot
+    uint32_t started;     // Milliseconds, arrival of the first fragment
+    uint16_t len;         // Bytes restored so far, outer header included
+    uint8_t id;
+    uint8_t count;
+    uint8_t next; // Index of the fragment expected next
+    uint8_t data[TUNNEL_REASSEMBLY_BUF_LEN];
+} tunnel_reassembly_slot_t;
+
+// Reassembly slots of one receiving task, shared by all the peers it serves
+struct tunnel_reassembly
+{
+    tunnel_reassembly_slot_t slots[TUNNEL_REASSEMBLY_SLOTS];
+};
+#endif
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void tunnel_peer_init(tunnel_peer_t *peer);
+void tunnel_peer_reset(tunnel_peer_t *peer);
+uint32_t tunnel_encapsulate(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, const uint8_t *dst_addr, const uint8_t *src_addr);
+int32_t tunnel_decapsulate(tunnel_peer_t *peer, uint8_t *frame, uint32_t len);
+bool tunnel_is_aggregate(const uint8_t *frame, uint32_t len);
+bool tunnel_is_compressed(const uint8_t *frame, uint32_t len);
+bool tunnel_is_fragment(const uint8_t *frame, uint32_t len);
+int32_t tunnel_receive(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, tunnel_deliver_t deliver, void *ctx);
+bool tunnel_send(tunnel_peer_t *peer, uint8_t *frame, uint32_t len, tunnel_send_t send, void *ctx);
+bool tunnel_aggregate_supported(tunnel_peer_t *peer);
+uint32_t tunnel_aggregate_append(tunnel_peer_t *peer, uint8_t *aggregate, uint32_t aggregate_len, uint8_t *frame, uint32_t len, const uint8_t *dst_addr, const uint8_t *src_addr);
+uint32_t tunnel_aggregate_finish(tunnel_peer_t *peer, uint8_t *aggregate, uint32_t aggregate_len);
+bool tunnel_control_pending(tunnel_peer_t *peer);
+uint32_t tunnel_build_control(tunnel_peer_t *peer, uint8_t *frame, const uint8_t *dst_addr, const uint8_t *src_addr);
+uint32_t tunnel_control_delay_ms(tunnel_peer_t *peer);
+uint8_t tunnel_tx_version(tunnel_peer_t *peer);
+void tunnel_get_stats(tunnel_peer_t *peer, tunnel_stats_t *stats);
+#if CONFIG_WENET_TUNNEL_COMPRESS
+void tunnel_set_compression(tunnel_peer_t *peer, compress_t *tx_compress, uint8_t *rx_expand);
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+void tunnel_reassembly_init(tunnel_reassembly_t *reassembly);
+void tunnel_set_reassembly(tunnel_peer_t *peer, tunnel_reassembly_t *reassembly);
+void tunnel_set_mtu(tunnel_peer_t *peer, uint32_t mtu);
+#endif
+#endif /* __TUNNEL_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
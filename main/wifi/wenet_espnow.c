@@ -0,0 +1,348 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "wenet_espnow.h"
+#include "wenet_station.h"
+/* Private macro -------------------------------------------------------------*/
+#define ESPNOW_LOG "ESPNOW"
+#define ESPNOW_CHANNEL CONFIG_WENET_ESPNOW_CHANNEL
+#define ESPNOW_PEERS CONFIG_WENET_ESPNOW_PEERS
+#define ESPNOW_PMK CONFIG_WENET_ESPNOW_PMK
+#define ESPNOW_LMK CONFIG_WENET_ESPNOW_LMK
+// The listed peers are encrypted once a peer key is set
+#define ESPNOW_ENCRYPT (sizeof(ESPNOW_LMK) > 1)
+_Static_assert(sizeof(ESPNOW_LMK) == 1 || sizeof(ESPNOW_LMK) == ESP_NOW_KEY_LEN + 1, "CONFIG_WENET_ESPNOW_LMK must be empty or 16 characters");
+_Static_assert(sizeof(ESPNOW_LMK) == 1 || sizeof(ESPNOW_PMK) == ESP_NOW_KEY_LEN + 1, "CONFIG_WENET_ESPNOW_PMK must be 16 characters when a peer key is set");
+#if CONFIG_WENET_ESPNOW_LEARN_PEERS
+#define ESPNOW_LINK_LOSS CONFIG_WENET_ESPNOW_LINK_LOSS
+#endif
+// Every peer becomes a wifi peer of the forwarding core
+#define ESPNOW_PEER_MAX STATION_MAX
+/* Private typedef -----------------------------------------------------------*/
+// Coordinator reached over ESP-NOW
+typedef struct
+{
+    uint8_t addr[TUNNEL_ADDR_LEN];
+    bool used;
+    bool configured;  // Listed in CONFIG_WENET_ESPNOW_PEERS, linked for as long as the transport runs
+    bool up;          // Reported to the forwarding core
+    uint8_t failures; // Sends in a row the peer did not acknowledge
+} espnow_peer_t;
+/* Private function prototypes -----------------------------------------------*/
+static esp_err_t espnow_start(wifi_interface_t ifx, const uint8_t *local_addr, transport_link_cb_t link_cb);
+static void espnow_stop(wifi_interface_t ifx);
+static esp_err_t espnow_reg_rxcb(wifi_interface_t ifx, wifi_rxcb_t rx_callback);
+static esp_err_t espnow_tx(wifi_interface_t ifx, void *buffer, uint16_t len);
+static esp_err_t espnow_reg_tx_done(transport_tx_done_cb_t tx_done_cb);
+static void espnow_add_configured_peers(void);
+static espnow_peer_t *espnow_add_peer(const uint8_t *addr, bool configured);
+static espnow_peer_t *espnow_find_peer(const uint8_t *addr);
+static void espnow_receive(const esp_now_recv_info_t *info, const uint8_t *data, int len);
+static void espnow_sent(const uint8_t *addr, esp_now_send_status_t status);
+/* Private variables ---------------------------------------------------------*/
+// Connectionless links between coordinators. A frame goes out as soon as the peer is known, there is no
+// association and no access point in between
+const transport_t transport_espnow = {
+    .name = "espnow",
+    .mtu = ESPNOW_MTU,
+    .start = espnow_start,
+    .stop = espnow_stop,
+    .reg_rxcb = espnow_reg_rxcb,
+    .tx = espnow_tx,
+    .reg_tx_done = espnow_reg_tx_done,
+};
+// The peers and the receive buffer are only used from the wifi driver task while the transport runs
+static espnow_peer_t espnow_peers[ESPNOW_PEER_MAX];
+static uint8_t espnow_rx_buffer[ESPNOW_MTU];
+static wifi_interface_t espnow_ifx;
+static transport_link_cb_t espnow_link_cb;
+static wifi_rxcb_t espnow_rx_callback;
+static transport_tx_done_cb_t espnow_tx_done_cb;
+static bool espnow_started;
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Start ESP-NOW on a started wifi interface and bring the links to the configured peers up
+ * @param[in] ifx Wifi interface ESP-NOW sends on
+ * @param[in] local_addr Local wifi address
+ * @param[in] link_cb Told about the peers found and lost
+ * @retval Result of esp_now_init
+ */
+static esp_err_t espnow_start(wifi_interface_t ifx, const uint8_t *local_addr, transport_link_cb_t link_cb)
+{
+    memset(espnow_peers, 0, sizeof(espnow_peers));
+    espnow_ifx = ifx;
+    espnow_link_cb = link_cb;
+    esp_err_t ret = esp_now_init();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (ESPNOW_ENCRYPT)
+    {
+        esp_now_set_pmk((const uint8_t *)ESPNOW_PMK);
+    }
+    esp_now_register_recv_cb(espnow_receive);
+    esp_now_register_send_cb(espnow_sent);
+    if (ifx == WIFI_IF_STA)
+    {
+        // The station joins no access point, it stays on the channel of the coordinator links
+        esp_wifi_set_channel(ESPNOW_CHANNEL, WIFI_SECOND_CHAN_NONE);
+    }
+    espnow_started = true;
+    espnow_add_configured_peers();
+    ESP_LOGI(ESPNOW_LOG, "ESP-NOW links started on " MACSTR ", %s", MAC2STR(local_addr), ESPNOW_ENCRYPT ? "encrypted" : "NOT encrypted");
+    return ESP_OK;
+}
+
+/**
+ * @brief Stop ESP-NOW, which forgets the peers. The forwarding core drops its wifi peers itself
+ * @param[in] ifx Wifi interface
+ * @retval
+ */
+static void espnow_stop(wifi_interface_t ifx)
+{
+    (void)ifx;
+    if (!espnow_started)
+    {
+        return;
+    }
+    espnow_started = false;
+    esp_now_unregister_recv_cb();
+    esp_now_unregister_send_cb();
+    esp_now_deinit();
+    memset(espnow_peers, 0, sizeof(espnow_peers));
+}
+
+/**
+ * @brief Register the callback that gets the tunnel frames of the peers
+ * @param[in] ifx Wifi interface
+ * @param[in] rx_callback Receive callback, NULL to stop receiving. It gets no driver buffer, the frame is only
+ *            valid during the call
+ * @retval ESP_OK
+ */
+static esp_err_t espnow_reg_rxcb(wifi_interface_t ifx, wifi_rxcb_t rx_callback)
+{
+    (void)ifx;
+    espnow_rx_callback = rx_callback;
+    return ESP_OK;
+}
+
+/**
+ * @brief Send a tunnel frame to the peer its outer destination address names. The outer addresses are left
+ *        to the ESP-NOW header
+ * @param[in] ifx Wifi interface
+ * @param[in] buffer Tunnel frame
+ * @param[in] len Frame length, at most ESPNOW_MTU
+ * @retval Result of esp_now_send, ESP_ERR_NO_MEM while the ESP-NOW buffers are in use
+ */
+static esp_err_t espnow_tx(wifi_interface_t ifx, void *buffer, uint16_t len)
+{
+    (void)ifx;
+    if (len <= ESPNOW_ADDR_HEADER_LEN || len > ESPNOW_MTU)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t ret = esp_now_send(buffer, (const uint8_t *)buffer + ESPNOW_ADDR_HEADER_LEN, len - ESPNOW_ADDR_HEADER_LEN);
+    // Retried by the wifi send task like a busy wifi driver
+    return ret == ESP_ERR_ESPNOW_NO_MEM ? ESP_ERR_NO_MEM : ret;
+}
+
+/**
+ * @brief Register the callback told about the frames sent, ESP-NOW reports every frame to espnow_sent
+ * @param[in] tx_done_cb Callback, NULL to stop telling
+ * @retval ESP_OK
+ */
+static esp_err_t espnow_reg_tx_done(transport_tx_done_cb_t tx_done_cb)
+{
+    espnow_tx_done_cb = tx_done_cb;
+    return ESP_OK;
+}
+
+/**
+ * @brief Add the peers of CONFIG_WENET_ESPNOW_PEERS, a comma separated list of addresses, and report them up
+ * @param None
+ * @retval
+ */
+static void espnow_add_configured_peers(void)
+{
+    const char *list = ESPNOW_PEERS;
+    while (*list != '\0')
+    {
+        uint8_t addr[TUNNEL_ADDR_LEN];
+        int consumed = 0;
+        if (sscanf(list, " %hhx:%hhx:%hhx:%hhx:%hhx:%hhx%n", &addr[0], &addr[1], &addr[2], &addr[3], &addr[4], &addr[5], &consumed) != 6)
+        {
+            ESP_LOGW(ESPNOW_LOG, "Ignoring the peer list from \"%s\" on", list);
+            return;
+        }
+        espnow_peer_t *peer = espnow_add_peer(addr, true);
+        if (peer != NULL && !peer->up)
+        {
+            // Reported again with its first frame if the report is not taken
+            peer->up = espnow_link_cb(peer->addr, true);
+        }
+        list += consumed;
+        while (*list == ',' || *list == ' ')
+        {
+            list++;
+        }
+    }
+}
+
+/**
+ * @brief Add a peer to the transport and to ESP-NOW
+ * @param[in] addr Peer address
+ * @param[in] configured Listed in CONFIG_WENET_ESPNOW_PEERS
+ * @retval Peer, NULL if no slot is free or ESP-NOW refused it
+ */
+static espnow_peer_t *espnow_add_peer(const uint8_t *addr, bool configured)
+{
+    espnow_peer_t *free_peer = NULL;
+    for (uint32_t i = 0; i < ESPNOW_PEER_MAX; i++)
+    {
+        espnow_peer_t *peer = &espnow_peers[i];
+        if (peer->used && memcmp(peer->addr, addr, TUNNEL_ADDR_LEN) == 0)
+        {
+            peer->configured |= configured;
+            return peer;
+        }
+        if (!peer->used && free_peer == NULL)
+        {
+            free_peer = peer;
+        }
+    }
+    if (free_peer == NULL)
+    {
+        ESP_LOGW(ESPNOW_LOG, "No free peer slot for " MACSTR, MAC2STR(addr));
+        return NULL;
+    }
+    // Channel 0 sends on the channel the interface is on. Learned peers cannot be encrypted, see
+    // CONFIG_WENET_ESPNOW_LEARN_PEERS
+    esp_now_peer_info_t info = {
+        .channel = 0,
+        .ifidx = espnow_ifx,
+        .encrypt = configured && ESPNOW_ENCRYPT,
+    };
+    memcpy(info.peer_addr, addr, ESP_NOW_ETH_ALEN);
+    if (info.encrypt)
+    {
+        memcpy(info.lmk, ESPNOW_LMK, ESP_NOW_KEY_LEN);
+    }
+    esp_err_t ret = esp_now_add_peer(&info);
+    if (ret != ESP_OK && ret != ESP_ERR_ESPNOW_EXIST)
+    {
+        ESP_LOGW(ESPNOW_LOG, "Could not add peer " MACSTR ": %s", MAC2STR(addr), esp_err_to_name(ret));
+        return NULL;
+    }
+    memset(free_peer, 0, sizeof(espnow_peer_t));
+    memcpy(free_peer->addr, addr, TUNNEL_ADDR_LEN);
+    free_peer->used = true;
+    free_peer->configured = configured;
+    return free_peer;
+}
+
+/**
+ * @brief Find a peer of the transport
+ * @param[in] addr Peer address
+ * @retval Peer, NULL if unknown
+ */
+static espnow_peer_t *espnow_find_peer(const uint8_t *addr)
+{
+    for (uint32_t i = 0; i < ESPNOW_PEER_MAX; i++)
+    {
+        espnow_peer_t *peer = &espnow_peers[i];
+        if (peer->used && memcmp(peer->addr, addr, TUNNEL_ADDR_LEN) == 0)
+        {
+            return peer;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief ESP-NOW receive callback, runs in the wifi driver task. Learns the sender when it is new, then passes
+ *        the frame on with its outer addresses restored
+ * @param[in] info Sender and receiver addresses
+ * @param[in] data ESP-NOW payload, only valid during the call
+ * @param[in] len Payload length
+ * @retval
+ */
+static void espnow_receive(const esp_now_recv_info_t *info, const uint8_t *data, int len)
+{
+    if (!espnow_started || len <= 0 || len > ESP_NOW_MAX_DATA_LEN)
+    {
+        return;
+    }
+    espnow_peer_t *peer = espnow_find_peer(info->src_addr);
+#if CONFIG_WENET_ESPNOW_LEARN_PEERS
+    if (peer == NULL)
+    {
+        peer = espnow_add_peer(info->src_addr, false);
+    }
+#endif
+    if (peer == NULL)
+    {
+        // Not a coordinator this one links with
+        return;
+    }
+    peer->failures = 0;
+    if (!peer->up)
+    {
+        ESP_LOGI(ESPNOW_LOG, "Peer " MACSTR " found", MAC2STR(peer->addr));
+        peer->up = espnow_link_cb(peer->addr, true);
+    }
+    wifi_rxcb_t rx_callback = espnow_rx_callback;
+    if (rx_callback == NULL)
+    {
+        return;
+    }
+    memcpy(espnow_rx_buffer, info->des_addr, TUNNEL_ADDR_LEN);
+    memcpy(espnow_rx_buffer + TUNNEL_ADDR_LEN, info->src_addr, TUNNEL_ADDR_LEN);
+    memcpy(espnow_rx_buffer + ESPNOW_ADDR_HEADER_LEN, data, len);
+    rx_callback(espnow_rx_buffer, (uint16_t)(ESPNOW_ADDR_HEADER_LEN + len), NULL);
+}
+
+/**
+ * @brief ESP-NOW send callback, runs in the wifi driver task. A learned peer that stops acknowledging is lost
+ *        until it sends again, a configured peer stays linked so both ends keep trying
+ * @param[in] addr Peer address
+ * @param[in] status Whether the peer acknowledged the frame
+ * @retval
+ */
+static void espnow_sent(const uint8_t *addr, esp_now_send_status_t status)
+{
+    transport_tx_done_cb_t tx_done_cb = espnow_tx_done_cb;
+    if (tx_done_cb != NULL)
+    {
+        tx_done_cb();
+    }
+    espnow_peer_t *peer = espnow_started ? espnow_find_peer(addr) : NULL;
+    if (peer == NULL)
+    {
+        return;
+    }
+    if (status == ESP_NOW_SEND_SUCCESS)
+    {
+        peer->failures = 0;
+        return;
+    }
+    if (peer->failures < UINT8_MAX)
+    {
+        peer->failures++;
+    }
+#if CONFIG_WENET_ESPNOW_LEARN_PEERS
+    if (peer->configured || !peer->up || peer->failures < ESPNOW_LINK_LOSS)
+    {
+        return;
+    }
+    ESP_LOGI(ESPNOW_LOG, "Peer " MACSTR " lost after %u unacknowledged frames", MAC2STR(peer->addr), peer->failures);
+    peer->up = false;
+    peer->used = false;
+    esp_now_del_peer(peer->addr);
+    espnow_link_cb(peer->addr, false);
+#endif
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,22 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ESPNOW_H
+#define __ESPNOW_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "esp_now.h"
+#include "wenet_transport.h"
+#include "wenet_tunnel.h"
+/* Exported macro ------------------------------------------------------------*/
+// The outer addresses of a tunnel frame are carried by the ESP-NOW header, they are not sent twice
+#define ESPNOW_ADDR_HEADER_LEN (2 * TUNNEL_ADDR_LEN)
+#define ESPNOW_MTU (ESPNOW_ADDR_HEADER_LEN + ESP_NOW_MAX_DATA_LEN)
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+extern const transport_t transport_espnow;
+/* Exported functions prototypes ---------------------------------------------*/
+
+#endif /* __ESPNOW_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,259 @@
+/* Includes ------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "wenet_loopback.h"
+#include "wenet_tunnel.h"
+/* Private macro -------------------------------------------------------------*/
+#define LOOPBACK_LOG "LOOPBACK"
+#define LOOPBACK_TASK_STACK 3072
+#define LOOPBACK_TASK_PRIORITY 1
+/* Private typedef -----------------------------------------------------------*/
+// Frame on its way to the emulated peer
+typedef struct
+{
+    uint16_t len;
+    uint8_t data[];
+} loopback_frame_t;
+/* Private function prototypes -----------------------------------------------*/
+static esp_err_t loopback_start(wifi_interface_t ifx, const uint8_t *local_addr, transport_link_cb_t link_cb);
+static esp_err_t loopback_reg_rxcb(wifi_interface_t ifx, wifi_rxcb_t rx_callback);
+static esp_err_t loopback_tx(wifi_interface_t ifx, void *buffer, uint16_t len);
+static esp_err_t loopback_reg_tx_done(transport_tx_done_cb_t tx_done_cb);
+static void loopback_task(void *pvParameters);
+static void loopback_echo(void *ctx, uint8_t *frame, uint32_t len);
+static bool loopback_send(void *ctx, uint8_t *frame, uint32_t len);
+static void loopback_deliver(uint8_t *buffer, uint32_t len);
+/* Private variables ---------------------------------------------------------*/
+const uint8_t loopback_peer_addr[6] = {0x02, 0x57, 0x4C, 0x42, 0x00, 0x01};
+static uint8_t loopback_local_addr[6];
+static wifi_rxcb_t loopback_rx_callback = NULL;
+static transport_tx_done_cb_t loopback_tx_done_cb = NULL;
+static QueueHandle_t loopback_queue = NULL;
+static TaskHandle_t loopback_taskHandler = NULL;
+// Tunnel end of the emulated peer, only used from the loopback task
+static tunnel_peer_t loopback_tunnel;
+#if CONFIG_WENET_TUNNEL_COMPRESS
+static compress_t loopback_compress;
+static uint8_t loopback_expand_buffer[TUNNEL_EXPAND_BUF_LEN];
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+static tunnel_reassembly_t loopback_reassembly;
+#endif
+// Stand-in for the wifi driver, e.g. in QEMU which does not emulate the radio
+const transport_t transport_loopback = {
+    .name = "loopback",
+    .mtu = TRANSPORT_WIFI_MTU,
+    .start = loopback_start,
+    .stop = NULL,
+    .reg_rxcb = loopback_reg_rxcb,
+    .tx = loopback_tx,
+    .reg_tx_done = loopback_reg_tx_done,
+};
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Start the loopback stand-in for the wifi driver. It plays one remote WeNet peer behind an ideal link:
+ *        the peer answers the tunnel negotiation and sends every unicast frame it receives back with the
+ *        ethernet addresses swapped, so a frame injected on ethernet comes back out of ethernet after crossing
+ *        the bridge in both directions. The peer is connected right away
+ * @param[in] ifx Wifi interface
+ * @param[in] local_addr Local wifi address
+ * @param[in] link_cb Told about the emulated peer
+ * @retval ESP_OK on success, ESP_ERR_NO_MEM if the queue or the task could not be created
+ */
+static esp_err_t loopback_start(wifi_interface_t ifx, const uint8_t *local_addr, transport_link_cb_t link_cb)
+{
+    memcpy(loopback_local_addr, local_addr, sizeof(loopback_local_addr));
+    if (loopback_taskHandler != NULL)
+    {
+        // Restarted by a mode change, the bridge negotiates the tunnel again
+        tunnel_peer_reset(&loopback_tunnel);
+        link_cb(loopback_peer_addr, true);
+        return ESP_OK;
+    }
+    tunnel_peer_init(&loopback_tunnel);
+#if CONFIG_WENET_TUNNEL_COMPRESS
+    tunnel_set_compression(&loopback_tunnel, &loopback_compress, loopback_expand_buffer);
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    tunnel_set_reassembly(&loopback_tunnel, &loopback_reassembly);
+#endif
+    loopback_queue = xQueueCreate(LOOPBACK_QUEUE_LEN, sizeof(loopback_frame_t *));
+    if (loopback_queue == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(loopback_task, "wifi_loopback_task", LOOPBACK_TASK_STACK, NULL, LOOPBACK_TASK_PRIORITY, &loopback_taskHandler, tskNO_AFFINITY) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGW(LOOPBACK_LOG, "Wifi is replaced by a loopback peer " MACSTR, MAC2STR(loopback_peer_addr));
+    link_cb(loopback_peer_addr, true);
+    return ESP_OK;
+}
+
+/**
+ * @brief Register the callback that gets the frames of the emulated peer, the stand-in for esp_wifi_internal_reg_rxcb
+ * @param[in] ifx Wifi interface
+ * @param[in] rx_callback Receive callback, NULL to stop receiving
+ * @retval ESP_OK
+ */
+static esp_err_t loopback_reg_rxcb(wifi_interface_t ifx, wifi_rxcb_t rx_callback)
+{
+    loopback_rx_callback = rx_callback;
+    return ESP_OK;
+}
+
+/**
+ * @brief Send a frame to the emulated peer, the stand-in for esp_wifi_internal_tx. The frame is copied
+ * @param[in] ifx Wifi interface
+ * @param[in] buffer Wifi frame
+ * @param[in] len Frame length
+ * @retval ESP_OK if the frame was taken, ESP_ERR_NO_MEM if the air queue is full
+ */
+static esp_err_t loopback_tx(wifi_interface_t ifx, void *buffer, uint16_t len)
+{
+    if (len <= 2 * TUNNEL_ADDR_LEN || memcmp(buffer, loopback_peer_addr, TUNNEL_ADDR_LEN) != 0)
+    {
+        // Nobody listens to other addresses, the frame is lost in the air
+        return ESP_OK;
+    }
+    loopback_frame_t *frame = malloc(sizeof(loopback_frame_t) + len);
+    if (frame == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    frame->len = len;
+    memcpy(frame->data, buffer, len);
+    if (xQueueSend(loopback_queue, &frame, 0) != pdTRUE)
+    {
+        free(frame);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Register the callback told when the emulated peer took a frame off the air queue
+ * @param[in] tx_done_cb Callback, NULL to stop telling
+ * @retval ESP_OK
+ */
+static esp_err_t loopback_reg_tx_done(transport_tx_done_cb_t tx_done_cb)
+{
+    loopback_tx_done_cb = tx_done_cb;
+    return ESP_OK;
+}
+
+/**
+ * @brief Release a frame passed to the receive callback, the stand-in for esp_wifi_internal_free_rx_buffer
+ * @param[in] eb Buffer handle given to the receive callback
+ * @retval
+ */
+void loopback_free_rx_buffer(void *eb)
+{
+    free(eb);
+}
+
+/**
+ * @brief Emulated peer: decodes the frames the bridge sent, echoes them and answers the tunnel negotiation
+ * @param[in] pvParameters
+ * @retval
+ */
+static void loopback_task(void *pvParameters)
+{
+    uint8_t control_frame[TUNNEL_CONTROL_FRAME_LEN];
+    while (true)
+    {
+        uint32_t delay_ms = tunnel_control_delay_ms(&loopback_tunnel);
+        TickType_t wait_ticks = delay_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(delay_ms) + 1;
+        loopback_frame_t *frame;
+        if (xQueueReceive(loopback_queue, &frame, wait_ticks) == pdTRUE)
+        {
+            transport_tx_done_cb_t tx_done_cb = loopback_tx_done_cb;
+            if (tx_done_cb != NULL)
+            {
+                tx_done_cb();
+            }
+            tunnel_receive(&loopback_tunnel, frame->data, frame->len, loopback_echo, NULL);
+            free(frame);
+        }
+        uint32_t len;
+        while ((len = tunnel_build_control(&loopback_tunnel, control_frame, loopback_local_addr, loopback_peer_addr)) > 0)
+        {
+            uint8_t *buffer = malloc(len);
+            if (buffer != NULL)
+            {
+                memcpy(buffer, control_frame, len);
+                loopback_deliver(buffer, len);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Send a frame decoded by the emulated peer back to the bridge with its ethernet addresses swapped
+ * @param[in] ctx
+ * @param[in] frame Ethernet frame
+ * @param[in] len Ethernet frame length
+ * @retval
+ */
+static void loopback_echo(void *ctx, uint8_t *frame, uint32_t len)
+{
+    if (len < TUNNEL_ETH_HEADER_LEN || (frame[0] & 0x01) != 0)
+    {
+        // A group addressed frame cannot be answered without a group source address
+        return;
+    }
+    uint8_t *buffer = malloc(len + TUNNEL_MAX_OVERHEAD);
+    if (buffer == NULL)
+    {
+        return;
+    }
+    memcpy(buffer, frame + TUNNEL_ADDR_LEN, TUNNEL_ADDR_LEN);
+    memcpy(buffer + TUNNEL_ADDR_LEN, frame, TUNNEL_ADDR_LEN);
+    memcpy(buffer + 2 * TUNNEL_ADDR_LEN, frame + 2 * TUNNEL_ADDR_LEN, len - 2 * TUNNEL_ADDR_LEN);
+    uint32_t wire_len = tunnel_encapsulate(&loopback_tunnel, buffer, len, loopback_local_addr, loopback_peer_addr);
+    tunnel_send(&loopback_tunnel, buffer, wire_len, loopback_send, NULL);
+    free(buffer);
+}
+
+/**
+ * @brief Pass a frame or fragment the emulated peer sends to the bridge, see tunnel_send
+ * @param[in] ctx
+ * @param[in] frame Wifi frame, copied
+ * @param[in] len Frame length
+ * @retval true if the frame was passed on
+ */
+static bool loopback_send(void *ctx, uint8_t *frame, uint32_t len)
+{
+    uint8_t *buffer = malloc(len);
+    if (buffer == NULL)
+    {
+        return false;
+    }
+    memcpy(buffer, frame, len);
+    loopback_deliver(buffer, len);
+    return true;
+}
+
+/**
+ * @brief Pass a frame of the emulated peer to the receive callback, which releases it with loopback_free_rx_buffer
+ * @param[in] buffer Wifi frame allocated with malloc
+ * @param[in] len Frame length
+ * @retval
+ */
+static void loopback_deliver(uint8_t *buffer, uint32_t len)
+{
+    if (loopback_rx_callback == NULL)
+    {
+        free(buffer);
+        return;
+    }
+    loopback_rx_callback(buffer, (uint16_t)len, buffer);
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,25 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LOOPBACK_H
+#define __LOOPBACK_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include "esp_private/wifi.h"
+#include "sdkconfig.h"
+#include "wenet_transport.h"
+/* Exported macro ------------------------------------------------------------*/
+#define LOOPBACK_QUEUE_LEN CONFIG_WENET_WIFI_LOOPBACK_QUEUE_LEN
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+// Address of the emulated wifi peer
+extern const uint8_t loopback_peer_addr[6];
+// Stand-in for the wifi driver: one emulated WeNet peer that echoes the unicast frames it receives
+extern const transport_t transport_loopback;
+/* Exported functions prototypes ---------------------------------------------*/
+void loopback_free_rx_buffer(void *eb);
+#endif /* __LOOPBACK_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,199 @@
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "wenet_station.h"
+/* Private macro -------------------------------------------------------------*/
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+static station_t station_table[STATION_MAX];
+/* Private function prototypes -----------------------------------------------*/
+
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Initialize the station table without stations
+ * @param None
+ * @retval
+ */
+void station_init(void)
+{
+    for (uint32_t i = 0; i < STATION_MAX; i++)
+    {
+        atomic_store(&station_table[i].state, STATION_FREE);
+    }
+}
+
+/**
+ * @brief Add a connected wifi peer. Called from the wifi event handler
+ * @param[in] addr Peer address
+ * @param[in] aid Association id, 0 for the access point in station mode
+ * @retval Station, NULL if the table is full
+ */
+station_t *station_add(const uint8_t *addr, uint8_t aid)
+{
+    station_t *station = station_find(addr);
+    if (station != NULL)
+    {
+        // Reassociation without a disconnect event, restart the tunnel negotiation only
+        station->aid = aid;
+        tunnel_peer_reset(&station->tunnel);
+        return station;
+    }
+    for (uint32_t i = 0; i < STATION_MAX; i++)
+    {
+        station = &station_table[i];
+        if (atomic_load(&station->state) != STATION_FREE)
+        {
+            continue;
+        }
+        memcpy(station->addr, addr, TUNNEL_ADDR_LEN);
+        station->aid = aid;
+        tunnel_peer_init(&station->tunnel);
+        for (uint32_t c = 0; c < QOS_CLASS_NUM; c++)
+        {
+            drr_flow_init(&station->flow[c], STATION_QUANTUM);
+#if CONFIG_WENET_AQM_CODEL
+            codel_init(&station->codel[c], CONFIG_WENET_AQM_TARGET_MS * 1000, CONFIG_WENET_AQM_INTERVAL_MS * 1000);
+#endif
+        }
+#if CONFIG_WENET_ACK_FILTER
+        ack_filter_init(&station->ack_filter);
+#endif
+        memset(&station->aggregate, 0, sizeof(station_aggregate_t));
+        memset(&station->stats, 0, sizeof(station_stats_t));
+        // Publish the slot only once it is fully initialized, the receive callback may look it up right away
+        atomic_store(&station->state, STATION_ACTIVE);
+        return station;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Mark a wifi peer as gone. Its slot is freed by the wifi send task once its queue is flushed
+ * @param[in] addr Peer address
+ * @retval
+ */
+void station_remove(const uint8_t *addr)
+{
+    station_t *station = station_find(addr);
+    if (station != NULL)
+    {
+        atomic_store(&station->state, STATION_CLOSING);
+    }
+}
+
+/**
+ * @brief Mark every wifi peer as gone
+ * @param None
+ * @retval
+ */
+void station_remove_all(void)
+{
+    for (uint32_t i = 0; i < STATION_MAX; i++)
+    {
+        uint_fast8_t expected = STATION_ACTIVE;
+        atomic_compare_exchange_strong(&station_table[i].state, &expected, STATION_CLOSING);
+    }
+}
+
+/**
+ * @brief Free the slot of a closing station. Called from the wifi send task once its queue is empty
+ * @param[in] station Station
+ * @retval
+ */
+void station_release(station_t *station)
+{
+    atomic_store(&station->state, STATION_FREE);
+}
+
+/**
+ * @brief Find a connected wifi peer by address
+ * @param[in] addr Peer address
+ * @retval Station, NULL if no connected peer has this address
+ */
+station_t *station_find(const uint8_t *addr)
+{
+    for (uint32_t i = 0; i < STATION_MAX; i++)
+    {
+        station_t *station = &station_table[i];
+        if (atomic_load(&station->state) == STATION_ACTIVE && memcmp(station->addr, addr, TUNNEL_ADDR_LEN) == 0)
+        {
+            return station;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Get a connected wifi peer by its slot index
+ * @param[in] index Slot index
+ * @retval Station, NULL if the slot holds no connected peer
+ */
+station_t *station_get(uint8_t index)
+{
+    if (index >= STATION_MAX || atomic_load(&station_table[index].state) != STATION_ACTIVE)
+    {
+        return NULL;
+    }
+    return &station_table[index];
+}
+
+/**
+ * @brief Get a wifi peer that left and still has to be cleaned up by its slot index
+ * @param[in] index Slot index
+ * @retval Station, NULL if the slot holds no closing peer
+ */
+station_t *station_get_closing(uint8_t index)
+{
+    if (index >= STATION_MAX || atomic_load(&station_table[index].state) != STATION_CLOSING)
+    {
+        return NULL;
+    }
+    return &station_table[index];
+}
+
+/**
+ * @brief Get the slot index of a station, used as the wifi peer number in the forwarding database
+ * @param[in] station Station
+ * @retval Slot index
+ */
+uint8_t station_index(const station_t *station)
+{
+    return (uint8_t)(station - station_table);
+}
+
+/**
+ * @brief Get the number of connected wifi peers
+ * @param None
+ * @retval Number of connected peers
+ */
+uint32_t station_count(void)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < STATION_MAX; i++)
+    {
+        if (atomic_load(&station_table[i].state) == STATION_ACTIVE)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Get the number of frames queued for a station over all traffic classes
+ * @param[in] station Station
+ * @retval Number of queued frames
+ */
+uint32_t station_queued(const station_t *station)
+{
+    uint32_t count = 0;
+    for (uint32_t c = 0; c < QOS_CLASS_NUM; c++)
+    {
+        count += station->flow[c].count;
+    }
+    return count;
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
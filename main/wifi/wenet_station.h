@@ -0,0 +1,81 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STATION_H
+#define __STATION_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#include "wenet_drr.h"
+#include "wenet_codel.h"
+#include "wenet_tunnel.h"
+#include "wenet_qos.h"
+#if CONFIG_WENET_ACK_FILTER
+#include "wenet_ackfilter.h"
+#endif
+/* Exported macro ------------------------------------------------------------*/
+#define STATION_MAX CONFIG_WENET_AP_MAX_STATIONS
+#define STATION_QUEUE_LIMIT CONFIG_WENET_STATION_QUEUE_LIMIT
+#define STATION_QUANTUM CONFIG_WENET_STATION_QUANTUM
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    STATION_FREE = 0, // Slot is unused
+    STATION_ACTIVE,   // Peer is connected
+    STATION_CLOSING,  // Peer left, the wifi send task still has to flush its queue
+} station_state_t;
+
+typedef struct
+{
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t queue_drops; // Frames dropped because the station queue or one of its class queues was full
+} station_stats_t;
+
+// Small frames held back to be sent together in one aggregate frame
+typedef struct
+{
+    raw_data_t *head;
+    raw_data_t *tail;
+    uint32_t count;
+    uint32_t wire_len; // Worst case length of the aggregate frame
+    uint32_t deadline; // Microseconds, the frames are sent at the latest then
+} station_aggregate_t;
+
+// Wifi peer: the access point in station mode, or one associated station in softAP mode.
+// The class queues, AQM and statistics are owned by the wifi send task, the tunnel state is shared with the
+// wifi receive callback.
+typedef struct
+{
+    atomic_uint_fast8_t state;
+    uint8_t addr[TUNNEL_ADDR_LEN];
+    uint8_t aid;
+    tunnel_peer_t tunnel;
+    drr_flow_t flow[QOS_CLASS_NUM];
+#if CONFIG_WENET_AQM_CODEL
+    codel_t codel[QOS_CLASS_NUM];
+#endif
+#if CONFIG_WENET_ACK_FILTER
+    ack_filter_t ack_filter;
+#endif
+    station_aggregate_t aggregate;
+    station_stats_t stats;
+} station_t;
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void station_init(void);
+station_t *station_add(const uint8_t *addr, uint8_t aid);
+void station_remove(const uint8_t *addr);
+void station_remove_all(void);
+void station_release(station_t *station);
+station_t *station_find(const uint8_t *addr);
+station_t *station_get(uint8_t index);
+station_t *station_get_closing(uint8_t index);
+uint8_t station_index(const station_t *station);
+uint32_t station_count(void);
+uint32_t station_queued(const station_t *station);
+#endif /* __STATION_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,78 @@
+/* Includes ------------------------------------------------------------------*/
+#include "wenet_transport.h"
+/* Private macro -------------------------------------------------------------*/
+/* Private typedef -----------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static esp_err_t transport_wifi_reg_rxcb(wifi_interface_t ifx, wifi_rxcb_t rx_callback);
+static esp_err_t transport_wifi_tx(wifi_interface_t ifx, void *buffer, uint16_t len);
+static esp_err_t transport_wifi_reg_tx_done(transport_tx_done_cb_t tx_done_cb);
+static void transport_wifi_tx_done(uint8_t ifidx, uint8_t *data, uint16_t *data_len, bool tx_status);
+/* Private variables ---------------------------------------------------------*/
+// Raw frames on the station or access point interface. The peers come and go with the association events
+const transport_t transport_wifi = {
+    .name = "wifi",
+    .mtu = TRANSPORT_WIFI_MTU,
+    .start = NULL,
+    .stop = NULL,
+    .reg_rxcb = transport_wifi_reg_rxcb,
+    .tx = transport_wifi_tx,
+    .reg_tx_done = transport_wifi_reg_tx_done,
+};
+static transport_tx_done_cb_t transport_wifi_tx_done_cb;
+/* Private user code ---------------------------------------------------------*/
+/**
+ * @brief Register the raw receive callback of a wifi interface
+ * @param[in] ifx Wifi interface
+ * @param[in] rx_callback Receive callback, NULL to stop receiving
+ * @retval Result of esp_wifi_internal_reg_rxcb
+ */
+static esp_err_t transport_wifi_reg_rxcb(wifi_interface_t ifx, wifi_rxcb_t rx_callback)
+{
+    return esp_wifi_internal_reg_rxcb(ifx, rx_callback);
+}
+
+/**
+ * @brief Send a raw frame on a wifi interface
+ * @param[in] ifx Wifi interface
+ * @param[in] buffer Wifi frame
+ * @param[in] len Frame length
+ * @retval Result of esp_wifi_internal_tx
+ */
+static esp_err_t transport_wifi_tx(wifi_interface_t ifx, void *buffer, uint16_t len)
+{
+    return esp_wifi_internal_tx(ifx, buffer, len);
+}
+
+/**
+ * @brief Register the callback told about the frames the wifi driver sent
+ * @param[in] tx_done_cb Callback, NULL to stop telling
+ * @retval Result of esp_wifi_set_tx_done_cb
+ */
+static esp_err_t transport_wifi_reg_tx_done(transport_tx_done_cb_t tx_done_cb)
+{
+    transport_wifi_tx_done_cb = tx_done_cb;
+    return esp_wifi_set_tx_done_cb(tx_done_cb != NULL ? transport_wifi_tx_done : NULL);
+}
+
+/**
+ * @brief Wifi driver transmit done callback, runs in the wifi driver task
+ * @param[in] ifidx Wifi interface
+ * @param[in] data Frame sent
+ * @param[in] data_len Frame length
+ * @param[in] tx_status Whether the frame was acknowledged
+ * @retval
+ */
+static void transport_wifi_tx_done(uint8_t ifidx, uint8_t *data, uint16_t *data_len, bool tx_status)
+{
+    (void)ifidx;
+    (void)data;
+    (void)data_len;
+    (void)tx_status;
+    transport_tx_done_cb_t tx_done_cb = transport_wifi_tx_done_cb;
+    if (tx_done_cb != NULL)
+    {
+        tx_done_cb();
+    }
+}
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -0,0 +1,57 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TRANSPORT_H
+#define __TRANSPORT_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include "esp_private/wifi.h"
+#include "sdkconfig.h"
+/* Exported macro ------------------------------------------------------------*/
+// Longest frame the wifi driver takes on the station and access point interfaces
+#define TRANSPORT_WIFI_MTU 1514
+/* Exported types ------------------------------------------------------------*/
+// Transports that can be selected at run time, kept in NVS
+typedef enum
+{
+    TRANSPORT_WIFI = 0, // Raw frames on the station or access point interface, to the associated peers
+    TRANSPORT_ESPNOW,   // ESP-NOW frames to peers that need no association, e.g. another coordinator
+    TRANSPORT_MAX,
+} transport_id_t;
+
+// Called by a transport when a peer becomes reachable or is lost. May be called from any task, returns false
+// if the report was not taken and has to be made again
+typedef bool (*transport_link_cb_t)(const uint8_t *addr, bool up);
+
+// Called by a transport when it finished sending a frame, so a transmit buffer is free again. May be called from
+// any task
+typedef void (*transport_tx_done_cb_t)(void);
+
+// Radio below the forwarding core. The frames passed both ways are tunnel frames that start with the outer
+// destination and source addresses, whatever the transport puts on the air
+typedef struct
+{
+    const char *name;
+    uint16_t mtu; // Longest frame the transport carries, outer header included
+    // Bring the peer links up on a started interface. NULL if the peers are the stations associated with the
+    // interface, reported by the wifi driver events
+    esp_err_t (*start)(wifi_interface_t ifx, const uint8_t *local_addr, transport_link_cb_t link_cb);
+    // Take the peer links down, NULL if there is nothing to do
+    void (*stop)(wifi_interface_t ifx);
+    // Register the receive callback, NULL to stop receiving. The callback gets the driver buffer to free with
+    // wifi_free_rx_buffer, or NULL if the frame is only valid during the call
+    esp_err_t (*reg_rxcb)(wifi_interface_t ifx, wifi_rxcb_t rx_callback);
+    // Send a frame, ESP_ERR_NO_MEM while all the transmit buffers are in use
+    esp_err_t (*tx)(wifi_interface_t ifx, void *buffer, uint16_t len);
+    // Register the callback told about the frames sent, NULL to stop telling
+    esp_err_t (*reg_tx_done)(transport_tx_done_cb_t tx_done_cb);
+} transport_t;
+/* Exported constants --------------------------------------------------------*/
+extern const transport_t transport_wifi;
+/* Exported functions prototypes ---------------------------------------------*/
+
+#endif /* __TRANSPORT_H */
+
+/************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
@@ -1,32 +1,216 @@
 /* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include "esp_log.h"
+#include "esp_event.h"
+#include "esp_console.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
 
 #include "wenet_wifi.h"
 #include "wenet_ethernet.h"
+#include "wenet_bridge.h"
+#include "wenet_codel.h"
+#include "wenet_tunnel.h"
+#include "wenet_fdb.h"
+#include "wenet_ring.h"
+#include "wenet_drr.h"
+#include "wenet_station.h"
+#include "wenet_qos.h"
+#include "wenet_arp.h"
+#include "wenet_filter.h"
+#include "wenet_telemetry.h"
+#include "wenet_capture.h"
+#include "wenet_loopback.h"
+#include "wenet_transport.h"
+#if CONFIG_WENET_ESPNOW
+#include "wenet_espnow.h"
+#endif
 
 /* Private macro -------------------------------------------------------------*/
 #define LOG_WIFI_TAG "WIFI"
+#define WIFI_RELAY_RING_SIZE CONFIG_WENET_WIFI_RELAY_RING_SIZE
+#if (WIFI_RELAY_RING_SIZE & (WIFI_RELAY_RING_SIZE - 1)) != 0
+#error "CONFIG_WENET_WIFI_RELAY_RING_SIZE must be a power of two"
+#endif
+#define WIFI_AGGREGATE_MAX_FRAME CONFIG_WENET_AGGREGATE_MAX_FRAME
+#define WIFI_AGGREGATE_MAX_LEN CONFIG_WENET_AGGREGATE_MAX_LEN
+#define WIFI_AGGREGATE_HOLD_US CONFIG_WENET_AGGREGATE_HOLD_US
+#define WIFI_TX_TASK_STACK CONFIG_WENET_WIFI_TX_TASK_STACK
+#define WIFI_TX_TASK_PRIORITY CONFIG_WENET_WIFI_TX_TASK_PRIORITY
+#define WIFI_TX_TASK_CORE BRIDGE_TASK_CORE(CONFIG_WENET_WIFI_TX_TASK_CORE)
+// Frames the wifi send task sends in run to completion mode before it services the peers and the tunnels again
+#define WIFI_RUN_TO_COMPLETION_LIMIT CONFIG_WENET_ETH_RING_SIZE
+// At least a tick, a shorter wait would not block at all
+#define WIFI_TX_RETRY_TICKS (CONFIG_WENET_WIFI_TX_RETRY_MS == 0 ? 0 : pdMS_TO_TICKS(CONFIG_WENET_WIFI_TX_RETRY_MS) + 1)
+#define WIFI_NVS_NAMESPACE "wenet"
+#define WIFI_NVS_KEY "wifi"
+#define WIFI_NVS_VERSION 1
+#if CONFIG_WENET_WIFI_FAST_RECONNECT
+#define WIFI_DIRECT_ATTEMPTS CONFIG_WENET_WIFI_DIRECT_ATTEMPTS
+#define WIFI_RECONNECT_MIN_MS CONFIG_WENET_WIFI_RECONNECT_MIN_MS
+#define WIFI_RECONNECT_MAX_MS CONFIG_WENET_WIFI_RECONNECT_MAX_MS
+#endif
+#define WIFI_SWITCH_HOLD_MS CONFIG_WENET_WIFI_SWITCH_HOLD_MS
+#define WIFI_TIME_AFTER_EQ(a, b) ((int32_t)((a) - (b)) >= 0)
+#define WIFI_FLOW_STATION(flow, qos_class) ((station_t *)((uint8_t *)((flow) - (qos_class)) - offsetof(station_t, flow)))
+#if CONFIG_WENET_WIFI_LOOPBACK
+// The loopback peer stands in for the wifi driver, e.g. in QEMU which does not emulate the radio
+#define WIFI_DRIVER_TRANSPORT transport_loopback
+#define WIFI_DRIVER_FREE_RX_BUFFER(eb) loopback_free_rx_buffer(eb)
+#else
+#define WIFI_DRIVER_TRANSPORT transport_wifi
+#define WIFI_DRIVER_FREE_RX_BUFFER(eb) esp_wifi_internal_free_rx_buffer(eb)
+#endif
 /* Private typedef -----------------------------------------------------------*/
+// Lifecycle of the wifi module. The driver, the event handler and the forwarding task are set up once,
+// a mode change only stops and starts the interface
+typedef enum
+{
+    WIFI_STATE_UNINIT = 0, // wifi_init not called yet
+    WIFI_STATE_STOPPED,    // Driver ready, no interface started
+    WIFI_STATE_STARTED,    // Interface started in current_wifi_mode
+    WIFI_STATE_STOPPING,   // Interface being stopped, its late events are ignored
+} wifi_state_t;
+
+// Private events of the module, handled by the default event loop task like the wifi driver events
+typedef enum
+{
+    WENET_WIFI_EVENT_SET_MODE = 0,  // Change the mode, the event data is the new wifi_mode_t
+    WENET_WIFI_EVENT_RECONNECT,     // Reconnect backoff expired
+    WENET_WIFI_EVENT_SET_TRANSPORT, // Change the transport, the event data is the new transport_id_t
+    WENET_WIFI_EVENT_PEER_UP,       // The transport found a peer, the event data is a wifi_link_event_t
+    WENET_WIFI_EVENT_PEER_DOWN,     // The transport lost a peer, the event data is a wifi_link_event_t
+} wenet_wifi_event_t;
+
+// Peer link change reported by a transport that starts its own peer links
+typedef struct
+{
+    uint8_t addr[6];
+    uint32_t generation; // wifi_link_generation when it was reported, older reports are ignored
+} wifi_link_event_t;
 
+// Link state kept in NVS, so a reboot comes back in the same mode and joins the access point without scanning
+typedef struct
+{
+    uint8_t version;
+    uint8_t mode;     // wifi_mode_t last started, WIFI_MODE_NULL if none
+    uint8_t raw_mode; // Frames are bridged over the raw tunnel
+    uint8_t channel;  // Channel of the access point last joined in station mode, 0 if unknown
+    uint8_t bssid[6]; // Address of that access point
+    char ssid[32];
+    char password[64];
+    uint8_t transport; // transport_id_t
+} wifi_link_config_t;
 /* Private variables ---------------------------------------------------------*/
 uint8_t wifi_eth_addr[6] = {0x00, 0xE0, 0x4C, 0x68, 0x08, 0x7A};
 uint8_t wifi_sta_addr[6];
 uint8_t wifi_ap_addr[6];
-static bool wifi_connected = false;
 static TaskHandle_t wifi_send_raw_taskHandler;
 static wifi_mode_t current_wifi_mode = WIFI_MODE_NULL;
+static wifi_state_t wifi_state = WIFI_STATE_UNINIT;
+// Time the last mode change started, it is over once the first peer of the new mode connects
+static int64_t wifi_switch_start_us;
+static bool wifi_switch_pending;
+static uint32_t wifi_switch_ms;      // Stopping the old interface and starting the new one, for the last change
+static uint32_t wifi_switch_peer_ms; // Start of the last change to the first peer connected
+// Milliseconds since boot, truncated to 32 bits, until which the send task leaves the ethernet frames queued
+// while a mode change waits for its first peer, 0 when not holding
+static atomic_uint_fast32_t wifi_hold_until_ms;
 static char ssid[32];
 static char password[64];
 static bool raw_mode = false;
+// Transport chosen for the next start, and the one the interface was started with
+static transport_id_t wifi_transport_id = TRANSPORT_WIFI;
+static const transport_t *wifi_transport = &WIFI_DRIVER_TRANSPORT;
+// Counts the interface stops, so the peer reports of a stopped transport are told apart
+static atomic_uint_fast32_t wifi_link_generation;
+// Set while the send task waits for a transmit buffer, so the frames sent meanwhile wake it up
+static atomic_bool wifi_tx_waiting;
+// Access point last joined in station mode, channel 0 if unknown
+static uint8_t wifi_last_bssid[6];
+static uint8_t wifi_last_channel;
+// Copy of the link state in NVS, so only changes are written
+static wifi_link_config_t wifi_saved_config;
+#if CONFIG_WENET_WIFI_FAST_RECONNECT
+// Connection attempts since the station was last connected, only used from the event loop and the timer task
+static uint32_t wifi_connect_attempt;
+static esp_timer_handle_t wifi_reconnect_timer;
+#endif
+static qos_sched_t wifi_sched;
+static ring_t wifi_relay_ring;
+static raw_data_t *wifi_relay_slots[WIFI_RELAY_RING_SIZE];
+// Receive time of the frame the wifi receive callback is working on, only used from the wifi driver task
+static uint32_t wifi_rx_timestamp;
+// Driver buffer of that frame while it can still be handed to the ethernet transmit task without a copy
+static void *wifi_rx_eb;
+#if CONFIG_WENET_AGGREGATION
+static uint8_t wifi_aggregate_buffer[WIFI_AGGREGATE_MAX_LEN];
+static esp_timer_handle_t wifi_aggregate_timer;
+#endif
+#if CONFIG_WENET_TUNNEL_COMPRESS
+// Compressor of the wifi send task and expansion buffer of the wifi receive callback, shared by all peers
+static compress_t wifi_compress;
+static uint8_t wifi_expand_buffer[TUNNEL_EXPAND_BUF_LEN];
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+// Only used from the wifi receive callback
+static tunnel_reassembly_t wifi_reassembly;
+#endif
+ESP_EVENT_DEFINE_BASE(WENET_WIFI_EVENT);
 /* Private function prototypes -----------------------------------------------*/
 static void wifi_start_station(void);
+static void wifi_start_forwarding(wifi_interface_t ifx);
+static void wifi_start_transport(wifi_interface_t ifx, const uint8_t *local_addr);
+static const transport_t *wifi_select_transport(void);
+static bool wifi_transport_link(const uint8_t *addr, bool up);
+static void wifi_transport_link_changed(int32_t event_id, const wifi_link_event_t *event);
+static void wifi_module_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+static bool wifi_holding(void);
 static void wifi_start_AP(void);
+#if !CONFIG_WENET_WIFI_LOOPBACK
+static void wifi_connect(void);
+static void wifi_reconnect(void);
+#if CONFIG_WENET_WIFI_FAST_RECONNECT
+static void wifi_reconnect_timer_callback(void *arg);
+#endif
+#endif
+static esp_err_t wifi_load_config(wifi_link_config_t *config);
+static void wifi_save_config(void);
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static esp_err_t wifi_callback_receive_raw(void *buffer, uint16_t len, void *eb);
 static void wifi_task_send_raw(void *pvParameters);
+static void wifi_forward_received(void *ctx, uint8_t *frame, uint32_t len);
+static void wifi_relay_frame(station_t *station, const uint8_t *frame, uint32_t len, uint8_t egress_peer);
+static void wifi_forward_to_ethernet(uint8_t *frame, uint32_t len);
+static uint32_t wifi_pull_frames(void);
+static void wifi_dispatch_frame(raw_data_t *raw_data);
+static void wifi_enqueue_frame(station_t *station, raw_data_t *raw_data);
+static uint32_t wifi_schedule(uint32_t budget);
+static void wifi_transmit(wifi_interface_t ifx, station_t *station, raw_data_t *raw_data, const uint8_t *src_addr);
+static void wifi_send_raw_frame(wifi_interface_t ifx, station_t *station, raw_data_t *raw_data, const uint8_t *src_addr);
+static esp_err_t wifi_driver_send(wifi_interface_t ifx, void *buffer, uint16_t len);
+static bool wifi_driver_send_tunnel(void *ctx, uint8_t *frame, uint32_t len);
+static void wifi_tx_done(void);
+#if CONFIG_WENET_AGGREGATION
+static void wifi_flush_aggregate(wifi_interface_t ifx, station_t *station, const uint8_t *src_addr);
+static void wifi_drop_aggregate(station_t *station);
+static void wifi_service_aggregates(void);
+static void wifi_aggregate_timer_callback(void *arg);
+#endif
+static bool wifi_aqm_drop(station_t *station, raw_data_t *raw_data);
+static bool wifi_get_local(wifi_interface_t *ifx, const uint8_t **src_addr);
+static void wifi_peer_connected(const uint8_t *addr, uint8_t aid);
+static void wifi_peer_disconnected(void);
+static void wifi_service_stations(void);
+static void wifi_send_tunnel_control(void);
+static TickType_t wifi_control_wait_ticks(void);
+#if CONFIG_WENET_TELEMETRY_CONSOLE
+static int wifi_console(int argc, char **argv);
+#endif
 /* Private user code ---------------------------------------------------------*/
 /**
  * @brief Initialize the wifi module
@@ -35,41 +219,118 @@ static void wifi_task_send_raw(void *pvParameters);
  */
 void wifi_init(void)
 {
-    // TODO: Read the wifi last mode and last data
+    if (wifi_state != WIFI_STATE_UNINIT)
+    {
+        return;
+    }
+    station_init();
+    ring_init(&wifi_relay_ring, wifi_relay_slots, WIFI_RELAY_RING_SIZE);
+#if CONFIG_WENET_AGGREGATION
+    const esp_timer_create_args_t timer_args = {
+        .callback = wifi_aggregate_timer_callback,
+        .name = "wifi_aggregate",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &wifi_aggregate_timer));
+#endif
+#if CONFIG_WENET_WIFI_FAST_RECONNECT && !CONFIG_WENET_WIFI_LOOPBACK
+    const esp_timer_create_args_t reconnect_args = {
+        .callback = wifi_reconnect_timer_callback,
+        .name = "wifi_reconnect",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&reconnect_args, &wifi_reconnect_timer));
+#endif
+#if !CONFIG_WENET_WIFI_LOOPBACK
+    // Initialize wifi with default configuration
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    // The link state has its own NVS record, the station config is set again for every connection attempt
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+#endif
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(WENET_WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_module_event_handler, NULL));
+    wifi_state = WIFI_STATE_STOPPED;
+    // Come back in the last mode with the last settings
+    wifi_link_config_t config;
+    if (wifi_load_config(&config) != ESP_OK)
+    {
+        return;
+    }
+    wifi_saved_config = config;
+    memcpy(ssid, config.ssid, sizeof(ssid));
+    memcpy(password, config.password, sizeof(password));
+    raw_mode = config.raw_mode != 0;
+    wifi_transport_id = (transport_id_t)config.transport;
+    memcpy(wifi_last_bssid, config.bssid, sizeof(wifi_last_bssid));
+    wifi_last_channel = config.channel;
+    if (config.mode != WIFI_MODE_NULL)
+    {
+        ESP_LOGI(LOG_WIFI_TAG, "Restoring wifi mode %d, SSID:%s, last channel %u", config.mode, ssid, wifi_last_channel);
+        wifi_change_mode((wifi_mode_t)config.mode);
+    }
 }
 
 /**
- * @brief Uinitialize the wifi module
+ * @brief Stop the wifi interface. The driver, the forwarding task and the frames waiting in the ethernet
+ *        receive ring stay, the peers of the interface are dropped with their queues
  * @param None
  * @retval
  */
 void wifi_uninit(void)
 {
-    switch (current_wifi_mode)
+    if (wifi_state != WIFI_STATE_STARTED)
+    {
+        return;
+    }
+    wifi_state = WIFI_STATE_STOPPING;
+#if CONFIG_WENET_WIFI_FAST_RECONNECT && !CONFIG_WENET_WIFI_LOOPBACK
+    esp_timer_stop(wifi_reconnect_timer);
+#endif
+    wifi_interface_t ifx;
+    const uint8_t *src_addr;
+    if (wifi_get_local(&ifx, &src_addr))
     {
-    case WIFI_MODE_NULL:
-        break;
-    case WIFI_MODE_STA:
         if (raw_mode)
         {
-            esp_wifi_internal_reg_rxcb(WIFI_IF_STA, NULL);
+            wifi_transport->reg_rxcb(ifx, NULL);
+            wifi_transport->reg_tx_done(NULL);
         }
-        break;
-    case WIFI_MODE_AP:
-        if (raw_mode)
+        if (wifi_transport->stop != NULL)
         {
-            esp_wifi_internal_reg_rxcb(WIFI_IF_AP, NULL);
+            wifi_transport->stop(ifx);
         }
-        break;
-    default:
-        break;
     }
+    atomic_fetch_add(&wifi_link_generation, 1);
+#if !CONFIG_WENET_WIFI_LOOPBACK
+    esp_wifi_stop();
+#endif
+    station_remove_all();
+    wifi_peer_disconnected();
+    telemetry_link_down();
+    wifi_state = WIFI_STATE_STOPPED;
 }
 
+/**
+ * @brief Change the wifi mode at run time. Only the interface is restarted: the send task keeps running, and the
+ *        frames received on ethernet meanwhile wait in the receive ring for the first peer of the new mode
+ * @param[in] new_mode New wifi mode, WIFI_MODE_NULL stops wifi
+ * @retval
+ */
 void wifi_change_mode(wifi_mode_t new_mode)
 {
+    if (wifi_state == WIFI_STATE_UNINIT)
+    {
+        ESP_LOGE(LOG_WIFI_TAG, "wifi_init must be called before the mode is changed");
+        return;
+    }
+    int64_t start_us = esp_timer_get_time();
+    bool switching = wifi_state == WIFI_STATE_STARTED && new_mode != WIFI_MODE_NULL;
     wifi_uninit();
     current_wifi_mode = new_mode;
+    if (switching && WIFI_SWITCH_HOLD_MS > 0 && raw_mode)
+    {
+        uint32_t until_ms = (uint32_t)(start_us / 1000) + WIFI_SWITCH_HOLD_MS;
+        atomic_store(&wifi_hold_until_ms, until_ms != 0 ? until_ms : 1);
+    }
     switch (current_wifi_mode)
     {
     case WIFI_MODE_NULL:
@@ -81,69 +342,172 @@ void wifi_change_mode(wifi_mode_t new_mode)
         wifi_start_AP();
         break;
     default:
+        ESP_LOGW(LOG_WIFI_TAG, "Wifi mode %d is not supported", current_wifi_mode);
+        current_wifi_mode = WIFI_MODE_NULL;
         break;
     }
+    if (switching && current_wifi_mode != WIFI_MODE_NULL)
+    {
+        wifi_switch_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+        // Unless a peer already connected while the interface started
+        if (station_count() == 0)
+        {
+            wifi_switch_start_us = start_us;
+            wifi_switch_pending = true;
+        }
+        ESP_LOGI(LOG_WIFI_TAG, "Wifi interface switched to mode %d in %lu ms", current_wifi_mode, (unsigned long)wifi_switch_ms);
+    }
+    wifi_save_config();
+}
+
+/**
+ * @brief Ask the event loop task to change the wifi mode, so the change is serialized with the wifi driver events.
+ *        For callers outside the event loop, e.g. the console
+ * @param[in] new_mode New wifi mode
+ * @retval Result of esp_event_post
+ */
+esp_err_t wifi_request_mode(wifi_mode_t new_mode)
+{
+    return esp_event_post(WENET_WIFI_EVENT, WENET_WIFI_EVENT_SET_MODE, &new_mode, sizeof(new_mode), portMAX_DELAY);
 }
 
 void wifi_change_ssid_pass(char *new_ssid, char *new_pass)
 {
+    if (strcmp(ssid, new_ssid) != 0)
+    {
+        // Another network, the access point last joined says nothing about it
+        memset(wifi_last_bssid, 0, sizeof(wifi_last_bssid));
+        wifi_last_channel = 0;
+    }
     memset(ssid, 0, sizeof(ssid));
     memset(password, 0, sizeof(password));
     strcpy(ssid, new_ssid);
     strcpy(password, new_pass);
+    wifi_save_config();
 }
 
 void wifi_set_raw_mode(bool mode)
 {
     raw_mode = mode;
+    wifi_save_config();
 }
 
-static void wifi_start_station(void)
+/**
+ * @brief Choose the transport the tunnel frames are sent over. It is used from the next start of the interface
+ * @param[in] transport New transport
+ * @retval
+ */
+void wifi_set_transport(transport_id_t transport)
 {
-    // Initialize wifi with default configuration
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    // esp_iface_mac_addr_set(wifi_global_addr, ESP_MAC_WIFI_STA);
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
+    if (transport >= TRANSPORT_MAX)
+    {
+        return;
+    }
+    wifi_transport_id = transport;
+    wifi_save_config();
+}
 
-    // Initialize wifi AP configuration
-    wifi_config_t wifi_configuration = {
-        .sta = {
-            .ssid = "",
-            .password = "",
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK},
+/**
+ * @brief Ask the event loop task to change the transport and restart the interface with it. For callers outside
+ *        the event loop, e.g. the console
+ * @param[in] transport New transport
+ * @retval Result of esp_event_post
+ */
+esp_err_t wifi_request_transport(transport_id_t transport)
+{
+    return esp_event_post(WENET_WIFI_EVENT, WENET_WIFI_EVENT_SET_TRANSPORT, &transport, sizeof(transport), portMAX_DELAY);
+}
+
+/**
+ * @brief Get the wifi mode, restored from NVS by wifi_init
+ * @param None
+ * @retval Current wifi mode, WIFI_MODE_NULL if wifi was never started
+ */
+wifi_mode_t wifi_get_mode(void)
+{
+    return current_wifi_mode;
+}
+
+/**
+ * @brief Tell whether a wifi link record is stored in NVS. A stored record with mode WIFI_MODE_NULL means wifi
+ *        was switched off on purpose, it is not a first boot
+ * @param None
+ * @retval true if wifi_init loaded a valid record or one was stored since
+ */
+bool wifi_has_stored_config(void)
+{
+    return wifi_saved_config.version == WIFI_NVS_VERSION;
+}
+
+#if CONFIG_WENET_TELEMETRY_CONSOLE
+/**
+ * @brief Register the "wifi" console command
+ * @param None
+ * @retval Result of esp_console_cmd_register
+ */
+esp_err_t wifi_register_console(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "wifi",
+        .help = "Show the wifi mode, the peers and the time the last mode change took. \"wifi sta|ap|off\" changes "
+                "the mode without a reboot, \"wifi transport wifi|espnow\" the transport the peers are reached over",
+        .hint = "[sta|ap|off|transport wifi|espnow]",
+        .func = wifi_console,
     };
-    strcpy((char *)wifi_configuration.ap.ssid, ssid);
-    strcpy((char *)wifi_configuration.ap.password, password);
+    return esp_console_cmd_register(&command);
+}
+#endif
+
+/**
+ * @brief Give a receive buffer back to the wifi driver, for frames handed over with their driver buffer. Only the
+ *        wifi driver, or the loopback peer replacing it, hands over its buffers
+ * @param[in] eb Buffer handle given to the receive callback
+ * @retval
+ */
+void wifi_free_rx_buffer(void *eb)
+{
+    WIFI_DRIVER_FREE_RX_BUFFER(eb);
+}
 
+static void wifi_start_station(void)
+{
+    wifi_transport = wifi_select_transport();
+#if !CONFIG_WENET_WIFI_LOOPBACK
+    // esp_iface_mac_addr_set(wifi_global_addr, ESP_MAC_WIFI_STA);
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_configuration));
     ESP_ERROR_CHECK(esp_wifi_start());
+#endif
     esp_read_mac(wifi_sta_addr, ESP_MAC_WIFI_STA);
+    wifi_state = WIFI_STATE_STARTED;
     ESP_LOGI(LOG_WIFI_TAG, "ESP32 wifi station addr->%02x:%02x:%02x:%02x:%02x:%02x", wifi_sta_addr[0], wifi_sta_addr[1], wifi_sta_addr[2], wifi_sta_addr[3], wifi_sta_addr[4], wifi_sta_addr[5]);
-    if (raw_mode)
+    wifi_start_forwarding(WIFI_IF_STA);
+    if (wifi_transport->start != NULL)
     {
-        esp_wifi_internal_reg_rxcb(WIFI_IF_STA, wifi_callback_receive_raw);
-        // Start a task to send raw data from ethernet buffer
-        xTaskCreatePinnedToCore(wifi_task_send_raw, "wifi_send_raw_task", 2048, NULL, 0, &wifi_send_raw_taskHandler, tskNO_AFFINITY);
+        // The transport links the peers itself, the station joins no access point
+        wifi_start_transport(WIFI_IF_STA, wifi_sta_addr);
+        return;
     }
-    esp_wifi_connect();
+#if !CONFIG_WENET_WIFI_LOOPBACK
+#if CONFIG_WENET_WIFI_FAST_RECONNECT
+    wifi_connect_attempt = 0;
+#endif
+    wifi_connect();
+#endif
 }
 
 static void wifi_start_AP(void)
 {
-    // Initialize wifi with default configuration
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
-
+    wifi_transport = wifi_select_transport();
+#if CONFIG_WENET_WIFI_LOOPBACK
+    esp_read_mac(wifi_ap_addr, ESP_MAC_WIFI_SOFTAP);
+#else
     // Initialize wifi AP configuration
     wifi_config_t wifi_configuration = {
         .ap = {
             .ssid = "",
             .ssid_len = 0,
             .password = "",
-            .max_connection = 1,
+            .max_connection = STATION_MAX,
             .authmode = WIFI_AUTH_WPA2_PSK,
             .pmf_cfg = {
                 .required = true,
@@ -157,17 +521,254 @@ static void wifi_start_AP(void)
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_configuration));
     ESP_ERROR_CHECK(esp_wifi_start());
     esp_read_mac(wifi_ap_addr, ESP_MAC_WIFI_SOFTAP);
+#endif
+    wifi_state = WIFI_STATE_STARTED;
     ESP_LOGI(LOG_WIFI_TAG, "ESP32 wifi ap addr->%02x:%02x:%02x:%02x:%02x:%02x", wifi_ap_addr[0], wifi_ap_addr[1], wifi_ap_addr[2], wifi_ap_addr[3], wifi_ap_addr[4], wifi_ap_addr[5]);
-    if (raw_mode)
+    wifi_start_forwarding(WIFI_IF_AP);
+    if (wifi_transport->start != NULL)
+    {
+        // Stations that join the access point are not linked, the transport brings its own peers
+        wifi_start_transport(WIFI_IF_AP, wifi_ap_addr);
+    }
+}
+
+/**
+ * @brief Hook the raw receive callback to the started interface and start the send task on the first start.
+ *        The task and its queues are kept across mode changes
+ * @param[in] ifx Started interface
+ * @retval
+ */
+static void wifi_start_forwarding(wifi_interface_t ifx)
+{
+    if (!raw_mode)
+    {
+        return;
+    }
+    wifi_transport->reg_rxcb(ifx, wifi_callback_receive_raw);
+    wifi_transport->reg_tx_done(wifi_tx_done);
+    if (wifi_send_raw_taskHandler == NULL)
     {
-        esp_wifi_internal_reg_rxcb(WIFI_IF_AP, wifi_callback_receive_raw);
         // Start a task to send raw data from ethernet buffer
-        xTaskCreatePinnedToCore(wifi_task_send_raw, "wifi_send_raw_task", 2048, NULL, 0, &wifi_send_raw_taskHandler, tskNO_AFFINITY);
+        xTaskCreatePinnedToCore(wifi_task_send_raw, "wifi_send_raw_task", WIFI_TX_TASK_STACK, NULL, WIFI_TX_TASK_PRIORITY, &wifi_send_raw_taskHandler, WIFI_TX_TASK_CORE);
+    }
+}
+
+/**
+ * @brief Start a transport that links its peers itself on the started interface
+ * @param[in] ifx Started interface
+ * @param[in] local_addr Local wifi address
+ * @retval
+ */
+static void wifi_start_transport(wifi_interface_t ifx, const uint8_t *local_addr)
+{
+    esp_err_t ret = wifi_transport->start(ifx, local_addr, wifi_transport_link);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(LOG_WIFI_TAG, "Could not start the %s transport: %s", wifi_transport->name, esp_err_to_name(ret));
+        return;
+    }
+    ESP_LOGI(LOG_WIFI_TAG, "Wifi peers are reached over the %s transport, MTU %u", wifi_transport->name, wifi_transport->mtu);
+}
+
+/**
+ * @brief Get the transport the interface starts with
+ * @param None
+ * @retval The loopback peer when it replaces the wifi driver, else the chosen transport
+ */
+static const transport_t *wifi_select_transport(void)
+{
+#if CONFIG_WENET_WIFI_LOOPBACK
+    return &transport_loopback;
+#else
+    switch (wifi_transport_id)
+    {
+#if CONFIG_WENET_ESPNOW
+    case TRANSPORT_ESPNOW:
+        return &transport_espnow;
+#endif
+    case TRANSPORT_WIFI:
+        return &transport_wifi;
+    default:
+        ESP_LOGW(LOG_WIFI_TAG, "Transport %d is not available, using wifi", wifi_transport_id);
+        return &transport_wifi;
+    }
+#endif
+}
+
+/**
+ * @brief Peer report of a transport, passed to the event loop task so it is serialized with the mode changes and
+ *        the wifi driver events
+ * @param[in] addr Peer address
+ * @param[in] up true if the peer was found, false if it was lost
+ * @retval true if the report was queued
+ */
+static bool wifi_transport_link(const uint8_t *addr, bool up)
+{
+    wifi_link_event_t event = {
+        .generation = (uint32_t)atomic_load(&wifi_link_generation),
+    };
+    memcpy(event.addr, addr, sizeof(event.addr));
+    // May come from the wifi driver task, which must not wait for the event loop
+    return esp_event_post(WENET_WIFI_EVENT, up ? WENET_WIFI_EVENT_PEER_UP : WENET_WIFI_EVENT_PEER_DOWN, &event, sizeof(event), 0) == ESP_OK;
+}
+
+/**
+ * @brief Add or remove the wifi peer a transport reported
+ * @param[in] event_id WENET_WIFI_EVENT_PEER_UP or WENET_WIFI_EVENT_PEER_DOWN
+ * @param[in] event Peer report
+ * @retval
+ */
+static void wifi_transport_link_changed(int32_t event_id, const wifi_link_event_t *event)
+{
+    // A transport stopped by a mode change may have reported its peers late
+    if (wifi_state != WIFI_STATE_STARTED || event->generation != (uint32_t)atomic_load(&wifi_link_generation))
+    {
+        return;
+    }
+    if (event_id == WENET_WIFI_EVENT_PEER_UP)
+    {
+        if (station_find(event->addr) == NULL)
+        {
+            wifi_peer_connected(event->addr, 0);
+            ESP_LOGI(LOG_WIFI_TAG, "Peer " MACSTR " linked over %s", MAC2STR(event->addr), wifi_transport->name);
+        }
+        return;
+    }
+    station_remove(event->addr);
+    wifi_peer_disconnected();
+    if (station_count() == 0)
+    {
+        telemetry_link_down();
+    }
+    ESP_LOGI(LOG_WIFI_TAG, "Peer " MACSTR " lost over %s", MAC2STR(event->addr), wifi_transport->name);
+}
+
+/**
+ * @brief Event handler of the module's own events, so mode changes and reconnects run in the event loop task
+ * @param[in] arg
+ * @param[in] event_base WENET_WIFI_EVENT
+ * @param[in] event_id wenet_wifi_event_t
+ * @param[in] event_data New mode for WENET_WIFI_EVENT_SET_MODE
+ * @retval
+ */
+static void wifi_module_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    (void)arg;
+    (void)event_base;
+    switch (event_id)
+    {
+    case WENET_WIFI_EVENT_SET_MODE:
+        wifi_change_mode(*(wifi_mode_t *)event_data);
+        break;
+    case WENET_WIFI_EVENT_SET_TRANSPORT:
+        wifi_set_transport(*(transport_id_t *)event_data);
+        if (wifi_state == WIFI_STATE_STARTED)
+        {
+            // Restart the interface with the new transport
+            wifi_change_mode(current_wifi_mode);
+        }
+        break;
+    case WENET_WIFI_EVENT_PEER_UP:
+    case WENET_WIFI_EVENT_PEER_DOWN:
+        wifi_transport_link_changed(event_id, event_data);
+        break;
+#if CONFIG_WENET_WIFI_FAST_RECONNECT && !CONFIG_WENET_WIFI_LOOPBACK
+    case WENET_WIFI_EVENT_RECONNECT:
+        if (wifi_state == WIFI_STATE_STARTED && current_wifi_mode == WIFI_MODE_STA)
+        {
+            wifi_connect();
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+#if !CONFIG_WENET_WIFI_LOOPBACK
+/**
+ * @brief Set the station config and start joining the access point. The first attempts after a boot or a link
+ *        loss go straight to the access point last joined on its channel, scanning every channel takes seconds
+ * @param None
+ * @retval
+ */
+static void wifi_connect(void)
+{
+    wifi_config_t wifi_configuration = {
+        .sta = {
+            .ssid = "",
+            .password = "",
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK},
+    };
+    strcpy((char *)wifi_configuration.sta.ssid, ssid);
+    strcpy((char *)wifi_configuration.sta.password, password);
+#if CONFIG_WENET_WIFI_FAST_RECONNECT
+    if (wifi_last_channel != 0 && wifi_connect_attempt < WIFI_DIRECT_ATTEMPTS)
+    {
+        wifi_configuration.sta.channel = wifi_last_channel;
+        wifi_configuration.sta.bssid_set = true;
+        memcpy(wifi_configuration.sta.bssid, wifi_last_bssid, sizeof(wifi_configuration.sta.bssid));
+    }
+    else if (wifi_connect_attempt == WIFI_DIRECT_ATTEMPTS)
+    {
+        ESP_LOGI(LOG_WIFI_TAG, "Access point " MACSTR " not found on channel %u, scanning", MAC2STR(wifi_last_bssid), wifi_last_channel);
+    }
+#endif
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_configuration);
+    esp_wifi_connect();
+}
+
+/**
+ * @brief Try to join the access point again after the station lost it or failed to join it. The first retry
+ *        is immediate, the following ones back off exponentially
+ * @param None
+ * @retval
+ */
+static void wifi_reconnect(void)
+{
+#if CONFIG_WENET_WIFI_FAST_RECONNECT
+    wifi_connect_attempt++;
+    if (wifi_connect_attempt == 1)
+    {
+        wifi_connect();
+        return;
     }
+    uint32_t shift = wifi_connect_attempt - 2;
+    uint32_t delay_ms = shift < 16 ? WIFI_RECONNECT_MIN_MS << shift : WIFI_RECONNECT_MAX_MS;
+    if (delay_ms > WIFI_RECONNECT_MAX_MS)
+    {
+        delay_ms = WIFI_RECONNECT_MAX_MS;
+    }
+    esp_timer_stop(wifi_reconnect_timer);
+    esp_timer_start_once(wifi_reconnect_timer, (uint64_t)delay_ms * 1000);
+#else
+    wifi_connect();
+#endif
+}
+
+#if CONFIG_WENET_WIFI_FAST_RECONNECT
+/**
+ * @brief Backoff timer of wifi_reconnect
+ * @param[in] arg
+ * @retval
+ */
+static void wifi_reconnect_timer_callback(void *arg)
+{
+    (void)arg;
+    esp_event_post(WENET_WIFI_EVENT, WENET_WIFI_EVENT_RECONNECT, NULL, 0, 0);
 }
+#endif
+#endif
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
+    (void)arg;
+    (void)event_base;
+    // Events an interface posted before a mode change stopped it arrive late, they must not touch the peers
+    // of the new mode. A transport that links its peers itself does not use the associations
+    bool associations = wifi_state == WIFI_STATE_STARTED && wifi_transport->start == NULL;
+    bool station_started = associations && current_wifi_mode == WIFI_MODE_STA;
+    bool ap_started = associations && current_wifi_mode == WIFI_MODE_AP;
     switch (event_id)
     {
     // WIFI Station events
@@ -178,16 +779,36 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         ESP_LOGI(LOG_WIFI_TAG, "Wifi station stopped");
         break;
     case WIFI_EVENT_STA_CONNECTED:
-        wifi_ap_record_t ap_info;
-        esp_wifi_sta_get_ap_info(&ap_info);
-        memcpy(wifi_ap_addr, ap_info.bssid, 6);
-        wifi_connected = true;
-        ESP_LOGI(LOG_WIFI_TAG, "Wifi station has connected to %s mac->" MACSTR, ssid, MAC2STR(wifi_ap_addr));
+    {
+        if (!station_started)
+        {
+            break;
+        }
+        wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)event_data;
+        memcpy(wifi_ap_addr, event->bssid, 6);
+        wifi_peer_connected(wifi_ap_addr, 0);
+        ESP_LOGI(LOG_WIFI_TAG, "Wifi station has connected to %s mac->" MACSTR " channel %u", ssid, MAC2STR(wifi_ap_addr), event->channel);
+#if CONFIG_WENET_WIFI_FAST_RECONNECT
+        wifi_connect_attempt = 0;
+#endif
+        // Remember the access point, the next boot or link loss joins it again without scanning
+        memcpy(wifi_last_bssid, event->bssid, sizeof(wifi_last_bssid));
+        wifi_last_channel = event->channel;
+        wifi_save_config();
         break;
+    }
     case WIFI_EVENT_STA_DISCONNECTED:
-        wifi_connected = false;
+        if (!station_started)
+        {
+            break;
+        }
+        station_remove_all();
+        wifi_peer_disconnected();
+        telemetry_link_down();
         ESP_LOGI(LOG_WIFI_TAG, "Wifi station disconnected from %s", ssid);
-        esp_wifi_connect();
+#if !CONFIG_WENET_WIFI_LOOPBACK
+        wifi_reconnect();
+#endif
         break;
 
     // WIFI Accesspoint events
@@ -200,16 +821,29 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         break;
     case WIFI_EVENT_AP_STACONNECTED:
     {
+        if (!ap_started)
+        {
+            break;
+        }
         wifi_event_ap_staconnected_t *event = (wifi_event_ap_staconnected_t *)event_data;
-        memcpy(wifi_sta_addr, event->mac, 6);
-        wifi_connected = true;
+        wifi_peer_connected(event->mac, event->aid);
         ESP_LOGI(LOG_WIFI_TAG, "station " MACSTR " join, AID=%d", MAC2STR(event->mac), event->aid);
         break;
     }
     case WIFI_EVENT_AP_STADISCONNECTED:
     {
-        wifi_connected = false;
+        if (!ap_started)
+        {
+            break;
+        }
         wifi_event_ap_stadisconnected_t *event = (wifi_event_ap_stadisconnected_t *)event_data;
+        station_remove(event->mac);
+        wifi_peer_disconnected();
+        if (station_count() == 0)
+        {
+            // The last station left, forwarding stops until one joins
+            telemetry_link_down();
+        }
         ESP_LOGI(LOG_WIFI_TAG, "station " MACSTR " leave, AID=%d", MAC2STR(event->mac), event->aid);
         break;
     }
@@ -218,59 +852,1006 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
 
 static esp_err_t wifi_callback_receive_raw(void *buffer, uint16_t len, void *eb)
 {
-    if (eth_connected)
+    wifi_rx_timestamp = (uint32_t)esp_timer_get_time();
+#if CONFIG_WENET_CAPTURE
+    // Captured as sent over the air, aggregates and tunnel control frames included
+    capture_frame(CAPTURE_POINT_WIFI_RX, buffer, len, wifi_rx_timestamp);
+#endif
+    // The outer source address tells which wifi peer sent the frame
+    station_t *station = len > 2 * TUNNEL_ADDR_LEN ? station_find((uint8_t *)buffer + TUNNEL_ADDR_LEN) : NULL;
+    // A data frame goes to ethernet in the driver buffer. The frames of an aggregate, expanded frames,
+    // reassembled frames and the frames of a transport that keeps its buffer are copied
+    bool copied = eb == NULL || tunnel_is_aggregate(buffer, len) || tunnel_is_compressed(buffer, len) || tunnel_is_fragment(buffer, len);
+    wifi_rx_eb = copied ? NULL : eb;
+    if (station != NULL)
+    {
+        tunnel_receive(&station->tunnel, buffer, len, wifi_forward_received, station);
+        if (tunnel_control_pending(&station->tunnel) && wifi_send_raw_taskHandler != NULL)
+        {
+            // Tunnel control frames are only sent from the wifi send task
+            xTaskNotifyGive(wifi_send_raw_taskHandler);
+        }
+    }
+    if (eb != NULL && (copied || wifi_rx_eb != NULL))
     {
-        memcpy(buffer, buffer + (len - 12), 12);
-        esp_eth_transmit(eth_handle, buffer, len - 12);
+        // Not taken by the ethernet transmit task
+        WIFI_DRIVER_FREE_RX_BUFFER(eb);
     }
-    esp_wifi_internal_free_rx_buffer(eb);
+    wifi_rx_eb = NULL;
     return ESP_OK;
 }
 
-static void wifi_task_send_raw(void *pvParameters)
+/**
+ * @brief Forward a decapsulated frame received from a wifi peer to ethernet and to the other wifi peers
+ * @param[in] ctx Wifi peer the frame was received from
+ * @param[in] frame Ethernet frame
+ * @param[in] len Ethernet frame length
+ * @retval
+ */
+static void wifi_forward_received(void *ctx, uint8_t *frame, uint32_t len)
 {
-    if (eth_receive_queue != NULL)
+    station_t *station = ctx;
+    uint8_t peer = station_index(station);
+    fdb_port_t egress_port = FDB_PORT_NONE;
+    uint8_t egress_peer = FDB_PEER_ANY;
+    telemetry_count_rx(TELEMETRY_DIR_WIFI_TO_ETH, len);
+    arp_snoop(frame, len);
+    filter_snoop(frame, len, peer);
+#if CONFIG_WENET_FDB
+    // Learn the hosts behind the peer, and do not send frames back to where they came from
+    if (!fdb_forward(frame, FDB_PORT_WIFI, peer, &egress_port, &egress_peer))
     {
-        xQueueReset(eth_receive_queue);
+        return;
     }
-    while (true)
+#endif
+#if CONFIG_WENET_ARP_PROXY
+    arp_proxy_result_t proxy_result = arp_proxy(frame, len, FDB_PORT_WIFI, peer);
+    if (proxy_result != ARP_PROXY_FORWARD)
     {
-        raw_data_t *received_data;
-        if (eth_receive_queue != NULL && xQueueReceive(eth_receive_queue, &received_data, portMAX_DELAY) == pdTRUE)
+        // The request would have been flooded to the other peers
+        arp_count_airtime(len, station_count() - 1);
+        if (proxy_result == ARP_PROXY_REPLIED)
         {
-            if (wifi_connected)
-            {
-                uint8_t *new_data = malloc((received_data->data_length) + 12);
-                memcpy(new_data, received_data->data, received_data->data_length);
-                free(received_data->data);
-                memcpy(new_data + received_data->data_length, new_data, 12);
-                switch (current_wifi_mode)
-                {
-                case WIFI_MODE_STA:
-                    memcpy(new_data, wifi_ap_addr, 6);
-                    memcpy(new_data + 6, wifi_sta_addr, 6);
-                    esp_wifi_internal_tx(WIFI_IF_STA, new_data, received_data->data_length + 12);
-                    free(new_data);
-                    free(received_data);
-                    break;
-                case WIFI_MODE_AP:
-                    memcpy(new_data, wifi_sta_addr, 6);
-                    memcpy(new_data + 6, wifi_ap_addr, 6);
-                    esp_wifi_internal_tx(WIFI_IF_AP, new_data, received_data->data_length + 12);
-                    free(new_data);
-                    free(received_data);
-                    break;
-                default:
-                    break;
-                }
-            }
-            else
-            {
-                free(received_data->data);
-                free(received_data);
-            }
+            wifi_relay_frame(station, frame, len, peer);
+        }
+        return;
+    }
+#endif
+    // Relayed first, the frame may be gone once it is queued for ethernet
+    if (egress_port != FDB_PORT_ETH)
+    {
+        wifi_relay_frame(station, frame, len, egress_peer);
+    }
+    if (egress_port != FDB_PORT_WIFI)
+    {
+        wifi_forward_to_ethernet(frame, len);
+    }
+}
+
+/**
+ * @brief Queue a frame received from a wifi peer for the ethernet transmit task. A data frame takes the
+ *        driver buffer along and the task frees it once the frame is sent, the frames of an aggregate,
+ *        expanded frames and reassembled frames are copied to a pool buffer
+ * @param[in] frame Ethernet frame in the driver buffer
+ * @param[in] len Ethernet frame length
+ * @retval
+ */
+static void wifi_forward_to_ethernet(uint8_t *frame, uint32_t len)
+{
+    if (!eth_connected)
+    {
+        bridge_count_drop(BRIDGE_DROP_LINK_DOWN);
+        return;
+    }
+    raw_data_t *raw_data = pool_alloc_desc();
+    if (raw_data == NULL)
+    {
+        bridge_count_drop(BRIDGE_DROP_NO_DESC);
+        return;
+    }
+    if (wifi_rx_eb != NULL)
+    {
+        raw_data->data = frame;
+        raw_data->eb = wifi_rx_eb;
+        wifi_rx_eb = NULL;
+    }
+    else
+    {
+        uint8_t *buffer = len <= POOL_BUF_SIZE ? pool_alloc_buf() : NULL;
+        if (buffer == NULL)
+        {
+            bridge_count_drop(len <= POOL_BUF_SIZE ? BRIDGE_DROP_NO_BUF : BRIDGE_DROP_OVERSIZE);
+            pool_free_desc(raw_data);
+            return;
         }
+        memcpy(buffer, frame, len);
+        raw_data->data = buffer;
+    }
+    raw_data->data_length = len;
+    raw_data->timestamp = wifi_rx_timestamp;
+    ethernet_transmit_enqueue(raw_data);
+}
+
+/**
+ * @brief Queue a frame received from one wifi peer to be sent to the other wifi peers by the wifi send task
+ * @param[in] station Wifi peer the frame was received from
+ * @param[in] frame Ethernet frame, it is copied since the driver buffer is freed by the receive callback
+ * @param[in] len Ethernet frame length
+ * @param[in] egress_peer Destination wifi peer, FDB_PEER_ANY to flood it
+ * @retval
+ */
+static void wifi_relay_frame(station_t *station, const uint8_t *frame, uint32_t len, uint8_t egress_peer)
+{
+    if (egress_peer == FDB_PEER_ANY && station_count() < 2)
+    {
+        // No other peer to flood to
+        return;
+    }
+    if (len + TUNNEL_MAX_OVERHEAD > POOL_BUF_SIZE)
+    {
+        bridge_count_drop(BRIDGE_DROP_OVERSIZE);
+        return;
+    }
+    raw_data_t *raw_data = pool_alloc_desc();
+    if (raw_data == NULL)
+    {
+        bridge_count_drop(BRIDGE_DROP_NO_DESC);
+        return;
+    }
+    uint8_t *buffer = pool_alloc_buf();
+    if (buffer == NULL)
+    {
+        bridge_count_drop(BRIDGE_DROP_NO_BUF);
+        pool_free_desc(raw_data);
+        return;
+    }
+    memcpy(buffer, frame, len);
+    raw_data->data = buffer;
+    raw_data->data_length = len;
+    raw_data->timestamp = (uint32_t)esp_timer_get_time();
+    raw_data->peer = egress_peer;
+    raw_data->ingress_peer = station_index(station);
+    raw_data->qos_class = qos_classify(buffer, len);
+    telemetry_count_rx(TELEMETRY_DIR_WIFI_TO_WIFI, len);
+    uint32_t queued = ring_push(&wifi_relay_ring, raw_data);
+    if (queued == 0)
+    {
+        bridge_count_drop(BRIDGE_DROP_QUEUE_FULL);
+        pool_release(raw_data);
+        return;
+    }
+    telemetry_queue_depth(TELEMETRY_QUEUE_WIFI_RELAY, queued);
+    if (queued == 1 && wifi_send_raw_taskHandler != NULL)
+    {
+        xTaskNotifyGive(wifi_send_raw_taskHandler);
+    }
+}
+
+static void wifi_task_send_raw(void *pvParameters)
+{
+    (void)pvParameters;
+    qos_sched_init(&wifi_sched);
+    ethernet_set_receive_consumer(xTaskGetCurrentTaskHandle());
+    ethernet_flush_receive_queue();
+    while (true)
+    {
+        wifi_service_stations();
+#if CONFIG_WENET_AGGREGATION
+        wifi_service_aggregates();
+#endif
+        wifi_send_tunnel_control();
+        uint32_t count = wifi_holding() ? 0 : wifi_pull_frames();
+        if (count == 0 && qos_sched_count(&wifi_sched) == 0)
+        {
+            // Sleep until an input path queues a frame into an empty ring, a peer connects or leaves,
+            // or a tunnel control frame is due
+            ulTaskNotifyTake(pdTRUE, wifi_control_wait_ticks());
+            continue;
+        }
+#if CONFIG_WENET_RUN_TO_COMPLETION
+        // Send everything queued, then take the next burst right away. The housekeeping above runs again
+        // once the rings are empty, or at the latest after a ring worth of frames
+        uint32_t sent = 0;
+        do
+        {
+            sent += wifi_schedule(qos_sched_count(&wifi_sched));
+        } while (sent < WIFI_RUN_TO_COMPLETION_LIMIT && wifi_pull_frames() > 0);
+#else
+        wifi_schedule(ETH_RECEIVE_BURST);
+#endif
+#if CONFIG_WENET_ETH_PAUSE
+        ethernet_set_wifi_backlog(qos_sched_count(&wifi_sched));
+#endif
+    }
+}
+
+/**
+ * @brief Check whether the frames received on ethernet are left queued because a mode change waits for its first
+ *        peer. Flooding them to no peer at all would lose them
+ * @param None
+ * @retval true while holding
+ */
+static bool wifi_holding(void)
+{
+    uint_fast32_t until_ms = atomic_load_explicit(&wifi_hold_until_ms, memory_order_relaxed);
+    if (until_ms == 0)
+    {
+        return false;
+    }
+    if (!WIFI_TIME_AFTER_EQ((uint32_t)(esp_timer_get_time() / 1000), (uint32_t)until_ms))
+    {
+        return true;
+    }
+    // No peer came in time, the frames are dropped as usual
+    atomic_compare_exchange_strong(&wifi_hold_until_ms, &until_ms, 0);
+    return false;
+}
+
+/**
+ * @brief Move one burst of frames from the ethernet ring and the wifi relay ring to the wifi peer queues
+ * @param None
+ * @retval Number of frames taken from the rings
+ */
+static uint32_t wifi_pull_frames(void)
+{
+    raw_data_t *received_data[ETH_RECEIVE_BURST];
+    uint32_t count = ethernet_receive_burst(received_data, ETH_RECEIVE_BURST);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        wifi_dispatch_frame(received_data[i]);
+    }
+    uint32_t relayed = ring_pop_burst(&wifi_relay_ring, received_data, ETH_RECEIVE_BURST);
+    for (uint32_t i = 0; i < relayed; i++)
+    {
+        wifi_dispatch_frame(received_data[i]);
+    }
+    telemetry_queue_depth(TELEMETRY_QUEUE_WIFI_PEERS, qos_sched_count(&wifi_sched));
+    return count + relayed;
+}
+
+/**
+ * @brief Queue a frame for its destination wifi peer, or for every peer but the one it came from when it is flooded
+ * @param[in] raw_data Frame descriptor
+ * @retval
+ */
+static void wifi_dispatch_frame(raw_data_t *raw_data)
+{
+    if (raw_data->peer != RAW_DATA_PEER_ALL)
+    {
+        station_t *station = station_get(raw_data->peer);
+        if (station == NULL)
+        {
+            bridge_count_drop(BRIDGE_DROP_LINK_DOWN);
+            pool_release(raw_data);
+            return;
+        }
+        wifi_enqueue_frame(station, raw_data);
+        return;
+    }
+    uint32_t peers = 0;
+    for (uint8_t i = 0; i < STATION_MAX; i++)
+    {
+        if (station_get(i) != NULL && i != raw_data->ingress_peer)
+        {
+            peers |= 1u << i;
+        }
+    }
+#if CONFIG_WENET_ARP_PROXY
+    // Requests from the wifi peers are answered when they are received
+    if (raw_data->ingress_peer == RAW_DATA_PEER_ALL && peers != 0)
+    {
+        arp_proxy_result_t proxy_result = arp_proxy(raw_data->data, raw_data->data_length, FDB_PORT_ETH, FDB_PEER_ANY);
+        if (proxy_result != ARP_PROXY_FORWARD)
+        {
+            arp_count_airtime(raw_data->data_length, __builtin_popcount(peers));
+            if (proxy_result == ARP_PROXY_REPLIED)
+            {
+                // The request was rewritten into the reply in place, the ethernet transmit task sends it
+                ethernet_transmit_reply(raw_data);
+                return;
+            }
+            pool_release(raw_data);
+            return;
+        }
+    }
+#endif
+    uint32_t selected = filter_flood(raw_data->data, raw_data->data_length, peers);
+    if (peers != 0 && selected == 0)
+    {
+        // Suppressed by a broadcast or multicast rule, accounted there
+        pool_release(raw_data);
+        return;
+    }
+    // Every peer encapsulates the frame in place with its own tunnel state, so each additional peer needs a copy
+    station_t *first = NULL;
+    for (uint8_t i = 0; i < STATION_MAX; i++)
+    {
+        station_t *station = station_get(i);
+        if (station == NULL || (selected & (1u << i)) == 0)
+        {
+            continue;
+        }
+        if (first == NULL)
+        {
+            first = station;
+            continue;
+        }
+        raw_data_t *copy = pool_clone(raw_data);
+        if (copy == NULL)
+        {
+            bridge_count_drop(BRIDGE_DROP_NO_BUF);
+            continue;
+        }
+        wifi_enqueue_frame(station, copy);
+    }
+    if (first == NULL)
+    {
+        bridge_count_drop(BRIDGE_DROP_LINK_DOWN);
+        pool_release(raw_data);
+        return;
+    }
+    wifi_enqueue_frame(first, raw_data);
+}
+
+/**
+ * @brief Append a frame to the class queue of a wifi peer, or drop it if the peer queue or the class queue is full
+ * @param[in] station Wifi peer
+ * @param[in] raw_data Frame descriptor
+ * @retval
+ */
+static void wifi_enqueue_frame(station_t *station, raw_data_t *raw_data)
+{
+#if CONFIG_WENET_ACK_FILTER
+    if (ack_filter_merge(&station->ack_filter, station->flow, raw_data))
+    {
+        // The frame took the place of an older ACK of its flow, the descriptor now holds the older one
+        pool_release(raw_data);
+        return;
+    }
+#endif
+    if (station_queued(station) >= STATION_QUEUE_LIMIT || !qos_sched_enqueue(&wifi_sched, station->flow, raw_data))
+    {
+#if CONFIG_WENET_ACK_FILTER
+        ack_filter_forget(&station->ack_filter, raw_data);
+#endif
+        station->stats.queue_drops++;
+        bridge_count_drop(BRIDGE_DROP_STATION);
+        pool_release(raw_data);
+    }
+}
+
+/**
+ * @brief Send queued frames by traffic class priority and weight. Within a class every wifi peer gets the
+ *        same share of bytes, so a peer with a full queue cannot hold back the others
+ * @param[in] budget Maximum number of frames to take before the rings are polled again
+ * @retval Number of frames taken from the peer queues
+ */
+static uint32_t wifi_schedule(uint32_t budget)
+{
+    wifi_interface_t ifx;
+    const uint8_t *src_addr;
+    bool local_available = wifi_get_local(&ifx, &src_addr);
+    uint32_t count = 0;
+    drr_flow_t *flow;
+    raw_data_t *raw_data;
+    while (count < budget && (raw_data = qos_sched_dequeue(&wifi_sched, &flow)) != NULL)
+    {
+        station_t *station = WIFI_FLOW_STATION(flow, raw_data->qos_class);
+#if CONFIG_WENET_ACK_FILTER
+        ack_filter_forget(&station->ack_filter, raw_data);
+#endif
+        if (!local_available)
+        {
+            bridge_count_drop(BRIDGE_DROP_LINK_DOWN);
+        }
+        else if (wifi_aqm_drop(station, raw_data))
+        {
+            bridge_count_drop(BRIDGE_DROP_AQM);
+        }
+        else
+        {
+            wifi_transmit(ifx, station, raw_data, src_addr);
+            count++;
+            continue;
+        }
+        pool_release(raw_data);
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Send a dequeued frame, or hold it back to be packed with the next small frames to the same peer
+ * @param[in] ifx Wifi interface to send the frame on
+ * @param[in] station Destination wifi peer
+ * @param[in] raw_data Frame descriptor, released once the frame is sent
+ * @param[in] src_addr Local wifi address
+ * @retval
+ */
+static void wifi_transmit(wifi_interface_t ifx, station_t *station, raw_data_t *raw_data, const uint8_t *src_addr)
+{
+#if CONFIG_WENET_AGGREGATION
+    station_aggregate_t *aggregate = &station->aggregate;
+    uint32_t len = raw_data->data_length;
+    if (len >= TUNNEL_ETH_HEADER_LEN && len <= WIFI_AGGREGATE_MAX_FRAME && tunnel_aggregate_supported(&station->tunnel))
+    {
+        // An aggregate is not fragmented, it has to fit the transport
+        uint32_t max_len = wifi_transport->mtu < WIFI_AGGREGATE_MAX_LEN ? wifi_transport->mtu : WIFI_AGGREGATE_MAX_LEN;
+        if (aggregate->count > 0 && aggregate->wire_len + TUNNEL_AGGREGATE_ROOM(len) > max_len)
+        {
+            wifi_flush_aggregate(ifx, station, src_addr);
+        }
+        if (aggregate->count == 0)
+        {
+            aggregate->head = NULL;
+            aggregate->wire_len = TUNNEL_AGGREGATE_EMPTY_LEN;
+            aggregate->deadline = (uint32_t)esp_timer_get_time() + WIFI_AGGREGATE_HOLD_US;
+        }
+        raw_data->next = NULL;
+        if (aggregate->head == NULL)
+        {
+            aggregate->head = raw_data;
+        }
+        else
+        {
+            aggregate->tail->next = raw_data;
+        }
+        aggregate->tail = raw_data;
+        aggregate->count++;
+        aggregate->wire_len += TUNNEL_AGGREGATE_ROOM(len);
+        return;
+    }
+    // Frames held back for the peer go first so its frames stay in order
+    wifi_flush_aggregate(ifx, station, src_addr);
+#endif
+    wifi_send_raw_frame(ifx, station, raw_data, src_addr);
+    pool_release(raw_data);
+}
+
+/**
+ * @brief Encapsulate an ethernet frame in place and pass it to the wifi driver, in fragments when it grew
+ *        longer than the driver carries
+ * @param[in] ifx Wifi interface to send the frame on
+ * @param[in] station Destination wifi peer
+ * @param[in] raw_data Frame descriptor, the buffer must have TUNNEL_MAX_OVERHEAD bytes of room behind the frame
+ * @param[in] src_addr Local wifi address
+ * @retval
+ */
+static void wifi_send_raw_frame(wifi_interface_t ifx, station_t *station, raw_data_t *raw_data, const uint8_t *src_addr)
+{
+    station->stats.tx_frames++;
+    station->stats.tx_bytes += raw_data->data_length;
+    telemetry_dir_t dir = raw_data->ingress_peer == RAW_DATA_PEER_ALL ? TELEMETRY_DIR_ETH_TO_WIFI : TELEMETRY_DIR_WIFI_TO_WIFI;
+    telemetry_count_tx(dir, raw_data->data_length, raw_data->timestamp);
+    uint32_t wire_len = tunnel_encapsulate(&station->tunnel, raw_data->data, raw_data->data_length, station->addr, src_addr);
+    if (!tunnel_send(&station->tunnel, raw_data->data, wire_len, wifi_driver_send_tunnel, &ifx))
+    {
+        bridge_count_drop(BRIDGE_DROP_WIFI_TX);
+        telemetry_count_tx_error(dir, 1);
+    }
+}
+
+/**
+ * @brief Hand a frame to the wifi driver. When all its transmit buffers are in use the frame is retried for a
+ *        while instead of being lost: the send task sleeps until the transport sent a frame, the queues behind
+ *        it fill up and the ethernet side pauses the link partner or drops by policy before anything is queued
+ * @param[in] ifx Wifi interface
+ * @param[in] buffer Wifi frame
+ * @param[in] len Frame length
+ * @retval Result of the last attempt
+ */
+static esp_err_t wifi_driver_send(wifi_interface_t ifx, void *buffer, uint16_t len)
+{
+    esp_err_t ret = wifi_transport->tx(ifx, buffer, len);
+    if (ret != ESP_ERR_NO_MEM || WIFI_TX_RETRY_TICKS == 0)
+    {
+        return ret;
+    }
+    // Set before the next attempt, a frame sent after it failed leaves a notification behind. Any other
+    // notification only costs an early attempt, the input paths are checked again before the task sleeps
+    atomic_store(&wifi_tx_waiting, true);
+    TickType_t start = xTaskGetTickCount();
+    TickType_t waited = 0;
+    while ((ret = wifi_transport->tx(ifx, buffer, len)) == ESP_ERR_NO_MEM && waited < WIFI_TX_RETRY_TICKS)
+    {
+        ulTaskNotifyTake(pdTRUE, WIFI_TX_RETRY_TICKS - waited);
+        waited = xTaskGetTickCount() - start;
+    }
+    atomic_store(&wifi_tx_waiting, false);
+    return ret;
+}
+
+/**
+ * @brief Transport callback for every frame sent: wakes the send task up when it waits for a transmit buffer
+ * @param None
+ * @retval
+ */
+static void wifi_tx_done(void)
+{
+    TaskHandle_t task = wifi_send_raw_taskHandler;
+    if (task != NULL && atomic_load_explicit(&wifi_tx_waiting, memory_order_relaxed))
+    {
+        xTaskNotifyGive(task);
+    }
+}
+
+/**
+ * @brief Hand a tunnel frame or fragment to the wifi driver, see tunnel_send
+ * @param[in] ctx Wifi interface
+ * @param[in] frame Wifi frame
+ * @param[in] len Frame length
+ * @retval true if the driver took the frame
+ */
+static bool wifi_driver_send_tunnel(void *ctx, uint8_t *frame, uint32_t len)
+{
+    return wifi_driver_send(*(wifi_interface_t *)ctx, frame, (uint16_t)len) == ESP_OK;
+}
+
+#if CONFIG_WENET_AGGREGATION
+/**
+ * @brief Send the frames held back for a peer, packed into one aggregate frame when there are several
+ * @param[in] ifx Wifi interface to send the frames on
+ * @param[in] station Destination wifi peer
+ * @param[in] src_addr Local wifi address
+ * @retval
+ */
+static void wifi_flush_aggregate(wifi_interface_t ifx, station_t *station, const uint8_t *src_addr)
+{
+    station_aggregate_t *aggregate = &station->aggregate;
+    raw_data_t *raw_data = aggregate->head;
+    if (aggregate->count == 1)
+    {
+        // Nothing to pack it with, a plain data frame is shorter
+        wifi_send_raw_frame(ifx, station, raw_data, src_addr);
+        pool_release(raw_data);
+    }
+    else if (aggregate->count > 1)
+    {
+        uint32_t len = 0;
+        uint32_t frames[TELEMETRY_DIR_MAX] = {0};
+        while (raw_data != NULL)
+        {
+            raw_data_t *next = raw_data->next;
+            telemetry_dir_t dir = raw_data->ingress_peer == RAW_DATA_PEER_ALL ? TELEMETRY_DIR_ETH_TO_WIFI : TELEMETRY_DIR_WIFI_TO_WIFI;
+            telemetry_count_tx(dir, raw_data->data_length, raw_data->timestamp);
+            frames[dir]++;
+            station->stats.tx_frames++;
+            station->stats.tx_bytes += raw_data->data_length;
+            len = tunnel_aggregate_append(&station->tunnel, wifi_aggregate_buffer, len, raw_data->data, raw_data->data_length, station->addr, src_addr);
+            pool_release(raw_data);
+            raw_data = next;
+        }
+        len = tunnel_aggregate_finish(&station->tunnel, wifi_aggregate_buffer, len);
+        if (wifi_driver_send(ifx, wifi_aggregate_buffer, len) != ESP_OK)
+        {
+            for (uint32_t i = 0; i < aggregate->count; i++)
+            {
+                bridge_count_drop(BRIDGE_DROP_WIFI_TX);
+            }
+            telemetry_count_tx_error(TELEMETRY_DIR_ETH_TO_WIFI, frames[TELEMETRY_DIR_ETH_TO_WIFI]);
+            telemetry_count_tx_error(TELEMETRY_DIR_WIFI_TO_WIFI, frames[TELEMETRY_DIR_WIFI_TO_WIFI]);
+        }
+    }
+    aggregate->head = NULL;
+    aggregate->tail = NULL;
+    aggregate->count = 0;
+}
+
+/**
+ * @brief Drop the frames held back for a peer that cannot be reached any more
+ * @param[in] station Destination wifi peer
+ * @retval
+ */
+static void wifi_drop_aggregate(station_t *station)
+{
+    station_aggregate_t *aggregate = &station->aggregate;
+    raw_data_t *raw_data = aggregate->head;
+    while (raw_data != NULL && aggregate->count > 0)
+    {
+        raw_data_t *next = raw_data->next;
+        bridge_count_drop(BRIDGE_DROP_LINK_DOWN);
+        pool_release(raw_data);
+        raw_data = next;
+        aggregate->count--;
+    }
+    aggregate->head = NULL;
+    aggregate->tail = NULL;
+    aggregate->count = 0;
+}
+
+/**
+ * @brief Send the aggregates whose hold time is over, and arm the aggregation timer for the next one
+ * @param None
+ * @retval
+ */
+static void wifi_service_aggregates(void)
+{
+    wifi_interface_t ifx;
+    const uint8_t *src_addr;
+    bool local_available = wifi_get_local(&ifx, &src_addr);
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint32_t next_delay_us = UINT32_MAX;
+    for (uint8_t i = 0; i < STATION_MAX; i++)
+    {
+        station_t *station = station_get(i);
+        if (station == NULL || station->aggregate.count == 0)
+        {
+            continue;
+        }
+        if (!local_available)
+        {
+            wifi_drop_aggregate(station);
+        }
+        else if (WIFI_TIME_AFTER_EQ(now, station->aggregate.deadline))
+        {
+            wifi_flush_aggregate(ifx, station, src_addr);
+        }
+        else if (station->aggregate.deadline - now < next_delay_us)
+        {
+            next_delay_us = station->aggregate.deadline - now;
+        }
+    }
+    // Every aggregate gets the same hold time, a running timer always expires before a newer deadline
+    if (next_delay_us != UINT32_MAX && !esp_timer_is_active(wifi_aggregate_timer))
+    {
+        esp_timer_start_once(wifi_aggregate_timer, next_delay_us);
+    }
+}
+
+/**
+ * @brief Wake the wifi send task up when the hold time of an aggregate is over
+ * @param[in] arg
+ * @retval
+ */
+static void wifi_aggregate_timer_callback(void *arg)
+{
+    (void)arg;
+    if (wifi_send_raw_taskHandler != NULL)
+    {
+        xTaskNotifyGive(wifi_send_raw_taskHandler);
+    }
+}
+#endif
+
+/**
+ * @brief Run the active queue management on a dequeued frame. Based on the time the frame waited since
+ *        it was received, the CoDel instance of its wifi peer and class decides to drop it, or to mark it when ECN
+ *        marking is enabled
+ * @param[in] station Wifi peer the frame was dequeued for
+ * @param[in] raw_data Dequeued frame
+ * @retval true if the frame has to be dropped
+ */
+static bool wifi_aqm_drop(station_t *station, raw_data_t *raw_data)
+{
+#if CONFIG_WENET_AQM_CODEL
+    uint8_t qos_class = raw_data->qos_class;
+    if (!codel_should_drop(&station->codel[qos_class], raw_data->timestamp, (uint32_t)esp_timer_get_time(), station->flow[qos_class].count))
+    {
+        return false;
+    }
+#if CONFIG_WENET_AQM_ECN
+    if (bridge_mark_ecn(raw_data->data, raw_data->data_length))
+    {
+        return false;
+    }
+#endif
+    return true;
+#else
+    (void)station;
+    (void)raw_data;
+    return false;
+#endif
+}
+
+/**
+ * @brief Get the interface and local address used to reach the wifi peers
+ * @param[out] ifx Wifi interface
+ * @param[out] src_addr Local wifi address
+ * @retval true if wifi is started in a mode that has peers
+ */
+static bool wifi_get_local(wifi_interface_t *ifx, const uint8_t **src_addr)
+{
+    switch (current_wifi_mode)
+    {
+    case WIFI_MODE_STA:
+        *ifx = WIFI_IF_STA;
+        *src_addr = wifi_sta_addr;
+        return true;
+    case WIFI_MODE_AP:
+        *ifx = WIFI_IF_AP;
+        *src_addr = wifi_ap_addr;
+        return true;
+    default:
+        *ifx = WIFI_IF_STA;
+        *src_addr = NULL;
+        return false;
+    }
+}
+
+/**
+ * @brief Add a newly connected wifi peer and start the tunnel negotiation with it
+ * @param[in] addr Peer address
+ * @param[in] aid Association id, 0 for the access point in station mode
+ * @retval
+ */
+static void wifi_peer_connected(const uint8_t *addr, uint8_t aid)
+{
+    station_t *station = station_add(addr, aid);
+    if (station == NULL)
+    {
+        ESP_LOGW(LOG_WIFI_TAG, "No free station slot for " MACSTR, MAC2STR(addr));
+        return;
+    }
+#if CONFIG_WENET_TUNNEL_COMPRESS
+    tunnel_set_compression(&station->tunnel, &wifi_compress, wifi_expand_buffer);
+#endif
+#if CONFIG_WENET_TUNNEL_FRAGMENT
+    tunnel_set_reassembly(&station->tunnel, &wifi_reassembly);
+    tunnel_set_mtu(&station->tunnel, wifi_transport->mtu);
+#endif
+    if (wifi_switch_pending)
+    {
+        wifi_switch_pending = false;
+        wifi_switch_peer_ms = (uint32_t)((esp_timer_get_time() - wifi_switch_start_us) / 1000);
+        ESP_LOGI(LOG_WIFI_TAG, "First peer of the new mode connected %lu ms after the switch started", (unsigned long)wifi_switch_peer_ms);
+    }
+    // The frames held back during a mode change can go now
+    atomic_store(&wifi_hold_until_ms, 0);
+    if (wifi_send_raw_taskHandler != NULL)
+    {
+        xTaskNotifyGive(wifi_send_raw_taskHandler);
+    }
+}
+
+/**
+ * @brief Let the wifi send task clean up the wifi peers that left
+ * @param None
+ * @retval
+ */
+static void wifi_peer_disconnected(void)
+{
+    if (wifi_send_raw_taskHandler != NULL)
+    {
+        xTaskNotifyGive(wifi_send_raw_taskHandler);
+    }
+    else
+    {
+        // Without the send task nothing is queued and the slots can be freed right away
+        wifi_service_stations();
+    }
+}
+
+/**
+ * @brief Drop the queued frames and the learned hosts of the wifi peers that left, then free their slots
+ * @param None
+ * @retval
+ */
+static void wifi_service_stations(void)
+{
+    for (uint8_t i = 0; i < STATION_MAX; i++)
+    {
+        station_t *station = station_get_closing(i);
+        if (station == NULL)
+        {
+            continue;
+        }
+        for (uint32_t c = 0; c < QOS_CLASS_NUM; c++)
+        {
+            raw_data_t *raw_data;
+            while ((raw_data = drr_flow_pop(&wifi_sched.classes[c], &station->flow[c])) != NULL)
+            {
+                bridge_count_drop(BRIDGE_DROP_LINK_DOWN);
+                pool_release(raw_data);
+            }
+        }
+#if CONFIG_WENET_ACK_FILTER
+        ack_filter_init(&station->ack_filter);
+#endif
+#if CONFIG_WENET_AGGREGATION
+        wifi_drop_aggregate(station);
+#endif
+        fdb_flush(FDB_PORT_WIFI, i);
+        filter_flush_peer(i);
+        station_release(station);
+    }
+}
+
+/**
+ * @brief Send the tunnel control frames that are due to the wifi peers
+ * @param None
+ * @retval
+ */
+static void wifi_send_tunnel_control(void)
+{
+    wifi_interface_t ifx;
+    const uint8_t *src_addr;
+    if (!wifi_get_local(&ifx, &src_addr))
+    {
+        return;
+    }
+    uint8_t control_frame[TUNNEL_CONTROL_FRAME_LEN];
+    for (uint8_t i = 0; i < STATION_MAX; i++)
+    {
+        station_t *station = station_get(i);
+        if (station == NULL)
+        {
+            continue;
+        }
+        uint32_t len;
+        while ((len = tunnel_build_control(&station->tunnel, control_frame, station->addr, src_addr)) > 0)
+        {
+            wifi_driver_send(ifx, control_frame, len);
+        }
+    }
+}
+
+/**
+ * @brief Get how long the wifi send task may sleep when no frame is queued
+ * @param None
+ * @retval Ticks until the next tunnel control frame is due
+ */
+static TickType_t wifi_control_wait_ticks(void)
+{
+    // Connection events wake the task up, nothing can be sent to a peer before it connects
+    uint32_t delay_ms = UINT32_MAX;
+    for (uint8_t i = 0; i < STATION_MAX; i++)
+    {
+        station_t *station = station_get(i);
+        if (station != NULL)
+        {
+            uint32_t station_delay_ms = tunnel_control_delay_ms(&station->tunnel);
+            if (station_delay_ms < delay_ms)
+            {
+                delay_ms = station_delay_ms;
+            }
+        }
+    }
+    uint32_t until_ms = atomic_load_explicit(&wifi_hold_until_ms, memory_order_relaxed);
+    if (until_ms != 0)
+    {
+        // Wake up when the hold of a mode change expires
+        int32_t hold_ms = (int32_t)(until_ms - (uint32_t)(esp_timer_get_time() / 1000));
+        uint32_t remaining_ms = hold_ms > 0 ? (uint32_t)hold_ms : 0;
+        if (remaining_ms < delay_ms)
+        {
+            delay_ms = remaining_ms;
+        }
+    }
+    return delay_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(delay_ms) + 1;
+}
+
+#if CONFIG_WENET_TELEMETRY_CONSOLE
+/**
+ * @brief "wifi" console command
+ * @param[in] argc Argument count
+ * @param[in] argv Arguments
+ * @retval 0 on success
+ */
+static int wifi_console(int argc, char **argv)
+{
+    if (argc > 2 && strcmp(argv[1], "transport") == 0)
+    {
+        transport_id_t transport;
+        if (strcmp(argv[2], "wifi") == 0)
+        {
+            transport = TRANSPORT_WIFI;
+        }
+#if CONFIG_WENET_ESPNOW
+        else if (strcmp(argv[2], "espnow") == 0)
+        {
+            transport = TRANSPORT_ESPNOW;
+        }
+#endif
+        else
+        {
+            printf("unknown transport %s\n", argv[2]);
+            return 1;
+        }
+        return wifi_request_transport(transport) == ESP_OK ? 0 : 1;
+    }
+    if (argc > 1)
+    {
+        wifi_mode_t mode;
+        if (strcmp(argv[1], "sta") == 0)
+        {
+            mode = WIFI_MODE_STA;
+        }
+        else if (strcmp(argv[1], "ap") == 0)
+        {
+            mode = WIFI_MODE_AP;
+        }
+        else if (strcmp(argv[1], "off") == 0)
+        {
+            mode = WIFI_MODE_NULL;
+        }
+        else
+        {
+            printf("usage: wifi [sta|ap|off|transport wifi|espnow]\n");
+            return 1;
+        }
+        return wifi_request_mode(mode) == ESP_OK ? 0 : 1;
+    }
+    static const char *const mode_names[WIFI_MODE_MAX] = {
+        [WIFI_MODE_NULL] = "off",
+        [WIFI_MODE_STA] = "sta",
+        [WIFI_MODE_AP] = "ap",
+        [WIFI_MODE_APSTA] = "apsta",
+    };
+    printf("mode %s, transport %s, SSID %s, peers %lu\n", mode_names[current_wifi_mode], wifi_transport->name, ssid, (unsigned long)station_count());
+    if (wifi_last_channel != 0)
+    {
+        printf("last access point " MACSTR " channel %u\n", MAC2STR(wifi_last_bssid), wifi_last_channel);
+    }
+    printf("last mode change: interface %lu ms, first peer %s%lu ms\n", (unsigned long)wifi_switch_ms,
+           wifi_switch_pending ? "pending, " : "", (unsigned long)(wifi_switch_pending ? (esp_timer_get_time() - wifi_switch_start_us) / 1000 : wifi_switch_peer_ms));
+    return 0;
+}
+#endif
+
+/**
+ * @brief Read the link state from NVS
+ * @param[out] config Link state
+ * @retval ESP_OK if a valid link state was found
+ */
+static esp_err_t wifi_load_config(wifi_link_config_t *config)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    size_t length = sizeof(wifi_link_config_t);
+    ret = nvs_get_blob(handle, WIFI_NVS_KEY, config, &length);
+    nvs_close(handle);
+    if (ret == ESP_OK && (length != sizeof(wifi_link_config_t) || config->version != WIFI_NVS_VERSION || config->mode >= WIFI_MODE_MAX ||
+                          config->transport >= TRANSPORT_MAX || config->ssid[sizeof(config->ssid) - 1] != '\0' || config->password[sizeof(config->password) - 1] != '\0'))
+    {
+        ESP_LOGW(LOG_WIFI_TAG, "Ignoring invalid wifi link state in NVS");
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    return ret;
+}
+
+/**
+ * @brief Write the link state to NVS when it changed since the last write
+ * @param None
+ * @retval
+ */
+static void wifi_save_config(void)
+{
+    wifi_link_config_t config = {
+        .version = WIFI_NVS_VERSION,
+        .mode = (uint8_t)current_wifi_mode,
+        .raw_mode = raw_mode,
+        .channel = wifi_last_channel,
+        .transport = (uint8_t)wifi_transport_id,
+    };
+    memcpy(config.bssid, wifi_last_bssid, sizeof(config.bssid));
+    memcpy(config.ssid, ssid, sizeof(config.ssid));
+    memcpy(config.password, password, sizeof(config.password));
+    if (memcmp(&config, &wifi_saved_config, sizeof(config)) == 0)
+    {
+        // Nothing changed, spare the flash
+        return;
+    }
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK)
+    {
+        ret = nvs_set_blob(handle, WIFI_NVS_KEY, &config, sizeof(config));
+        if (ret == ESP_OK)
+        {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(LOG_WIFI_TAG, "Could not store the wifi link state: %s", esp_err_to_name(ret));
+        return;
     }
+    wifi_saved_config = config;
 }
 
 /************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
\ No newline at end of file
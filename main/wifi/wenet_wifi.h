@@ -8,15 +8,10 @@
 #include "freertos/queue.h"
 #include "esp_wifi.h"
 #include "esp_private/wifi.h"
+#include "wenet_pool.h"
+#include "wenet_transport.h"
 /* Exported macro ------------------------------------------------------------*/
-
 /* Exported types ------------------------------------------------------------*/
-typedef struct raw_data
-{
-    void *data;
-    void* eb;
-    uint32_t data_length;
-} raw_data_t;
 /* Exported constants --------------------------------------------------------*/
 
 /* Exported functions prototypes ---------------------------------------------*/
@@ -25,6 +20,13 @@ void wifi_uninit(void);
 void wifi_change_mode(wifi_mode_t new_mode);
 void wifi_change_ssid_pass(char *new_ssid, char *new_pass);
 void wifi_set_raw_mode(bool mode);
+void wifi_set_transport(transport_id_t transport);
+esp_err_t wifi_request_transport(transport_id_t transport);
+wifi_mode_t wifi_get_mode(void);
+bool wifi_has_stored_config(void);
+esp_err_t wifi_request_mode(wifi_mode_t new_mode);
+esp_err_t wifi_register_console(void);
+void wifi_free_rx_buffer(void *eb);
 #endif /* __WIFI_H */
 
 /************************ (C) COPYRIGHT WeNet *****END OF FILE****************/
\ No newline at end of file